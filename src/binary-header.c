@@ -24,6 +24,7 @@
 // n_labels               : u32
 // n_strings              : u32
 // code_size (in bytes)   : u32
+// n_objects              : u32
 // module_name            : counted_string
 // string_list[n_strings] : counted_string;
 // label_list[n_labels]   : struct
@@ -32,6 +33,13 @@
 //                           lbl_type : u8 (0 == jump label, !0 == task label)
 //                           lbl_addr : u32 // relative to 0th instruction of code.
 //                         };
+// object_list[n_objects] : struct
+//                         {
+//                           obj_name  : counted_string
+//                           obj_type  : u8 (OBJ_...)
+//                           obj_flags : u8 (OBJF_...)
+//                           obj_size  : u32
+//                         };
 //
 // NOTE: THESE ROUTINES ARE NOT RE-ENTRANT. (dynamic module loading
 //       won't work)
@@ -41,7 +49,9 @@
 #define HEADER_N_LABELS_IDX (sizeof(uint32_t))
 #define HEADER_N_STRINGS_IDX (HEADER_N_LABELS_IDX + sizeof(uint32_t))
 #define HEADER_CODE_SIZE_IDX (HEADER_N_STRINGS_IDX + sizeof(uint32_t))
-#define HEADER_MODULE_NAME_IDX (HEADER_CODE_SIZE_IDX + sizeof(uint32_t))
+#define HEADER_N_OBJECTS_IDX (HEADER_CODE_SIZE_IDX + sizeof(uint32_t))
+#define HEADER_INIT_FRAME_SIZE_IDX (HEADER_N_OBJECTS_IDX + sizeof(uint32_t))
+#define HEADER_MODULE_NAME_IDX (HEADER_INIT_FRAME_SIZE_IDX + sizeof(uint32_t))
 #define MAX_HEADER_SIZE 32768  // bytes
 //------------------------------------------------------------------------------
 static uint8_t g_raw_header[MAX_HEADER_SIZE];  // Blob of binary read from or
@@ -115,6 +125,12 @@ static uint32_t bhdr_get_code_size_in_bytes(void)
   return result;
 }
 //------------------------------------------------------------------------------
+static uint32_t bhdr_get_object_count(void)
+{
+  uint32_t result = bhdr_get_u32(HEADER_N_OBJECTS_IDX);
+  return result;
+}
+//------------------------------------------------------------------------------
 static uint32_t bhdr_get_counted_string(uint32_t ofs, char *p_dest)
 {
   uint32_t string_size = bhdr_get_u32(ofs);
@@ -159,7 +175,7 @@ static uint32_t bhdr_get_string_list_ofs(void)
 //------------------------------------------------------------------------------
 // Allocate new header and arrays contained therein.
 // RETURN: NULL if memory overflow.
-static HEADER *bhdr_new(uint32_t n_labels, uint32_t n_strings)
+static HEADER *bhdr_new(uint32_t n_labels, uint32_t n_strings, uint32_t n_objects)
 {
   HEADER *result = malloc(sizeof(HEADER));
   uint32_t idx_str;
@@ -174,9 +190,13 @@ static HEADER *bhdr_new(uint32_t n_labels, uint32_t n_strings)
         if (!(result->hdr_p_string_list[idx_str] = malloc(sizeof(char)*MAX_STR)))
           goto ERROR_EXIT_1;
       }
-      if (!(result->hdr_p_label_list = malloc(sizeof(HEADER_LABEL)*n_labels)))
-        goto ERROR_EXIT_1;
     }
+    else
+      idx_str = 0;
+    if (!(result->hdr_p_label_list = malloc(sizeof(HEADER_LABEL)*n_labels)))
+      goto ERROR_EXIT_1;
+    if (!(result->hdr_p_object_list = malloc(sizeof(HEADER_OBJECT)*n_objects)))
+      goto ERROR_EXIT_1;
   }
   return result;
 ERROR_EXIT_0:
@@ -194,6 +214,7 @@ HEADER *bhdr_read(FILE *fin)
   uint32_t n_header_bytes;
   uint32_t n_labels;
   uint32_t n_strings;
+  uint32_t n_objects;
   uint32_t offset;
   uint32_t n_chars;
   HEADER *result = NULL;
@@ -204,12 +225,15 @@ HEADER *bhdr_read(FILE *fin)
   {
     n_labels = bhdr_get_label_count();
     n_strings = bhdr_get_string_count();
-    if (result = bhdr_new(n_labels, n_strings))
+    n_objects = bhdr_get_object_count();
+    if (result = bhdr_new(n_labels, n_strings, n_objects))
     {
       result->hdr_size_bytes = n_header_bytes;
       result->hdr_n_strings = n_strings;
       result->hdr_n_labels = n_labels;
       result->hdr_code_size_bytes = bhdr_get_code_size_in_bytes();
+      result->hdr_n_objects = n_objects;
+      result->hdr_init_frame_size = bhdr_get_u32(HEADER_INIT_FRAME_SIZE_IDX);
       n_chars = bhdr_get_counted_string(HEADER_MODULE_NAME_IDX, result->hdr_module_name);
       //                                count              chars ...
       offset = HEADER_MODULE_NAME_IDX + sizeof(uint32_t) + n_chars;
@@ -227,6 +251,21 @@ HEADER *bhdr_read(FILE *fin)
         offset += sizeof(uint8_t);
         result->hdr_p_label_list[idx_label].hlbl_addr = bhdr_get_u32(offset);
         offset += sizeof(uint32_t);
+        result->hdr_p_label_list[idx_label].hlbl_frame_size = bhdr_get_u32(offset);
+        offset += sizeof(uint32_t);
+        result->hdr_p_label_list[idx_label].hlbl_priority = (int8_t) bhdr_get_u8(offset);
+        offset += sizeof(uint8_t);
+      }
+      for (uint32_t idx_object = 0; idx_object < n_objects; ++idx_object)
+      {
+        n_chars = bhdr_get_counted_string(offset, result->hdr_p_object_list[idx_object].hobj_name);
+        offset += n_chars + sizeof(uint32_t);
+        result->hdr_p_object_list[idx_object].hobj_type = bhdr_get_u8(offset);
+        offset += sizeof(uint8_t);
+        result->hdr_p_object_list[idx_object].hobj_flags = bhdr_get_u8(offset);
+        offset += sizeof(uint8_t);
+        result->hdr_p_object_list[idx_object].hobj_size = bhdr_get_u32(offset);
+        offset += sizeof(uint32_t);
       }
     }
   }
@@ -239,6 +278,7 @@ void bhdr_print_struct(HEADER *p_header)
   printf("      Header size = %d bytes\n", p_header->hdr_size_bytes);
   printf("        Code size = %d (bytes), %lu (instructions)\n", p_header->hdr_code_size_bytes,
          p_header->hdr_code_size_bytes/sizeof(INSTRUCTION));
+  printf(" Init frame size = %d (variables)\n", p_header->hdr_init_frame_size);
   printf(" Number of labels = %d\n", p_header->hdr_n_labels);
   printf("Number of strings = %d\n", p_header->hdr_n_strings);
   if (p_header->hdr_n_strings)
@@ -257,13 +297,49 @@ void bhdr_print_struct(HEADER *p_header)
     printf("--Begin label list--\n");
     for (uint32_t i = 0; i < p_header->hdr_n_labels; ++i)
     {
-      printf("%30s (%c) @ %08x\n",
+      printf("%30s (%c) @ %08x",
              p_header->hdr_p_label_list[i].hlbl_name,
              p_header->hdr_p_label_list[i].hlbl_type != 0 ? 'T' : 'J',
              p_header->hdr_p_label_list[i].hlbl_addr);
+      if (p_header->hdr_p_label_list[i].hlbl_type != 0)
+      {
+        printf(" frame %u", p_header->hdr_p_label_list[i].hlbl_frame_size);
+        if (p_header->hdr_p_label_list[i].hlbl_priority)
+          printf(" priority %d", p_header->hdr_p_label_list[i].hlbl_priority);
+      }
+      printf("\n");
     }
     printf("--End label list--\n");
   }
+  if (p_header->hdr_n_objects)
+  {
+    printf("--Begin object list--\n");
+    for (uint32_t i = 0; i < p_header->hdr_n_objects; ++i)
+    {
+      HEADER_OBJECT *p_object = &p_header->hdr_p_object_list[i];
+      printf("%04d: %30s", i, p_object->hobj_name);
+      switch (p_object->hobj_type)
+      {
+        case OBJ_CHANNEL:
+          printf(" channel[%u]%s\n", p_object->hobj_size,
+                 (p_object->hobj_flags & OBJF_SPSC) ? " (spsc)" : "");
+          break;
+        case OBJ_BARRIER:
+          printf(" barrier[%u]\n", p_object->hobj_size);
+          break;
+        case OBJ_EVENT:
+          printf(" event\n");
+          break;
+        case OBJ_LOCK:
+          printf(" lock\n");
+          break;
+        default:
+          printf(" ???\n");
+          break;
+      }
+    }
+    printf("--End object list--\n");
+  }
 }
 //------------------------------------------------------------------------------
 uint32_t bhdr_write(FILE *fout, HEADER *p_header)
@@ -274,6 +350,8 @@ uint32_t bhdr_write(FILE *fout, HEADER *p_header)
   bhdr_add_u32_to_header(p_header->hdr_n_labels);
   bhdr_add_u32_to_header(p_header->hdr_n_strings);
   bhdr_add_u32_to_header(p_header->hdr_code_size_bytes);
+  bhdr_add_u32_to_header(p_header->hdr_n_objects);
+  bhdr_add_u32_to_header(p_header->hdr_init_frame_size);
   bhdr_add_counted_string_to_header(p_header->hdr_module_name);
   for (uint32_t idx_string = 0; idx_string < p_header->hdr_n_strings; ++idx_string)
     bhdr_add_counted_string_to_header(p_header->hdr_p_string_list[idx_string]);
@@ -282,6 +360,15 @@ uint32_t bhdr_write(FILE *fout, HEADER *p_header)
     bhdr_add_counted_string_to_header(p_header->hdr_p_label_list[idx_label].hlbl_name);
     bhdr_add_u8_to_header(p_header->hdr_p_label_list[idx_label].hlbl_type);
     bhdr_add_u32_to_header(p_header->hdr_p_label_list[idx_label].hlbl_addr);
+    bhdr_add_u32_to_header(p_header->hdr_p_label_list[idx_label].hlbl_frame_size);
+    bhdr_add_u8_to_header((uint8_t) p_header->hdr_p_label_list[idx_label].hlbl_priority);
+  }
+  for (uint32_t idx_object = 0; idx_object < p_header->hdr_n_objects; ++idx_object)
+  {
+    bhdr_add_counted_string_to_header(p_header->hdr_p_object_list[idx_object].hobj_name);
+    bhdr_add_u8_to_header(p_header->hdr_p_object_list[idx_object].hobj_type);
+    bhdr_add_u8_to_header(p_header->hdr_p_object_list[idx_object].hobj_flags);
+    bhdr_add_u32_to_header(p_header->hdr_p_object_list[idx_object].hobj_size);
   }
   result = bhdr_raw_write(fout);
   return result;
@@ -7,6 +7,38 @@ struct HEADER_LABEL
   uint8_t hlbl_type;  // (0 == jump label, !0 == task label)
   uint32_t hlbl_addr;  // Address of  this lable relative to  0th instruciton in
                        // code.
+  uint32_t hlbl_frame_size;  // Task label: variable slots the task uses.
+  int8_t hlbl_priority;  // Task label: 'priority' (TASK_PRIORITY_MIN..MAX).
+};
+//------------------------------------------------------------------------------
+#define TASK_PRIORITY_MIN -10
+#define TASK_PRIORITY_MAX 10
+#define N_TASK_PRIORITIES (TASK_PRIORITY_MAX - TASK_PRIORITY_MIN + 1)
+//------------------------------------------------------------------------------
+#define MAX_MODULE_OBJECTS 256
+//------------------------------------------------------------------------------
+// Module-level objects shared by all tasks in a module.
+enum
+{
+  OBJ_CHANNEL = 1,
+  OBJ_BARRIER = 2,
+  OBJ_EVENT = 3,
+  OBJ_LOCK = 4
+};
+//------------------------------------------------------------------------------
+// Object flags.
+enum
+{
+  OBJF_SPSC = 0x01  // Channel: at most one sending and one receiving task.
+};
+//------------------------------------------------------------------------------
+typedef struct HEADER_OBJECT HEADER_OBJECT;
+struct HEADER_OBJECT
+{
+  char hobj_name[MAX_STR];
+  uint8_t hobj_type;  // OBJ_...
+  uint8_t hobj_flags;  // OBJF_...
+  uint32_t hobj_size;  // OBJ_CHANNEL: capacity, OBJ_BARRIER: number of tasks.
 };
 //------------------------------------------------------------------------------
 typedef struct HEADER HEADER;
@@ -16,10 +48,13 @@ struct HEADER
   uint32_t hdr_n_labels;
   uint32_t hdr_n_strings;
   uint32_t hdr_code_size_bytes; // How many bytes of P-machine code follows header.
+  uint32_t hdr_n_objects;
+  uint32_t hdr_init_frame_size;  // Variable slots used by the 'init' block.
   char hdr_module_name[MAX_STR];
   char **hdr_p_string_list;  // List of string constants that occur in mini-pogo
                              // source module.
   HEADER_LABEL *hdr_p_label_list;  // List of labels described above.
+  HEADER_OBJECT *hdr_p_object_list;  // Channels etc.  Indexed by i_object_idx.
 };
 //------------------------------------------------------------------------------
 void bhdr_print_struct(HEADER *p_header);
@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <util.h>
+//------------------------------------------------------------------------------
+#include "park.h"
+#include "channel.h"
+//------------------------------------------------------------------------------
+// THEORY OF OPERATION:
+//
+// A channel is a bounded ring buffer of  int32s with capacity rounded up to a
+// power of 2.  ch_tail and ch_head  are free-running positions; a position's
+// ring index is (position & ch_mask).
+//
+//   -- SPSC (one sending task, one receiving task):
+//
+//     The sender owns ch_tail, the receiver owns ch_head.  Each side publishes
+//     its  position with  a release  store and  reads the  other's with  an
+//     acquire load.  Each side also caches the other side's position so that it
+//     only touches the other side's cache line when the cached value says the
+//     ring is full (sender) or empty (receiver).
+//
+//   -- MPMC (anything else):
+//
+//     Bounded queue with a sequence number per slot (D. Vyukov).  A sender may
+//     fill  slot  (pos &  ch_mask)  when  its  cs_seq  ==  pos; a  receiver  may
+//     empty it when cs_seq == pos + 1.   Senders (receivers) claim positions by
+//     CAS on ch_tail (ch_head).  No locks are taken.
+//
+//   -- Blocking:
+//
+//     A  blocked  OP_SEND/OP_RECEIVE  retries  the  try_  functions  below  and
+//     parks on ch_not_full/ch_not_empty (see exec_wait_until()).  Each successful
+//     send notifies ch_not_empty and each successful receive notifies ch_not_full.
+//
+//     A 'select' waits on several channels  at once, so it parks on its task's
+//     own event and links that to the ch_not_full/ch_not_empty of each channel
+//     it names (see park_link()).  Channels no select names pay nothing for it.
+//------------------------------------------------------------------------------
+static uint32_t channel_round_up_to_power_of_2(uint32_t n)
+{
+  uint32_t result = 1;
+  while (result < n)
+    result <<= 1;
+  return result;
+}
+//------------------------------------------------------------------------------
+CHANNEL *channel_new(uint32_t capacity, bool is_spsc)
+{
+  CHANNEL *result = aligned_alloc(CACHE_LINE_SIZE,
+                                  (sizeof(CHANNEL) + CACHE_LINE_SIZE - 1)/CACHE_LINE_SIZE*CACHE_LINE_SIZE);
+  zero_mem(result, sizeof(CHANNEL));
+  result->ch_capacity = channel_round_up_to_power_of_2(capacity);
+  result->ch_mask = result->ch_capacity - 1;
+  result->ch_is_spsc = is_spsc;
+  if (is_spsc)
+    result->ch_p_buffer = malloc(result->ch_capacity*sizeof(int32_t));
+  else
+  {
+    result->ch_p_slots = malloc(result->ch_capacity*sizeof(CHANNEL_SLOT));
+    for (uint32_t i = 0; i < result->ch_capacity; ++i)
+      atomic_init(&result->ch_p_slots[i].cs_seq, i);
+  }
+  atomic_init(&result->ch_head, 0);
+  atomic_init(&result->ch_tail, 0);
+  park_event_init(&result->ch_not_empty);
+  park_event_init(&result->ch_not_full);
+  return result;
+}
+//------------------------------------------------------------------------------
+void channel_free(CHANNEL *p_channel)
+{
+  free(p_channel->ch_p_buffer);
+  free(p_channel->ch_p_slots);
+  free(p_channel);
+}
+//------------------------------------------------------------------------------
+static bool channel_spsc_try_send(CHANNEL *p_channel, int32_t value)
+{
+  uint32_t tail = atomic_load_explicit(&p_channel->ch_tail, memory_order_relaxed);
+  if (tail - p_channel->ch_cached_head == p_channel->ch_capacity)
+  {
+    p_channel->ch_cached_head = atomic_load_explicit(&p_channel->ch_head,
+                                                     memory_order_acquire);
+    if (tail - p_channel->ch_cached_head == p_channel->ch_capacity)
+      return false;  // Full.
+  }
+  p_channel->ch_p_buffer[tail & p_channel->ch_mask] = value;
+  atomic_store_explicit(&p_channel->ch_tail, tail + 1, memory_order_release);
+  return true;
+}
+//------------------------------------------------------------------------------
+static bool channel_spsc_try_receive(CHANNEL *p_channel, int32_t *p_value)
+{
+  uint32_t head = atomic_load_explicit(&p_channel->ch_head, memory_order_relaxed);
+  if (head == p_channel->ch_cached_tail)
+  {
+    p_channel->ch_cached_tail = atomic_load_explicit(&p_channel->ch_tail,
+                                                     memory_order_acquire);
+    if (head == p_channel->ch_cached_tail)
+      return false;  // Empty.
+  }
+  *p_value = p_channel->ch_p_buffer[head & p_channel->ch_mask];
+  atomic_store_explicit(&p_channel->ch_head, head + 1, memory_order_release);
+  return true;
+}
+//------------------------------------------------------------------------------
+static bool channel_mpmc_try_send(CHANNEL *p_channel, int32_t value)
+{
+  uint32_t pos = atomic_load_explicit(&p_channel->ch_tail, memory_order_relaxed);
+  for (;;)
+  {
+    CHANNEL_SLOT *p_slot = &p_channel->ch_p_slots[pos & p_channel->ch_mask];
+    uint32_t seq = atomic_load_explicit(&p_slot->cs_seq, memory_order_acquire);
+    int32_t diff = (int32_t) (seq - pos);
+    if (0 == diff)
+    {
+      if (atomic_compare_exchange_weak_explicit(&p_channel->ch_tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed))
+      {
+        p_slot->cs_value = value;
+        atomic_store_explicit(&p_slot->cs_seq, pos + 1, memory_order_release);
+        return true;
+      }
+      // CAS failure reloaded pos.
+    }
+    else if (diff < 0)
+      return false;  // Full.
+    else
+      pos = atomic_load_explicit(&p_channel->ch_tail, memory_order_relaxed);
+  }
+}
+//------------------------------------------------------------------------------
+static bool channel_mpmc_try_receive(CHANNEL *p_channel, int32_t *p_value)
+{
+  uint32_t pos = atomic_load_explicit(&p_channel->ch_head, memory_order_relaxed);
+  for (;;)
+  {
+    CHANNEL_SLOT *p_slot = &p_channel->ch_p_slots[pos & p_channel->ch_mask];
+    uint32_t seq = atomic_load_explicit(&p_slot->cs_seq, memory_order_acquire);
+    int32_t diff = (int32_t) (seq - (pos + 1));
+    if (0 == diff)
+    {
+      if (atomic_compare_exchange_weak_explicit(&p_channel->ch_head, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed))
+      {
+        *p_value = p_slot->cs_value;
+        atomic_store_explicit(&p_slot->cs_seq, pos + p_channel->ch_capacity,
+                              memory_order_release);
+        return true;
+      }
+    }
+    else if (diff < 0)
+      return false;  // Empty.
+    else
+      pos = atomic_load_explicit(&p_channel->ch_head, memory_order_relaxed);
+  }
+}
+//------------------------------------------------------------------------------
+// RETURNS: false if the channel is full.
+bool channel_try_send(CHANNEL *p_channel, int32_t value)
+{
+  bool result = p_channel->ch_is_spsc
+    ? channel_spsc_try_send(p_channel, value)
+    : channel_mpmc_try_send(p_channel, value);
+  if (result)
+    park_notify_all(&p_channel->ch_not_empty);
+  return result;
+}
+//------------------------------------------------------------------------------
+// RETURNS: false if the channel is empty.
+bool channel_try_receive(CHANNEL *p_channel, int32_t *p_value)
+{
+  bool result = p_channel->ch_is_spsc
+    ? channel_spsc_try_receive(p_channel, p_value)
+    : channel_mpmc_try_receive(p_channel, p_value);
+  if (result)
+    park_notify_all(&p_channel->ch_not_full);
+  return result;
+}
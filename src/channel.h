@@ -0,0 +1,34 @@
+#pragma once
+//------------------------------------------------------------------------------
+#define CACHE_LINE_SIZE 64
+//------------------------------------------------------------------------------
+// MPMC ring slot.  cs_seq tells senders/receivers whose turn it is.
+typedef struct CHANNEL_SLOT CHANNEL_SLOT;
+struct CHANNEL_SLOT
+{
+  atomic_uint cs_seq;
+  int32_t cs_value;
+};
+//------------------------------------------------------------------------------
+typedef struct CHANNEL CHANNEL;
+struct CHANNEL
+{
+  uint32_t ch_capacity;  // Power of 2.
+  uint32_t ch_mask;  // ch_capacity - 1.
+  bool ch_is_spsc;  // One sender and one receiver (OBJF_SPSC).
+  int32_t *ch_p_buffer;  // SPSC ring.
+  CHANNEL_SLOT *ch_p_slots;  // MPMC ring.
+  PARK_EVENT ch_not_empty;  // Receivers park here.
+  PARK_EVENT ch_not_full;  // Senders park here.
+  // Sender side.
+  _Alignas(CACHE_LINE_SIZE) atomic_uint ch_tail;  // Next position to send to.
+  uint32_t ch_cached_head;  // SPSC: sender's last view of ch_head.
+  // Receiver side.
+  _Alignas(CACHE_LINE_SIZE) atomic_uint ch_head;  // Next position to receive from.
+  uint32_t ch_cached_tail;  // SPSC: receiver's last view of ch_tail.
+};
+//------------------------------------------------------------------------------
+CHANNEL *channel_new(uint32_t capacity, bool is_spsc);
+void channel_free(CHANNEL *p_channel);
+bool channel_try_send(CHANNEL *p_channel, int32_t value);
+bool channel_try_receive(CHANNEL *p_channel, int32_t *p_value);
@@ -0,0 +1,879 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <util.h>
+//------------------------------------------------------------------------------
+#include "parse.h"
+#include "instruction.h"
+#include "symbol-table.h"
+#include "optimize.h"
+#include "code-opt.h"
+//------------------------------------------------------------------------------
+// THEORY OF OPERATION:
+//
+// copt_simplify_jumps() (passes 1, 2), copt_strength_reduce() (pass 3) and
+// copt_remove_dead_stores() (pass 4) run on the whole module once compile() is
+// done.  Each pass below only flags
+// instructions as removed or rewrites them in place; then copt_compact() drops
+// what was flagged or can't be reached and fixes up the addresses.  The passes
+// are repeated until none of them changes anything.
+//
+//   1) Constant branches.  'PUSH_CONST_INT c' directly followed by a
+//      conditional jump (what 'if 0', 'while 1', ... compile to once
+//      optimize.c has folded the test) becomes an OP_JUMP if the jump is
+//      always taken and disappears if it never is.  The pair is left alone if
+//      anything jumps to the conditional jump itself.
+//
+//   2) Jump threading.  A jump whose target is an OP_JUMP goes straight to the
+//      end of the chain (e.g. the JUMP over the 'else' of an 'if' that ends the
+//      'then' branch of another goes to the outer END-IF).  Then
+//
+//          JUMP_IF_ZERO L1           JUMP_IF_NONZERO L2
+//          JUMP L2             ->  L1:
+//        L1:
+//
+//      (and the same for the other OP_JUMP_IF_...), and an OP_JUMP to the
+//      next instruction is removed (OP_JUMP_IF_(NON)ZERO becomes OP_DROP).
+//
+//      Backward jumps are cancellation points in exec.c, which is what keeps a
+//      loop cancellable: every cycle has at least one backward edge.  Only
+//      OP_JUMP, OP_JUMP_IF_... and OP_EVERY_WAIT are allowed to become backward
+//      jumps, so that still holds.
+//
+//   3) Strength reduction.  'PUSH_CONST_INT c' directly followed by
+//      OP_MULTIPLY, OP_DIVIDE or OP_REMAINDER becomes one of the instructions
+//      of instruction.h that do the same to x without an idiv, followed by an
+//      OP_NEGATE if c < 0 (but not for '%', whose sign is x's):
+//
+//          x*2^k -> SHIFT_LEFT k          x/d -> MULTIPLY_HIGH m s
+//          x/2^k -> SHIFT_RIGHT k         x%d -> MULTIPLY_HIGH_REMAINDER m s d
+//          x%2^k -> AND_MASK k
+//
+//      Other multiplications are left alone (the hardware multiplies as fast
+//      as the shifts and adds would run), as are '%' by d > 65535, which
+//      doesn't fit in i_divisor, and c = 0, 1, -1, INT32_MIN, so a division
+//      that traps still does.  copt_test_strength_reduction() checks the
+//      rewrites against the plain operators.
+//
+//   4) Dead stores.  A variable is live at an instruction if some path from
+//      it reads the variable (OP_PUSH_VAR) before anything stores to it
+//      (OP_POP_INT, OP_DUP_POP_INT, OP_JOIN_FIRST...).  Every task and call
+//      starts with a zeroed frame of its own that nothing else touches, so
+//      following the fall-through and jump edges from each instruction, as in
+//      step 5, finds all the reads: OP_CALL and OP_SPAWN... run other frames,
+//      and a frame is gone after OP_END_TASK or OP_RETURN.  Then
+//
+//          POP_INT x; PUSH_VAR x  ->  DUP_POP_INT x   (x read later)
+//                                 ->  (nothing)       (x never read again)
+//
+//      and an OP_POP_INT to a variable that isn't live after it is removed
+//      along with the instructions before it that only computed the value:
+//      pushes and operators that can't trap, going back until they have
+//      consumed as many values as they pushed.  An OP_DROP is left for each
+//      value they took from code before them:
+//
+//          PUSH_VAR a; PUSH_CONST_INT 1; ADD; POP_INT x  ->  (nothing)
+//          CALL t; PUSH_CONST_INT 1; ADD; POP_INT x      ->  CALL t; DROP
+//
+//      This stops at a jump target, so no instruction anything jumps to is
+//      removed except the first.
+//
+//   5) Reachability (in copt_compact()).  Starting from the module's init code
+//      (address 0) and each task, follow fall-through and jump edges.
+//      OP_JUMP, OP_EVERY_WAIT, OP_END_TASK and OP_RETURN don't fall through.
+//      OP_SELECT is followed by its case instructions and jump table, which
+//      are read, not run, so they are kept along with it and only the table's
+//      targets are followed.  Anything not reached (code after 'stop', the
+//      implied OP_END_TASK of a task that always stops first, the branch a
+//      constant test never takes) is dropped.
+//
+//   6) Compaction.  The instructions kept are moved down and every jump, task
+//      address (OP_CALL, OP_SPAWN, OP_SPAWN_INLINE) and label is moved to the
+//      new address of its old target.  A label on dropped code ends up on the
+//      next instruction kept.  The order of instructions doesn't change, so a
+//      backward jump stays backward.
+//------------------------------------------------------------------------------
+extern LABEL *g_hash_labels[SYMBOL_HTABLE_SIZE];
+//------------------------------------------------------------------------------
+// What the passes know about the code they are looking at.
+typedef struct CODE CODE;
+struct CODE
+{
+  INSTRUCTION *cd_p_code;
+  uint32_t cd_n_instructions;
+  bool *cd_p_removed;  // Flagged by a pass, dropped by copt_compact().
+  bool *cd_p_is_target;  // Something jumps to (or spawns, calls) the instruction.
+  bool *cd_p_is_select_operand;  // OP_SELECT case or jump table entry.
+};
+//------------------------------------------------------------------------------
+// RETURNS: true if the instruction's operand is i_jump_addr.
+static bool copt_has_jump_addr(uint8_t opcode)
+{
+  switch (opcode)
+  {
+    case OP_JUMP:
+    case OP_JUMP_IF_ZERO:
+    case OP_JUMP_IF_NONZERO:
+    case OP_JUMP_IF_EQ:
+    case OP_JUMP_IF_NE:
+    case OP_JUMP_IF_LT:
+    case OP_JUMP_IF_LE:
+    case OP_JUMP_IF_GT:
+    case OP_JUMP_IF_GE:
+    case OP_TEST_AND_JUMP_IF_ZERO:
+    case OP_TEST_AND_JUMP_IF_NONZERO:
+    case OP_WAIT_JUMP:
+    case OP_WAIT_CANCEL_JUMP:
+    case OP_EVERY_WAIT:
+      return true;
+    default:
+      return false;
+  }
+}
+//------------------------------------------------------------------------------
+// RETURNS: true if the instruction's operand is i_task_addr.
+static bool copt_has_task_addr(uint8_t opcode)
+{
+  return OP_CALL == opcode || OP_SPAWN == opcode || OP_SPAWN_INLINE == opcode;
+}
+//------------------------------------------------------------------------------
+static bool copt_falls_through(uint8_t opcode)
+{
+  return !(OP_JUMP == opcode || OP_EVERY_WAIT == opcode
+           || OP_END_TASK == opcode || OP_RETURN == opcode);
+}
+//------------------------------------------------------------------------------
+// RETURNS: the conditional jump taken exactly when opcode's isn't, OP_BAD if
+// opcode isn't OP_JUMP_IF_...
+static uint8_t copt_inverted_jump(uint8_t opcode)
+{
+  switch (opcode)
+  {
+    case OP_JUMP_IF_ZERO:
+      return OP_JUMP_IF_NONZERO;
+    case OP_JUMP_IF_NONZERO:
+      return OP_JUMP_IF_ZERO;
+    case OP_JUMP_IF_EQ:
+      return OP_JUMP_IF_NE;
+    case OP_JUMP_IF_NE:
+      return OP_JUMP_IF_EQ;
+    case OP_JUMP_IF_LT:
+      return OP_JUMP_IF_GE;
+    case OP_JUMP_IF_GE:
+      return OP_JUMP_IF_LT;
+    case OP_JUMP_IF_LE:
+      return OP_JUMP_IF_GT;
+    case OP_JUMP_IF_GT:
+      return OP_JUMP_IF_LE;
+    default:
+      return OP_BAD;
+  }
+}
+//------------------------------------------------------------------------------
+// RETURNS: true if an instruction with opcode may jump backward (see THEORY).
+static bool copt_may_jump_backward(uint8_t opcode)
+{
+  return OP_JUMP == opcode || OP_EVERY_WAIT == opcode || OP_BAD != copt_inverted_jump(opcode);
+}
+//------------------------------------------------------------------------------
+static void copt_find_targets(CODE *p_code)
+{
+  INSTRUCTION *p_instructions = p_code->cd_p_code;
+  zero_mem(p_code->cd_p_is_target, (p_code->cd_n_instructions + 1)*sizeof(bool));
+  zero_mem(p_code->cd_p_is_select_operand, (p_code->cd_n_instructions + 1)*sizeof(bool));
+  for (uint32_t ip = 0; ip < p_code->cd_n_instructions; ++ip)
+  {
+    if (copt_has_jump_addr(p_instructions[ip].i_opcode))
+      p_code->cd_p_is_target[p_instructions[ip].i_jump_addr] = true;
+    else if (copt_has_task_addr(p_instructions[ip].i_opcode))
+      p_code->cd_p_is_target[p_instructions[ip].i_task_addr] = true;
+    else if (OP_SELECT == p_instructions[ip].i_opcode)
+      for (uint32_t i = 1; i <= 2*p_instructions[ip].i_n_select_cases; ++i)
+        p_code->cd_p_is_select_operand[ip + i] = true;
+  }
+}
+//------------------------------------------------------------------------------
+// RETURNS: address of the first instruction at or after addr that isn't
+// flagged as removed.
+static uint32_t copt_next_kept(CODE *p_code, uint32_t addr)
+{
+  while (addr < p_code->cd_n_instructions && p_code->cd_p_removed[addr])
+    addr += 1;
+  return addr;
+}
+//------------------------------------------------------------------------------
+// RETURNS: where a jump to addr ends up once the OP_JUMPs it lands on are
+// followed, or addr if they loop.
+static uint32_t copt_final_target(CODE *p_code, uint32_t addr)
+{
+  uint32_t result = copt_next_kept(p_code, addr);
+  for (uint32_t n_jumps = 0;
+       result < p_code->cd_n_instructions && OP_JUMP == p_code->cd_p_code[result].i_opcode;
+       ++n_jumps)
+  {
+    if (n_jumps == p_code->cd_n_instructions)
+      return addr;
+    result = copt_next_kept(p_code, p_code->cd_p_code[result].i_jump_addr);
+  }
+  return result;
+}
+//------------------------------------------------------------------------------
+// Pass 1.
+// RETURNS: number of changes.
+static uint32_t copt_fold_constant_branches(CODE *p_code, OPT_STATS *p_stats)
+{
+  INSTRUCTION *p_instructions = p_code->cd_p_code;
+  uint32_t result = 0;
+  for (uint32_t ip = 0; ip + 1 < p_code->cd_n_instructions; ++ip)
+  {
+    INSTRUCTION *p_jump = &p_instructions[ip + 1];
+    bool is_taken;
+    if (OP_PUSH_CONST_INT != p_instructions[ip].i_opcode || p_code->cd_p_removed[ip]
+        || p_code->cd_p_removed[ip + 1] || p_code->cd_p_is_target[ip + 1])
+      continue;
+    switch (p_jump->i_opcode)
+    {
+      case OP_JUMP_IF_ZERO:
+      case OP_TEST_AND_JUMP_IF_ZERO:
+        is_taken = 0 == p_instructions[ip].i_const_int;
+        break;
+      case OP_JUMP_IF_NONZERO:
+      case OP_TEST_AND_JUMP_IF_NONZERO:
+        is_taken = 0 != p_instructions[ip].i_const_int;
+        break;
+      default:
+        continue;
+    }
+    if (!is_taken)
+    {
+      p_code->cd_p_removed[ip] = true;
+      p_code->cd_p_removed[ip + 1] = true;
+    }
+    else
+    {
+      // OP_TEST_AND_JUMP_... leaves the constant on the stack when it jumps.
+      if (OP_JUMP_IF_ZERO == p_jump->i_opcode || OP_JUMP_IF_NONZERO == p_jump->i_opcode)
+        p_code->cd_p_removed[ip] = true;
+      p_jump->i_opcode = OP_JUMP;
+    }
+    p_stats->os_n_branches_folded += 1;
+    result += 1;
+    ip += 1;
+  }
+  return result;
+}
+//------------------------------------------------------------------------------
+// Pass 2.
+// RETURNS: number of changes.
+static uint32_t copt_thread_jumps(CODE *p_code, OPT_STATS *p_stats)
+{
+  INSTRUCTION *p_instructions = p_code->cd_p_code;
+  uint32_t result = 0;
+  // Redirect jumps to the end of OP_JUMP chains.
+  for (uint32_t ip = 0; ip < p_code->cd_n_instructions; ++ip)
+  {
+    INSTRUCTION *p_jump = &p_instructions[ip];
+    uint32_t target;
+    if (p_code->cd_p_removed[ip] || !copt_has_jump_addr(p_jump->i_opcode))
+      continue;
+    target = copt_final_target(p_code, p_jump->i_jump_addr);
+    if (copt_next_kept(p_code, p_jump->i_jump_addr) != target
+        && (target > ip || copt_may_jump_backward(p_jump->i_opcode)))
+    {
+      p_jump->i_jump_addr = target;
+      p_stats->os_n_jumps_threaded += 1;
+      result += 1;
+    }
+  }
+  // Conditional jump over an OP_JUMP: invert the condition.
+  for (uint32_t ip = 0; ip + 1 < p_code->cd_n_instructions; ++ip)
+  {
+    INSTRUCTION *p_test = &p_instructions[ip];
+    INSTRUCTION *p_jump = &p_instructions[ip + 1];
+    if (p_code->cd_p_removed[ip] || p_code->cd_p_removed[ip + 1]
+        || OP_BAD == copt_inverted_jump(p_test->i_opcode)
+        || OP_JUMP != p_jump->i_opcode || p_code->cd_p_is_target[ip + 1]
+        || p_code->cd_p_is_select_operand[ip + 1]
+        || copt_next_kept(p_code, p_test->i_jump_addr) != copt_next_kept(p_code, ip + 2))
+      continue;
+    p_test->i_opcode = copt_inverted_jump(p_test->i_opcode);
+    p_test->i_jump_addr = p_jump->i_jump_addr;
+    p_code->cd_p_removed[ip + 1] = true;
+    p_stats->os_n_jumps_inverted += 1;
+    result += 1;
+    ip += 1;
+  }
+  // Jumps to the next instruction.
+  for (uint32_t ip = 0; ip < p_code->cd_n_instructions; ++ip)
+  {
+    INSTRUCTION *p_jump = &p_instructions[ip];
+    if (p_code->cd_p_removed[ip] || p_code->cd_p_is_select_operand[ip]
+        || (OP_JUMP != p_jump->i_opcode && OP_JUMP_IF_ZERO != p_jump->i_opcode
+            && OP_JUMP_IF_NONZERO != p_jump->i_opcode)
+        || copt_next_kept(p_code, p_jump->i_jump_addr) != copt_next_kept(p_code, ip + 1))
+      continue;
+    if (OP_JUMP == p_jump->i_opcode)
+      p_code->cd_p_removed[ip] = true;
+    else
+      p_jump->i_opcode = OP_DROP;  // Just pop the test.
+    p_stats->os_n_jumps_removed += 1;
+    result += 1;
+  }
+  return result;
+}
+//------------------------------------------------------------------------------
+// Sets *p_m and *p_s so that INSTR_MULTIPLY_HIGH(x, *p_m, *p_s) is x/d for all
+// x, 2 < d < 2^31 not a power of 2 (Hacker's Delight, section 10-1: the
+// smallest s that works, so m < 2^32).
+static void copt_magic(uint32_t d, uint32_t *p_m, uint8_t *p_s)
+{
+  const uint32_t two31 = 0x80000000;
+  uint32_t anc = two31 - 1 - two31 % d;  // Largest x with x % d == d - 1.
+  uint32_t q1 = two31/anc;
+  uint32_t r1 = two31 - q1*anc;
+  uint32_t q2 = two31/d;
+  uint32_t r2 = two31 - q2*d;
+  uint32_t delta;
+  uint32_t p = 31;
+  do
+  {
+    p += 1;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= anc)
+    {
+      q1 += 1;
+      r1 -= anc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= d)
+    {
+      q2 += 1;
+      r2 -= d;
+    }
+    delta = d - r2;
+  } while (q1 < delta || (q1 == delta && 0 == r1));
+  *p_m = q2 + 1;
+  *p_s = p - 32;
+}
+//------------------------------------------------------------------------------
+// RETURNS: k if n is 2^k, -1 if n isn't a power of 2.
+static int32_t copt_log2(uint32_t n)
+{
+  int32_t result = 0;
+  if (0 == n || (n & (n - 1)))
+    return -1;
+  while (n >>= 1)
+    result += 1;
+  return result;
+}
+//------------------------------------------------------------------------------
+// Rewrites p_pair[0..1], 'PUSH_CONST_INT c; <op>', as in pass 3.  p_pair[1]
+// is left as OP_BAD if it isn't needed.
+// RETURNS: false (and leaves p_pair alone) if c or <op> isn't reduced.
+static bool copt_reduce_pair(INSTRUCTION *p_pair)
+{
+  int32_t c = p_pair[0].i_const_int;
+  uint32_t abs_c = c < 0 ? -(uint32_t) c : (uint32_t) c;
+  int32_t k = copt_log2(abs_c);
+  INSTRUCTION reduced = { 0 };
+  INSTRUCTION negate = { 0 };
+  if (abs_c < 2 || abs_c > INT32_MAX)
+    return false;
+  switch (p_pair[1].i_opcode)
+  {
+    case OP_MULTIPLY:
+      if (k < 0)
+        return false;
+      reduced.i_opcode = OP_SHIFT_LEFT;
+      break;
+    case OP_DIVIDE:
+      reduced.i_opcode = k < 0 ? OP_MULTIPLY_HIGH : OP_SHIFT_RIGHT;
+      break;
+    case OP_REMAINDER:
+      if (k < 0 && abs_c > UINT16_MAX)
+        return false;
+      reduced.i_opcode = k < 0 ? OP_MULTIPLY_HIGH_REMAINDER : OP_AND_MASK;
+      break;
+    default:
+      return false;
+  }
+  if (k >= 0)
+    reduced.i_shift = k;
+  else
+  {
+    uint32_t m;
+    copt_magic(abs_c, &m, &reduced.i_shift);
+    reduced.i_const_int = (int32_t) m;
+    if (OP_MULTIPLY_HIGH_REMAINDER == reduced.i_opcode)
+      reduced.i_divisor = abs_c;
+  }
+  negate.i_opcode = c < 0 && OP_REMAINDER != p_pair[1].i_opcode ? OP_NEGATE : OP_BAD;
+  p_pair[0] = reduced;
+  p_pair[1] = negate;
+  return true;
+}
+//------------------------------------------------------------------------------
+// Pass 3.
+// RETURNS: number of changes.
+static uint32_t copt_reduce_strength(CODE *p_code, OPT_STATS *p_stats)
+{
+  INSTRUCTION *p_instructions = p_code->cd_p_code;
+  uint32_t result = 0;
+  for (uint32_t ip = 0; ip + 1 < p_code->cd_n_instructions; ++ip)
+  {
+    if (OP_PUSH_CONST_INT != p_instructions[ip].i_opcode || p_code->cd_p_removed[ip]
+        || p_code->cd_p_removed[ip + 1] || p_code->cd_p_is_target[ip + 1]
+        || !copt_reduce_pair(&p_instructions[ip]))
+      continue;
+    if (OP_BAD == p_instructions[ip + 1].i_opcode)
+      p_code->cd_p_removed[ip + 1] = true;
+    p_stats->os_n_strength_reduced += 1;
+    result += 1;
+    ip += 1;
+  }
+  return result;
+}
+//------------------------------------------------------------------------------
+// RETURNS: true if the instruction's operand is i_var_slot.
+static bool copt_has_var_slot(uint8_t opcode)
+{
+  return OP_PUSH_VAR == opcode || OP_POP_INT == opcode || OP_DUP_POP_INT == opcode
+         || OP_JOIN_FIRST == opcode || OP_JOIN_FIRST_CANCEL == opcode;
+}
+//------------------------------------------------------------------------------
+// RETURNS: true if an instruction with opcode only computes from the stack
+// (and variables), and then *p_n_pushed is how many values it pushes minus how
+// many it pops.
+static bool copt_is_pure(uint8_t opcode, int32_t *p_n_pushed)
+{
+  switch (opcode)
+  {
+    case OP_PUSH_CONST_INT:
+    case OP_PUSH_VAR:
+      *p_n_pushed = 1;
+      return true;
+    case OP_NEGATE:
+    case OP_NOT:
+    case OP_SHIFT_LEFT:
+    case OP_SHIFT_RIGHT:
+    case OP_AND_MASK:
+    case OP_MULTIPLY_HIGH:
+    case OP_MULTIPLY_HIGH_REMAINDER:
+      *p_n_pushed = 0;
+      return true;
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_EQ:
+    case OP_NE:
+    case OP_LT:
+    case OP_LE:
+    case OP_GT:
+    case OP_GE:
+    case OP_AND:
+    case OP_OR:
+      *p_n_pushed = -1;
+      return true;
+    default:
+      return false;
+  }
+}
+//------------------------------------------------------------------------------
+// Variable liveness for pass 4: one bit per frame slot for each instruction.
+typedef struct LIVENESS LIVENESS;
+struct LIVENESS
+{
+  uint32_t lv_n_words;  // Per instruction.
+  uint32_t *lv_p_live_in;  // Live before each instruction.
+  uint32_t *lv_p_scratch;
+};
+//------------------------------------------------------------------------------
+#define LIVE_BIT(p_set, slot) ((p_set)[(slot)/32] >> ((slot)%32) & 1)
+//------------------------------------------------------------------------------
+// *p_set |= what is live before the instruction at addr.
+static void copt_add_live_in(CODE *p_code, LIVENESS *p_liveness, uint32_t *p_set, uint32_t addr)
+{
+  if (addr >= p_code->cd_n_instructions)
+    return;
+  for (uint32_t i = 0; i < p_liveness->lv_n_words; ++i)
+    p_set[i] |= p_liveness->lv_p_live_in[addr*p_liveness->lv_n_words + i];
+}
+//------------------------------------------------------------------------------
+// p_set = what is live after the instruction at ip.
+static void copt_live_out(CODE *p_code, LIVENESS *p_liveness, uint32_t ip, uint32_t *p_set)
+{
+  INSTRUCTION *p_instruction = &p_code->cd_p_code[ip];
+  zero_mem(p_set, p_liveness->lv_n_words*sizeof(uint32_t));
+  if (OP_SELECT == p_instruction->i_opcode)
+  {
+    uint32_t n_cases = p_instruction->i_n_select_cases;
+    for (uint32_t i = 0; i < n_cases; ++i)
+      copt_add_live_in(p_code, p_liveness, p_set, p_instruction[1 + n_cases + i].i_jump_addr);
+    return;
+  }
+  if (copt_has_jump_addr(p_instruction->i_opcode))
+    copt_add_live_in(p_code, p_liveness, p_set, p_instruction->i_jump_addr);
+  if (copt_falls_through(p_instruction->i_opcode))
+    copt_add_live_in(p_code, p_liveness, p_set, ip + 1);
+}
+//------------------------------------------------------------------------------
+// Fill in p_liveness->lv_p_live_in, going over the code backward until nothing
+// changes.  The caller frees lv_p_live_in and lv_p_scratch.
+static void copt_find_liveness(CODE *p_code, LIVENESS *p_liveness)
+{
+  uint32_t n_slots = 0;
+  uint32_t n_words;
+  bool changed = true;
+  for (uint32_t ip = 0; ip < p_code->cd_n_instructions; ++ip)
+    if (copt_has_var_slot(p_code->cd_p_code[ip].i_opcode)
+        && p_code->cd_p_code[ip].i_var_slot >= n_slots)
+      n_slots = p_code->cd_p_code[ip].i_var_slot + 1;
+  n_words = p_liveness->lv_n_words = (n_slots + 31)/32 + 1;
+  p_liveness->lv_p_live_in = calloc((p_code->cd_n_instructions + 1)*n_words, sizeof(uint32_t));
+  p_liveness->lv_p_scratch = malloc(n_words*sizeof(uint32_t));
+  while (changed)
+  {
+    changed = false;
+    for (uint32_t ip = p_code->cd_n_instructions; ip-- > 0;)
+    {
+      INSTRUCTION *p_instruction = &p_code->cd_p_code[ip];
+      uint32_t *p_live_in = &p_liveness->lv_p_live_in[ip*n_words];
+      uint32_t *p_set = p_liveness->lv_p_scratch;
+      if (p_code->cd_p_is_select_operand[ip])
+        continue;  // Never run.
+      copt_live_out(p_code, p_liveness, ip, p_set);
+      if (copt_has_var_slot(p_instruction->i_opcode))
+      {
+        uint32_t slot = p_instruction->i_var_slot;
+        if (OP_PUSH_VAR == p_instruction->i_opcode)
+          p_set[slot/32] |= (uint32_t) 1 << slot%32;
+        else
+          p_set[slot/32] &= ~((uint32_t) 1 << slot%32);
+      }
+      for (uint32_t i = 0; i < n_words; ++i)
+      {
+        changed = changed || p_live_in[i] != p_set[i];
+        p_live_in[i] = p_set[i];
+      }
+    }
+  }
+}
+//------------------------------------------------------------------------------
+// Remove 'POP_INT x' at ip_store, which stores a value never read, and the
+// pure instructions before it that computed the value (see THEORY).
+// RETURNS: number of instructions removed.
+static uint32_t copt_remove_store(CODE *p_code, uint32_t ip_store)
+{
+  uint32_t first = ip_store;  // First instruction to remove.
+  int32_t n_values = 1;  // Values what is removed takes from the code before it.
+  int32_t n_pushed;
+  while (n_values > 0 && first > 0 && !p_code->cd_p_is_target[first]
+         && !p_code->cd_p_removed[first - 1] && !p_code->cd_p_is_select_operand[first - 1]
+         && copt_is_pure(p_code->cd_p_code[first - 1].i_opcode, &n_pushed))
+  {
+    first -= 1;
+    n_values -= n_pushed;
+  }
+  for (uint32_t ip = first; ip <= ip_store; ++ip)
+  {
+    if (ip + n_values > ip_store)
+      p_code->cd_p_code[ip].i_opcode = OP_DROP;
+    else
+      p_code->cd_p_removed[ip] = true;
+  }
+  return ip_store + 1 - first - n_values;
+}
+//------------------------------------------------------------------------------
+// Pass 4.
+// RETURNS: number of changes.
+static uint32_t copt_eliminate_dead_stores(CODE *p_code, OPT_STATS *p_stats)
+{
+  INSTRUCTION *p_instructions = p_code->cd_p_code;
+  uint32_t result = 0;
+  LIVENESS liveness;
+  copt_find_liveness(p_code, &liveness);
+  for (uint32_t ip = 0; ip < p_code->cd_n_instructions; ++ip)
+  {
+    uint32_t slot = p_instructions[ip].i_var_slot;
+    uint32_t *p_live_out = liveness.lv_p_scratch;
+    uint32_t n_removed;
+    if (OP_POP_INT != p_instructions[ip].i_opcode || p_code->cd_p_removed[ip]
+        || p_code->cd_p_is_select_operand[ip])
+      continue;
+    if (ip + 1 < p_code->cd_n_instructions && !p_code->cd_p_removed[ip + 1]
+        && !p_code->cd_p_is_target[ip + 1] && !p_code->cd_p_is_select_operand[ip + 1]
+        && OP_PUSH_VAR == p_instructions[ip + 1].i_opcode && slot == p_instructions[ip + 1].i_var_slot)
+    {
+      copt_live_out(p_code, &liveness, ip + 1, p_live_out);
+      if (LIVE_BIT(p_live_out, slot))
+      {
+        p_instructions[ip].i_opcode = OP_DUP_POP_INT;
+        n_removed = 1;
+      }
+      else
+      {
+        p_code->cd_p_removed[ip] = true;
+        n_removed = 2;
+      }
+      p_code->cd_p_removed[ip + 1] = true;
+      ip += 1;
+    }
+    else
+    {
+      copt_live_out(p_code, &liveness, ip, p_live_out);
+      if (LIVE_BIT(p_live_out, slot))
+        continue;
+      n_removed = copt_remove_store(p_code, ip);
+    }
+    p_stats->os_n_dead_stores += n_removed;
+    result += 1;
+  }
+  free(liveness.lv_p_scratch);
+  free(liveness.lv_p_live_in);
+  return result;
+}
+//------------------------------------------------------------------------------
+// Step 5.  p_reached[ip] is set for each instruction reachable from addr.
+static void copt_mark_reachable(CODE *p_code, bool *p_reached, uint32_t *p_work,
+                                uint32_t addr)
+{
+  INSTRUCTION *p_instructions = p_code->cd_p_code;
+  uint32_t n_work = 0;
+  p_work[n_work++] = addr;
+  while (n_work)
+  {
+    uint32_t ip = p_work[--n_work];
+    INSTRUCTION *p_instruction;
+    if (ip >= p_code->cd_n_instructions || p_reached[ip])
+      continue;
+    p_reached[ip] = true;
+    p_instruction = &p_instructions[ip];
+    if (p_code->cd_p_removed[ip])
+    {
+      p_work[n_work++] = ip + 1;
+      continue;
+    }
+    if (OP_SELECT == p_instruction->i_opcode)
+    {
+      uint32_t n_cases = p_instruction->i_n_select_cases;
+      for (uint32_t i = 1; i <= 2*n_cases; ++i)
+        p_reached[ip + i] = true;
+      for (uint32_t i = 0; i < n_cases; ++i)
+        p_work[n_work++] = p_instructions[ip + 1 + n_cases + i].i_jump_addr;
+      continue;
+    }
+    if (copt_has_jump_addr(p_instruction->i_opcode))
+      p_work[n_work++] = p_instruction->i_jump_addr;
+    if (copt_falls_through(p_instruction->i_opcode))
+      p_work[n_work++] = ip + 1;
+  }
+}
+//------------------------------------------------------------------------------
+// Steps 5 and 6: drop instructions flagged as removed or not reachable.
+// RETURNS: number of instructions dropped.
+static uint32_t copt_compact(CODE *p_code, OPT_STATS *p_stats)
+{
+  INSTRUCTION *p_instructions = p_code->cd_p_code;
+  uint32_t n_instructions = p_code->cd_n_instructions;
+  bool *p_reached = calloc(n_instructions + 1, sizeof(bool));
+  // Each instruction reached adds at most two successors to the work list.
+  uint32_t *p_work = malloc(2*(n_instructions + 1)*sizeof(uint32_t));
+  uint32_t *p_new_addr = malloc((n_instructions + 1)*sizeof(uint32_t));
+  uint32_t n_kept = 0;
+  copt_mark_reachable(p_code, p_reached, p_work, 0);
+  for (uint32_t i = 0; i < SYMBOL_HTABLE_SIZE; ++i)
+    for (LABEL *p_label = g_hash_labels[i]; p_label; p_label = p_label->lbl_p_next)
+      if (p_label->lbl_is_task && p_label->lbl_addr_set)
+        copt_mark_reachable(p_code, p_reached, p_work, p_label->lbl_addr);
+  for (uint32_t ip = 0; ip < n_instructions; ++ip)
+  {
+    p_new_addr[ip] = n_kept;
+    if (p_reached[ip] && !p_code->cd_p_removed[ip])
+      n_kept += 1;
+    else if (!p_reached[ip])
+      p_stats->os_n_dead_removed += 1;
+  }
+  p_new_addr[n_instructions] = n_kept;
+  for (uint32_t ip = 0; ip < n_instructions; ++ip)
+  {
+    INSTRUCTION instruction = p_instructions[ip];
+    if (!p_reached[ip] || p_code->cd_p_removed[ip])
+      continue;
+    if (copt_has_jump_addr(instruction.i_opcode))
+      instruction.i_jump_addr = p_new_addr[instruction.i_jump_addr];
+    else if (copt_has_task_addr(instruction.i_opcode))
+      instruction.i_task_addr = p_new_addr[instruction.i_task_addr];
+    p_instructions[p_new_addr[ip]] = instruction;
+  }
+  for (uint32_t i = 0; i < SYMBOL_HTABLE_SIZE; ++i)
+    for (LABEL *p_label = g_hash_labels[i]; p_label; p_label = p_label->lbl_p_next)
+      if (p_label->lbl_addr_set)
+        p_label->lbl_addr = p_new_addr[p_label->lbl_addr];
+  p_code->cd_n_instructions = n_kept;
+  free(p_new_addr);
+  free(p_work);
+  free(p_reached);
+  return n_instructions - n_kept;
+}
+//------------------------------------------------------------------------------
+typedef uint32_t CODE_PASS(CODE *p_code, OPT_STATS *p_stats);
+//------------------------------------------------------------------------------
+// Run the passes in pp_passes (NULL-terminated), then copt_compact(), until
+// nothing changes.
+static void copt_run(INSTRUCTION *p_instructions, uint32_t *p_n_instructions,
+                     OPT_STATS *p_stats, CODE_PASS **pp_passes)
+{
+  CODE code;
+  uint32_t n_changes;
+  code.cd_p_code = p_instructions;
+  code.cd_n_instructions = *p_n_instructions;
+  code.cd_p_removed = malloc((code.cd_n_instructions + 1)*sizeof(bool));
+  code.cd_p_is_target = malloc((code.cd_n_instructions + 1)*sizeof(bool));
+  code.cd_p_is_select_operand = malloc((code.cd_n_instructions + 1)*sizeof(bool));
+  do
+  {
+    zero_mem(code.cd_p_removed, (code.cd_n_instructions + 1)*sizeof(bool));
+    copt_find_targets(&code);
+    n_changes = 0;
+    for (CODE_PASS **pp_pass = pp_passes; *pp_pass; ++pp_pass)
+      n_changes += (*pp_pass)(&code, p_stats);
+    n_changes += copt_compact(&code, p_stats);
+  } while (n_changes);
+  *p_n_instructions = code.cd_n_instructions;
+  free(code.cd_p_is_select_operand);
+  free(code.cd_p_is_target);
+  free(code.cd_p_removed);
+}
+//------------------------------------------------------------------------------
+void copt_simplify_jumps(INSTRUCTION *p_instructions, uint32_t *p_n_instructions,
+                         OPT_STATS *p_stats)
+{
+  static CODE_PASS *passes[] = { copt_fold_constant_branches, copt_thread_jumps, NULL };
+  copt_run(p_instructions, p_n_instructions, p_stats, passes);
+}
+//------------------------------------------------------------------------------
+void copt_remove_dead_stores(INSTRUCTION *p_instructions, uint32_t *p_n_instructions,
+                             OPT_STATS *p_stats)
+{
+  static CODE_PASS *passes[] = { copt_eliminate_dead_stores, NULL };
+  copt_run(p_instructions, p_n_instructions, p_stats, passes);
+}
+//------------------------------------------------------------------------------
+void copt_strength_reduce(INSTRUCTION *p_instructions, uint32_t *p_n_instructions,
+                          OPT_STATS *p_stats)
+{
+  static CODE_PASS *passes[] = { copt_reduce_strength, NULL };
+  copt_run(p_instructions, p_n_instructions, p_stats, passes);
+}
+//------------------------------------------------------------------------------
+// RETURNS: what the instructions copt_reduce_pair() made leave on the stack for
+// x, as exec.c would compute it.
+static int32_t copt_run_reduced_pair(INSTRUCTION *p_pair, int32_t x)
+{
+  for (uint32_t i = 0; i < 2; ++i)
+  {
+    INSTRUCTION *p_instruction = &p_pair[i];
+    switch (p_instruction->i_opcode)
+    {
+      case OP_SHIFT_LEFT:
+        x = INSTR_SHIFT_LEFT(x, p_instruction->i_shift);
+        break;
+      case OP_SHIFT_RIGHT:
+        x = INSTR_SHIFT_RIGHT(x, p_instruction->i_shift);
+        break;
+      case OP_AND_MASK:
+        x = INSTR_AND_MASK(x, p_instruction->i_shift);
+        break;
+      case OP_MULTIPLY_HIGH:
+        x = INSTR_MULTIPLY_HIGH(x, p_instruction->i_const_int, p_instruction->i_shift);
+        break;
+      case OP_MULTIPLY_HIGH_REMAINDER:
+        x = INSTR_MULTIPLY_HIGH_REMAINDER(x, p_instruction->i_const_int,
+                                          p_instruction->i_shift, p_instruction->i_divisor);
+        break;
+      case OP_NEGATE:
+        x = (int32_t) -(uint32_t) x;
+        break;
+      default:
+        break;
+    }
+  }
+  return x;
+}
+//------------------------------------------------------------------------------
+// Checks x op c for each op reduced and constant c against x op c with the
+// plain operator, for x near 0, INT32_MIN, INT32_MAX and the multiples of c.
+// RETURNS: number of mismatches (each one printed to fout).
+static uint32_t copt_test_constant(FILE *fout, int32_t c, uint32_t *p_n_checks)
+{
+  static const uint8_t opcodes[] = { OP_MULTIPLY, OP_DIVIDE, OP_REMAINDER };
+  static const char *const operators[] = { "*", "/", "%" };
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < sizeof(opcodes)/sizeof(opcodes[0]); ++i)
+  {
+    INSTRUCTION pair[2] = { { 0 }, { 0 } };
+    int64_t abs_c = c < 0 ? -(int64_t) c : c;
+    int64_t q_max;
+    pair[0].i_opcode = OP_PUSH_CONST_INT;
+    pair[0].i_const_int = c;
+    pair[1].i_opcode = opcodes[i];
+    if (!copt_reduce_pair(pair))
+      continue;
+    q_max = INT32_MAX/abs_c;
+    for (int64_t j = -300; j <= 300; ++j)
+    {
+      int64_t xs[] = { j, INT32_MIN + 300 + j, INT32_MAX - 300 + j,
+                       (j/3)*abs_c + j%3, (q_max - j/3)*abs_c + j%3,
+                       -(q_max - j/3)*abs_c + j%3 };
+      for (uint32_t idx_x = 0; idx_x < sizeof(xs)/sizeof(xs[0]); ++idx_x)
+      {
+        int32_t x = (int32_t) xs[idx_x];
+        int32_t expected;
+        int32_t reduced;
+        if (xs[idx_x] < INT32_MIN || xs[idx_x] > INT32_MAX)
+          continue;
+        if (OP_MULTIPLY == opcodes[i])
+          expected = (int32_t) (uint32_t) ((int64_t) x*c);
+        else if (OP_DIVIDE == opcodes[i])
+          expected = x/c;
+        else
+          expected = x%c;
+        reduced = copt_run_reduced_pair(pair, x);
+        *p_n_checks += 1;
+        if (reduced != expected)
+        {
+          fprintf(fout, "%d %s %d: reduced to %d instead of %d\n",
+                  x, operators[i], c, reduced, expected);
+          result += 1;
+        }
+      }
+    }
+  }
+  return result;
+}
+//------------------------------------------------------------------------------
+uint32_t copt_test_strength_reduction(FILE *fout)
+{
+  uint32_t n_checks = 0;
+  uint32_t n_mismatches = 0;
+  static const int32_t big_constants[] = { 65535, 65536, 65537, 1000003, 0x55555555,
+                                           INT32_MAX - 1, INT32_MAX };
+  for (int32_t c = -1100; c <= 1100; ++c)
+    n_mismatches += copt_test_constant(fout, c, &n_checks);
+  for (uint32_t k = 11; k < 31; ++k)
+    for (int32_t delta = -1; delta <= 1; ++delta)
+    {
+      n_mismatches += copt_test_constant(fout, (1 << k) + delta, &n_checks);
+      n_mismatches += copt_test_constant(fout, -(1 << k) - delta, &n_checks);
+    }
+  for (uint32_t i = 0; i < sizeof(big_constants)/sizeof(big_constants[0]); ++i)
+  {
+    n_mismatches += copt_test_constant(fout, big_constants[i], &n_checks);
+    n_mismatches += copt_test_constant(fout, -big_constants[i], &n_checks);
+  }
+  fprintf(fout, "strength reduction: %u checks, %u mismatches\n", n_checks, n_mismatches);
+  return n_mismatches;
+}
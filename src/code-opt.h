@@ -0,0 +1,11 @@
+#pragma once
+//------------------------------------------------------------------------------
+// Optimizations on the instructions mpc emits.  See code-opt.c.
+//------------------------------------------------------------------------------
+void copt_simplify_jumps(INSTRUCTION *p_instructions, uint32_t *p_n_instructions,
+                         OPT_STATS *p_stats);
+void copt_remove_dead_stores(INSTRUCTION *p_instructions, uint32_t *p_n_instructions,
+                             OPT_STATS *p_stats);
+void copt_strength_reduce(INSTRUCTION *p_instructions, uint32_t *p_n_instructions,
+                          OPT_STATS *p_stats);
+uint32_t copt_test_strength_reduction(FILE *fout);
@@ -11,14 +11,27 @@
 #include "lex.h"
 #include "instruction.h"
 #include "binary-header.h"
+#include "optimize.h"
 #include "compile.h"
 #include "symbol-table.h"
 #include "string-table.h"
+#include "code-opt.h"
+#include "ir.h"
+#include "passes.h"
+//------------------------------------------------------------------------------
+#define MAX_TASK_VARIABLES 1024
 //------------------------------------------------------------------------------
 static uint32_t g_n_labels = 0;
 static INSTRUCTION g_code[MAX_CODE_SIZE];
 static uint32_t g_ip = 0;
 static char g_module_name[MAX_STR];
+static HEADER_OBJECT g_objects[MAX_MODULE_OBJECTS];  // Channels etc.
+static uint32_t g_n_objects = 0;
+static char g_variable_names[MAX_TASK_VARIABLES][MAX_STR];  // Task being compiled.
+static uint32_t g_n_variables = 0;
+static uint32_t g_init_frame_size = 0;
+static uint8_t g_opt_level = OPT_LEVEL_MAX;  // -O
+static OPT_STATS *g_p_opt_stats;
 //------------------------------------------------------------------------------
 extern uint32_t g_n_strings;
 extern STRING_CONST *g_hash_strings[STRING_HTABLE_SIZE];
@@ -31,6 +44,296 @@ static void compile_create_label_name(char *prefix, char *name_dest)
   sprintf(name_dest, "<%s_%u>", prefix, g_label_suffix_number++);
 }
 //------------------------------------------------------------------------------
+// RETURNS: index of object named 'name' in g_objects[] or -1 if not found.
+static int32_t compile_lookup_object(char *name)
+{
+  int32_t result = -1;
+  for (uint32_t i = 0; i < g_n_objects && result < 0; ++i)
+  {
+    if (STREQ(name, g_objects[i].hobj_name))
+      result = i;
+  }
+  return result;
+}
+//------------------------------------------------------------------------------
+// Indexed by OBJ_...
+static char *g_object_type_names[] = { "", "channel", "barrier", "event", "lock" };
+//------------------------------------------------------------------------------
+// RETURNS: index of object 'name' of type 'obj_type'.  Exits if there is none.
+static uint32_t compile_object_index(char *name, uint8_t obj_type)
+{
+  int32_t result = compile_lookup_object(name);
+  if (result < 0 || obj_type != g_objects[result].hobj_type)
+  {
+    fprintf(stderr, "Undefined %s: %s\n", g_object_type_names[obj_type], name);
+    error_exit(0);
+  }
+  return (uint32_t) result;
+}
+//------------------------------------------------------------------------------
+// Variables are local to  the task (or 'init' block) that uses them.  Each name
+// gets the next free slot in  the task's frame the first time it is seen, so a
+// task's frame is exactly as big as the number of names in it.
+static void compile_begin_frame(void)
+{
+  g_n_variables = 0;
+}
+//------------------------------------------------------------------------------
+// RETURNS: frame slot of variable 'name' in the task being compiled.
+static uint32_t compile_variable_slot(char *name)
+{
+  uint32_t result = 0;
+  while (result < g_n_variables && !STREQ(name, g_variable_names[result]))
+    result += 1;
+  if (result == g_n_variables)
+  {
+    if (g_n_variables >= MAX_TASK_VARIABLES)
+    {
+      fprintf(stderr, "Too many variables in one task (%s).\n", name);
+      error_exit(0);
+    }
+    strcpy(g_variable_names[g_n_variables++], name);
+  }
+  return result;
+}
+//------------------------------------------------------------------------------
+// ND_CHANNEL_DECLARATION, ND_BARRIER_DECLARATION, ND_EVENT_DECLARATION
+static void compile_object_declaration(PARSE_NODE *p_tree, uint8_t obj_type)
+{
+  HEADER_OBJECT *p_object;
+  if (compile_lookup_object(p_tree->nd_object_name) >= 0)
+  {
+    fprintf(stderr, "%u:%u : %s declared twice.\n", p_tree->nd_src_line,
+            p_tree->nd_src_col, p_tree->nd_object_name);
+    error_exit(0);
+  }
+  if (g_n_objects >= MAX_MODULE_OBJECTS)
+  {
+    fprintf(stderr, "Too many module objects.\n");
+    error_exit(0);
+  }
+  if (OBJ_CHANNEL == obj_type && p_tree->nd_object_size <= 0)
+  {
+    fprintf(stderr, "%u:%u : channel %s must have a capacity > 0.\n",
+            p_tree->nd_src_line, p_tree->nd_src_col, p_tree->nd_object_name);
+    error_exit(0);
+  }
+  if (OBJ_BARRIER == obj_type && p_tree->nd_object_size <= 0)
+  {
+    fprintf(stderr, "%u:%u : barrier %s must be for > 0 tasks.\n",
+            p_tree->nd_src_line, p_tree->nd_src_col, p_tree->nd_object_name);
+    error_exit(0);
+  }
+  p_object = &g_objects[g_n_objects++];
+  strcpy(p_object->hobj_name, p_tree->nd_object_name);
+  p_object->hobj_type = obj_type;
+  p_object->hobj_flags = 0;
+  p_object->hobj_size = (uint32_t) p_tree->nd_object_size;
+}
+//------------------------------------------------------------------------------
+// CHANNEL CLASSIFICATION:
+//
+// A  channel  is  marked  OBJF_SPSC  when  at  most  one task  instance  can
+// ever  send on  it and  at  most one  can ever  receive on  it.  The  runtime
+// then uses a  cheaper single-producer/single-consumer ring.  The number of
+// live  instances  of each  task  is estimated  as  0, 1  or  MANY from  the
+// spawn sites that name it:
+//
+//   1. The init block has exactly one instance.
+//
+//   2. Each time a task  is named in a spawn statement, it  gains one instance
+//      per instance of the spawning task.  A 'call' counts the same way: the
+//      callee runs inside each instance of the caller.
+//
+//   3. A spawn with a timeout inside a loop may leave instances running while
+//      the next iteration spawns more, so it contributes MANY.
+//
+// Counts saturate at MANY, so spawn cycles converge.
+#define CLASSIFY_MANY 2
+//------------------------------------------------------------------------------
+typedef struct CLASSIFY
+{
+  uint32_t c_n_tasks;  // Task 0 is the init block.
+  LISTITEM *c_p_task_decl_list;
+  uint8_t *c_p_spawn_weight;  // [spawner*c_n_tasks + spawnee]
+  uint8_t *c_p_sends;  // [object*c_n_tasks + task] != 0 if task sends.
+  uint8_t *c_p_receives;  // [object*c_n_tasks + task] != 0 if task receives.
+} CLASSIFY;
+//------------------------------------------------------------------------------
+static uint8_t compile_saturating_add(uint8_t a, uint8_t b)
+{
+  return a + b > CLASSIFY_MANY ? CLASSIFY_MANY : a + b;
+}
+//------------------------------------------------------------------------------
+// RETURNS: index of task named 'task_name' (1-based, 0 is init) or 0 if not found.
+static uint32_t compile_classify_task_index(CLASSIFY *p_classify, char *task_name)
+{
+  uint32_t idx_task = 1;
+  for (LISTITEM *p_task_decl = p_classify->c_p_task_decl_list;
+       p_task_decl;
+       p_task_decl = p_task_decl->l_p_next, ++idx_task)
+  {
+    if (STREQ(task_name, p_task_decl->l_parse_node->nd_task_name))
+      return idx_task;
+  }
+  return 0;
+}
+//------------------------------------------------------------------------------
+static void compile_classify_walk(CLASSIFY *p_classify,
+                                  PARSE_NODE *p_tree,
+                                  uint32_t idx_task,  // Task containing p_tree.
+                                  bool in_loop)
+{
+  int32_t idx_object;
+  if (!p_tree)
+    return;
+  switch (p_tree->nd_type)
+  {
+    case ND_STATEMENT_SEQUENCE:
+      for (LISTITEM *p_statement = p_tree->nd_p_statement_seq;
+           p_statement;
+           p_statement = p_statement->l_p_next)
+        compile_classify_walk(p_classify, p_statement->l_parse_node, idx_task, in_loop);
+      break;
+    case ND_IF:
+      compile_classify_walk(p_classify, p_tree->nd_p_true_branch_statement_seq, idx_task, in_loop);
+      compile_classify_walk(p_classify, p_tree->nd_p_false_branch_statement_seq, idx_task, in_loop);
+      break;
+    case ND_WHILE:
+      compile_classify_walk(p_classify, p_tree->nd_p_while_statement_seq, idx_task, true);
+      break;
+    case ND_EVERY:
+      compile_classify_walk(p_classify, p_tree->nd_p_every_statement_seq, idx_task, true);
+      break;
+    case ND_CRITICAL:
+      compile_classify_walk(p_classify, p_tree->nd_p_critical_statement_seq, idx_task, in_loop);
+      break;
+    case ND_SPAWN_JOIN:
+    case ND_SPAWN_JOIN_WITH_TIMEOUT:
+    case ND_SPAWN_JOIN_FIRST:
+      for (LISTITEM *p_task_name = p_tree->nd_p_task_names;
+           p_task_name;
+           p_task_name = p_task_name->l_p_next)
+      {
+        uint32_t idx_spawnee = compile_classify_task_index(p_classify, p_task_name->l_name);
+        // Tasks left running by a timed-out wait or 'join first' may overlap
+        // the next time round the loop.
+        bool may_outlive = p_tree->nd_p_millisec_expr
+          || (ND_SPAWN_JOIN_FIRST == p_tree->nd_type && !p_tree->nd_cancel_rest);
+        uint8_t weight = (in_loop && may_outlive) ? CLASSIFY_MANY : 1;
+        uint8_t *p_weight = &p_classify->c_p_spawn_weight[idx_task*p_classify->c_n_tasks + idx_spawnee];
+        if (idx_spawnee)
+          *p_weight = compile_saturating_add(*p_weight, weight);
+      }
+      if (p_tree->nd_p_millisec_expr)
+      {
+        compile_classify_walk(p_classify, p_tree->nd_p_statement_seq_if_timed_out, idx_task, in_loop);
+        compile_classify_walk(p_classify, p_tree->nd_p_statement_seq_if_not_timed_out, idx_task, in_loop);
+      }
+      break;
+    case ND_ASSIGN:
+      if (ND_CALL == p_tree->nd_p_assign_expr->nd_type)
+        compile_classify_walk(p_classify, p_tree->nd_p_assign_expr, idx_task, in_loop);
+      break;
+    case ND_CALL:
+      {
+        uint32_t idx_callee = compile_classify_task_index(p_classify, p_tree->nd_callee_name);
+        uint8_t *p_weight = &p_classify->c_p_spawn_weight[idx_task*p_classify->c_n_tasks + idx_callee];
+        if (idx_callee)
+          *p_weight = compile_saturating_add(*p_weight, 1);
+      }
+      break;
+    case ND_SEND:
+      if ((idx_object = compile_lookup_object(p_tree->nd_channel_name)) >= 0)
+        p_classify->c_p_sends[idx_object*p_classify->c_n_tasks + idx_task] = 1;
+      break;
+    case ND_RECEIVE:
+      if ((idx_object = compile_lookup_object(p_tree->nd_channel_name)) >= 0)
+        p_classify->c_p_receives[idx_object*p_classify->c_n_tasks + idx_task] = 1;
+      break;
+    case ND_SELECT:
+      for (LISTITEM *p_case = p_tree->nd_p_select_cases;
+           p_case;
+           p_case = p_case->l_p_next)
+      {
+        compile_classify_walk(p_classify, p_case->l_parse_node->nd_p_select_op, idx_task, in_loop);
+        compile_classify_walk(p_classify, p_case->l_parse_node->nd_p_select_statement_seq,
+                              idx_task, in_loop);
+      }
+      break;
+    default:
+      break;
+  }
+}
+//------------------------------------------------------------------------------
+// Set OBJF_SPSC on channels that can be shown to have one sender and one receiver.
+static void compile_classify_channels(PARSE_NODE *p_module)
+{
+  CLASSIFY classify;
+  uint8_t *p_n_instances;
+  uint32_t n_tasks = 1;
+  uint32_t idx_task;
+  bool changed = true;
+  for (LISTITEM *p_task_decl = p_module->nd_p_task_decl_list;
+       p_task_decl;
+       p_task_decl = p_task_decl->l_p_next)
+    n_tasks += 1;
+  classify.c_n_tasks = n_tasks;
+  classify.c_p_task_decl_list = p_module->nd_p_task_decl_list;
+  classify.c_p_spawn_weight = calloc(n_tasks*n_tasks, sizeof(uint8_t));
+  classify.c_p_sends = calloc(g_n_objects*n_tasks + 1, sizeof(uint8_t));
+  classify.c_p_receives = calloc(g_n_objects*n_tasks + 1, sizeof(uint8_t));
+  p_n_instances = calloc(n_tasks, sizeof(uint8_t));
+  compile_classify_walk(&classify, p_module->nd_p_init_statements, 0, false);
+  idx_task = 1;
+  for (LISTITEM *p_task_decl = p_module->nd_p_task_decl_list;
+       p_task_decl;
+       p_task_decl = p_task_decl->l_p_next, ++idx_task)
+    compile_classify_walk(&classify, p_task_decl->l_parse_node->nd_p_task_body,
+                          idx_task, false);
+  // Propagate instance counts from the init block until nothing changes.
+  p_n_instances[0] = 1;
+  while (changed)
+  {
+    changed = false;
+    for (uint32_t idx_spawnee = 1; idx_spawnee < n_tasks; ++idx_spawnee)
+    {
+      uint8_t n_instances = 0;
+      for (uint32_t idx_spawner = 0; idx_spawner < n_tasks; ++idx_spawner)
+      {
+        uint8_t weight = classify.c_p_spawn_weight[idx_spawner*n_tasks + idx_spawnee];
+        for (uint8_t i = 0; i < p_n_instances[idx_spawner]; ++i)
+          n_instances = compile_saturating_add(n_instances, weight);
+      }
+      if (n_instances != p_n_instances[idx_spawnee])
+      {
+        p_n_instances[idx_spawnee] = n_instances;
+        changed = true;
+      }
+    }
+  }
+  for (uint32_t idx_object = 0; idx_object < g_n_objects; ++idx_object)
+  {
+    uint8_t n_senders = 0;
+    uint8_t n_receivers = 0;
+    if (OBJ_CHANNEL != g_objects[idx_object].hobj_type)
+      continue;
+    for (idx_task = 0; idx_task < n_tasks; ++idx_task)
+    {
+      if (classify.c_p_sends[idx_object*n_tasks + idx_task])
+        n_senders = compile_saturating_add(n_senders, p_n_instances[idx_task]);
+      if (classify.c_p_receives[idx_object*n_tasks + idx_task])
+        n_receivers = compile_saturating_add(n_receivers, p_n_instances[idx_task]);
+    }
+    if (n_senders <= 1 && n_receivers <= 1)
+      g_objects[idx_object].hobj_flags |= OBJF_SPSC;
+  }
+  free(p_n_instances);
+  free(classify.c_p_receives);
+  free(classify.c_p_sends);
+  free(classify.c_p_spawn_weight);
+}
+//------------------------------------------------------------------------------
 void compile_OP_END_TASK(void)
 {
   g_code[g_ip++].i_opcode = OP_END_TASK;
@@ -59,26 +362,98 @@ void compile_OP_PRINT_INT(void)
   g_code[g_ip++].i_opcode = OP_PRINT_INT;
 }
 //------------------------------------------------------------------------------
-void compile_OP_PUSH_VAR(char var_name)
+void compile_OP_PUSH_VAR(char *var_name)
 {
-  g_code[g_ip].i_var_name = var_name;
+  g_code[g_ip].i_var_slot = compile_variable_slot(var_name);
   g_code[g_ip++].i_opcode = OP_PUSH_VAR;
 }
 //------------------------------------------------------------------------------
+static void compile_OP_POP_INT(char *var_name)
+{
+  g_code[g_ip].i_opcode = OP_POP_INT;
+  g_code[g_ip++].i_var_slot = compile_variable_slot(var_name);
+}
+//------------------------------------------------------------------------------
 void compile_OP_JOIN(void)
 {
   g_code[g_ip++].i_opcode = OP_JOIN;
 }
 //------------------------------------------------------------------------------
-void compile_OP_WAIT_JUMP(void)
+void compile_OP_WAIT_JUMP(bool cancel_on_timeout)
 {
-  g_code[g_ip++].i_opcode = OP_WAIT_JUMP;
+  g_code[g_ip++].i_opcode = cancel_on_timeout ? OP_WAIT_CANCEL_JUMP : OP_WAIT_JUMP;
+}
+//------------------------------------------------------------------------------
+// RETURNS: address of task 'task_name' for the instruction about to be emitted
+// at g_ip.
+//
+// 1) If  task_name isn't in the symbol table, then we add it and g_ip for future
+//    backpatching.
+//
+// 2) If task_name is in the symbol table and it address is set (lbl_addr_set),
+//    then we use the address and no backpatching is necessary.
+//
+// 3) If task_name is in the symbol table and its address is not set
+//    (lbl_addr_set), then we add g_ip for future backpatching.
+static uint32_t compile_task_addr(char *task_name)
+{
+  LABEL *p_label = symtab_lookup_label(task_name);
+  uint32_t result = 0;
+  if (!p_label)
+  {
+    // Case 1.
+    p_label = symtab_add_forward_ref_task_label(task_name);
+    g_n_labels += 1;
+    symtab_add_backpatch(p_label, g_ip);
+  }
+  else
+  {
+    if (p_label->lbl_addr_set)
+      // Case 2.
+      result = p_label->lbl_addr;
+    else
+      // Case 3.
+      symtab_add_backpatch(p_label, g_ip);
+  }
+  return result;
+}
+//------------------------------------------------------------------------------
+// "call t" compiles to
+//
+//     CALL <addr of t>
+//
+// and leaves t's 'return' value on the stack.
+static void compile_OP_CALL(char *task_name)
+{
+  uint32_t task_addr = compile_task_addr(task_name);
+  g_code[g_ip].i_opcode = OP_CALL;
+  g_code[g_ip++].i_task_addr = task_addr;
+}
+//------------------------------------------------------------------------------
+static void compile_ND_RETURN(PARSE_NODE *p_tree)
+{
+  compile(p_tree->nd_p_expr);
+  g_code[g_ip++].i_opcode = OP_RETURN;
+}
+//------------------------------------------------------------------------------
+// RETURNS: REDUCE_* for 'join' 'reduce' op, REDUCE_NONE if there is no 'reduce'.
+static uint8_t compile_reduce_op(PARSE_NODE *p_nd_spawn)
+{
+  static char *reduce_op_names[N_REDUCE_OPS] = { "", "sum", "min", "max", "and", "or", "xor" };
+  for (uint8_t op = REDUCE_NONE; op < N_REDUCE_OPS; ++op)
+    if (0 == strcmp(p_nd_spawn->nd_reduce_op, reduce_op_names[op]))
+      return op;
+  fprintf(stderr, "%u:%u : Unknown reduce operation: %s\n", p_nd_spawn->nd_src_line,
+          p_nd_spawn->nd_src_col, p_nd_spawn->nd_reduce_op);
+  error_exit(0);
+  return REDUCE_NONE;
 }
 //------------------------------------------------------------------------------
 void compile_ND_SPAWN(PARSE_NODE *p_nd_spawn)
 {
   uint32_t n_spawn_tasks = 0;
   uint32_t begin_spawn_addr = g_ip;
+  uint8_t reduce_op = ND_SPAWN_JOIN == p_nd_spawn->nd_type ? compile_reduce_op(p_nd_spawn) : REDUCE_NONE;
   // "spawn t0; t1; t2; end"
   // compiles to:
   //     BEGIN_SPAWN 3
@@ -87,41 +462,48 @@ void compile_ND_SPAWN(PARSE_NODE *p_nd_spawn)
   //     SPAWN <addr of t2>
   //     JOIN
   //
-  // 1) If  t_k isn't in the  symbol table, then we  add it and g_ip  for future
-  //    backpatching.
+  // See compile_task_addr() for how t_k's address is found.
+  //
+  // "spawn t; join" (one task, no timeout) can't overlap with anything: the
+  // parent does nothing until t stops.  It compiles to
   //
-  // 2) If t_k is in the symbol table and it address is set (lbl_addr_set), then
-  //    we use the address and no backpatching is necessary.
+  //     SPAWN_INLINE <addr of t>
+  //     DROP
   //
-  // 3) If t_k is in the symbol table and its address is not set (lbl_addr_set),
-  //    then we add it and g_ip++ for future backpatching.
+  // which runs t on the parent's thread like 'call t'.  With 'reduce' op x the
+  // one result is the reduction, so DROP becomes POP_INT <slot of x>.
+  if (ND_SPAWN_JOIN == p_nd_spawn->nd_type && !p_nd_spawn->nd_p_task_names->l_p_next)
+  {
+    uint32_t task_addr = compile_task_addr(p_nd_spawn->nd_p_task_names->l_name);
+    g_code[g_ip].i_opcode = OP_SPAWN_INLINE;
+    g_code[g_ip++].i_task_addr = task_addr;
+    if (REDUCE_NONE == reduce_op)
+      g_code[g_ip++].i_opcode = OP_DROP;
+    else
+      compile_OP_POP_INT(p_nd_spawn->nd_reduce_var_name);
+    return;
+  }
   compile_OP_BEGIN_SPAWN();
   for (LISTITEM *p_task_name = p_nd_spawn->nd_p_task_names;
        p_task_name;
        p_task_name = p_task_name->l_p_next)
   {
-    LABEL *p_label = symtab_lookup_label(p_task_name->l_name);
-    uint32_t task_addr = 0;
-    if (!p_label)
-    {
-      // Case 1.
-      p_label = symtab_add_forward_ref_task_label(p_task_name->l_name);
-      g_n_labels += 1;
-      symtab_add_backpatch(p_label, g_ip);
-    }
-    else
-    {
-      if (p_label->lbl_addr_set)
-        // Case 2.
-        task_addr = p_label->lbl_addr;
-      else
-        // Case 3.
-        symtab_add_backpatch(p_label, g_ip);
-    }
     n_spawn_tasks += 1;
-    compile_OP_SPAWN(task_addr);
+    compile_OP_SPAWN(compile_task_addr(p_task_name->l_name));
   }
   g_code[begin_spawn_addr].i_n_spawn_tasks = n_spawn_tasks;
+  // "spawn t0; t1; t2; limit 2 join" evaluates the limit just before JOIN (or
+  // the wait's time):
+  //
+  //     SPAWN t2
+  //     PUSH_CONST_INT 2
+  //     SPAWN_LIMIT
+  //     JOIN
+  if (p_nd_spawn->nd_p_limit_expr)
+  {
+    compile(p_nd_spawn->nd_p_limit_expr);
+    g_code[g_ip++].i_opcode = OP_SPAWN_LIMIT;
+  }
   //  spawn t0;t1;t2;
   //  wait 1000*2
   //  timeout
@@ -140,6 +522,7 @@ void compile_ND_SPAWN(PARSE_NODE *p_nd_spawn)
   //   PUSH_INT_CONST 2
   //   MULTIPLY
   //   WAIT_JUMP L0  <- else_jump_addr (L0 gets poked here)
+  //                    (WAIT_CANCEL_JUMP for 'timeout cancel')
   //   ATOMIC_PRINT "join timed out"
   //   JUMP L1 <- jump_over_else_addr (L1 gets poked here)
   // L0:
@@ -153,7 +536,7 @@ void compile_ND_SPAWN(PARSE_NODE *p_nd_spawn)
     // Compile in a similar fashion to 'if'/'then'/'else'
     compile(p_nd_spawn->nd_p_millisec_expr);
     else_jump_addr = g_ip;
-    compile_OP_WAIT_JUMP();
+    compile_OP_WAIT_JUMP(p_nd_spawn->nd_cancel_on_timeout);
     if (p_nd_spawn->nd_p_statement_seq_if_timed_out)
       compile(p_nd_spawn->nd_p_statement_seq_if_timed_out);
     jump_over_else_addr = g_ip;
@@ -167,11 +550,29 @@ void compile_ND_SPAWN(PARSE_NODE *p_nd_spawn)
       g_code[else_jump_addr].i_jump_addr = g_ip;
       compile(p_nd_spawn->nd_p_statement_seq_if_not_timed_out);
     }
+    else
+      g_code[else_jump_addr].i_jump_addr = g_ip;
     compile_create_label_name("END-SPAWN", jump_label_name);
     symtab_add_jump_label(jump_label_name, g_ip);
     g_n_labels += 1;
     g_code[jump_over_else_addr].i_jump_addr = g_ip;
   }
+  else if (ND_SPAWN_JOIN_FIRST == p_nd_spawn->nd_type)
+  {
+    // "spawn t0; t1; join first x" ends with
+    //     JOIN_FIRST <slot of x>   (JOIN_FIRST_CANCEL for 'cancel')
+    g_code[g_ip].i_opcode = p_nd_spawn->nd_cancel_rest ? OP_JOIN_FIRST_CANCEL : OP_JOIN_FIRST;
+    g_code[g_ip++].i_var_slot = compile_variable_slot(p_nd_spawn->nd_first_var_name);
+  }
+  else if (REDUCE_NONE != reduce_op)
+  {
+    // "join reduce sum x" ends with
+    //     JOIN_REDUCE sum
+    //     POP_INT <slot of x>
+    g_code[g_ip].i_opcode = OP_JOIN_REDUCE;
+    g_code[g_ip++].i_reduce_op = reduce_op;
+    compile_OP_POP_INT(p_nd_spawn->nd_reduce_var_name);
+  }
   else  // No timeout.
   {
     compile_OP_JOIN();
@@ -220,83 +621,196 @@ static void compile_ND_OR(PARSE_NODE *p_tree)
   g_code[backpatch].i_jump_addr = g_ip;
 }
 //------------------------------------------------------------------------------
+// RETURNS: the OP_JUMP_IF_<cmp> taken when comparison nd_type holds (or, with
+// negate, doesn't), OP_BAD if nd_type isn't a comparison.
+static uint8_t compile_compare_and_jump_op(uint8_t nd_type, bool negate)
+{
+  switch (nd_type)
+  {
+    case ND_EQ:
+      return negate ? OP_JUMP_IF_NE : OP_JUMP_IF_EQ;
+    case ND_NE:
+      return negate ? OP_JUMP_IF_EQ : OP_JUMP_IF_NE;
+    case ND_LT:
+      return negate ? OP_JUMP_IF_GE : OP_JUMP_IF_LT;
+    case ND_LE:
+      return negate ? OP_JUMP_IF_GT : OP_JUMP_IF_LE;
+    case ND_GT:
+      return negate ? OP_JUMP_IF_LE : OP_JUMP_IF_GT;
+    case ND_GE:
+      return negate ? OP_JUMP_IF_LT : OP_JUMP_IF_GE;
+    default:
+      return OP_BAD;
+  }
+}
+//------------------------------------------------------------------------------
+// Jump lists: jumps whose target isn't compiled yet are chained through their
+// i_jump_addr fields (the head is the address of the last one emitted) until
+// compile_patch_jump_list() sets them all.
+#define JUMP_LIST_END UINT32_MAX
+//------------------------------------------------------------------------------
+// Emit a jump with opcode and add it to *p_jump_list.
+static void compile_listed_jump(uint8_t opcode, uint32_t *p_jump_list)
+{
+  g_code[g_ip].i_opcode = opcode;
+  g_code[g_ip].i_jump_addr = *p_jump_list;
+  *p_jump_list = g_ip++;
+}
+//------------------------------------------------------------------------------
+static void compile_patch_jump_list(uint32_t jump_list, uint32_t addr)
+{
+  while (JUMP_LIST_END != jump_list)
+  {
+    uint32_t next = g_code[jump_list].i_jump_addr;
+    g_code[jump_list].i_jump_addr = addr;
+    jump_list = next;
+  }
+}
+//------------------------------------------------------------------------------
+// Compile the test of an 'if' or 'while' as jumping code: the jumps emitted
+// (added to *p_jump_list) are taken if p_test's value is non-zero
+// (jump_if_true) or zero, and the code falls through otherwise.  No 0/1 value
+// is left on the stack for 'and', 'or', 'not' and comparisons:
+//
+//     "a < b"       compile(a)            "a and b"     <a, false: L0>
+//     (false)       compile(b)            (true)        <b, true: list>
+//                   JUMP_IF_GE <list>                 L0:
+//
+// 'and'/'or' still only evaluate their right operand when the left one
+// doesn't decide the value.
+static void compile_condition(PARSE_NODE *p_test, bool jump_if_true, uint32_t *p_jump_list)
+{
+  uint32_t skip_list = JUMP_LIST_END;  // Jumps past the right operand.
+  uint8_t opcode;
+  switch (p_test->nd_type)
+  {
+    case ND_AND:
+    case ND_OR:
+      // The left operand decides the value if it is false for 'and' (true for
+      // 'or').  When that is also the outcome jumped on, the left operand jumps
+      // straight to *p_jump_list, otherwise it skips the right operand.
+      if (jump_if_true == (ND_OR == p_test->nd_type))
+        compile_condition(p_test->nd_p_left_expr, jump_if_true, p_jump_list);
+      else
+        compile_condition(p_test->nd_p_left_expr, !jump_if_true, &skip_list);
+      compile_condition(p_test->nd_p_right_expr, jump_if_true, p_jump_list);
+      compile_patch_jump_list(skip_list, g_ip);
+      break;
+    case ND_NOT:
+      compile_condition(p_test->nd_p_expr, !jump_if_true, p_jump_list);
+      break;
+    case ND_NUMBER:
+      if ((0 != p_test->nd_number) == jump_if_true)
+        compile_listed_jump(OP_JUMP, p_jump_list);
+      break;
+    default:
+      if (OP_BAD != (opcode = compile_compare_and_jump_op(p_test->nd_type, !jump_if_true)))
+      {
+        compile(p_test->nd_p_left_expr);
+        compile(p_test->nd_p_right_expr);
+      }
+      else
+      {
+        compile(p_test);
+        opcode = jump_if_true ? OP_JUMP_IF_NONZERO : OP_JUMP_IF_ZERO;
+      }
+      compile_listed_jump(opcode, p_jump_list);
+      break;
+  }
+}
+//------------------------------------------------------------------------------
 static void compile_ND_IF(PARSE_NODE *p_nd_if)
 {
-  uint32_t condition_false_jump_addr;
-  uint32_t jump_to_end_if_addr;
+  uint32_t false_jump_list = JUMP_LIST_END;
+  uint32_t end_if_jump_list = JUMP_LIST_END;
   char jump_label_name[MAX_STR];
   // "if p then ss0 else ss1 end"
   // compiles to:
-  //     compile(p)
-  //     JUMP_IF_ZERO <ELSE> ; <- condition_false_jump_addr location
+  //     <p, false: ELSE>    ; jumping code, see compile_condition()
   //     compile(ss0)        ; could be empty
-  //     JUMP END-IF         ; <- jump_to_end_if_addr location
-  //   ELSE:                 ; address for jump instruction at condition_false_jump_addr
+  //     JUMP END-IF
+  //   ELSE:
   //     compile(ss1)        ; could be empty
-  //   END-IF:               ; address for jump instruction at jump_to_end_if_addr
+  //   END-IF:
   // "if p then ss0 end"
   // compiles to:
-  //     compile(p)
-  //     JUMP_IF_ZERO L0     ; <- condition_false_jump_addr/jump_to_end_if_addr location.
+  //     <p, false: END-IF>
   //     compile(ss0)
-  //   L0:
-  compile(p_nd_if->nd_p_if_test_expr);
-  condition_false_jump_addr = g_ip;
-  g_code[g_ip].i_opcode = OP_JUMP_IF_ZERO;
-  g_code[g_ip++].i_jump_addr = 0;
+  //   END-IF:
+  compile_condition(p_nd_if->nd_p_if_test_expr, false, &false_jump_list);
   compile(p_nd_if->nd_p_true_branch_statement_seq);
   if (p_nd_if->nd_p_false_branch_statement_seq)
   {
-    jump_to_end_if_addr = g_ip;
-    g_code[g_ip].i_opcode = OP_JUMP;
-    g_code[g_ip++].i_jump_addr = 0;
+    compile_listed_jump(OP_JUMP, &end_if_jump_list);
     compile_create_label_name("ELSE", jump_label_name);
     symtab_add_jump_label(jump_label_name, g_ip);
     g_n_labels += 1;
-    g_code[condition_false_jump_addr].i_jump_addr = g_ip;
+    compile_patch_jump_list(false_jump_list, g_ip);
     compile(p_nd_if->nd_p_false_branch_statement_seq);
   }
   else
-    jump_to_end_if_addr = condition_false_jump_addr;
+    end_if_jump_list = false_jump_list;
   compile_create_label_name("END-IF", jump_label_name);
   symtab_add_jump_label(jump_label_name, g_ip);
   g_n_labels += 1;
-  g_code[jump_to_end_if_addr].i_jump_addr = g_ip;
+  compile_patch_jump_list(end_if_jump_list, g_ip);
 }
 //------------------------------------------------------------------------------
 static void compile_ND_WHILE(PARSE_NODE *p_nd_while)
 {
   uint32_t top_of_loop_addr;
-  uint32_t backpatch;
+  uint32_t jump_to_test_addr;
+  uint32_t true_jump_list = JUMP_LIST_END;
   char jump_label_name[MAX_STR];
   // "while p do ss end"
   // compiles to:
+  //       JUMP L1           ; <- jump_to_test_addr
   //     L0:                 ; <- top_of_loop_addr
-  //       compile(p)
-  //       JUMP_IF_ZERO L1   ; <- backpatch location
   //       compile(s)        ; could be empty
-  //       JUMP L0
-  //     L1:                 ; address for jump instruction at backpatch
+  //     L1:
+  //       <p, true: L0>     ; jumping code, see compile_condition()
+  //     END-WHILE:
+  //
+  // The test is at the bottom so that each pass runs one (backward, hence
+  // cancellable) branch instead of a test at the top and a JUMP back to it.
+  jump_to_test_addr = g_ip;
+  g_code[g_ip++].i_opcode = OP_JUMP;
   top_of_loop_addr = g_ip;
   compile_create_label_name("WHILE", jump_label_name);
   symtab_add_jump_label(jump_label_name, g_ip);
   g_n_labels += 1;
-  compile(p_nd_while->nd_p_while_test_expr);
-  backpatch = g_ip;
-  g_code[g_ip++].i_opcode = OP_JUMP_IF_ZERO;
   compile(p_nd_while->nd_p_while_statement_seq);
-  g_code[g_ip].i_opcode = OP_JUMP;
-  g_code[g_ip++].i_jump_addr = top_of_loop_addr;
-  g_code[backpatch].i_jump_addr = g_ip;
+  compile_create_label_name("WHILE-TEST", jump_label_name);
+  symtab_add_jump_label(jump_label_name, g_ip);
+  g_n_labels += 1;
+  g_code[jump_to_test_addr].i_jump_addr = g_ip;
+  compile_condition(p_nd_while->nd_p_while_test_expr, true, &true_jump_list);
+  compile_patch_jump_list(true_jump_list, top_of_loop_addr);
   compile_create_label_name("END-WHILE", jump_label_name);
   symtab_add_jump_label(jump_label_name, g_ip);
   g_n_labels += 1;
 }
 //------------------------------------------------------------------------------
-static void compile_OP_POP_INT(char var_name)
+static void compile_ND_EVERY(PARSE_NODE *p_nd_every)
 {
-  g_code[g_ip].i_opcode = OP_POP_INT;
-  g_code[g_ip++].i_var_name = var_name;
+  uint32_t top_of_loop_addr;
+  char jump_label_name[MAX_STR];
+  // "every ms do ss end"
+  // compiles to:
+  //       compile(ms)
+  //       EVERY_BEGIN       ; First deadline: now.
+  //     L0:                 ; <- top_of_loop_addr
+  //       compile(s)        ; could be empty
+  //       EVERY_WAIT L0     ; Until the next deadline, then loop.
+  compile(p_nd_every->nd_p_every_millisec_expr);
+  g_code[g_ip++].i_opcode = OP_EVERY_BEGIN;
+  top_of_loop_addr = g_ip;
+  compile_create_label_name("EVERY", jump_label_name);
+  symtab_add_jump_label(jump_label_name, g_ip);
+  g_n_labels += 1;
+  compile(p_nd_every->nd_p_every_statement_seq);
+  g_code[g_ip].i_opcode = OP_EVERY_WAIT;
+  g_code[g_ip++].i_jump_addr = top_of_loop_addr;
 }
 //------------------------------------------------------------------------------
 static void compile_OP_PRINT_CHAR(char ch)
@@ -329,12 +843,172 @@ static void compile_ND_NEGATE(PARSE_NODE *p_tree)
   g_code[g_ip++].i_opcode = OP_NEGATE;
 }
 //------------------------------------------------------------------------------
+static void compile_ND_NOT(PARSE_NODE *p_tree)
+{
+  compile(p_tree->nd_p_expr);
+  g_code[g_ip++].i_opcode = OP_NOT;
+}
+//------------------------------------------------------------------------------
 static void compile_ND_ASSIGN(PARSE_NODE *p_tree)
 {
-  compile(p_tree->nd_p_assign_expr);
+  if (ND_CALL == p_tree->nd_p_assign_expr->nd_type)
+    compile_OP_CALL(p_tree->nd_p_assign_expr->nd_callee_name);
+  else
+    compile(p_tree->nd_p_assign_expr);
   compile_OP_POP_INT(p_tree->nd_var_name);
 }
 //------------------------------------------------------------------------------
+static void compile_ND_SEND(PARSE_NODE *p_tree)
+{
+  // "send c, e"
+  // compiles to:
+  //     compile(e)
+  //     SEND c
+  uint32_t idx_object = compile_object_index(p_tree->nd_channel_name, OBJ_CHANNEL);
+  compile(p_tree->nd_p_send_expr);
+  g_code[g_ip].i_opcode = OP_SEND;
+  g_code[g_ip++].i_object_idx = idx_object;
+}
+//------------------------------------------------------------------------------
+static void compile_ND_RECEIVE(PARSE_NODE *p_tree)
+{
+  // "receive c, x"
+  // compiles to:
+  //     RECEIVE c
+  //     POP_INT x
+  g_code[g_ip].i_opcode = OP_RECEIVE;
+  g_code[g_ip++].i_object_idx = compile_object_index(p_tree->nd_channel_name,
+                                                     OBJ_CHANNEL);
+  compile_OP_POP_INT(p_tree->nd_receive_var_name);
+}
+//------------------------------------------------------------------------------
+static void compile_ND_SYNC_WAIT(PARSE_NODE *p_tree)
+{
+  // "wait b" compiles to BARRIER_WAIT b, "wait e" to EVENT_WAIT e.
+  int32_t idx_object = compile_lookup_object(p_tree->nd_sync_object_name);
+  if (idx_object < 0
+      || (OBJ_BARRIER != g_objects[idx_object].hobj_type
+          && OBJ_EVENT != g_objects[idx_object].hobj_type))
+  {
+    fprintf(stderr, "%u:%u : Undefined barrier or event: %s\n", p_tree->nd_src_line,
+            p_tree->nd_src_col, p_tree->nd_sync_object_name);
+    error_exit(0);
+  }
+  g_code[g_ip].i_opcode = OBJ_BARRIER == g_objects[idx_object].hobj_type
+    ? OP_BARRIER_WAIT
+    : OP_EVENT_WAIT;
+  g_code[g_ip++].i_object_idx = (uint32_t) idx_object;
+}
+//------------------------------------------------------------------------------
+static void compile_ND_CRITICAL(PARSE_NODE *p_tree)
+{
+  // "critical l <statements> end"
+  // compiles to:
+  //     LOCK_ACQUIRE l
+  //     <statements>
+  //     LOCK_RELEASE l
+  //
+  // exec_end_task() and exec_return() let go of locks that a 'stop' or 'return'
+  // inside the block skips the LOCK_RELEASE of.
+  uint32_t idx_object = compile_object_index(p_tree->nd_sync_object_name, OBJ_LOCK);
+  g_code[g_ip].i_opcode = OP_LOCK_ACQUIRE;
+  g_code[g_ip++].i_object_idx = idx_object;
+  compile(p_tree->nd_p_critical_statement_seq);
+  g_code[g_ip].i_opcode = OP_LOCK_RELEASE;
+  g_code[g_ip++].i_object_idx = idx_object;
+}
+//------------------------------------------------------------------------------
+static void compile_ND_SELECT(PARSE_NODE *p_nd_select)
+{
+  uint32_t n_cases = 0;
+  uint32_t jump_table_addr;
+  uint32_t idx_case;
+  uint32_t *p_end_jump_addrs;
+  char jump_label_name[MAX_STR];
+  // "select
+  //    case send c, e then ss0
+  //    case receive d, x then ss1
+  //    case wait t timeout ss2
+  //  end"
+  // compiles to:
+  //     compile(e)          ; values of all send cases, in order
+  //     compile(t)          ; only if there is a timeout case
+  //     SELECT 3
+  //     SELECT_SEND c
+  //     SELECT_RECEIVE d
+  //     SELECT_TIMEOUT
+  //     JUMP L0             ; jump table: one entry per case.  OP_SELECT branches
+  //     JUMP L1             ; directly to the  address in entry k when case k
+  //     JUMP L2             ; can proceed.
+  //   L0:
+  //     compile(ss0)
+  //     JUMP END-SELECT
+  //   L1:
+  //     POP_INT x           ; OP_SELECT pushed the value received.
+  //     compile(ss1)
+  //     JUMP END-SELECT
+  //   L2:
+  //     compile(ss2)
+  //   END-SELECT:
+  for (LISTITEM *p_case = p_nd_select->nd_p_select_cases; p_case; p_case = p_case->l_p_next)
+  {
+    PARSE_NODE *p_op = p_case->l_parse_node->nd_p_select_op;
+    if (p_op && ND_SEND == p_op->nd_type)
+      compile(p_op->nd_p_send_expr);
+    n_cases += 1;
+  }
+  for (LISTITEM *p_case = p_nd_select->nd_p_select_cases; p_case; p_case = p_case->l_p_next)
+  {
+    if (!p_case->l_parse_node->nd_p_select_op)
+      compile(p_case->l_parse_node->nd_p_select_millisec_expr);
+  }
+  g_code[g_ip].i_opcode = OP_SELECT;
+  g_code[g_ip++].i_n_select_cases = n_cases;
+  for (LISTITEM *p_case = p_nd_select->nd_p_select_cases; p_case; p_case = p_case->l_p_next)
+  {
+    PARSE_NODE *p_op = p_case->l_parse_node->nd_p_select_op;
+    if (!p_op)
+      g_code[g_ip++].i_opcode = OP_SELECT_TIMEOUT;
+    else
+    {
+      g_code[g_ip].i_opcode = ND_SEND == p_op->nd_type ? OP_SELECT_SEND : OP_SELECT_RECEIVE;
+      g_code[g_ip++].i_object_idx = compile_object_index(p_op->nd_channel_name, OBJ_CHANNEL);
+    }
+  }
+  jump_table_addr = g_ip;
+  for (idx_case = 0; idx_case < n_cases; ++idx_case)
+  {
+    g_code[g_ip].i_opcode = OP_JUMP;
+    g_code[g_ip++].i_jump_addr = 0;
+  }
+  p_end_jump_addrs = malloc(n_cases*sizeof(uint32_t));
+  idx_case = 0;
+  for (LISTITEM *p_case = p_nd_select->nd_p_select_cases; p_case; p_case = p_case->l_p_next)
+  {
+    PARSE_NODE *p_op = p_case->l_parse_node->nd_p_select_op;
+    compile_create_label_name("SELECT-CASE", jump_label_name);
+    symtab_add_jump_label(jump_label_name, g_ip);
+    g_n_labels += 1;
+    g_code[jump_table_addr + idx_case].i_jump_addr = g_ip;
+    if (p_op && ND_RECEIVE == p_op->nd_type)
+      compile_OP_POP_INT(p_op->nd_receive_var_name);
+    compile(p_case->l_parse_node->nd_p_select_statement_seq);
+    p_end_jump_addrs[idx_case] = g_ip;
+    if (p_case->l_p_next)
+    {
+      g_code[g_ip].i_opcode = OP_JUMP;
+      g_code[g_ip++].i_jump_addr = 0;
+    }
+    idx_case += 1;
+  }
+  compile_create_label_name("END-SELECT", jump_label_name);
+  symtab_add_jump_label(jump_label_name, g_ip);
+  g_n_labels += 1;
+  for (idx_case = 0; idx_case + 1 < n_cases; ++idx_case)
+    g_code[p_end_jump_addrs[idx_case]].i_jump_addr = g_ip;
+  free(p_end_jump_addrs);
+}
+//------------------------------------------------------------------------------
 static void compile_ND_STATEMENT_SEQUENCE(PARSE_NODE *p_tree)
 {
   for (LISTITEM *p_statement = p_tree->nd_p_statement_seq;
@@ -345,9 +1019,422 @@ static void compile_ND_STATEMENT_SEQUENCE(PARSE_NODE *p_tree)
   }
 }
 //------------------------------------------------------------------------------
+// FROM THE IR (-O2):
+//
+// compile_ir_func() emits the blocks of a task's IR (see ir.c) in layout
+// order, with the jump labels compile() gives the statements they came from,
+// so loops keep their backward branch at the bottom.  A jump to the next
+// block is left out, and a branch is inverted when that lets it fall through
+// to the next block.
+//
+// Each value an instruction uses is pushed in one of three ways:
+//
+//   1. A constant (or a variable's IR_ENTRY 0) by PUSH_CONST_INT.
+//
+//   2. Stack scheduling: a value used once, as an operand of a later
+//      instruction in the same block, is computed where it is used, as if
+//      the statements were one expression tree.  "x := a*b; print_int x + c"
+//      becomes
+//
+//          PUSH_VAR a; PUSH_VAR b; MULTIPLY; PUSH_VAR c; ADD; PRINT_INT
+//
+//      with no POP_INT x; PUSH_VAR x.  Moving its code there mustn't move it
+//      past anything else, so this is only done when all the code in between
+//      is that of other values the same way: compile_ir_schedule() checks
+//      that they would be left on the stack, above it, in the order used.
+//
+//   3. Otherwise by PUSH_VAR from the value's frame slot: POP_INT stores a
+//      value in its variable's slot (or a temporary's) where it's computed.
+//      IR_ENTRY, IR_SLOT and phi values are in their variable's slot already,
+//      and so are all of a phi's arguments, so phis need no code.  A
+//      constant a phi, an IR_STATEMENT or an IR_EXPR reads from its
+//      variable's slot is stored there too.
+//
+// A value that isn't used but has to be computed (a 'call', a '/' that may
+// trap) is dropped with OP_DROP.
+typedef struct EMIT EMIT;
+struct EMIT
+{
+  IR_FUNC *em_p_func;
+  uint32_t *em_p_n_uses;  // Indexed by ii_id, like the other arrays.
+  IR_INSTR **em_p_user;  // Last instruction using the value.
+  bool *em_p_read_from_slot;  // By a phi, IR_STATEMENT or IR_EXPR.
+  bool *em_p_in_tree;  // Computed where it's used (stack scheduling).
+  uint32_t *em_p_var_slots;  // Frame slot of each IR variable, UINT32_MAX if none yet.
+};
+//------------------------------------------------------------------------------
+// RETURNS: true if op is a value computed by code of its own.
+static bool compile_ir_is_computed(uint8_t op)
+{
+  return op >= IR_COPY && op <= IR_EXPR;
+}
+//------------------------------------------------------------------------------
+// RETURNS: true if op reads its arguments from their frame slots.
+static bool compile_ir_reads_slots(uint8_t op)
+{
+  return IR_PHI == op || IR_STATEMENT == op || IR_EXPR == op;
+}
+//------------------------------------------------------------------------------
+static uint32_t compile_ir_slot(EMIT *p_emit, IR_INSTR *p_value)
+{
+  uint32_t idx_var = p_value->ii_var;
+  if (IR_NO_VAR == idx_var)
+  {
+    char temporary_name[MAX_STR];
+    sprintf(temporary_name, "<ir_%u>", p_value->ii_id);
+    return compile_variable_slot(temporary_name);
+  }
+  if (UINT32_MAX == p_emit->em_p_var_slots[idx_var])
+    p_emit->em_p_var_slots[idx_var] =
+      compile_variable_slot(p_emit->em_p_func->if_p_variable_names[idx_var]);
+  return p_emit->em_p_var_slots[idx_var];
+}
+//------------------------------------------------------------------------------
+// Take values out of the tree of the one using them until, going through
+// p_block in order, the values in trees are always on top of the stack when
+// they're used.
+static void compile_ir_schedule(EMIT *p_emit, IR_BLOCK *p_block)
+{
+  uint32_t n_instrs = 0;
+  IR_INSTR **p_stack;  // Values computed, in trees, not yet used.
+  bool changed = true;
+  for (IR_INSTR *p_instr = p_block->ib_p_first; p_instr; p_instr = p_instr->ii_p_next)
+    n_instrs += 1;
+  p_stack = malloc((n_instrs + 1)*sizeof(IR_INSTR *));
+  while (changed)
+  {
+    uint32_t depth = 0;
+    changed = false;
+    for (IR_INSTR *p_instr = p_block->ib_p_first; p_instr && !changed; p_instr = p_instr->ii_p_next)
+    {
+      uint32_t n_in_tree = 0;
+      uint32_t idx_stack;
+      bool in_order = true;
+      if (!compile_ir_is_computed(p_instr->ii_op) && ir_is_value(p_instr->ii_op)
+          && !(IR_CONST == p_instr->ii_op && p_emit->em_p_read_from_slot[p_instr->ii_id]))
+        continue;  // No code.
+      for (uint32_t i = 0; i < p_instr->ii_n_args; ++i)
+        n_in_tree += p_emit->em_p_in_tree[p_instr->ii_p_args[i]->ii_id];
+      in_order = n_in_tree <= depth;
+      idx_stack = depth - n_in_tree;
+      for (uint32_t i = 0; i < p_instr->ii_n_args && in_order; ++i)
+        if (p_emit->em_p_in_tree[p_instr->ii_p_args[i]->ii_id])
+          in_order = p_instr->ii_p_args[i] == p_stack[idx_stack++];
+      if (!in_order)
+      {
+        for (uint32_t i = 0; i < p_instr->ii_n_args; ++i)
+          p_emit->em_p_in_tree[p_instr->ii_p_args[i]->ii_id] = false;
+        changed = true;
+        break;
+      }
+      depth -= n_in_tree;
+      if (p_emit->em_p_in_tree[p_instr->ii_id])
+        p_stack[depth++] = p_instr;
+      else if (depth)
+      {
+        // p_instr's code would come between a tree's code and its user.
+        while (depth)
+          p_emit->em_p_in_tree[p_stack[--depth]->ii_id] = false;
+        changed = true;
+      }
+    }
+  }
+  free(p_stack);
+}
+//------------------------------------------------------------------------------
+// RETURNS: OP_... computing IR value op (only for ops that have one).
+static uint8_t compile_ir_opcode(uint8_t op)
+{
+  switch (op)
+  {
+    case IR_NEGATE:
+      return OP_NEGATE;
+    case IR_NOT:
+      return OP_NOT;
+    case IR_ADD:
+      return OP_ADD;
+    case IR_SUBTRACT:
+      return OP_SUBTRACT;
+    case IR_MULTIPLY:
+      return OP_MULTIPLY;
+    case IR_DIVIDE:
+      return OP_DIVIDE;
+    case IR_REMAINDER:
+      return OP_REMAINDER;
+    case IR_EQ:
+      return OP_EQ;
+    case IR_NE:
+      return OP_NE;
+    case IR_LT:
+      return OP_LT;
+    case IR_LE:
+      return OP_LE;
+    case IR_GT:
+      return OP_GT;
+    case IR_GE:
+      return OP_GE;
+    default:
+      return OP_BAD;
+  }
+}
+//------------------------------------------------------------------------------
+// RETURNS: the ND_... comparison of IR_BRANCH condition cond.
+static uint8_t compile_ir_condition_node(uint8_t cond)
+{
+  switch (cond)
+  {
+    case IR_EQ:
+      return ND_EQ;
+    case IR_NE:
+      return ND_NE;
+    case IR_LT:
+      return ND_LT;
+    case IR_LE:
+      return ND_LE;
+    case IR_GT:
+      return ND_GT;
+    default:
+      return ND_GE;
+  }
+}
+//------------------------------------------------------------------------------
+static void compile_ir_value(EMIT *p_emit, IR_INSTR *p_value);
+//------------------------------------------------------------------------------
+// Emit the code that pushes p_value (see 1-3 above).
+static void compile_ir_push(EMIT *p_emit, IR_INSTR *p_value)
+{
+  if (p_emit->em_p_in_tree[p_value->ii_id])
+    compile_ir_value(p_emit, p_value);
+  else if (IR_CONST == p_value->ii_op)
+    compile_OP_PUSH_CONST_INT(p_value->ii_const);
+  else if (IR_ENTRY == p_value->ii_op)
+    compile_OP_PUSH_CONST_INT(0);
+  else
+  {
+    g_code[g_ip].i_opcode = OP_PUSH_VAR;
+    g_code[g_ip++].i_var_slot = compile_ir_slot(p_emit, p_value);
+  }
+}
+//------------------------------------------------------------------------------
+// Emit the code that computes p_value and leaves it on the stack.
+static void compile_ir_value(EMIT *p_emit, IR_INSTR *p_value)
+{
+  switch (p_value->ii_op)
+  {
+    case IR_COPY:
+      compile_ir_push(p_emit, p_value->ii_p_args[0]);
+      break;
+    case IR_CALL:
+      compile_OP_CALL(p_value->ii_p_tree->nd_callee_name);
+      break;
+    case IR_RECEIVE:
+      g_code[g_ip].i_opcode = OP_RECEIVE;
+      g_code[g_ip++].i_object_idx = compile_object_index(p_value->ii_p_tree->nd_channel_name,
+                                                         OBJ_CHANNEL);
+      break;
+    case IR_EXPR:
+      compile(p_value->ii_p_tree);
+      break;
+    default:
+      for (uint32_t i = 0; i < p_value->ii_n_args; ++i)
+        compile_ir_push(p_emit, p_value->ii_p_args[i]);
+      g_code[g_ip++].i_opcode = compile_ir_opcode(p_value->ii_op);
+      break;
+  }
+}
+//------------------------------------------------------------------------------
+// IR_BRANCH at the end of a block followed by p_next.
+static void compile_ir_branch(EMIT *p_emit, IR_INSTR *p_branch, IR_BLOCK *p_next)
+{
+  IR_BLOCK *p_true = p_branch->ii_p_block->ib_p_succs[0];
+  IR_BLOCK *p_false = p_branch->ii_p_block->ib_p_succs[1];
+  IR_INSTR *p_right = p_branch->ii_p_args[1];
+  uint8_t nd_type = compile_ir_condition_node(p_branch->ii_cond);
+  // 'x = 0' and 'x <> 0' (what a test that isn't a comparison is) don't need
+  // the 0 pushed.
+  bool versus_zero = (ND_EQ == nd_type || ND_NE == nd_type)
+    && ((IR_CONST == p_right->ii_op && 0 == p_right->ii_const) || IR_ENTRY == p_right->ii_op);
+  uint8_t jump_if_true;
+  uint8_t jump_if_false;
+  compile_ir_push(p_emit, p_branch->ii_p_args[0]);
+  if (versus_zero)
+  {
+    jump_if_true = ND_NE == nd_type ? OP_JUMP_IF_NONZERO : OP_JUMP_IF_ZERO;
+    jump_if_false = ND_NE == nd_type ? OP_JUMP_IF_ZERO : OP_JUMP_IF_NONZERO;
+  }
+  else
+  {
+    compile_ir_push(p_emit, p_right);
+    jump_if_true = compile_compare_and_jump_op(nd_type, false);
+    jump_if_false = compile_compare_and_jump_op(nd_type, true);
+  }
+  if (p_false == p_next)
+    compile_listed_jump(jump_if_true, &p_true->ib_jump_list);
+  else if (p_true == p_next)
+    compile_listed_jump(jump_if_false, &p_false->ib_jump_list);
+  else
+  {
+    compile_listed_jump(jump_if_true, &p_true->ib_jump_list);
+    compile_listed_jump(OP_JUMP, &p_false->ib_jump_list);
+  }
+}
+//------------------------------------------------------------------------------
+// Emit p_instr, in a block followed by p_next.
+static void compile_ir_instr(EMIT *p_emit, IR_INSTR *p_instr, IR_BLOCK *p_next)
+{
+  uint32_t idx_object;
+  switch (p_instr->ii_op)
+  {
+    case IR_CONST:
+      if (p_emit->em_p_read_from_slot[p_instr->ii_id])
+      {
+        compile_OP_PUSH_CONST_INT(p_instr->ii_const);
+        g_code[g_ip].i_opcode = OP_POP_INT;
+        g_code[g_ip++].i_var_slot = compile_ir_slot(p_emit, p_instr);
+      }
+      break;
+    case IR_ENTRY:
+    case IR_SLOT:
+    case IR_PHI:
+      break;
+    case IR_PRINT_INT:
+      compile_ir_push(p_emit, p_instr->ii_p_args[0]);
+      g_code[g_ip++].i_opcode = OP_PRINT_INT;
+      break;
+    case IR_PRINT_CHAR:
+    case IR_PRINT_STRING:
+    case IR_STATEMENT:
+      compile(p_instr->ii_p_tree);
+      break;
+    case IR_BEGIN_ATOMIC_PRINT:
+      g_code[g_ip++].i_opcode = OP_BEGIN_ATOMIC_PRINT;
+      break;
+    case IR_END_ATOMIC_PRINT:
+      g_code[g_ip++].i_opcode = OP_END_ATOMIC_PRINT;
+      break;
+    case IR_SEND:
+      idx_object = compile_object_index(p_instr->ii_p_tree->nd_channel_name, OBJ_CHANNEL);
+      compile_ir_push(p_emit, p_instr->ii_p_args[0]);
+      g_code[g_ip].i_opcode = OP_SEND;
+      g_code[g_ip++].i_object_idx = idx_object;
+      break;
+    case IR_SLEEP:
+      compile_ir_push(p_emit, p_instr->ii_p_args[0]);
+      g_code[g_ip++].i_opcode = OP_SLEEP;
+      break;
+    case IR_JUMP:
+      if (p_instr->ii_p_block->ib_p_succs[0] != p_next)
+        compile_listed_jump(OP_JUMP, &p_instr->ii_p_block->ib_p_succs[0]->ib_jump_list);
+      break;
+    case IR_BRANCH:
+      compile_ir_branch(p_emit, p_instr, p_next);
+      break;
+    case IR_RETURN:
+      compile_ir_push(p_emit, p_instr->ii_p_args[0]);
+      g_code[g_ip++].i_opcode = OP_RETURN;
+      break;
+    case IR_STOP:
+      compile_OP_END_TASK();
+      break;
+    default:
+      if (p_emit->em_p_in_tree[p_instr->ii_id])
+        break;  // Its user emits it.
+      compile_ir_value(p_emit, p_instr);
+      if (0 == p_emit->em_p_n_uses[p_instr->ii_id])
+        g_code[g_ip++].i_opcode = OP_DROP;
+      else
+      {
+        g_code[g_ip].i_opcode = OP_POP_INT;
+        g_code[g_ip++].i_var_slot = compile_ir_slot(p_emit, p_instr);
+      }
+      break;
+  }
+}
+//------------------------------------------------------------------------------
+static void compile_ir_func(IR_FUNC *p_func)
+{
+  EMIT emit;
+  uint32_t n_instrs = p_func->if_n_instrs;
+  char jump_label_name[MAX_STR];
+  emit.em_p_func = p_func;
+  emit.em_p_n_uses = calloc(n_instrs + 1, sizeof(uint32_t));
+  emit.em_p_user = calloc(n_instrs + 1, sizeof(IR_INSTR *));
+  emit.em_p_read_from_slot = calloc(n_instrs + 1, sizeof(bool));
+  emit.em_p_in_tree = calloc(n_instrs + 1, sizeof(bool));
+  emit.em_p_var_slots = malloc((p_func->if_n_variables + 1)*sizeof(uint32_t));
+  for (uint32_t idx_var = 0; idx_var < p_func->if_n_variables; ++idx_var)
+    emit.em_p_var_slots[idx_var] = UINT32_MAX;
+  for (IR_BLOCK *p_block = p_func->if_p_entry; p_block; p_block = p_block->ib_p_next)
+    for (IR_INSTR *p_instr = p_block->ib_p_first; p_instr; p_instr = p_instr->ii_p_next)
+      for (uint32_t i = 0; i < p_instr->ii_n_args; ++i)
+      {
+        uint32_t id = p_instr->ii_p_args[i]->ii_id;
+        emit.em_p_n_uses[id] += 1;
+        emit.em_p_user[id] = p_instr;
+        if (compile_ir_reads_slots(p_instr->ii_op))
+          emit.em_p_read_from_slot[id] = true;
+      }
+  for (IR_BLOCK *p_block = p_func->if_p_entry; p_block; p_block = p_block->ib_p_next)
+  {
+    for (IR_INSTR *p_instr = p_block->ib_p_first; p_instr; p_instr = p_instr->ii_p_next)
+    {
+      uint32_t id = p_instr->ii_id;
+      emit.em_p_in_tree[id] = compile_ir_is_computed(p_instr->ii_op)
+        && 1 == emit.em_p_n_uses[id]
+        && !emit.em_p_read_from_slot[id]
+        && p_block == emit.em_p_user[id]->ii_p_block;
+    }
+    compile_ir_schedule(&emit, p_block);
+    p_block->ib_jump_list = JUMP_LIST_END;
+  }
+  for (IR_BLOCK *p_block = p_func->if_p_entry; p_block; p_block = p_block->ib_p_next)
+  {
+    p_block->ib_addr = g_ip;
+    if (p_block->ib_label_prefix)
+    {
+      compile_create_label_name(p_block->ib_label_prefix, jump_label_name);
+      symtab_add_jump_label(jump_label_name, g_ip);
+      g_n_labels += 1;
+    }
+    for (IR_INSTR *p_instr = p_block->ib_p_first; p_instr; p_instr = p_instr->ii_p_next)
+      compile_ir_instr(&emit, p_instr, p_block->ib_p_next);
+  }
+  for (IR_BLOCK *p_block = p_func->if_p_entry; p_block; p_block = p_block->ib_p_next)
+    compile_patch_jump_list(p_block->ib_jump_list, p_block->ib_addr);
+  free(emit.em_p_var_slots);
+  free(emit.em_p_in_tree);
+  free(emit.em_p_read_from_slot);
+  free(emit.em_p_user);
+  free(emit.em_p_n_uses);
+}
+//------------------------------------------------------------------------------
+// Compile the statements of a task (or the init block) and the 'stop' they end
+// with, through the IR from -O2 on.
+static void compile_task_body(PARSE_NODE *p_body)
+{
+  if (g_opt_level >= OPT_LEVEL_IR)
+  {
+    IR_FUNC *p_func = ir_build(p_body);
+    passes_run_ir(p_func, g_opt_level, g_p_opt_stats);
+    compile_ir_func(p_func);
+    ir_free(p_func);
+  }
+  else
+  {
+    compile(p_body);
+    compile_OP_END_TASK();
+  }
+}
+//------------------------------------------------------------------------------
 static void compile_ND_TASK_DECLARATION(PARSE_NODE *p_tree)
 {
   LABEL *p_task_label = symtab_lookup_label(p_tree->nd_task_name);
+  if (p_tree->nd_task_priority < TASK_PRIORITY_MIN || p_tree->nd_task_priority > TASK_PRIORITY_MAX)
+  {
+    fprintf(stderr, "%u:%u : Priority of %s must be from %d to %d.\n", p_tree->nd_src_line,
+            p_tree->nd_src_col, p_tree->nd_task_name, TASK_PRIORITY_MIN, TASK_PRIORITY_MAX);
+    error_exit(0);
+  }
   if (!p_task_label)
   {
     p_task_label = symtab_add_task_label(p_tree->nd_task_name, g_ip);
@@ -371,15 +1458,25 @@ static void compile_ND_TASK_DECLARATION(PARSE_NODE *p_tree)
       free(p_prev_backpatch);
     p_task_label->lbl_p_backpatch_list = NULL;
   }
-  compile(p_tree->nd_p_task_body);
-  compile_OP_END_TASK();  // Every task has an implicit 'stop' at the end.
+  compile_begin_frame();
+  compile_task_body(p_tree->nd_p_task_body);  // Every task has an implicit 'stop' at the end.
+  p_task_label->lbl_frame_size = g_n_variables;
+  p_task_label->lbl_priority = (int8_t) p_tree->nd_task_priority;
 }
 //------------------------------------------------------------------------------
 void compile_ND_MODULE_DECLARATION(PARSE_NODE *p_tree)
 {
-  compile(p_tree->nd_p_init_statements);
-  g_code[g_ip++].i_opcode = OP_END_TASK;  // Implied  'stop'  at end  of  module
-                                          // initialization.
+  for (LISTITEM *p_object_declaration = p_tree->nd_p_object_decl_list;
+       p_object_declaration;
+       p_object_declaration = p_object_declaration->l_p_next)
+  {
+    compile(p_object_declaration->l_parse_node);
+  }
+  compile_classify_channels(p_tree);
+  compile_begin_frame();
+  compile_task_body(p_tree->nd_p_init_statements);  // Implied 'stop' at end of
+                                                    // module initialization.
+  g_init_frame_size = g_n_variables;
   for (LISTITEM *p_task_declaration = p_tree->nd_p_task_decl_list;
        p_task_declaration;
        p_task_declaration = p_task_declaration->l_p_next)
@@ -411,17 +1508,28 @@ void compile_check_for_undefined_tasks(void)
     error_exit(0);
 }
 //------------------------------------------------------------------------------
-void compile_init(void)
+void compile_init(uint8_t opt_level, OPT_STATS *p_stats)
 {
+  g_opt_level = opt_level;
+  g_p_opt_stats = p_stats;
   symtab_hash_init();
   strtab_init();
   g_ip = 0;
+  g_n_objects = 0;
+  g_n_variables = 0;
+  g_init_frame_size = 0;
+}
+//------------------------------------------------------------------------------
+// Run the bytecode optimizations (code-opt.c) on the code compile() emitted.
+void compile_optimize_code(void)
+{
+  passes_run_code(g_code, &g_ip, g_opt_level, g_p_opt_stats);
 }
 //------------------------------------------------------------------------------
 uint32_t compile_write_header(FILE *fout)
 {
   uint32_t idx_label;
-  uint32_t n_bytes_header = 4*sizeof(uint32_t);
+  uint32_t n_bytes_header = 6*sizeof(uint32_t);
   HEADER *p_header = NULL;
   uint32_t result = 0;
   // NOTE:  memory overflow  not  checked because  it  increases the  complexity
@@ -431,6 +1539,7 @@ uint32_t compile_write_header(FILE *fout)
   strcpy(p_header->hdr_module_name, g_module_name);
   n_bytes_header += sizeof(uint32_t) + strlen(g_module_name);
   p_header->hdr_code_size_bytes = g_ip*sizeof(INSTRUCTION);
+  p_header->hdr_init_frame_size = g_init_frame_size;
   idx_label = 0;
   p_header->hdr_p_label_list = malloc(g_n_labels*sizeof(HEADER_LABEL));
   for (uint32_t i = 0; i < SYMBOL_HTABLE_SIZE; ++i)
@@ -446,6 +1555,10 @@ uint32_t compile_write_header(FILE *fout)
       n_bytes_header += sizeof(uint8_t);
       p_header->hdr_p_label_list[idx_label].hlbl_addr = p_label->lbl_addr;
       n_bytes_header += sizeof(uint32_t);
+      p_header->hdr_p_label_list[idx_label].hlbl_frame_size = p_label->lbl_frame_size;
+      n_bytes_header += sizeof(uint32_t);
+      p_header->hdr_p_label_list[idx_label].hlbl_priority = p_label->lbl_priority;
+      n_bytes_header += sizeof(uint8_t);
       idx_label += 1;
     }
   }
@@ -468,6 +1581,15 @@ uint32_t compile_write_header(FILE *fout)
       }
     }
   }
+  p_header->hdr_n_objects = g_n_objects;
+  p_header->hdr_p_object_list = g_objects;
+  for (uint32_t i = 0; i < g_n_objects; ++i)
+  {
+    // counted string:char count         chars ....
+    n_bytes_header += sizeof(uint32_t) + strlen(g_objects[i].hobj_name);
+    // type, flags, size.
+    n_bytes_header += 2*sizeof(uint8_t) + sizeof(uint32_t);
+  }
   p_header->hdr_size_bytes = n_bytes_header;
   result = bhdr_write(fout, p_header);
   return result;
@@ -535,6 +1657,9 @@ void compile(PARSE_NODE *p_tree)
       case ND_WHILE:
         compile_ND_WHILE(p_tree);
         break;
+      case ND_EVERY:
+        compile_ND_EVERY(p_tree);
+        break;
       case ND_PRINT_INT:
         compile_ND_PRINT_INT(p_tree);
         break;
@@ -545,11 +1670,21 @@ void compile(PARSE_NODE *p_tree)
         compile_ND_SLEEP(p_tree);
         break;
       case ND_SPAWN_JOIN:
+      case ND_SPAWN_JOIN_WITH_TIMEOUT:
+      case ND_SPAWN_JOIN_FIRST:
         compile_ND_SPAWN(p_tree);
         break;
       case ND_STOP:
         compile_OP_END_TASK();
         break;
+      case ND_CALL:
+        // Statement: the value returned isn't used.
+        compile_OP_CALL(p_tree->nd_callee_name);
+        g_code[g_ip++].i_opcode = OP_DROP;
+        break;
+      case ND_RETURN:
+        compile_ND_RETURN(p_tree);
+        break;
       case ND_OR:
         compile_ND_OR(p_tree);
         break;
@@ -557,7 +1692,7 @@ void compile(PARSE_NODE *p_tree)
         compile_ND_AND(p_tree);
         break;
       case ND_NOT:
-        compile_binary_op(OP_NOT, p_tree);
+        compile_ND_NOT(p_tree);
         break;
       case ND_LE:
         compile_binary_op(OP_LE, p_tree);
@@ -607,6 +1742,41 @@ void compile(PARSE_NODE *p_tree)
       case ND_ATOMIC_PRINT:
         compile_ND_ATOMIC_PRINT(p_tree);
         break;
+      case ND_CHANNEL_DECLARATION:
+        compile_object_declaration(p_tree, OBJ_CHANNEL);
+        break;
+      case ND_BARRIER_DECLARATION:
+        compile_object_declaration(p_tree, OBJ_BARRIER);
+        break;
+      case ND_EVENT_DECLARATION:
+        compile_object_declaration(p_tree, OBJ_EVENT);
+        break;
+      case ND_LOCK_DECLARATION:
+        compile_object_declaration(p_tree, OBJ_LOCK);
+        break;
+      case ND_CRITICAL:
+        compile_ND_CRITICAL(p_tree);
+        break;
+      case ND_SYNC_WAIT:
+        compile_ND_SYNC_WAIT(p_tree);
+        break;
+      case ND_SIGNAL:
+        g_code[g_ip].i_opcode = OP_EVENT_SIGNAL;
+        g_code[g_ip++].i_object_idx = compile_object_index(p_tree->nd_sync_object_name, OBJ_EVENT);
+        break;
+      case ND_RESET:
+        g_code[g_ip].i_opcode = OP_EVENT_RESET;
+        g_code[g_ip++].i_object_idx = compile_object_index(p_tree->nd_sync_object_name, OBJ_EVENT);
+        break;
+      case ND_SEND:
+        compile_ND_SEND(p_tree);
+        break;
+      case ND_RECEIVE:
+        compile_ND_RECEIVE(p_tree);
+        break;
+      case ND_SELECT:
+        compile_ND_SELECT(p_tree);
+        break;
       default:
         break;
     }
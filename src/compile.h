@@ -1,6 +1,7 @@
 #pragma once
 //------------------------------------------------------------------------------ //
-void compile_init(void);
+void compile_init(uint8_t opt_level, OPT_STATS *p_stats);
 void compile(PARSE_NODE *p_tree);
+void compile_optimize_code(void);
 uint32_t compile_write_header(FILE *fout);
 uint32_t compile_write_code(FILE *fout);
@@ -10,6 +10,7 @@
 #include "lex.h"
 #include "instruction.h"
 #include "binary-header.h"
+#include "park.h"
 #include "exec.h"
 #include "module.h"
 //------------------------------------------------------------------------------
@@ -19,6 +20,8 @@ char *g_opcode_names[] =
 #include "opcode-enums.txt"
 };
 //------------------------------------------------------------------------------
+char *g_reduce_op_names[N_REDUCE_OPS] = { "none", "sum", "min", "max", "and", "or", "xor" };
+//------------------------------------------------------------------------------
 static void disasm_print_label_from_addr(uint32_t addr,
                                          HEADER *p_header)
 {
@@ -44,18 +47,31 @@ static void disasm_print_instruction(INSTRUCTION *p_instruct,
       printf("%d ", p_instruct->i_const_int);
       break;
     case OP_POP_INT:
+    case OP_DUP_POP_INT:
     case OP_PUSH_VAR:
-      printf("%c ", p_instruct->i_var_name);
+    case OP_JOIN_FIRST:
+    case OP_JOIN_FIRST_CANCEL:
+      printf("%u ", p_instruct->i_var_slot);
       break;
     case OP_JUMP:
+    case OP_EVERY_WAIT:
     case OP_JUMP_IF_ZERO:
     case OP_JUMP_IF_NONZERO:
+    case OP_JUMP_IF_EQ:
+    case OP_JUMP_IF_NE:
+    case OP_JUMP_IF_LT:
+    case OP_JUMP_IF_LE:
+    case OP_JUMP_IF_GT:
+    case OP_JUMP_IF_GE:
     case OP_TEST_AND_JUMP_IF_ZERO:
     case OP_TEST_AND_JUMP_IF_NONZERO:
     case OP_WAIT_JUMP:
+    case OP_WAIT_CANCEL_JUMP:
       disasm_print_label_from_addr(p_instruct->i_jump_addr, p_header);
       break;
     case OP_SPAWN:
+    case OP_SPAWN_INLINE:
+    case OP_CALL:
       disasm_print_label_from_addr(p_instruct->i_task_addr, p_header);
       break;
     case OP_PRINT_CHAR:
@@ -67,6 +83,39 @@ static void disasm_print_instruction(INSTRUCTION *p_instruct,
     case OP_BEGIN_SPAWN:
       printf("%d ", p_instruct->i_n_spawn_tasks);
       break;
+    case OP_JOIN_REDUCE:
+      if (p_instruct->i_reduce_op < N_REDUCE_OPS)
+        printf("%s ", g_reduce_op_names[p_instruct->i_reduce_op]);
+      else
+        printf("?%u ", (uint32_t) p_instruct->i_reduce_op);
+      break;
+    case OP_SELECT:
+      printf("%d ", p_instruct->i_n_select_cases);
+      break;
+    case OP_SHIFT_LEFT:
+    case OP_SHIFT_RIGHT:
+    case OP_AND_MASK:
+      printf("%u ", (uint32_t) p_instruct->i_shift);
+      break;
+    case OP_MULTIPLY_HIGH:
+      printf("0x%08x %u ", (uint32_t) p_instruct->i_const_int, (uint32_t) p_instruct->i_shift);
+      break;
+    case OP_MULTIPLY_HIGH_REMAINDER:
+      printf("0x%08x %u %u ", (uint32_t) p_instruct->i_const_int, (uint32_t) p_instruct->i_shift,
+             (uint32_t) p_instruct->i_divisor);
+      break;
+    case OP_SEND:
+    case OP_RECEIVE:
+    case OP_SELECT_SEND:
+    case OP_SELECT_RECEIVE:
+    case OP_BARRIER_WAIT:
+    case OP_EVENT_WAIT:
+    case OP_EVENT_SIGNAL:
+    case OP_EVENT_RESET:
+    case OP_LOCK_ACQUIRE:
+    case OP_LOCK_RELEASE:
+      printf("%s ", p_header->hdr_p_object_list[p_instruct->i_object_idx].hobj_name);
+      break;
     case OP_PRINT_STRING:
       printf("%u : ", p_instruct->i_string_idx);
       lex_print_string_escaped(p_header->hdr_p_string_list[p_instruct->i_string_idx]);
@@ -9,13 +9,22 @@
 #include <pthread.h>
 #include <stdatomic.h>
 #include <assert.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <errno.h>
 #include <util.h>
+#include <cmdline-switch.h>
 //------------------------------------------------------------------------------
 #include "instruction.h"
 #include "binary-header.h"
 #include "instruction.h"
+#include "park.h"
 #include "exec.h"
 #include "module.h"
+#include "channel.h"
+#include "sync.h"
+#include "reaper.h"
 //------------------------------------------------------------------------------
 #define PUSH(p_task, x) (p_task)->task_stack[(p_task)->task_stack_top++] = (x)
 #define POP(p_task) (p_task)->task_stack[--(p_task)->task_stack_top]
@@ -31,131 +40,1193 @@
 void *exec_run_task(void *pv_task);
 //------------------------------------------------------------------------------
 uint32_t g_n_tasks_created = 0;
+atomic_ulong g_n_spawn_threads = 0;  // Tasks given their own thread.
+atomic_ulong g_n_spawns_elided = 0;  // OP_SPAWN_INLINE run as a call.
+atomic_ulong g_n_spawns_run_inline = 0;  // One-task groups run on the parent's thread.
+atomic_ulong g_n_instructions_run = 0;  // By all tasks (mpr --stats).
+// exec_run_inline() recurses into exec_run_task() on the C stack; past this
+// depth a one-task group gets its own thread after all.
+#define MAX_INLINE_DEPTH 16
+static _Thread_local uint32_t g_inline_depth = 0;
 pthread_mutex_t g_print_mtx = PTHREAD_MUTEX_INITIALIZER;
+bool g_print_stats = false;  // mpr --stats
+// mpr --hires-sleep: timed waits park until this long before the deadline,
+// then spin for it.  0: park the whole way.
+static uint32_t g_spin_window_nsec = 0;
+// mpr --edf: 'every' passes run earliest deadline first (see exec_edf_run_pass()).
+static bool g_edf = false;
+static pthread_mutex_t g_edf_mtx = PTHREAD_MUTEX_INITIALIZER;
+static TASK *g_p_edf_queue = NULL;  // Waiting passes, earliest deadline first.
+static uint32_t g_edf_n_free_slots = 0;  // Passes that may still run at once.
+static PARK_EVENT g_edf_slot_freed;
+// Scheduling latency by task priority (mpr --stats).
+typedef struct LATENCY
+{
+  atomic_ulong lt_n;
+  atomic_ulong lt_total_nsec;
+  atomic_ulong lt_max_nsec;
+} LATENCY;
+static LATENCY g_start_latency[N_TASK_PRIORITIES];  // Spawn to first instruction.
+static LATENCY g_wake_latency[N_TASK_PRIORITIES];  // 'every' deadline to pass start.
+static atomic_bool g_priority_warned = false;
 //------------------------------------------------------------------------------
 TASK *exec_create_task(char *name,
                        MODULE *p_module,
                        TASK *p_parent_task,
-                       uint32_t ip)
+                       uint32_t ip,
+                       uint32_t frame_size)
 {
-  TASK *result = malloc(sizeof(TASK));
+  TASK *result = malloc(sizeof(TASK) + frame_size*sizeof(int32_t));
   result->task_p_module = p_module;
   strcpy(result->task_name, name);
-  for (char v = 'A'; v <= 'Z'; ++v)
-    result->task_variables[(uint32_t) v] = 0;
+  result->task_frame_size = frame_size;
+  zero_mem(result->task_variables, frame_size*sizeof(int32_t));
+  result->task_p_frame = result->task_variables;
+  result->task_call_depth = 0;
+  result->task_p_call_stack = NULL;
+  result->task_p_call_frames = NULL;
+  result->task_call_frames_size = 0;
+  result->task_call_frames_top = 0;
+  result->task_result = 0;
+  result->task_ran_inline = false;
+  result->task_p_inline_child = NULL;
+  result->task_priority = 0;
+  result->task_runnable_at.tv_sec = 0;
+  result->task_runnable_at.tv_nsec = 0;
+  result->task_holds_edf_slot = false;
+  result->task_p_edf_next = NULL;
   result->task_stack_top = 0;
   result->task_ip = ip;
   result->task_state = ST_STOPPED;
-  result->task_n_spawn_running = 0;
+  result->task_state_flags = 0;
+  result->task_n_selects = 0;
   result->task_p_parent = p_parent_task;
-  result->task_n_spawn_running = 0;
+  result->task_p_group = NULL;
+  result->task_holds_print_lock = false;
+  result->task_n_held_locks = 0;
+  result->task_n_periods = 0;
+  result->task_n_passes = 0;
+  result->task_n_overruns = 0;
+  result->task_max_late_nsec = 0;
+  atomic_init(&result->task_cancel_requested, false);
+  pthread_mutex_init(&result->task_park_mtx, NULL);
+  result->task_p_parked_on = NULL;
+  park_event_init(&result->task_wakeup);
+  reaper_register(result);
   g_n_tasks_created += 1;
   return result;
 }
 //------------------------------------------------------------------------------
-// Execute OP_SPAWN.  New (TASK *) is pushed onto p_parent_task's stack.
+void exec_free_task(TASK *p_task)
+{
+  reaper_unregister(p_task);
+  free(p_task->task_p_call_stack);
+  free(p_task->task_p_call_frames);
+  pthread_mutex_destroy(&p_task->task_park_mtx);
+  free(p_task);
+}
+//------------------------------------------------------------------------------
+// Convert two uint32_ts (starting at stk_offset) on as task's stack to a void*.
+void *exec_top_of_stack_to_ptr(TASK *p_task, uint32_t stk_offset)
+{
+  uint32_t u32_hi = STACK_PEEK(p_task, 0 + stk_offset);
+  uint32_t u32_lo = STACK_PEEK(p_task, 1 + stk_offset);
+  void *result = (void *) U32x2_TO_U64(u32_lo, u32_hi);
+  return result;
+}
+//------------------------------------------------------------------------------
+void *exec_pop_ptr(TASK *p_task)
+{
+  void *result = exec_top_of_stack_to_ptr(p_task, 0);
+  STACK_DROP(p_task);
+  STACK_DROP(p_task);
+  return result;
+}
+//------------------------------------------------------------------------------
+// *p_deadline = now + msec (CLOCK_MONOTONIC).
+void exec_deadline_after_msec(struct timespec *p_deadline, int32_t msec)
+{
+  if (msec < 0)
+    msec = -msec;
+  clock_gettime(CLOCK_MONOTONIC, p_deadline);
+  p_deadline->tv_sec += msec/1000;
+  p_deadline->tv_nsec += (msec%1000)*NSEC_PER_MSEC;
+  if (p_deadline->tv_nsec >= 1000*NSEC_PER_MSEC)
+  {
+    p_deadline->tv_sec += 1;
+    p_deadline->tv_nsec -= 1000*NSEC_PER_MSEC;
+  }
+}
+//------------------------------------------------------------------------------
+// *p_remaining = *p_deadline - now.
+// RETURNS: false if the deadline has passed.
+bool exec_time_until(struct timespec *p_deadline, struct timespec *p_remaining)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  p_remaining->tv_sec = p_deadline->tv_sec - now.tv_sec;
+  p_remaining->tv_nsec = p_deadline->tv_nsec - now.tv_nsec;
+  if (p_remaining->tv_nsec < 0)
+  {
+    p_remaining->tv_sec -= 1;
+    p_remaining->tv_nsec += 1000*NSEC_PER_MSEC;
+  }
+  return p_remaining->tv_sec >= 0 && (p_remaining->tv_sec > 0 || p_remaining->tv_nsec > 0);
+}
+//------------------------------------------------------------------------------
+// Hybrid sleep (--hires-sleep).
+// RETURNS: true if *p_remaining is within the spin window; otherwise
+// *p_remaining is shortened to end where the window starts.
+static bool exec_in_spin_window(struct timespec *p_remaining)
+{
+  if (0 == p_remaining->tv_sec && p_remaining->tv_nsec <= g_spin_window_nsec)
+    return true;
+  p_remaining->tv_nsec -= g_spin_window_nsec;
+  if (p_remaining->tv_nsec < 0)
+  {
+    p_remaining->tv_sec -= 1;
+    p_remaining->tv_nsec += 1000*NSEC_PER_MSEC;
+  }
+  return false;
+}
+//------------------------------------------------------------------------------
+// Timer slack lets the kernel defer a thread's timed wake-ups (by 50 us by
+// default) to batch them.  --hires-sleep turns it down to 1 ns for task threads.
+static void exec_set_timer_slack(void)
+{
+  if (g_spin_window_nsec)
+    prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+}
+//------------------------------------------------------------------------------
+bool exec_is_cancelled(TASK *p_task)
+{
+  return atomic_load_explicit(&p_task->task_cancel_requested, memory_order_relaxed);
+}
+//------------------------------------------------------------------------------
+// Ask p_task to stop.  It notices at its next backward jump or blocking opcode.
+// If it is parked right now, wake it.
+void exec_cancel_task(TASK *p_task)
+{
+  atomic_store(&p_task->task_cancel_requested, true);
+  pthread_mutex_lock(&p_task->task_park_mtx);
+  if (p_task->task_p_parked_on)
+    park_notify_all(p_task->task_p_parked_on);
+  // A child running inline is what is really executing on p_task's thread.
+  if (p_task->task_p_inline_child)
+    exec_cancel_task(p_task->task_p_inline_child);
+  pthread_mutex_unlock(&p_task->task_park_mtx);
+}
+//------------------------------------------------------------------------------
+static void exec_set_parked_on(TASK *p_task, PARK_EVENT *p_event)
+{
+  pthread_mutex_lock(&p_task->task_park_mtx);
+  p_task->task_p_parked_on = p_event;
+  pthread_mutex_unlock(&p_task->task_park_mtx);
+}
+//------------------------------------------------------------------------------
+static int64_t exec_nsec_between(struct timespec *p_from, struct timespec *p_to)
+{
+  return (int64_t) (p_to->tv_sec - p_from->tv_sec)*1000*NSEC_PER_MSEC
+    + p_to->tv_nsec - p_from->tv_nsec;
+}
+//------------------------------------------------------------------------------
+static void exec_add_nsec(struct timespec *p_time, uint64_t nsec)
+{
+  p_time->tv_sec += nsec/(1000*NSEC_PER_MSEC);
+  p_time->tv_nsec += nsec%(1000*NSEC_PER_MSEC);
+  if (p_time->tv_nsec >= 1000*NSEC_PER_MSEC)
+  {
+    p_time->tv_sec += 1;
+    p_time->tv_nsec -= 1000*NSEC_PER_MSEC;
+  }
+}
+//------------------------------------------------------------------------------
+// THEORY OF OPERATION (priorities and --edf):
+//
+// Each task runs on its own thread, so a task's 'priority' becomes the nice
+// value of its thread (exec_set_priority()): priority p runs at nice -p, and
+// the kernel gives each nice step about 25% more or less CPU when threads
+// compete.  Lowering a priority needs no privileges; raising one above that
+// of the thread that started it needs CAP_SYS_NICE (a warning is printed once
+// if it can't be done).  Tasks run inline or called run at the priority of the
+// task whose thread they are on, so mpc/mpr only run a task inline if the
+// priorities match.  Tasks held back by a 'limit' start highest priority first.
+//
+// With --edf, passes of 'every' loops additionally go through a run queue:
+// at most one pass per CPU runs at a time, and when a slot frees up the
+// waiting pass whose period ends first gets it.  The slot is given back while
+// the pass blocks (exec_wait_until()) and at the end of the pass.  Passes are
+// not preempted once running.
+//------------------------------------------------------------------------------
+static uint64_t exec_nsec_since(struct timespec *p_since)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - p_since->tv_sec)*1000*NSEC_PER_MSEC + now.tv_nsec - p_since->tv_nsec;
+}
+//------------------------------------------------------------------------------
+static void exec_record_latency(LATENCY *p_latency, uint64_t nsec)
+{
+  uint64_t max_nsec = atomic_load_explicit(&p_latency->lt_max_nsec, memory_order_relaxed);
+  atomic_fetch_add_explicit(&p_latency->lt_n, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&p_latency->lt_total_nsec, nsec, memory_order_relaxed);
+  while (nsec > max_nsec
+         && !atomic_compare_exchange_weak(&p_latency->lt_max_nsec, &max_nsec, nsec))
+    ;
+}
+//------------------------------------------------------------------------------
+// Set the nice value of the calling thread from p_task's priority.  Threads
+// inherit the nice value of the thread that created them, so this is done for
+// every task once a module uses priorities at all.
+static void exec_set_priority(TASK *p_task)
+{
+  if (p_task->task_p_module && p_task->task_p_module->mod_has_priorities
+      && setpriority(PRIO_PROCESS, syscall(SYS_gettid), -p_task->task_priority) < 0
+      && (EPERM == errno || EACCES == errno)
+      && !atomic_exchange(&g_priority_warned, true))
+  {
+    fprintf(stderr, "%s: can't raise priority to %d (needs CAP_SYS_NICE).\n",
+            p_task->task_name, p_task->task_priority);
+  }
+}
+//------------------------------------------------------------------------------
+// Wait for a --edf slot to run the 'every' pass that must end by *p_deadline.
+// RETURNS: false if p_task was cancelled while waiting.
+static bool exec_edf_run_pass(TASK *p_task, struct timespec *p_deadline)
+{
+  TASK **pp_queue;
+  bool result = true;
+  p_task->task_edf_deadline = *p_deadline;
+  exec_set_parked_on(p_task, &g_edf_slot_freed);
+  pthread_mutex_lock(&g_edf_mtx);
+  for (pp_queue = &g_p_edf_queue;
+       *pp_queue && exec_nsec_between(&(*pp_queue)->task_edf_deadline, p_deadline) >= 0;
+       pp_queue = &(*pp_queue)->task_p_edf_next)
+    ;
+  p_task->task_p_edf_next = *pp_queue;
+  *pp_queue = p_task;
+  for (;;)
+  {
+    uint32_t key;
+    if (g_p_edf_queue == p_task && g_edf_n_free_slots)
+    {
+      g_p_edf_queue = p_task->task_p_edf_next;
+      g_edf_n_free_slots -= 1;
+      p_task->task_holds_edf_slot = true;
+      break;
+    }
+    if (exec_is_cancelled(p_task))
+    {
+      for (pp_queue = &g_p_edf_queue; *pp_queue != p_task; pp_queue = &(*pp_queue)->task_p_edf_next)
+        ;
+      *pp_queue = p_task->task_p_edf_next;
+      result = false;
+      break;
+    }
+    key = park_prepare_wait(&g_edf_slot_freed);
+    pthread_mutex_unlock(&g_edf_mtx);
+    park_wait(&g_edf_slot_freed, key, NULL);
+    pthread_mutex_lock(&g_edf_mtx);
+  }
+  pthread_mutex_unlock(&g_edf_mtx);
+  exec_set_parked_on(p_task, NULL);
+  // A new head of the queue may be able to take a slot too.
+  park_notify_all(&g_edf_slot_freed);
+  return result;
+}
+//------------------------------------------------------------------------------
+static void exec_edf_end_pass(TASK *p_task)
+{
+  if (p_task->task_holds_edf_slot)
+  {
+    p_task->task_holds_edf_slot = false;
+    pthread_mutex_lock(&g_edf_mtx);
+    g_edf_n_free_slots += 1;
+    pthread_mutex_unlock(&g_edf_mtx);
+    park_notify_all(&g_edf_slot_freed);
+  }
+}
+//------------------------------------------------------------------------------
+// Block p_task on p_event until condition(p_arg) holds.  Gives up when *p_deadline
+// passes (unless p_deadline == NULL) or when p_task is cancelled (if
+// interruptible).  condition == NULL never holds: wait for the deadline.
+// RETURNS: WAIT_DONE, WAIT_TIMED_OUT or WAIT_CANCELLED.
+uint32_t exec_wait_until(TASK *p_task,
+                         PARK_EVENT *p_event,
+                         WAIT_CONDITION condition,
+                         void *p_arg,
+                         struct timespec *p_deadline,
+                         bool interruptible)
+{
+  uint32_t result = WAIT_DONE;
+  struct timespec remaining;
+  bool held_edf_slot = p_task->task_holds_edf_slot;
+  if (condition)
+  {
+    for (uint32_t i = 0; i < PARK_SPIN_TRIES; ++i)
+    {
+      if (condition(p_arg))
+        return WAIT_DONE;
+      CPU_RELAX();
+    }
+  }
+  exec_edf_end_pass(p_task);
+  p_task->task_state = condition ? ST_BLOCKED : ST_SLEEPING;
+  exec_set_parked_on(p_task, p_event);
+  for (;;)
+  {
+    uint32_t key;
+    if (p_deadline && !exec_time_until(p_deadline, &remaining))
+    {
+      result = WAIT_TIMED_OUT;
+      break;
+    }
+    if (p_deadline && g_spin_window_nsec && exec_in_spin_window(&remaining))
+    {
+      // Last stretch of a hybrid sleep: no scheduler wake-up to be late.
+      for (;;)
+      {
+        if (condition && condition(p_arg))
+          break;
+        if (interruptible && exec_is_cancelled(p_task))
+        {
+          result = WAIT_CANCELLED;
+          break;
+        }
+        if (!exec_time_until(p_deadline, &remaining))
+        {
+          result = WAIT_TIMED_OUT;
+          break;
+        }
+        CPU_RELAX();
+      }
+      break;
+    }
+    key = park_prepare_wait(p_event);
+    if (condition && condition(p_arg))
+    {
+      park_cancel_wait(p_event);
+      break;
+    }
+    if (interruptible && exec_is_cancelled(p_task))
+    {
+      park_cancel_wait(p_event);
+      result = WAIT_CANCELLED;
+      break;
+    }
+    park_wait(p_event, key, p_deadline ? &remaining : NULL);
+    if (condition && condition(p_arg))
+      break;
+  }
+  exec_set_parked_on(p_task, NULL);
+  p_task->task_state = ST_RUNNING;
+  if (held_edf_slot)
+    exec_edf_run_pass(p_task, &p_task->task_edf_deadline);
+  return result;
+}
+//------------------------------------------------------------------------------
+static void exec_group_release(SPAWN_GROUP *p_group)
+{
+  if (1 == atomic_fetch_sub(&p_group->sg_n_refs, 1))
+    free(p_group);
+}
+//------------------------------------------------------------------------------
+static bool exec_group_done(void *pv_group)
+{
+  return 0 == atomic_load(&((SPAWN_GROUP *) pv_group)->sg_n_running);
+}
+//------------------------------------------------------------------------------
+static bool exec_group_any_done(void *pv_group)
+{
+  return UINT32_MAX != atomic_load(&((SPAWN_GROUP *) pv_group)->sg_i_first_stopped);
+}
+//------------------------------------------------------------------------------
+// Let go of the locks p_task took at call depth >= call_depth ('stop' or
+// 'return' inside a 'critical' block, or cancellation).
+static void exec_release_locks(TASK *p_task, uint32_t call_depth)
+{
+  while (p_task->task_n_held_locks
+         && p_task->task_held_locks[p_task->task_n_held_locks - 1].hl_call_depth >= call_depth)
+    sync_lock_release(p_task->task_held_locks[--p_task->task_n_held_locks].hl_p_lock);
+}
+//------------------------------------------------------------------------------
+// Give p_task its own thread.
+static void exec_start_task(TASK *p_task)
+{
+  reaper_task_started(p_task);
+  atomic_fetch_add_explicit(&g_n_spawn_threads, 1, memory_order_relaxed);
+  pthread_create(&(p_task->task_thread_id),
+                 NULL,
+                 exec_run_task,
+                 p_task);
+}
+//------------------------------------------------------------------------------
+// Stop p_task: give back the print lock if it holds it and tell its spawn group.
+// In a group with a 'limit' the stopping task starts the next one waiting.
+void exec_end_task(TASK *p_task)
+{
+  SPAWN_GROUP *p_group = p_task->task_p_group;
+  TASK *p_next_task = NULL;
+  if (p_task->task_holds_print_lock)
+  {
+    p_task->task_holds_print_lock = false;
+    pthread_mutex_unlock(&g_print_mtx);
+  }
+  exec_release_locks(p_task, 0);
+  exec_edf_end_pass(p_task);
+  if (g_print_stats && p_task->task_n_passes)
+    fprintf(stderr, "task %s: %lu periods, %lu overruns, %.3f ms worst wake-up\n",
+            p_task->task_name, p_task->task_n_passes, p_task->task_n_overruns,
+            p_task->task_max_late_nsec/1e6);
+  p_task->task_state = ST_STOPPED;
+  if (p_group)
+  {
+    uint32_t i_none = UINT32_MAX;
+    p_task->task_p_group = NULL;
+    atomic_compare_exchange_strong(&p_group->sg_i_first_stopped, &i_none, p_task->task_i_in_group);
+    if (p_group->sg_limit)
+    {
+      uint32_t i_next = atomic_fetch_add(&p_group->sg_n_started, 1);
+      if (i_next < p_group->sg_n_tasks)
+        p_next_task = p_group->sg_p_tasks[i_next];
+    }
+    assert(atomic_load(&p_group->sg_n_running) > 0);
+    atomic_fetch_sub(&p_group->sg_n_running, 1);
+    park_notify_all(&p_group->sg_child_stopped);
+    exec_group_release(p_group);
+  }
+  reaper_task_stopped(p_task);
+  // Not yet started, so nobody can have freed it.
+  if (p_next_task)
+    exec_start_task(p_next_task);
+}
+//------------------------------------------------------------------------------
+// OP_BEGIN_SPAWN n.  New (SPAWN_GROUP *) is pushed onto p_parent_task's stack.
+void exec_begin_spawn(TASK *p_parent_task, uint32_t n_tasks)
+{
+  SPAWN_GROUP *p_group;
+  reaper_admit(p_parent_task, n_tasks);
+  p_group = malloc(sizeof(SPAWN_GROUP) + n_tasks*sizeof(TASK *));
+  atomic_init(&p_group->sg_n_running, 0);
+  atomic_init(&p_group->sg_n_refs, 1);  // Parent's reference.
+  park_event_init(&p_group->sg_child_stopped);
+  p_group->sg_limit = 0;
+  atomic_init(&p_group->sg_n_started, 0);
+  atomic_init(&p_group->sg_i_first_stopped, UINT32_MAX);
+  p_group->sg_n_tasks = 0;
+  PUSH(p_parent_task, U64_LO_U32((uint64_t) p_group));
+  PUSH(p_parent_task, U64_HI_U32((uint64_t) p_group));
+}
+//------------------------------------------------------------------------------
+// Execute OP_SPAWN.  New TASK is added to the (SPAWN_GROUP *) on top of
+// p_parent_task's stack.
 void exec_add_spawn_task(TASK *p_parent_task, uint32_t child_task_addr)
 {
   TASK *p_child_task = NULL;
   char child_task_name[MAX_STR];
+  uint32_t frame_size = p_parent_task->task_p_module->mod_p_frame_sizes[child_task_addr];
   HEADER *p_header = p_parent_task->task_p_module->mod_p_header;
+  SPAWN_GROUP *p_group = (SPAWN_GROUP *) exec_top_of_stack_to_ptr(p_parent_task, 0);
   // TODO: Need a more efficient way of finding the task name.
   for (uint32_t i = 0; i < p_header->hdr_n_labels; ++i)
   {
-    if (child_task_addr == p_header->hdr_p_label_list[i].hlbl_addr)
+    HEADER_LABEL *p_label = &p_header->hdr_p_label_list[i];
+    if (child_task_addr == p_label->hlbl_addr && p_label->hlbl_type != 0)
     {
-      sprintf(child_task_name, "%s:%u", p_header->hdr_p_label_list[i].hlbl_name,
-              g_n_tasks_created);
+      sprintf(child_task_name, "%s:%u", p_label->hlbl_name, g_n_tasks_created);
       break;
     }
   }
   p_child_task = exec_create_task(child_task_name,
                                   p_parent_task->task_p_module,
                                   p_parent_task,
-                                  child_task_addr);
-  PUSH(p_parent_task, U64_LO_U32((uint64_t) p_child_task));
-  PUSH(p_parent_task, U64_HI_U32((uint64_t) p_child_task));
+                                  child_task_addr,
+                                  frame_size);
+  p_child_task->task_priority = p_parent_task->task_p_module->mod_p_priorities[child_task_addr];
+  p_child_task->task_p_group = p_group;
+  p_child_task->task_i_in_group = p_group->sg_n_tasks;
+  atomic_fetch_add(&p_group->sg_n_refs, 1);
+  p_group->sg_p_tasks[p_group->sg_n_tasks++] = p_child_task;
 }
 //------------------------------------------------------------------------------
-// Convert two uint32_ts (starting at stk_offset) on as task's stack to a void*.
-void *exec_top_of_stack_to_ptr(TASK *p_task, uint32_t stk_offset)
+// OP_SPAWN_LIMIT.  Pop the 'limit' for the (SPAWN_GROUP *) on top of the stack.
+// A limit below 1 is taken as 1.
+void exec_spawn_limit(TASK *p_parent_task)
 {
-  uint32_t u32_hi = STACK_PEEK(p_task, 0 + stk_offset);
-  uint32_t u32_lo = STACK_PEEK(p_task, 1 + stk_offset);
-  void *result = (void *) U32x2_TO_U64(u32_lo, u32_hi);
-  return result;
+  int32_t limit = POP(p_parent_task);
+  SPAWN_GROUP *p_group = (SPAWN_GROUP *) exec_top_of_stack_to_ptr(p_parent_task, 0);
+  p_group->sg_limit = limit < 1 ? 1 : (uint32_t) limit;
 }
 //------------------------------------------------------------------------------
-// Run tasks whose addresses have been placed on the stack by OP_SPAWN.
-void exec_run_spawn(TASK *p_parent_task)
+// Run tasks added to p_group by OP_SPAWN.  With a limit only the first
+// sg_limit get started here; exec_end_task() starts the rest, so the tasks are
+// first put in priority order (task_i_in_group keeps the order of the 'spawn').
+void exec_run_spawn(SPAWN_GROUP *p_group)
 {
-  uint32_t stk_offset = 0;
-  for (uint32_t i = 0; i < p_parent_task->task_n_spawn_tasks; ++i)
+  uint32_t n_to_start = p_group->sg_n_tasks;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  atomic_store(&p_group->sg_n_running, p_group->sg_n_tasks);
+  for (uint32_t i = 0; i < p_group->sg_n_tasks; ++i)
+    p_group->sg_p_tasks[i]->task_runnable_at = now;
+  if (p_group->sg_limit && p_group->sg_limit < n_to_start)
   {
-    TASK *p_child_task = (TASK *) exec_top_of_stack_to_ptr(p_parent_task, stk_offset);
-    pthread_create(&(p_child_task->task_thread_id),
-                   NULL,
-                   exec_run_task,
-                   p_child_task);
-    stk_offset += sizeof(void *)/sizeof(uint32_t);  // Look at next pointer in stack.
-    p_parent_task->task_n_spawn_running += 1;
+    n_to_start = p_group->sg_limit;
+    for (uint32_t i = 1; i < p_group->sg_n_tasks; ++i)
+    {
+      TASK *p_task = p_group->sg_p_tasks[i];
+      uint32_t j = i;
+      for (; j > 0 && p_group->sg_p_tasks[j - 1]->task_priority < p_task->task_priority; --j)
+        p_group->sg_p_tasks[j] = p_group->sg_p_tasks[j - 1];
+      p_group->sg_p_tasks[j] = p_task;
+    }
   }
+  atomic_store(&p_group->sg_n_started, n_to_start);
+  for (uint32_t i = 0; i < n_to_start; ++i)
+    exec_start_task(p_group->sg_p_tasks[i]);
 }
 //------------------------------------------------------------------------------
-// OP_JOIN
-void exec_run_then_join_spawn(TASK *p_parent_task)
+// Join and free  every task in p_group (they must all  have stopped), then drop
+// the parent's reference to the group.
+static void exec_reap_group(SPAWN_GROUP *p_group)
 {
-  exec_run_spawn(p_parent_task);
-  for (uint32_t i = 0; i < p_parent_task->task_n_spawn_tasks; ++i)
+  for (uint32_t i = 0; i < p_group->sg_n_tasks; ++i)
   {
-    TASK *p_child_task = (TASK *) exec_top_of_stack_to_ptr(p_parent_task, 0);
-    pthread_join(p_child_task->task_thread_id, NULL);
-    free(p_child_task);
-    STACK_DROP(p_parent_task);
-    STACK_DROP(p_parent_task);
+    if (!p_group->sg_p_tasks[i]->task_ran_inline)
+      pthread_join(p_group->sg_p_tasks[i]->task_thread_id, NULL);
+    exec_free_task(p_group->sg_p_tasks[i]);
   }
-  assert(p_parent_task->task_n_spawn_running == 0);
+  exec_group_release(p_group);
 }
 //------------------------------------------------------------------------------
-// OP_WAIT_JUMP
-void exec_run_then_wait_spawn(TASK *p_parent_task)
+// Cancel every task in p_group and wait until they have all unwound.
+static void exec_cancel_group(TASK *p_parent_task, SPAWN_GROUP *p_group)
 {
-  uint32_t msec = POP(p_parent_task);
-  struct timespec wait_period;
-  exec_run_spawn(p_parent_task);
-  // Lose addresses of tasks since we're not joining on them.
-  p_parent_task->task_stack_top -= p_parent_task->task_n_spawn_tasks;
-  if (msec < 0)
-    msec = -msec;
-  zero_mem(&wait_period, sizeof(struct timespec));
-  wait_period.tv_sec = msec/1000;
-  wait_period.tv_nsec = (msec%1000)*NSEC_PER_MSEC;
-  p_parent_task->task_state = ST_SLEEPING;
-  nanosleep(&wait_period, NULL);
-  p_parent_task->task_state = ST_RUNNING;
-  if (0 == atomic_load(&(p_parent_task->task_n_spawn_running)))
-    // If all tasks have completed after the wait period, then jump to the success vector.
-    p_parent_task->task_ip = p_parent_task->task_p_module->mod_p_code[p_parent_task->task_ip].i_jump_addr;
+  for (uint32_t i = 0; i < p_group->sg_n_tasks; ++i)
+    exec_cancel_task(p_group->sg_p_tasks[i]);
+  exec_wait_until(p_parent_task, &p_group->sg_child_stopped, exec_group_done,
+                  p_group, NULL, /*interruptible*/ false);
+}
+//------------------------------------------------------------------------------
+// Run the only task in p_group on p_parent_task's thread.  The parent would only
+// block in OP_JOIN meanwhile, so nothing observable changes.
+static void exec_run_inline(TASK *p_parent_task, SPAWN_GROUP *p_group)
+{
+  TASK *p_child_task = p_group->sg_p_tasks[0];
+  atomic_fetch_add_explicit(&g_n_spawns_run_inline, 1, memory_order_relaxed);
+  atomic_store(&p_group->sg_n_running, 1);
+  p_child_task->task_ran_inline = true;
+  pthread_mutex_lock(&p_parent_task->task_park_mtx);
+  p_parent_task->task_p_inline_child = p_child_task;
+  pthread_mutex_unlock(&p_parent_task->task_park_mtx);
+  if (exec_is_cancelled(p_parent_task))
+    atomic_store(&p_child_task->task_cancel_requested, true);
+  clock_gettime(CLOCK_MONOTONIC, &p_child_task->task_runnable_at);
+  reaper_task_started(p_child_task);
+  ++g_inline_depth;
+  exec_run_task(p_child_task);
+  --g_inline_depth;
+  pthread_mutex_lock(&p_parent_task->task_park_mtx);
+  p_parent_task->task_p_inline_child = NULL;
+  pthread_mutex_unlock(&p_parent_task->task_park_mtx);
+}
+//------------------------------------------------------------------------------
+// Combine the results of the (stopped) tasks in p_group.  Each task wrote its
+// own task_result before stopping, so no lock is needed.
+static int32_t exec_reduce_group(SPAWN_GROUP *p_group, uint8_t reduce_op)
+{
+  int32_t result = p_group->sg_p_tasks[0]->task_result;
+  for (uint32_t i = 1; i < p_group->sg_n_tasks; ++i)
+  {
+    int32_t x = p_group->sg_p_tasks[i]->task_result;
+    switch (reduce_op)
+    {
+      case REDUCE_SUM:
+        result += x;
+        break;
+      case REDUCE_MIN:
+        result = x < result ? x : result;
+        break;
+      case REDUCE_MAX:
+        result = x > result ? x : result;
+        break;
+      case REDUCE_AND:
+        result &= x;
+        break;
+      case REDUCE_OR:
+        result |= x;
+        break;
+      case REDUCE_XOR:
+        result ^= x;
+        break;
+    }
+  }
+  return result;
+}
+//------------------------------------------------------------------------------
+// OP_JOIN, OP_JOIN_REDUCE
+//
+// Wait for every task in the group to stop.  For OP_JOIN_REDUCE (reduce_op !=
+// REDUCE_NONE) push their combined results.
+void exec_run_then_join_spawn(TASK *p_parent_task, uint8_t reduce_op)
+{
+  SPAWN_GROUP *p_group = (SPAWN_GROUP *) exec_pop_ptr(p_parent_task);
+  if (1 == p_group->sg_n_tasks && g_inline_depth < MAX_INLINE_DEPTH
+      && p_group->sg_p_tasks[0]->task_priority == p_parent_task->task_priority)
+    exec_run_inline(p_parent_task, p_group);
+  else
+    exec_run_spawn(p_group);
+  p_parent_task->task_state_flags |= B_JOIN;
+  if (WAIT_CANCELLED == exec_wait_until(p_parent_task, &p_group->sg_child_stopped,
+                                        exec_group_done, p_group, NULL, true))
+    exec_cancel_group(p_parent_task, p_group);
+  p_parent_task->task_state_flags &= ~B_JOIN;
+  if (REDUCE_NONE != reduce_op)
+    PUSH(p_parent_task, exec_reduce_group(p_group, reduce_op));
+  exec_reap_group(p_group);
+  p_parent_task->task_ip += 1;
+}
+//------------------------------------------------------------------------------
+// OP_JOIN_FIRST, OP_JOIN_FIRST_CANCEL
+//
+// Wait for any one task in the group to stop and store its index in the
+// instruction's variable.  The others are cancelled (OP_JOIN_FIRST_CANCEL) or
+// detached for the reaper, as after a timed-out OP_WAIT_JUMP.
+void exec_run_then_join_first(TASK *p_parent_task, bool cancel_rest)
+{
+  SPAWN_GROUP *p_group = (SPAWN_GROUP *) exec_pop_ptr(p_parent_task);
+  INSTRUCTION *p_instruction = &p_parent_task->task_p_module->mod_p_code[p_parent_task->task_ip];
+  exec_run_spawn(p_group);
+  p_parent_task->task_state_flags |= B_JOIN;
+  if (WAIT_CANCELLED == exec_wait_until(p_parent_task, &p_group->sg_child_stopped,
+                                        exec_group_any_done, p_group, NULL, true))
+    cancel_rest = true;
+  p_parent_task->task_state_flags &= ~B_JOIN;
+  p_parent_task->task_p_frame[p_instruction->i_var_slot] =
+    (int32_t) atomic_load(&p_group->sg_i_first_stopped);
+  if (cancel_rest)
+  {
+    exec_cancel_group(p_parent_task, p_group);
+    exec_reap_group(p_group);
+  }
   else
-    // Continue to timeout vector.
-    p_parent_task->task_ip += 1;
+  {
+    reaper_detach_group(p_group);
+    exec_group_release(p_group);
+  }
+  p_parent_task->task_ip += 1;
+}
+//------------------------------------------------------------------------------
+// OP_WAIT_JUMP, OP_WAIT_CANCEL_JUMP
+//
+// Wait at most msec for the tasks in the group to stop.  If they all stop
+// in time,  jump to the  'else' (success) branch.  Otherwise  continue to the
+// 'timeout' branch  and either leave the  tasks running (OP_WAIT_JUMP) or
+// cancel them and wait for them to unwind (OP_WAIT_CANCEL_JUMP).
+void exec_run_then_wait_spawn(TASK *p_parent_task, bool cancel_on_timeout)
+{
+  int32_t msec = POP(p_parent_task);
+  SPAWN_GROUP *p_group = (SPAWN_GROUP *) exec_pop_ptr(p_parent_task);
+  struct timespec deadline;
+  exec_deadline_after_msec(&deadline, msec);
+  exec_run_spawn(p_group);
+  p_parent_task->task_state_flags |= B_JOIN;
+  switch (exec_wait_until(p_parent_task, &p_group->sg_child_stopped,
+                          exec_group_done, p_group, &deadline, true))
+  {
+    case WAIT_DONE:
+      // All tasks have completed within the wait period: jump to the success vector.
+      exec_reap_group(p_group);
+      p_parent_task->task_ip = p_parent_task->task_p_module->mod_p_code[p_parent_task->task_ip].i_jump_addr;
+      break;
+    case WAIT_TIMED_OUT:
+      if (cancel_on_timeout)
+      {
+        exec_cancel_group(p_parent_task, p_group);
+        exec_reap_group(p_group);
+      }
+      else
+      {
+        // Tasks keep running on their own.  The reaper frees them.
+        reaper_detach_group(p_group);
+        exec_group_release(p_group);
+      }
+      // Continue to timeout vector.
+      p_parent_task->task_ip += 1;
+      break;
+    case WAIT_CANCELLED:
+      exec_cancel_group(p_parent_task, p_group);
+      exec_reap_group(p_group);
+      break;
+  }
+  p_parent_task->task_state_flags &= ~B_JOIN;
 }
 //------------------------------------------------------------------------------
 void exec_sleep(TASK *p_task)
 {
-  uint32_t msec = POP(p_task);
-  struct timespec sleep_period;
-  if (msec < 0)
-    msec = -msec;
-  zero_mem(&sleep_period, sizeof(struct timespec));
-  sleep_period.tv_sec = msec/1000;
-  sleep_period.tv_nsec = (msec%1000)*NSEC_PER_MSEC;
-  p_task->task_state = ST_SLEEPING;
-  nanosleep(&sleep_period, NULL);
-  p_task->task_state = ST_RUNNING;
+  struct timespec deadline;
+  exec_deadline_after_msec(&deadline, POP(p_task));
+  exec_wait_until(p_task, &p_task->task_wakeup, NULL, NULL, &deadline, true);
+  p_task->task_ip += 1;
+}
+//------------------------------------------------------------------------------
+// OP_EVERY_BEGIN.  Pops the period (msec).  The first pass runs now.
+void exec_every_begin(TASK *p_task)
+{
+  int32_t msec = POP(p_task);
+  PERIOD *p_period;
+  // An 'every' loop is only left by 'stop' or 'return', so one at this call
+  // depth must be a loop that was left by 'return' and called again.
+  while (p_task->task_n_periods
+         && p_task->task_periods[p_task->task_n_periods - 1].pd_call_depth >= p_task->task_call_depth)
+    p_task->task_n_periods -= 1;
+  if (MAX_PERIODS == p_task->task_n_periods)
+  {
+    fprintf(stderr, "%s: 'every' loops nested more than %u deep.\n", p_task->task_name,
+            MAX_PERIODS);
+    exit(0);
+  }
+  p_period = &p_task->task_periods[p_task->task_n_periods++];
+  p_period->pd_msec = msec < 1 ? 1 : msec;
+  p_period->pd_call_depth = p_task->task_call_depth;
+  clock_gettime(CLOCK_MONOTONIC, &p_period->pd_next_deadline);
+  p_task->task_ip += 1;
+  if (g_edf && !p_task->task_holds_edf_slot)
+  {
+    struct timespec pass_deadline = p_period->pd_next_deadline;
+    exec_add_nsec(&pass_deadline, (uint64_t) p_period->pd_msec*NSEC_PER_MSEC);
+    exec_edf_run_pass(p_task, &pass_deadline);
+  }
+}
+//------------------------------------------------------------------------------
+// OP_EVERY_WAIT.  Wait for the next deadline of the innermost 'every' loop.
+// Deadlines are absolute, so time spent in the pass and waking up late don't
+// add up over the periods.  A pass that ran past one or more deadlines counts
+// them as overruns and the loop carries on at the next deadline still ahead
+// (the phase is kept; missed passes aren't made up).
+void exec_every_wait(TASK *p_task)
+{
+  PERIOD *p_period = &p_task->task_periods[p_task->task_n_periods - 1];
+  uint64_t period_nsec = (uint64_t) p_period->pd_msec*NSEC_PER_MSEC;
+  struct timespec now;
+  int64_t late_nsec;
+  bool woke_up = false;
+  exec_edf_end_pass(p_task);
+  p_task->task_n_passes += 1;
+  exec_add_nsec(&p_period->pd_next_deadline, period_nsec);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  late_nsec = exec_nsec_between(&p_period->pd_next_deadline, &now);
+  if (late_nsec >= 0)
+  {
+    uint64_t n_missed = late_nsec/period_nsec + 1;
+    p_task->task_n_overruns += n_missed;
+    exec_add_nsec(&p_period->pd_next_deadline, n_missed*period_nsec);
+  }
+  else
+    woke_up = WAIT_TIMED_OUT == exec_wait_until(p_task, &p_task->task_wakeup, NULL, NULL,
+                                                &p_period->pd_next_deadline, true);
+  if (g_edf)
+  {
+    struct timespec pass_deadline = p_period->pd_next_deadline;
+    exec_add_nsec(&pass_deadline, period_nsec);
+    exec_edf_run_pass(p_task, &pass_deadline);
+  }
+  if (woke_up)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    late_nsec = exec_nsec_between(&p_period->pd_next_deadline, &now);
+    if (late_nsec > (int64_t) p_task->task_max_late_nsec)
+      p_task->task_max_late_nsec = late_nsec;
+    exec_record_latency(&g_wake_latency[p_task->task_priority - TASK_PRIORITY_MIN], late_nsec);
+  }
+  p_task->task_ip = p_task->task_p_module->mod_p_code[p_task->task_ip].i_jump_addr;
+}
+//------------------------------------------------------------------------------
+// OP_CALL.  Run  the task at  callee_addr on  p_task's thread  with a new,  zeroed
+// variable frame.  The operand stack is shared.
+void exec_call(TASK *p_task, uint32_t callee_addr)
+{
+  uint32_t frame_size = p_task->task_p_module->mod_p_frame_sizes[callee_addr];
+  CALL_FRAME *p_call;
+  if (p_task->task_call_depth >= MAX_CALL_DEPTH)
+  {
+    fprintf(stderr, "%s: calls nested deeper than %u\n", p_task->task_name, MAX_CALL_DEPTH);
+    exit(0);
+  }
+  if (!p_task->task_p_call_stack)
+    p_task->task_p_call_stack = malloc(MAX_CALL_DEPTH*sizeof(CALL_FRAME));
+  if (p_task->task_call_frames_top + frame_size > p_task->task_call_frames_size)
+  {
+    uint32_t new_size = 2*p_task->task_call_frames_size;
+    if (new_size < p_task->task_call_frames_top + frame_size)
+      new_size = p_task->task_call_frames_top + frame_size + 16;
+    p_task->task_p_call_frames = realloc(p_task->task_p_call_frames, new_size*sizeof(int32_t));
+    p_task->task_call_frames_size = new_size;
+  }
+  p_call = &p_task->task_p_call_stack[p_task->task_call_depth++];
+  p_call->cf_return_ip = p_task->task_ip + 1;
+  p_call->cf_frame_base = p_task->task_call_frames_top;
+  p_task->task_call_frames_top += frame_size;
+  p_task->task_p_frame = p_task->task_p_call_frames + p_call->cf_frame_base;
+  zero_mem(p_task->task_p_frame, frame_size*sizeof(int32_t));
+  p_task->task_ip = callee_addr;
+}
+//------------------------------------------------------------------------------
+// OP_RETURN.  The value returned stays on the operand stack.  Returning  from
+// a task that wasn't called stops it and leaves the value as its result.
+void exec_return(TASK *p_task)
+{
+  if (0 == p_task->task_call_depth)
+  {
+    p_task->task_result = POP(p_task);
+    exec_end_task(p_task);
+  }
+  else
+  {
+    CALL_FRAME *p_call;
+    exec_release_locks(p_task, p_task->task_call_depth);
+    while (p_task->task_n_periods
+           && p_task->task_periods[p_task->task_n_periods - 1].pd_call_depth >= p_task->task_call_depth)
+      p_task->task_n_periods -= 1;
+    if (0 == p_task->task_n_periods)
+      exec_edf_end_pass(p_task);
+    p_call = &p_task->task_p_call_stack[--p_task->task_call_depth];
+    p_task->task_call_frames_top = p_call->cf_frame_base;
+    p_task->task_p_frame = p_task->task_call_depth
+      ? p_task->task_p_call_frames + p_task->task_p_call_stack[p_task->task_call_depth - 1].cf_frame_base
+      : p_task->task_variables;
+    p_task->task_ip = p_call->cf_return_ip;
+  }
+}
+//------------------------------------------------------------------------------
+// OP_SPAWN_INLINE.  mpc emits it (followed by OP_DROP or OP_POP_INT) for 'spawn
+// t; join': run t as a call.  If p_task is already nested too deeply, or t has
+// a different priority, spawn t for real.  Either way t's result is left on the
+// stack.
+void exec_spawn_inline(TASK *p_task, uint32_t child_task_addr)
+{
+  if (p_task->task_call_depth < MAX_CALL_DEPTH
+      && p_task->task_priority == p_task->task_p_module->mod_p_priorities[child_task_addr])
+  {
+    atomic_fetch_add_explicit(&g_n_spawns_elided, 1, memory_order_relaxed);
+    exec_call(p_task, child_task_addr);
+  }
+  else
+  {
+    exec_begin_spawn(p_task, 1);
+    exec_add_spawn_task(p_task, child_task_addr);
+    exec_run_then_join_spawn(p_task, REDUCE_SUM);
+  }
+}
+//------------------------------------------------------------------------------
+typedef struct CHANNEL_OP
+{
+  CHANNEL *co_p_channel;
+  int32_t co_value;  // Value to send or value received.
+} CHANNEL_OP;
+//------------------------------------------------------------------------------
+static bool exec_try_send(void *pv_op)
+{
+  CHANNEL_OP *p_op = (CHANNEL_OP *) pv_op;
+  return channel_try_send(p_op->co_p_channel, p_op->co_value);
+}
+//------------------------------------------------------------------------------
+static bool exec_try_receive(void *pv_op)
+{
+  CHANNEL_OP *p_op = (CHANNEL_OP *) pv_op;
+  return channel_try_receive(p_op->co_p_channel, &p_op->co_value);
+}
+//------------------------------------------------------------------------------
+// OP_SEND
+void exec_send(TASK *p_task, CHANNEL *p_channel)
+{
+  CHANNEL_OP op = { p_channel, STACK_PEEK(p_task, 0) };
+  p_task->task_state_flags |= B_CHANNEL;
+  if (WAIT_DONE == exec_wait_until(p_task, &p_channel->ch_not_full, exec_try_send,
+                                   &op, NULL, true))
+  {
+    STACK_DROP(p_task);
+    p_task->task_ip += 1;
+  }
+  p_task->task_state_flags &= ~B_CHANNEL;
+}
+//------------------------------------------------------------------------------
+// OP_RECEIVE
+void exec_receive(TASK *p_task, CHANNEL *p_channel)
+{
+  CHANNEL_OP op = { p_channel, 0 };
+  p_task->task_state_flags |= B_CHANNEL;
+  if (WAIT_DONE == exec_wait_until(p_task, &p_channel->ch_not_empty, exec_try_receive,
+                                   &op, NULL, true))
+  {
+    PUSH(p_task, op.co_value);
+    p_task->task_ip += 1;
+  }
+  p_task->task_state_flags &= ~B_CHANNEL;
+}
+//------------------------------------------------------------------------------
+typedef struct BARRIER_WAIT
+{
+  BARRIER *bw_p_barrier;
+  uint32_t bw_generation;  // Generation the task arrived in.
+} BARRIER_WAIT;
+//------------------------------------------------------------------------------
+static bool exec_barrier_passed(void *pv_wait)
+{
+  BARRIER_WAIT *p_wait = (BARRIER_WAIT *) pv_wait;
+  return sync_barrier_passed(p_wait->bw_p_barrier, p_wait->bw_generation);
+}
+//------------------------------------------------------------------------------
+// OP_BARRIER_WAIT.  See sync.c.  A task cancelled while waiting has still been
+// counted, so the others may be released one task short.
+void exec_barrier_wait(TASK *p_task, BARRIER *p_barrier)
+{
+  BARRIER_WAIT wait;
+  wait.bw_p_barrier = p_barrier;
+  if (sync_barrier_arrive(p_barrier, &wait.bw_generation)
+      || sync_barrier_spin(p_barrier, wait.bw_generation))
+    p_task->task_ip += 1;
+  else
+  {
+    p_task->task_state_flags |= B_SYNC;
+    if (WAIT_DONE == exec_wait_until(p_task, &p_barrier->br_released, exec_barrier_passed,
+                                     &wait, NULL, true))
+      p_task->task_ip += 1;
+    p_task->task_state_flags &= ~B_SYNC;
+  }
+}
+//------------------------------------------------------------------------------
+static bool exec_event_is_set(void *pv_event)
+{
+  return sync_event_is_set((EVENT *) pv_event);
+}
+//------------------------------------------------------------------------------
+// OP_EVENT_WAIT
+void exec_event_wait(TASK *p_task, EVENT *p_event)
+{
+  if (sync_event_is_set(p_event) || sync_event_spin(p_event))
+    p_task->task_ip += 1;
+  else
+  {
+    p_task->task_state_flags |= B_SYNC;
+    if (WAIT_DONE == exec_wait_until(p_task, &p_event->ev_set, exec_event_is_set,
+                                     p_event, NULL, true))
+      p_task->task_ip += 1;
+    p_task->task_state_flags &= ~B_SYNC;
+  }
+}
+//------------------------------------------------------------------------------
+static bool exec_try_acquire(void *pv_lock)
+{
+  return sync_lock_try_acquire((LOCK *) pv_lock);
+}
+//------------------------------------------------------------------------------
+// OP_LOCK_ACQUIRE.  See sync.c.
+void exec_lock_acquire(TASK *p_task, LOCK *p_lock)
+{
+  bool acquired = true;
+  for (uint32_t i = 0; i < p_task->task_n_held_locks; ++i)
+  {
+    if (p_lock == p_task->task_held_locks[i].hl_p_lock)
+    {
+      fprintf(stderr, "%s: 'critical' block for a lock it already holds.\n", p_task->task_name);
+      exit(0);
+    }
+  }
+  if (MAX_HELD_LOCKS == p_task->task_n_held_locks)
+  {
+    fprintf(stderr, "%s: 'critical' blocks nested more than %u deep.\n", p_task->task_name,
+            MAX_HELD_LOCKS);
+    exit(0);
+  }
+  atomic_fetch_add_explicit(&p_lock->lk_n_acquires, 1, memory_order_relaxed);
+  if (!sync_lock_try_acquire(p_lock))
+  {
+    struct timespec start;
+    struct timespec end;
+    atomic_fetch_add_explicit(&p_lock->lk_n_contended, 1, memory_order_relaxed);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!sync_lock_spin(p_lock))
+    {
+      p_task->task_state_flags |= B_SYNC;
+      acquired = WAIT_DONE == exec_wait_until(p_task, &p_lock->lk_released, exec_try_acquire,
+                                              p_lock, NULL, true);
+      p_task->task_state_flags &= ~B_SYNC;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    atomic_fetch_add_explicit(&p_lock->lk_wait_nsec,
+                              (end.tv_sec - start.tv_sec)*1000000000UL + end.tv_nsec - start.tv_nsec,
+                              memory_order_relaxed);
+  }
+  if (acquired)
+  {
+    HELD_LOCK *p_held = &p_task->task_held_locks[p_task->task_n_held_locks++];
+    p_held->hl_p_lock = p_lock;
+    p_held->hl_call_depth = p_task->task_call_depth;
+    p_task->task_ip += 1;
+  }
+}
+//------------------------------------------------------------------------------
+// OP_LOCK_RELEASE.  'critical' blocks nest, so p_lock is the innermost one held.
+void exec_lock_release(TASK *p_task, LOCK *p_lock)
+{
+  assert(p_task->task_n_held_locks
+         && p_lock == p_task->task_held_locks[p_task->task_n_held_locks - 1].hl_p_lock);
+  p_task->task_n_held_locks -= 1;
+  sync_lock_release(p_lock);
   p_task->task_ip += 1;
 }
 //------------------------------------------------------------------------------
+typedef struct SELECT_STATE
+{
+  INSTRUCTION *ss_p_cases;  // OP_SELECT_SEND/RECEIVE/TIMEOUT descriptors.
+  uint32_t ss_n_cases;
+  void **ss_p_objects;
+  int32_t *ss_p_values;  // Send values in, received value out.
+  uint32_t ss_idx_first;  // Case to try first.
+  int32_t ss_idx_ready;  // Case that proceeded or -1.
+  uint32_t ss_n_tries;  // exec_select_try() calls so far.
+  PARK_EVENT *ss_p_wakeup;  // Event the task parks on.
+  PARK_LINK *ss_p_links;  // One per case; linked once the task is about to park.
+  bool ss_is_linked;
+} SELECT_STATE;
+//------------------------------------------------------------------------------
+// The event that a case of an OP_SELECT waits on, or NULL (timeout).
+static PARK_EVENT *exec_select_case_event(SELECT_STATE *p_state, uint32_t idx_case)
+{
+  INSTRUCTION *p_case = &p_state->ss_p_cases[idx_case];
+  switch (p_case->i_opcode)
+  {
+    case OP_SELECT_SEND:
+      return &((CHANNEL *) p_state->ss_p_objects[p_case->i_object_idx])->ch_not_full;
+    case OP_SELECT_RECEIVE:
+      return &((CHANNEL *) p_state->ss_p_objects[p_case->i_object_idx])->ch_not_empty;
+    default:
+      return NULL;
+  }
+}
+//------------------------------------------------------------------------------
+// Link (is_linked) or unlink ss_p_wakeup to the event of each case.
+static void exec_select_link(SELECT_STATE *p_state, bool is_linked)
+{
+  for (uint32_t i = 0; i < p_state->ss_n_cases; ++i)
+  {
+    PARK_EVENT *p_event = exec_select_case_event(p_state, i);
+    if (p_event && is_linked)
+      park_link(p_event, &p_state->ss_p_links[i], p_state->ss_p_wakeup);
+    else if (p_event)
+      park_unlink(p_event, &p_state->ss_p_links[i]);
+  }
+  p_state->ss_is_linked = is_linked;
+}
+//------------------------------------------------------------------------------
+// Try the cases of an OP_SELECT once, starting with case ss_idx_first.  Once
+// the spinning is over, exec_wait_until() calls this after park_prepare_wait()
+// and before parking: link the case channels to ss_p_wakeup then, so that they
+// wake the task.
+// RETURNS: true if a case proceeded.  Its index is left in ss_idx_ready.
+static bool exec_select_try(void *pv_state)
+{
+  SELECT_STATE *p_state = (SELECT_STATE *) pv_state;
+  if (!p_state->ss_is_linked && ++p_state->ss_n_tries > PARK_SPIN_TRIES)
+    exec_select_link(p_state, true);
+  p_state->ss_idx_ready = -1;
+  for (uint32_t i = 0; i < p_state->ss_n_cases && p_state->ss_idx_ready < 0; ++i)
+  {
+    uint32_t idx_case = (p_state->ss_idx_first + i) % p_state->ss_n_cases;
+    INSTRUCTION *p_case = &p_state->ss_p_cases[idx_case];
+    switch (p_case->i_opcode)
+    {
+      case OP_SELECT_SEND:
+        if (channel_try_send((CHANNEL *) p_state->ss_p_objects[p_case->i_object_idx],
+                             p_state->ss_p_values[idx_case]))
+          p_state->ss_idx_ready = idx_case;
+        break;
+      case OP_SELECT_RECEIVE:
+        if (channel_try_receive((CHANNEL *) p_state->ss_p_objects[p_case->i_object_idx],
+                                &p_state->ss_p_values[idx_case]))
+          p_state->ss_idx_ready = idx_case;
+        break;
+      default:
+        break;
+    }
+  }
+  return p_state->ss_idx_ready >= 0;
+}
+//------------------------------------------------------------------------------
+// OP_SELECT n
+//
+// The n  case descriptors (OP_SELECT_SEND/RECEIVE/TIMEOUT)  follow, then a jump
+// table of n OP_JUMPs.  The values of the send cases  are on the stack (first
+// send deepest) with the timeout in milliseconds above them.  Wait until a case
+// can proceed,  park when  none can, and  branch to that  case's entry  in the
+// jump table.  A receive case leaves the value received on the stack.
+void exec_select(TASK *p_task)
+{
+  INSTRUCTION *p_code = p_task->task_p_module->mod_p_code;
+  uint32_t n_cases = p_code[p_task->task_ip].i_n_select_cases;
+  INSTRUCTION *p_jump_table = &p_code[p_task->task_ip + 1 + n_cases];
+  int32_t values[n_cases];
+  PARK_LINK links[n_cases];
+  uint32_t n_sends = 0;
+  int32_t idx_timeout = -1;
+  struct timespec deadline;
+  SELECT_STATE state;
+  uint32_t wait_result;
+  state.ss_p_cases = &p_code[p_task->task_ip + 1];
+  state.ss_n_cases = n_cases;
+  state.ss_p_objects = p_task->task_p_module->mod_p_objects;
+  state.ss_p_values = values;
+  state.ss_idx_first = p_task->task_n_selects++ % n_cases;
+  state.ss_n_tries = 0;
+  state.ss_p_wakeup = &p_task->task_wakeup;
+  state.ss_p_links = links;
+  state.ss_is_linked = false;
+  for (uint32_t i = 0; i < n_cases; ++i)
+  {
+    if (OP_SELECT_SEND == state.ss_p_cases[i].i_opcode)
+      n_sends += 1;
+    else if (OP_SELECT_TIMEOUT == state.ss_p_cases[i].i_opcode)
+      idx_timeout = i;
+  }
+  if (idx_timeout >= 0)
+    exec_deadline_after_msec(&deadline, POP(p_task));
+  for (uint32_t i = 0, idx_send = 0; i < n_cases; ++i)
+  {
+    if (OP_SELECT_SEND == state.ss_p_cases[i].i_opcode)
+      values[i] = STACK_PEEK(p_task, n_sends - 1 - idx_send++);
+  }
+  p_task->task_state_flags |= B_SELECT;
+  wait_result = exec_wait_until(p_task, state.ss_p_wakeup, exec_select_try, &state,
+                                idx_timeout >= 0 ? &deadline : NULL, true);
+  if (state.ss_is_linked)
+    exec_select_link(&state, false);
+  switch (wait_result)
+  {
+    case WAIT_TIMED_OUT:
+      state.ss_idx_ready = idx_timeout;
+      // Fall through.
+    case WAIT_DONE:
+      p_task->task_stack_top -= n_sends;
+      if (OP_SELECT_RECEIVE == state.ss_p_cases[state.ss_idx_ready].i_opcode)
+        PUSH(p_task, values[state.ss_idx_ready]);
+      p_task->task_ip = p_jump_table[state.ss_idx_ready].i_jump_addr;
+      break;
+    default:
+      break;
+  }
+  p_task->task_state_flags &= ~B_SELECT;
+}
+//------------------------------------------------------------------------------
+// Stop a task that has been asked to (see exec_cancel_task()).  Checked at
+// backward jumps so loops  can be cancelled, and after opcodes that may block.
+#define CANCELLATION_POINT(p_task)                                \
+  do                                                              \
+  {                                                               \
+    if (exec_is_cancelled(p_task))                                \
+      exec_end_task(p_task);                                      \
+  } while (0)
+//------------------------------------------------------------------------------
 #define BINARY_OP(operator)                                       \
   do                                                              \
   {                                                               \
@@ -164,6 +1235,22 @@ void exec_sleep(TASK *p_task)
     PUSH(p_task, y operator x);                                   \
   } while (0)
 //------------------------------------------------------------------------------
+// OP_JUMP_IF_EQ, ...: compare and branch without pushing the 0/1 result.
+#define COMPARE_AND_JUMP(operator)                                \
+  do                                                              \
+  {                                                               \
+    x = POP(p_task);                                              \
+    y = POP(p_task);                                              \
+    if (y operator x)                                             \
+    {                                                             \
+      if (p_instruction->i_jump_addr <= p_task->task_ip)          \
+        CANCELLATION_POINT(p_task);                               \
+      p_task->task_ip = p_instruction->i_jump_addr;               \
+    }                                                             \
+    else                                                          \
+      p_task->task_ip += 1;                                       \
+  } while (0)
+//------------------------------------------------------------------------------
 void *exec_run_task(void *pv_task)
 {
   int32_t x;
@@ -171,10 +1258,24 @@ void *exec_run_task(void *pv_task)
   TASK *p_task = (TASK *) pv_task;
   MODULE *p_module = p_task->task_p_module;
   INSTRUCTION *p_code = p_module->mod_p_code;
+  void **p_objects = p_module->mod_p_objects;
+  uint64_t n_instructions_run = 0;
   p_task->task_state = ST_RUNNING;
+  if (0 == g_inline_depth)
+  {
+    exec_set_timer_slack();
+    exec_set_priority(p_task);
+  }
+  if (p_task->task_runnable_at.tv_sec)
+    exec_record_latency(&g_start_latency[p_task->task_priority - TASK_PRIORITY_MIN],
+                        exec_nsec_since(&p_task->task_runnable_at));
+  // Cancelled while waiting for its turn under a 'limit'.
+  if (exec_is_cancelled(p_task))
+    exec_end_task(p_task);
   while (ST_STOPPED != p_task->task_state)
   {
     INSTRUCTION *p_instruction = p_code + p_task->task_ip;
+    n_instructions_run += 1;
     switch (p_instruction->i_opcode)
     {
       case OP_PUSH_CONST_INT:
@@ -182,17 +1283,35 @@ void *exec_run_task(void *pv_task)
         p_task->task_ip += 1;
         break;
       case OP_END_TASK:
-        p_task->task_state = ST_STOPPED;
-        if (p_task->task_p_parent)
+        if (p_task->task_call_depth)
         {
-          uint32_t n_siblings_running;
-          n_siblings_running = atomic_load(&(p_task->task_p_parent->task_n_spawn_running));
-          assert(n_siblings_running > 0);
-          atomic_fetch_sub(&(p_task->task_p_parent->task_n_spawn_running), 1);
+          // End of a called task (or 'stop' in it): return 0.
+          PUSH(p_task, 0);
+          exec_return(p_task);
         }
+        else
+          exec_end_task(p_task);
+        break;
+      case OP_CALL:
+        exec_call(p_task, p_instruction->i_task_addr);
+        break;
+      case OP_SPAWN_INLINE:
+        exec_spawn_inline(p_task, p_instruction->i_task_addr);
+        CANCELLATION_POINT(p_task);
+        break;
+      case OP_RETURN:
+        exec_return(p_task);
+        break;
+      case OP_DROP:
+        STACK_DROP(p_task);
+        p_task->task_ip += 1;
         break;
       case OP_POP_INT:
-        p_task->task_variables[p_instruction->i_var_name] = POP(p_task);
+        p_task->task_p_frame[p_instruction->i_var_slot] = POP(p_task);
+        p_task->task_ip += 1;
+        break;
+      case OP_DUP_POP_INT:
+        p_task->task_p_frame[p_instruction->i_var_slot] = STACK_PEEK(p_task, 0);
         p_task->task_ip += 1;
         break;
       case OP_NEGATE:
@@ -232,6 +1351,33 @@ void *exec_run_task(void *pv_task)
         BINARY_OP(%);
         p_task->task_ip += 1;
         break;
+      case OP_SHIFT_LEFT:
+        STACK_PEEK(p_task, 0) = INSTR_SHIFT_LEFT(STACK_PEEK(p_task, 0), p_instruction->i_shift);
+        p_task->task_ip += 1;
+        break;
+      case OP_SHIFT_RIGHT:
+        x = STACK_PEEK(p_task, 0);
+        STACK_PEEK(p_task, 0) = INSTR_SHIFT_RIGHT(x, p_instruction->i_shift);
+        p_task->task_ip += 1;
+        break;
+      case OP_AND_MASK:
+        x = STACK_PEEK(p_task, 0);
+        STACK_PEEK(p_task, 0) = INSTR_AND_MASK(x, p_instruction->i_shift);
+        p_task->task_ip += 1;
+        break;
+      case OP_MULTIPLY_HIGH:
+        x = STACK_PEEK(p_task, 0);
+        STACK_PEEK(p_task, 0) = INSTR_MULTIPLY_HIGH(x, p_instruction->i_const_int,
+                                                    p_instruction->i_shift);
+        p_task->task_ip += 1;
+        break;
+      case OP_MULTIPLY_HIGH_REMAINDER:
+        x = STACK_PEEK(p_task, 0);
+        STACK_PEEK(p_task, 0) = INSTR_MULTIPLY_HIGH_REMAINDER(x, p_instruction->i_const_int,
+                                                              p_instruction->i_shift,
+                                                              p_instruction->i_divisor);
+        p_task->task_ip += 1;
+        break;
       case OP_GT:
         BINARY_OP(>);
         p_task->task_ip += 1;
@@ -257,34 +1403,83 @@ void *exec_run_task(void *pv_task)
         p_task->task_ip += 1;
         break;
       case OP_JUMP:
+        if (p_instruction->i_jump_addr <= p_task->task_ip)
+          CANCELLATION_POINT(p_task);
         p_task->task_ip = p_instruction->i_jump_addr;
         break;
       case OP_JUMP_IF_ZERO:
         if (POP(p_task))
           p_task->task_ip += 1;  // No jump
         else
+        {
+          if (p_instruction->i_jump_addr <= p_task->task_ip)
+            CANCELLATION_POINT(p_task);
           p_task->task_ip = p_instruction->i_jump_addr;
+        }
         break;
       case OP_JUMP_IF_NONZERO:
         if (POP(p_task))
+        {
+          if (p_instruction->i_jump_addr <= p_task->task_ip)
+            CANCELLATION_POINT(p_task);
           p_task->task_ip = p_instruction->i_jump_addr;
+        }
         else
           p_task->task_ip += 1;  // No jump
         break;
+      case OP_JUMP_IF_EQ:
+        COMPARE_AND_JUMP(==);
+        break;
+      case OP_JUMP_IF_NE:
+        COMPARE_AND_JUMP(!=);
+        break;
+      case OP_JUMP_IF_LT:
+        COMPARE_AND_JUMP(<);
+        break;
+      case OP_JUMP_IF_LE:
+        COMPARE_AND_JUMP(<=);
+        break;
+      case OP_JUMP_IF_GT:
+        COMPARE_AND_JUMP(>);
+        break;
+      case OP_JUMP_IF_GE:
+        COMPARE_AND_JUMP(>=);
+        break;
       case OP_BEGIN_SPAWN:
-        p_task->task_n_spawn_tasks = p_code[p_task->task_ip].i_n_spawn_tasks;
+        exec_begin_spawn(p_task, p_instruction->i_n_spawn_tasks);
         p_task->task_ip += 1;
         break;
       case OP_SPAWN:
         exec_add_spawn_task(p_task, p_code[p_task->task_ip].i_task_addr);
         p_task->task_ip += 1;
         break;
-      case OP_JOIN:
-        exec_run_then_join_spawn(p_task);
+      case OP_SPAWN_LIMIT:
+        exec_spawn_limit(p_task);
         p_task->task_ip += 1;
         break;
+      case OP_JOIN:
+        exec_run_then_join_spawn(p_task, REDUCE_NONE);
+        CANCELLATION_POINT(p_task);
+        break;
+      case OP_JOIN_REDUCE:
+        exec_run_then_join_spawn(p_task, p_instruction->i_reduce_op);
+        CANCELLATION_POINT(p_task);
+        break;
+      case OP_JOIN_FIRST:
+        exec_run_then_join_first(p_task, false);
+        CANCELLATION_POINT(p_task);
+        break;
+      case OP_JOIN_FIRST_CANCEL:
+        exec_run_then_join_first(p_task, true);
+        CANCELLATION_POINT(p_task);
+        break;
       case OP_WAIT_JUMP:
-        exec_run_then_wait_spawn(p_task);
+        exec_run_then_wait_spawn(p_task, false);
+        CANCELLATION_POINT(p_task);
+        break;
+      case OP_WAIT_CANCEL_JUMP:
+        exec_run_then_wait_spawn(p_task, true);
+        CANCELLATION_POINT(p_task);
         break;
       case OP_PRINT_INT:
         printf("%d", POP(p_task));
@@ -295,11 +1490,20 @@ void *exec_run_task(void *pv_task)
         p_task->task_ip += 1;
         break;
       case OP_PUSH_VAR:
-        PUSH(p_task, p_task->task_variables[p_instruction->i_var_name]);
+        PUSH(p_task, p_task->task_p_frame[p_instruction->i_var_slot]);
         p_task->task_ip += 1;
         break;
+      case OP_EVERY_BEGIN:
+        exec_every_begin(p_task);
+        CANCELLATION_POINT(p_task);
+        break;
+      case OP_EVERY_WAIT:
+        exec_every_wait(p_task);
+        CANCELLATION_POINT(p_task);
+        break;
       case OP_SLEEP:
         exec_sleep(p_task);
+        CANCELLATION_POINT(p_task);
         break;
       case OP_TEST_AND_JUMP_IF_ZERO:
         if (0 == STACK_PEEK(p_task, 0))
@@ -321,9 +1525,11 @@ void *exec_run_task(void *pv_task)
         break;
       case OP_BEGIN_ATOMIC_PRINT:
         pthread_mutex_lock(&g_print_mtx);
+        p_task->task_holds_print_lock = true;
         p_task->task_ip += 1;
         break;
       case OP_END_ATOMIC_PRINT:
+        p_task->task_holds_print_lock = false;
         pthread_mutex_unlock(&g_print_mtx);
         p_task->task_ip += 1;
         break;
@@ -333,6 +1539,41 @@ void *exec_run_task(void *pv_task)
         //                                              YIKES!
         p_task->task_ip += 1;
         break;
+      case OP_SEND:
+        exec_send(p_task, (CHANNEL *) p_objects[p_instruction->i_object_idx]);
+        CANCELLATION_POINT(p_task);
+        break;
+      case OP_RECEIVE:
+        exec_receive(p_task, (CHANNEL *) p_objects[p_instruction->i_object_idx]);
+        CANCELLATION_POINT(p_task);
+        break;
+      case OP_BARRIER_WAIT:
+        exec_barrier_wait(p_task, (BARRIER *) p_objects[p_instruction->i_object_idx]);
+        CANCELLATION_POINT(p_task);
+        break;
+      case OP_EVENT_WAIT:
+        exec_event_wait(p_task, (EVENT *) p_objects[p_instruction->i_object_idx]);
+        CANCELLATION_POINT(p_task);
+        break;
+      case OP_EVENT_SIGNAL:
+        sync_event_signal((EVENT *) p_objects[p_instruction->i_object_idx]);
+        p_task->task_ip += 1;
+        break;
+      case OP_EVENT_RESET:
+        sync_event_reset((EVENT *) p_objects[p_instruction->i_object_idx]);
+        p_task->task_ip += 1;
+        break;
+      case OP_LOCK_ACQUIRE:
+        exec_lock_acquire(p_task, (LOCK *) p_objects[p_instruction->i_object_idx]);
+        CANCELLATION_POINT(p_task);
+        break;
+      case OP_LOCK_RELEASE:
+        exec_lock_release(p_task, (LOCK *) p_objects[p_instruction->i_object_idx]);
+        break;
+      case OP_SELECT:
+        exec_select(p_task);
+        CANCELLATION_POINT(p_task);
+        break;
       case OP_BAD:
         fprintf(stderr, "OP_BAD\n");
         exit(0);
@@ -341,7 +1582,104 @@ void *exec_run_task(void *pv_task)
         break;
     }
   }
-  pthread_exit(NULL);
+  atomic_fetch_add_explicit(&g_n_instructions_run, n_instructions_run, memory_order_relaxed);
+  return NULL;
+}
+//------------------------------------------------------------------------------
+// Create runtime state for the channels etc. listed in the module header.
+void exec_create_module_objects(MODULE *p_module)
+{
+  HEADER *p_header = p_module->mod_p_header;
+  p_module->mod_p_objects = malloc((p_header->hdr_n_objects + 1)*sizeof(void *));
+  for (uint32_t i = 0; i < p_header->hdr_n_objects; ++i)
+  {
+    HEADER_OBJECT *p_object = &p_header->hdr_p_object_list[i];
+    switch (p_object->hobj_type)
+    {
+      case OBJ_CHANNEL:
+        p_module->mod_p_objects[i] = channel_new(p_object->hobj_size,
+                                                 0 != (p_object->hobj_flags & OBJF_SPSC));
+        break;
+      case OBJ_BARRIER:
+        p_module->mod_p_objects[i] = sync_barrier_new(p_object->hobj_size);
+        break;
+      case OBJ_EVENT:
+        p_module->mod_p_objects[i] = sync_event_new();
+        break;
+      case OBJ_LOCK:
+        p_module->mod_p_objects[i] = sync_lock_new();
+        break;
+      default:
+        p_module->mod_p_objects[i] = NULL;
+        break;
+    }
+  }
+}
+//------------------------------------------------------------------------------
+void exec_free_module_objects(MODULE *p_module)
+{
+  HEADER *p_header = p_module->mod_p_header;
+  for (uint32_t i = 0; i < p_header->hdr_n_objects; ++i)
+  {
+    switch (p_header->hdr_p_object_list[i].hobj_type)
+    {
+      case OBJ_CHANNEL:
+        channel_free((CHANNEL *) p_module->mod_p_objects[i]);
+        break;
+      case OBJ_BARRIER:
+        sync_barrier_free((BARRIER *) p_module->mod_p_objects[i]);
+        break;
+      case OBJ_EVENT:
+        sync_event_free((EVENT *) p_module->mod_p_objects[i]);
+        break;
+      case OBJ_LOCK:
+        sync_lock_free((LOCK *) p_module->mod_p_objects[i]);
+        break;
+      default:
+        break;
+    }
+  }
+  free(p_module->mod_p_objects);
+  p_module->mod_p_objects = NULL;
+}
+//------------------------------------------------------------------------------
+// Contention counters for each lock in the module (mpr --stats).
+static void exec_print_lock_stats(FILE *fout, MODULE *p_module)
+{
+  HEADER *p_header = p_module->mod_p_header;
+  for (uint32_t i = 0; i < p_header->hdr_n_objects; ++i)
+  {
+    if (OBJ_LOCK == p_header->hdr_p_object_list[i].hobj_type)
+    {
+      LOCK *p_lock = (LOCK *) p_module->mod_p_objects[i];
+      fprintf(fout, "lock %s: %lu acquires, %lu contended, %.3f ms waiting\n",
+              p_header->hdr_p_object_list[i].hobj_name,
+              atomic_load(&p_lock->lk_n_acquires), atomic_load(&p_lock->lk_n_contended),
+              atomic_load(&p_lock->lk_wait_nsec)/1e6);
+    }
+  }
+}
+//------------------------------------------------------------------------------
+// Scheduling latency for each priority that had tasks (mpr --stats).
+static void exec_print_priority_stats(FILE *fout)
+{
+  for (int32_t priority = TASK_PRIORITY_MAX; priority >= TASK_PRIORITY_MIN; --priority)
+  {
+    LATENCY *p_start = &g_start_latency[priority - TASK_PRIORITY_MIN];
+    LATENCY *p_wake = &g_wake_latency[priority - TASK_PRIORITY_MIN];
+    uint64_t n_starts = atomic_load(&p_start->lt_n);
+    uint64_t n_wakes = atomic_load(&p_wake->lt_n);
+    if (n_starts || n_wakes)
+    {
+      fprintf(fout, "priority %3d: %lu started (mean %.3f ms, max %.3f ms to start), "
+              "%lu 'every' wake-ups (mean %.3f ms, max %.3f ms late)\n",
+              priority,
+              n_starts, n_starts ? atomic_load(&p_start->lt_total_nsec)/1e6/n_starts : 0.0,
+              atomic_load(&p_start->lt_max_nsec)/1e6,
+              n_wakes, n_wakes ? atomic_load(&p_wake->lt_total_nsec)/1e6/n_wakes : 0.0,
+              atomic_load(&p_wake->lt_max_nsec)/1e6);
+    }
+  }
 }
 //------------------------------------------------------------------------------
 // Load module and run its 'init' code block.
@@ -349,35 +1687,292 @@ void exec_run_module_at_init_code(char *module_file_name)
 {
   FILE *fin = fopen(module_file_name, "r");
   MODULE *p_module;
+  REAPER_STATS stats;
   if (fin)
   {
     p_module = module_read(fin);
     if (p_module)
     {
       char init_task_name[MAX_STR];
+      exec_create_module_objects(p_module);
       sprintf(init_task_name, "%s.<init>:%u", p_module->mod_p_header->hdr_module_name,
               g_n_tasks_created);
-      p_module->mod_p_init_task = exec_create_task(init_task_name, p_module, NULL, 0);
+      reaper_admit(NULL, 1);
+      p_module->mod_p_init_task = exec_create_task(init_task_name, p_module, NULL, 0,
+                                                   p_module->mod_p_header->hdr_init_frame_size);
+      reaper_task_started(p_module->mod_p_init_task);
       pthread_create(&(p_module->mod_p_init_task->task_thread_id),
                      NULL,
                      exec_run_task,
                      p_module->mod_p_init_task);
       pthread_join(p_module->mod_p_init_task->task_thread_id, NULL);
-      module_free(p_module);
+      exec_free_task(p_module->mod_p_init_task);
+      p_module->mod_p_init_task = NULL;
+      if (g_print_stats)
+        exec_print_lock_stats(stderr, p_module);
+      reaper_get_stats(&stats);
+      // Detached tasks still running may be using the module: leave it for
+      // process exit.
+      if (0 == stats.rs_n_live)
+      {
+        exec_free_module_objects(p_module);
+        module_free(p_module);
+      }
     }
     fclose(fin);
   }
 }
 //------------------------------------------------------------------------------
+enum
+{
+  S_HELP,
+  S_STATS,
+  S_STATS_PERIOD,
+  S_MAX_THREADS,
+  S_MAX_TASK_MEM,
+  S_BENCH_BARRIER,
+  S_HIRES_SLEEP,
+  S_BENCH_SLEEP,
+  S_EDF
+};
+//------------------------------------------------------------------------------
+SWITCH g_mpr_switches[] =
+{
+  //  s_switch_id      s_long_name                s_short_name  s_min_parameters s_max_parameters    s_usage                                             s_flags
+  { S_HELP,             "--help",                 "-h",         0,               0,                  "usage: --help",                                           CS_PARAM_ERROR_ALL },
+  { S_STATS,            "--stats",                "-s",         0,               0,                  "usage: --stats",                                          CS_PARAM_ERROR_ALL },
+  { S_STATS_PERIOD,     "--stats-period",         "",           1,               1,                  "usage: --stats-period <seconds>",                         CS_PARAM_ERROR_ALL },
+  { S_MAX_THREADS,      "--max-threads",          "",           1,               1,                  "usage: --max-threads <n>",                                CS_PARAM_ERROR_ALL },
+  { S_MAX_TASK_MEM,     "--max-task-mem",         "",           1,               1,                  "usage: --max-task-mem <bytes>",                           CS_PARAM_ERROR_ALL },
+  { S_BENCH_BARRIER,    "--bench-barrier",        "",           1,               1,                  "usage: --bench-barrier <rounds>",                         CS_PARAM_ERROR_ALL },
+  { S_HIRES_SLEEP,      "--hires-sleep",          "",           1,               1,                  "usage: --hires-sleep <microseconds>",                     CS_PARAM_ERROR_ALL },
+  { S_BENCH_SLEEP,      "--bench-sleep",          "",           1,               1,                  "usage: --bench-sleep <sleeps>",                           CS_PARAM_ERROR_ALL },
+  { S_EDF,              "--edf",                  "",           0,               0,                  "usage: --edf",                                            CS_PARAM_ERROR_ALL },
+  SWITCH_LIST_END
+};
+//------------------------------------------------------------------------------
+// --bench-barrier: n tasks (threads) pass one barrier n_rounds times, for
+// n = 2, 4, ..., BENCH_MAX_TASKS.  Goes through exec_barrier_wait() as
+// OP_BARRIER_WAIT does.
+#define BENCH_MAX_TASKS 64
+typedef struct BENCH_TASK
+{
+  TASK *bt_p_task;
+  BARRIER *bt_p_barrier;
+  uint32_t bt_n_rounds;
+} BENCH_TASK;
+//------------------------------------------------------------------------------
+static void *exec_bench_barrier_task(void *pv_bench)
+{
+  BENCH_TASK *p_bench = (BENCH_TASK *) pv_bench;
+  for (uint32_t i = 0; i < p_bench->bt_n_rounds; ++i)
+    exec_barrier_wait(p_bench->bt_p_task, p_bench->bt_p_barrier);
+  return NULL;
+}
+//------------------------------------------------------------------------------
+static void exec_bench_barrier(uint32_t n_rounds)
+{
+  BENCH_TASK bench[BENCH_MAX_TASKS];
+  for (uint32_t n_tasks = 2; n_tasks <= BENCH_MAX_TASKS; n_tasks *= 2)
+  {
+    struct timespec start;
+    struct timespec end;
+    double nsec;
+    BARRIER *p_barrier = sync_barrier_new(n_tasks);
+    reaper_admit(NULL, n_tasks);
+    for (uint32_t i = 0; i < n_tasks; ++i)
+    {
+      bench[i].bt_p_task = exec_create_task("bench", NULL, NULL, 0, 0);
+      bench[i].bt_p_barrier = p_barrier;
+      bench[i].bt_n_rounds = n_rounds;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < n_tasks; ++i)
+      pthread_create(&bench[i].bt_p_task->task_thread_id, NULL, exec_bench_barrier_task, &bench[i]);
+    for (uint32_t i = 0; i < n_tasks; ++i)
+      pthread_join(bench[i].bt_p_task->task_thread_id, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    nsec = (end.tv_sec - start.tv_sec)*1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("barrier %2u tasks: %10.0f ns/round (spin tries now %u)\n", n_tasks,
+           nsec/n_rounds, atomic_load(&p_barrier->br_spin_tries));
+    for (uint32_t i = 0; i < n_tasks; ++i)
+      exec_free_task(bench[i].bt_p_task);
+    sync_barrier_free(p_barrier);
+  }
+}
+//------------------------------------------------------------------------------
+// --bench-sleep: n_sleeps 1 ms sleeps (as OP_SLEEP does them) parking the whole
+// way, then as many with the hybrid sleep.  Prints how late each woke up as a
+// histogram with power-of-2 microsecond buckets.
+#define BENCH_SLEEP_BUCKETS 12  // < 1 us, < 2 us, ... < 1024 us, more.
+#define BENCH_SPIN_WINDOW_USEC 100  // Without --hires-sleep.
+typedef struct BENCH_SLEEP
+{
+  uint32_t bs_n_sleeps;
+  uint64_t bs_buckets[BENCH_SLEEP_BUCKETS];
+  uint64_t bs_total_nsec;
+  uint64_t bs_max_nsec;
+} BENCH_SLEEP;
+//------------------------------------------------------------------------------
+static void *exec_bench_sleep_task(void *pv_bench)
+{
+  BENCH_SLEEP *p_bench = (BENCH_SLEEP *) pv_bench;
+  TASK *p_task = exec_create_task("bench", NULL, NULL, 0, 0);
+  exec_set_timer_slack();
+  for (uint32_t i = 0; i < p_bench->bs_n_sleeps; ++i)
+  {
+    struct timespec deadline;
+    struct timespec now;
+    uint64_t late_nsec;
+    uint32_t bucket = 0;
+    exec_deadline_after_msec(&deadline, 1);
+    exec_wait_until(p_task, &p_task->task_wakeup, NULL, NULL, &deadline, true);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    late_nsec = (now.tv_sec - deadline.tv_sec)*1000*NSEC_PER_MSEC + now.tv_nsec - deadline.tv_nsec;
+    while (bucket < BENCH_SLEEP_BUCKETS - 1 && late_nsec >= (1000UL << bucket))
+      ++bucket;
+    p_bench->bs_buckets[bucket] += 1;
+    p_bench->bs_total_nsec += late_nsec;
+    if (late_nsec > p_bench->bs_max_nsec)
+      p_bench->bs_max_nsec = late_nsec;
+  }
+  exec_free_task(p_task);
+  return NULL;
+}
+//------------------------------------------------------------------------------
+static void exec_bench_sleep(uint32_t n_sleeps)
+{
+  BENCH_SLEEP bench[2];
+  uint32_t spin_window_nsec = g_spin_window_nsec ? g_spin_window_nsec
+                                                 : BENCH_SPIN_WINDOW_USEC*1000;
+  zero_mem(bench, sizeof(bench));
+  reaper_admit(NULL, 2);
+  for (uint32_t i = 0; i < 2; ++i)
+  {
+    pthread_t thread_id;
+    // Each run on its own thread: timer slack is per thread.
+    g_spin_window_nsec = i ? spin_window_nsec : 0;
+    bench[i].bs_n_sleeps = n_sleeps;
+    pthread_create(&thread_id, NULL, exec_bench_sleep_task, &bench[i]);
+    pthread_join(thread_id, NULL);
+  }
+  printf("1 ms sleep woke up late by  default      hybrid (%u us)\n", spin_window_nsec/1000);
+  for (uint32_t b = 0; b < BENCH_SLEEP_BUCKETS; ++b)
+  {
+    if (b < BENCH_SLEEP_BUCKETS - 1)
+      printf("           < %4lu us", 1UL << b);
+    else
+      printf("          >= %4lu us", 1UL << (b - 1));
+    printf("        %10lu  %10lu\n", bench[0].bs_buckets[b], bench[1].bs_buckets[b]);
+  }
+  printf("                 mean        %10.1f  %10.1f us\n",
+         bench[0].bs_total_nsec/1e3/n_sleeps, bench[1].bs_total_nsec/1e3/n_sleeps);
+  printf("                  max        %10.1f  %10.1f us\n",
+         bench[0].bs_max_nsec/1e3, bench[1].bs_max_nsec/1e3);
+}
+//------------------------------------------------------------------------------
+void help(void)
+{
+  fprintf(stderr, "usage: mpr [OPTIONS] <compiled module file>\n");
+  fprintf(stderr, "       mpr --bench-barrier <rounds>\n");
+  fprintf(stderr, "       mpr [--hires-sleep <microseconds>] --bench-sleep <sleeps>\n");
+  fprintf(stderr, "OPTIONS:\n");
+  fprintf(stderr, "--help | -h                                       This help message.\n");
+  fprintf(stderr, "--stats | -s                                      Print task counts to stderr at exit.\n");
+  fprintf(stderr, "--stats-period <seconds>                          Also print them every <seconds>.\n");
+  fprintf(stderr, "--max-threads <n>                                 Ceiling on task threads (default %u).\n",
+          REAPER_DEFAULT_MAX_THREADS);
+  fprintf(stderr, "--max-task-mem <bytes>                            Ceiling on task memory (default %lu).\n",
+          (unsigned long) REAPER_DEFAULT_MAX_TASK_MEM);
+  fprintf(stderr, "--bench-barrier <rounds>                          Time barrier round trips for 2..%u tasks.\n",
+          BENCH_MAX_TASKS);
+  fprintf(stderr, "--hires-sleep <microseconds>                      Spin the last <microseconds> of timed waits.\n");
+  fprintf(stderr, "--bench-sleep <sleeps>                            Histogram of sleep wake-up error.\n");
+  fprintf(stderr, "--edf                                             Run 'every' passes earliest deadline first.\n");
+}
+//------------------------------------------------------------------------------
 int main(int argc, char **argv)
 {
-  if (argc != 2)
-    fprintf(stderr, "usage: mpr <compiled module file>\n");
+  int32_t n_params = 0;
+  uint32_t switch_id;
+  int argv_idx = 1;
+  char *switch_params[255];
+  uint32_t stats_period_sec = 0;
+  uint32_t max_threads = 0;
+  uint64_t max_task_bytes = 0;
+  uint32_t bench_rounds = 0;
+  uint32_t bench_sleeps = 0;
+  while (n_params >= 0 && argv_idx < argc && '-' == argv[argv_idx][0])
+  {
+    n_params = cs_parse(argc, argv,
+                        g_mpr_switches,
+                        &switch_id,
+                        &argv_idx,
+                        switch_params);
+    if (n_params < 0)
+      fprintf(stderr, "Unknown switch: %s\n", argv[argv_idx]);
+    else
+    {
+      switch (switch_id)
+      {
+        case S_HELP:
+          n_params = -1;
+          break;
+        case S_STATS:
+          g_print_stats = true;
+          break;
+        case S_STATS_PERIOD:
+          stats_period_sec = strtoul(switch_params[0], NULL, 10);
+          break;
+        case S_MAX_THREADS:
+          max_threads = strtoul(switch_params[0], NULL, 10);
+          break;
+        case S_MAX_TASK_MEM:
+          max_task_bytes = strtoull(switch_params[0], NULL, 10);
+          break;
+        case S_BENCH_BARRIER:
+          bench_rounds = strtoul(switch_params[0], NULL, 10);
+          break;
+        case S_HIRES_SLEEP:
+          g_spin_window_nsec = 1000*strtoul(switch_params[0], NULL, 10);
+          break;
+        case S_BENCH_SLEEP:
+          bench_sleeps = strtoul(switch_params[0], NULL, 10);
+          break;
+        case S_EDF:
+          g_edf = true;
+          g_edf_n_free_slots = sysconf(_SC_NPROCESSORS_ONLN);
+          park_event_init(&g_edf_slot_freed);
+          break;
+        default:
+          break;
+      }
+    }
+  }
+  if (n_params >= 0 && bench_rounds && argv_idx == argc)
+    exec_bench_barrier(bench_rounds);
+  else if (n_params >= 0 && bench_sleeps && argv_idx == argc)
+    exec_bench_sleep(bench_sleeps);
+  else if (n_params < 0 || argv_idx != argc - 1)
+    help();
   else
   {
-    if (0 != access(argv[1], R_OK))
-      fprintf(stderr, "%s : doesn't exist\n", argv[1]);
+    if (0 != access(argv[argv_idx], R_OK))
+      fprintf(stderr, "%s : doesn't exist\n", argv[argv_idx]);
     else
-      exec_run_module_at_init_code(argv[1]);
+    {
+      reaper_init(max_threads, max_task_bytes, stats_period_sec);
+      exec_run_module_at_init_code(argv[argv_idx]);
+      reaper_shutdown();
+      if (g_print_stats)
+      {
+        reaper_print_stats(stderr);
+        fprintf(stderr, "spawned tasks: %lu threads, %lu elided by mpc, %lu run inline\n",
+                atomic_load(&g_n_spawn_threads), atomic_load(&g_n_spawns_elided),
+                atomic_load(&g_n_spawns_run_inline));
+        fprintf(stderr, "instructions run: %lu\n", atomic_load(&g_n_instructions_run));
+        exec_print_priority_stats(stderr);
+      }
+    }
   }
 }
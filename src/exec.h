@@ -1,7 +1,7 @@
 #pragma once
 //------------------------------------------------------------------------------
 #define STACK_SIZE 256
-#define MAX_CHANNELS_PER_TASK 10
+#define MAX_CALL_DEPTH 256
 //------------------------------------------------------------------------------
 // Task states.
 enum
@@ -15,26 +15,119 @@ enum
 // Block flags
 enum
 {
-  B_JOIN = 1  // Currently the only way to block a task.
+  B_JOIN = 1,
+  B_CHANNEL = 2,  // Waiting to send to a full/receive from an empty channel.
+  B_SELECT = 4,  // Waiting for any case of a 'select'.
+  B_SYNC = 8  // Waiting at a barrier, for an event or for a lock.
+};
+//------------------------------------------------------------------------------
+// exec_wait_until() outcomes.
+enum
+{
+  WAIT_DONE = 0,
+  WAIT_TIMED_OUT = 1,
+  WAIT_CANCELLED = 2
 };
 //------------------------------------------------------------------------------
 typedef struct TASK TASK;
 typedef struct MODULE MODULE;
+typedef struct SPAWN_GROUP SPAWN_GROUP;
+typedef bool (*WAIT_CONDITION)(void *p_arg);
+//------------------------------------------------------------------------------
+// One active 'call'.  The callee's variables are task_p_call_frames[cf_frame_base..].
+typedef struct CALL_FRAME
+{
+  uint32_t cf_return_ip;
+  uint32_t cf_frame_base;
+} CALL_FRAME;
+//------------------------------------------------------------------------------
+// A lock held by a task ('critical' block).
+#define MAX_HELD_LOCKS 16  // Nested 'critical' blocks per task.
+typedef struct HELD_LOCK
+{
+  struct LOCK *hl_p_lock;
+  uint32_t hl_call_depth;  // task_call_depth at OP_LOCK_ACQUIRE.
+} HELD_LOCK;
+//------------------------------------------------------------------------------
+// An 'every' loop a task is in.
+#define MAX_PERIODS 8  // 'every' loops in calls made from 'every' loops.
+typedef struct PERIOD
+{
+  struct timespec pd_next_deadline;  // Absolute, CLOCK_MONOTONIC.
+  uint32_t pd_msec;
+  uint32_t pd_call_depth;  // task_call_depth at OP_EVERY_BEGIN.
+} PERIOD;
+//------------------------------------------------------------------------------
+// Tasks started by one 'spawn' statement.  Created by OP_BEGIN_SPAWN and kept
+// on the parent's stack until OP_JOIN/OP_WAIT_JUMP.  Children that outlive a
+// timed-out wait still point here, so it is freed by whoever lets go last.
+struct SPAWN_GROUP
+{
+  atomic_uint sg_n_running;  // How many tasks have yet to stop?
+  atomic_uint sg_n_refs;  // Parent + one per child.
+  PARK_EVENT sg_child_stopped;  // Notified each time a task stops.
+  uint32_t sg_limit;  // Most tasks running at once ('limit'), 0: no limit.
+  atomic_uint sg_n_started;  // With sg_limit: next task in sg_p_tasks[] to start.
+  atomic_uint sg_i_first_stopped;  // Index of the first task to stop (or UINT32_MAX).
+  uint32_t sg_n_tasks;
+  TASK *sg_p_tasks[];
+};
 //------------------------------------------------------------------------------
 struct TASK
 {
   pthread_t task_thread_id;
   char task_name[MAX_STR];
   MODULE *task_p_module;  // Module that this task belongs to.
-  int32_t task_variables[26];  // A-Z cheesy variables per task.
   int32_t task_stack[STACK_SIZE]; // Mini-pogo runs on a stack machine.
   uint32_t task_stack_top;
   uint32_t task_ip;  // Instruction pointer to module code block.
   uint32_t task_state;
   uint32_t task_state_flags;
-  atomic_uint task_n_spawn_running;  // How many tasks in a 'spawn' statement
-                                     // have yet to stop?
-  uint32_t task_n_spawn_tasks; // How many tasks in a 'spawn' statement?
-                               // Operand of OP_BEGIN_SPAWN.
+  uint32_t task_n_selects;  // OP_SELECTs executed.  Rotates first case tried.
   TASK *task_p_parent;
+  SPAWN_GROUP *task_p_group;  // Group this task was spawned in (NULL for init).
+  bool task_holds_print_lock;  // Between OP_BEGIN/END_ATOMIC_PRINT.
+  atomic_bool task_cancel_requested;
+  pthread_mutex_t task_park_mtx;  // Guards task_p_parked_on.
+  PARK_EVENT *task_p_parked_on;  // Event this task is parked on, if any.
+  PARK_EVENT task_wakeup;  // Parked on by 'sleep' and 'select'.
+  // Registry (see reaper.c).
+  uint32_t task_reg_flags;
+  TASK *task_p_reg_next;
+  TASK *task_p_reg_prev;
+  TASK *task_p_zombie_next;
+  // 'call' (allocated on the first call).
+  int32_t *task_p_frame;  // Variables in use: task_variables or the innermost callee's.
+  uint32_t task_call_depth;
+  CALL_FRAME *task_p_call_stack;  // [MAX_CALL_DEPTH]
+  int32_t *task_p_call_frames;  // Callee variable frames, stacked.
+  uint32_t task_call_frames_size;
+  uint32_t task_call_frames_top;
+  HELD_LOCK task_held_locks[MAX_HELD_LOCKS];  // Innermost last.
+  uint32_t task_n_held_locks;
+  PERIOD task_periods[MAX_PERIODS];  // Innermost last.
+  uint32_t task_n_periods;
+  uint64_t task_n_passes;  // 'every' loop passes (mpr --stats).
+  uint64_t task_n_overruns;  // Deadlines missed because a pass ran late.
+  uint64_t task_max_late_nsec;  // Worst wake-up after a deadline.
+  int32_t task_result;  // Value of 'return' at the top level (for 'join' 'reduce').
+  uint32_t task_i_in_group;  // Index in task_p_group->sg_p_tasks[].
+  bool task_ran_inline;  // On the parent's thread: no pthread_join().
+  TASK *task_p_inline_child;  // Running on this task's thread (guarded by task_park_mtx).
+  int32_t task_priority;  // 'priority' of the task declaration.
+  struct timespec task_runnable_at;  // When spawned; tv_sec == 0: not spawned.
+  // mpr --edf (see exec.c).
+  bool task_holds_edf_slot;
+  struct timespec task_edf_deadline;  // Of the 'every' pass queued for or running.
+  TASK *task_p_edf_next;  // Queue of passes waiting for a slot.
+  uint32_t task_frame_size;
+  int32_t task_variables[];  // task_frame_size slots, numbered by the compiler.
 };
+//------------------------------------------------------------------------------
+void exec_free_task(TASK *p_task);
+uint32_t exec_wait_until(TASK *p_task,
+                         PARK_EVENT *p_event,
+                         WAIT_CONDITION condition,
+                         void *p_arg,
+                         struct timespec *p_deadline,
+                         bool interruptible);
@@ -8,31 +8,74 @@ enum OPCODE
   #include "opcode-enums.txt"
 };
 //------------------------------------------------------------------------------
+// OP_JOIN_REDUCE operand: how task results are combined.
+enum REDUCE_OP
+{
+  REDUCE_NONE = 0,
+  REDUCE_SUM,
+  REDUCE_MIN,
+  REDUCE_MAX,
+  REDUCE_AND,
+  REDUCE_OR,
+  REDUCE_XOR,
+  N_REDUCE_OPS
+};
+//------------------------------------------------------------------------------
 typedef struct INSTRUCTION INSTRUCTION;
 struct INSTRUCTION {
   uint8_t i_opcode;
+  // opcodes: OP_SHIFT_LEFT, OP_SHIFT_RIGHT, OP_AND_MASK: k for 2^k.
+  //          OP_MULTIPLY_HIGH, OP_MULTIPLY_HIGH_REMAINDER: s (see below).
+  uint8_t i_shift;
+  // opcode: OP_MULTIPLY_HIGH_REMAINDER
+  uint16_t i_divisor;
   union
   {
-    // opcode: OP_PUSH_CONST_INT
+    // opcodes: OP_PUSH_CONST_INT,
+    //          OP_MULTIPLY_HIGH,  (i_const_int is the multiplier's bits)
+    //          OP_MULTIPLY_HIGH_REMAINDER
     int32_t i_const_int;
     // opcodes: OP_POP_INT,
-    //          OP_PUSH_VAR
-    uint8_t i_var_name;
+    //          OP_DUP_POP_INT,  (store the top of the stack, leaving it there)
+    //          OP_PUSH_VAR,
+    //          OP_JOIN_FIRST,
+    //          OP_JOIN_FIRST_CANCEL
+    uint32_t i_var_slot;  // Index in the task's variable frame.
     // opcodes: OP_JUMP
     //          OP_JUMP_IF_ZERO
     //          OP_JUMP_IF_NONZERO
+    //          OP_JUMP_IF_EQ, OP_JUMP_IF_NE,  (pop y, pop x, jump if x op y)
+    //          OP_JUMP_IF_LT, OP_JUMP_IF_LE,
+    //          OP_JUMP_IF_GT, OP_JUMP_IF_GE
     //          OP_TEST_AND_JUMP_IF_ZERO
     //          OP_TEST_AND_JUMP_IF_NONZERO
     //          OP_WAIT_JUMP
     uint32_t i_jump_addr;
     // opcode: OP_BEGIN_SPAWN
     uint32_t i_n_spawn_tasks;
-    // opcode: OP_SPAWN
+    // opcodes: OP_SPAWN,
+    //          OP_SPAWN_INLINE,
+    //          OP_CALL
     uint32_t i_task_addr;
     // OP_PRINT_CHAR
     uint8_t i_char;
+    // opcode: OP_JOIN_REDUCE
+    uint8_t i_reduce_op;  // REDUCE_*
     // opcode: OP_PRINT_STRING
     uint32_t i_string_idx;  // Index in header.
+    // opcodes: OP_SEND,
+    //          OP_RECEIVE,
+    //          OP_SELECT_SEND,
+    //          OP_SELECT_RECEIVE,
+    //          OP_BARRIER_WAIT,
+    //          OP_EVENT_WAIT,
+    //          OP_EVENT_SIGNAL,
+    //          OP_EVENT_RESET,
+    //          OP_LOCK_ACQUIRE,
+    //          OP_LOCK_RELEASE
+    uint32_t i_object_idx;  // Index in header object list.
+    // opcode: OP_SELECT
+    uint32_t i_n_select_cases;  // Number of OP_SELECT_... that follow.
     // opcodes: OP_ADD,
     //          OP_SUBTRACT,
     //          OP_MULTIPLY,
@@ -50,6 +93,29 @@ struct INSTRUCTION {
     //          OP_SLEEP
     //          OP_BEGIN_ATOMIC_PRINT
     //          OP_END_ATOMIC_PRINT
+    //          OP_RETURN
+    //          OP_DROP
     // no operands.
   };
 };
+//------------------------------------------------------------------------------
+// What OP_SHIFT_LEFT, OP_SHIFT_RIGHT, OP_AND_MASK, OP_MULTIPLY_HIGH and
+// OP_MULTIPLY_HIGH_REMAINDER do to the top of the stack x.  code-opt.c uses
+// them in place of '*', '/' and '%' by a constant d, with C's rounding toward
+// zero:
+//
+//   x*2^k  SHIFT_LEFT k                   x/2^k  SHIFT_RIGHT k
+//   x%2^k  AND_MASK k                     x/d    MULTIPLY_HIGH m s
+//   x%d    MULTIPLY_HIGH_REMAINDER m s d
+//
+// where m = ceil(2^(32+s)/d) < 2^32 is held as a uint32 (Granlund and
+// Montgomery's "magic number").  x is evaluated more than once.
+#define INSTR_SHIFT_LEFT(x, k) ((int32_t) ((uint32_t) (x) << (k)))
+// 2^k - 1 if x < 0, else 0: added before shifting, it rounds toward zero.
+#define INSTR_ROUNDING_BIAS(x, k) ((int32_t) ((uint32_t) ((x) >> 31) >> (32 - (k))))
+#define INSTR_SHIFT_RIGHT(x, k) (((x) + INSTR_ROUNDING_BIAS(x, k)) >> (k))
+#define INSTR_AND_MASK(x, k) \
+  ((int32_t) ((uint32_t) (x) - ((uint32_t) ((x) + INSTR_ROUNDING_BIAS(x, k)) & ~(uint32_t) 0 << (k))))
+#define INSTR_MULTIPLY_HIGH(x, m, s) \
+  ((int32_t) (((int64_t) (x)*(uint32_t) (m)) >> (32 + (s))) + ((x) < 0))
+#define INSTR_MULTIPLY_HIGH_REMAINDER(x, m, s, d) ((x) - INSTR_MULTIPLY_HIGH(x, m, s)*(int32_t) (d))
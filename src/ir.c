@@ -0,0 +1,1095 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <util.h>
+//------------------------------------------------------------------------------
+#include "parse.h"
+#include "optimize.h"
+#include "ir.h"
+//------------------------------------------------------------------------------
+// THEORY OF OPERATION:
+//
+// ir_build() turns the statements of one task (or the init block) into a
+// control flow graph of basic blocks.  Each assignment makes a new SSA value
+// of the variable; where control flow merges, an IR_PHI picks the value that
+// came in from the predecessor taken.  The branches of an 'if' merge in its
+// END-IF block, and a 'while' is laid out rotated, as compile() does it:
+//
+//         JUMP WHILE-TEST
+//       WHILE:                   body
+//       WHILE-TEST:              phis of the variables the body assigns
+//         BRANCH WHILE, END-WHILE
+//       END-WHILE:
+//
+// 'and', 'or' and 'not' in a test become branches between blocks.  Code after
+// 'return' or 'stop' isn't built.
+//
+// Statements the IR doesn't model ('spawn', 'select', 'every', 'critical',
+// 'wait', 'signal', 'reset') and 'and'/'or' used as values are kept whole, as
+// IR_STATEMENT and IR_EXPR instructions that compile() emits as usual.  They
+// read variables from their frame slots, so their arguments are the values of
+// the variables they name, and each variable a statement may assign gets a new
+// IR_SLOT value after it.
+//
+// Every value of a variable lives in that variable's frame slot.  Nothing
+// here ever puts one value in place of another (there is no copy
+// propagation), so two values of a variable are never live at the same time
+// and the emitter can simply drop the phis: the SSA stays "conventional".
+// The passes only turn values into constants and remove code:
+//
+//   -- ir_propagate_constants(): a value whose arguments are all constants
+//      becomes an IR_CONST, as does a phi whose arguments are all the same
+//      constant.  A variable's IR_ENTRY value is the constant 0.  A branch on
+//      constants becomes a jump, and blocks that can no longer be reached are
+//      removed, along with their phi arguments.  Repeated until nothing
+//      changes.  '/' and '%' that would trap are left for the runtime to do.
+//
+//   -- ir_remove_dead_code(): values nothing uses and whose evaluation can't
+//      trap (dead stores among them) are removed.
+//------------------------------------------------------------------------------
+typedef struct BUILD BUILD;
+struct BUILD
+{
+  IR_FUNC *bd_p_func;
+  IR_BLOCK *bd_p_block;  // Block statements go into, NULL if they can't be reached.
+  IR_BLOCK *bd_p_last_placed;  // Last block in layout order.
+  IR_INSTR **bd_p_defs;  // Value of each variable at this point.
+  bool *bd_p_named;  // Variables named by the statement being looked at.
+  bool *bd_p_assigned;  // Variables it may assign.
+};
+//------------------------------------------------------------------------------
+typedef void NAME_FN(BUILD *p_build, char *name, bool assigned);
+//------------------------------------------------------------------------------
+static char *g_ir_op_names[] =
+{
+  "bad", "const", "entry", "slot", "phi", "copy", "negate", "not", "add",
+  "subtract", "multiply", "divide", "remainder", "eq", "ne", "lt", "le", "gt",
+  "ge", "call", "receive", "expr", "print_int", "print_char", "print_string",
+  "begin_atomic_print", "end_atomic_print", "send", "sleep", "statement",
+  "jump", "branch", "return", "stop"
+};
+//------------------------------------------------------------------------------
+bool ir_is_value(uint8_t op)
+{
+  return op >= IR_CONST && op <= IR_EXPR;
+}
+//------------------------------------------------------------------------------
+// RETURNS: true if p_instr is IR_CONST or IR_ENTRY (0), with its value in *p_value.
+static bool ir_constant_value(IR_INSTR *p_instr, int32_t *p_value)
+{
+  if (IR_CONST == p_instr->ii_op)
+    *p_value = p_instr->ii_const;
+  else if (IR_ENTRY == p_instr->ii_op)
+    *p_value = 0;
+  else
+    return false;
+  return true;
+}
+//------------------------------------------------------------------------------
+// RETURNS: true if p_instr is a value that can be dropped when it isn't used:
+// it has no effect and can't trap.
+bool ir_is_pure(IR_INSTR *p_instr)
+{
+  int32_t divisor;
+  switch (p_instr->ii_op)
+  {
+    case IR_CONST:
+    case IR_ENTRY:
+    case IR_SLOT:
+    case IR_PHI:
+    case IR_COPY:
+    case IR_NEGATE:
+    case IR_NOT:
+    case IR_ADD:
+    case IR_SUBTRACT:
+    case IR_MULTIPLY:
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_LE:
+    case IR_GT:
+    case IR_GE:
+      return true;
+    case IR_DIVIDE:
+    case IR_REMAINDER:
+      return ir_constant_value(p_instr->ii_p_args[1], &divisor) && 0 != divisor && -1 != divisor;
+    default:
+      return false;
+  }
+}
+//------------------------------------------------------------------------------
+// RETURNS: the IR_... operator for expression node type nd_type, IR_BAD if
+// there is none.
+static uint8_t ir_op_for_node(uint8_t nd_type)
+{
+  switch (nd_type)
+  {
+    case ND_NEGATE:
+      return IR_NEGATE;
+    case ND_NOT:
+      return IR_NOT;
+    case ND_ADD:
+      return IR_ADD;
+    case ND_SUBTRACT:
+      return IR_SUBTRACT;
+    case ND_MULTIPLY:
+      return IR_MULTIPLY;
+    case ND_DIVIDE:
+      return IR_DIVIDE;
+    case ND_REMAINDER:
+      return IR_REMAINDER;
+    case ND_EQ:
+      return IR_EQ;
+    case ND_NE:
+      return IR_NE;
+    case ND_LT:
+      return IR_LT;
+    case ND_LE:
+      return IR_LE;
+    case ND_GT:
+      return IR_GT;
+    case ND_GE:
+      return IR_GE;
+    default:
+      return IR_BAD;
+  }
+}
+//------------------------------------------------------------------------------
+// Evaluate op on constants x and y (only x for IR_NEGATE, IR_NOT) as the
+// runtime would.
+// RETURNS: false if it would trap.
+static bool ir_eval(uint8_t op, int32_t x, int32_t y, int32_t *p_result)
+{
+  switch (op)
+  {
+    case IR_COPY:
+      *p_result = x;
+      break;
+    case IR_NEGATE:
+      *p_result = (int32_t) (0u - (uint32_t) x);
+      break;
+    case IR_NOT:
+      *p_result = !x;
+      break;
+    case IR_ADD:
+      *p_result = (int32_t) ((uint32_t) x + (uint32_t) y);
+      break;
+    case IR_SUBTRACT:
+      *p_result = (int32_t) ((uint32_t) x - (uint32_t) y);
+      break;
+    case IR_MULTIPLY:
+      *p_result = (int32_t) ((uint32_t) x*(uint32_t) y);
+      break;
+    case IR_DIVIDE:
+    case IR_REMAINDER:
+      if (0 == y || (INT32_MIN == x && -1 == y))
+        return false;
+      *p_result = IR_DIVIDE == op ? x/y : x%y;
+      break;
+    case IR_EQ:
+      *p_result = x == y;
+      break;
+    case IR_NE:
+      *p_result = x != y;
+      break;
+    case IR_LT:
+      *p_result = x < y;
+      break;
+    case IR_LE:
+      *p_result = x <= y;
+      break;
+    case IR_GT:
+      *p_result = x > y;
+      break;
+    case IR_GE:
+      *p_result = x >= y;
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+//------------------------------------------------------------------------------
+static IR_INSTR *ir_new_instr(IR_FUNC *p_func, uint8_t op, uint32_t n_args)
+{
+  IR_INSTR *p_instr = calloc(1, sizeof(IR_INSTR));
+  p_instr->ii_op = op;
+  p_instr->ii_id = p_func->if_n_instrs++;
+  p_instr->ii_var = IR_NO_VAR;
+  p_instr->ii_n_args = n_args;
+  p_instr->ii_p_args = n_args ? calloc(n_args, sizeof(IR_INSTR *)) : NULL;
+  return p_instr;
+}
+//------------------------------------------------------------------------------
+static void ir_append(IR_BLOCK *p_block, IR_INSTR *p_instr)
+{
+  p_instr->ii_p_block = p_block;
+  p_instr->ii_p_prev = p_block->ib_p_last;
+  p_instr->ii_p_next = NULL;
+  if (p_block->ib_p_last)
+    p_block->ib_p_last->ii_p_next = p_instr;
+  else
+    p_block->ib_p_first = p_instr;
+  p_block->ib_p_last = p_instr;
+}
+//------------------------------------------------------------------------------
+static void ir_delete_instr(IR_INSTR *p_instr)
+{
+  IR_BLOCK *p_block = p_instr->ii_p_block;
+  if (p_instr->ii_p_prev)
+    p_instr->ii_p_prev->ii_p_next = p_instr->ii_p_next;
+  else
+    p_block->ib_p_first = p_instr->ii_p_next;
+  if (p_instr->ii_p_next)
+    p_instr->ii_p_next->ii_p_prev = p_instr->ii_p_prev;
+  else
+    p_block->ib_p_last = p_instr->ii_p_prev;
+  free(p_instr->ii_p_args);
+  free(p_instr);
+}
+//------------------------------------------------------------------------------
+// Make p_instr an IR_CONST holding value (it keeps its variable, if any).
+static void ir_make_constant(IR_INSTR *p_instr, int32_t value)
+{
+  p_instr->ii_op = IR_CONST;
+  p_instr->ii_const = value;
+  free(p_instr->ii_p_args);
+  p_instr->ii_p_args = NULL;
+  p_instr->ii_n_args = 0;
+}
+//------------------------------------------------------------------------------
+static void ir_replace_uses(IR_FUNC *p_func, IR_INSTR *p_old, IR_INSTR *p_new)
+{
+  for (IR_BLOCK *p_block = p_func->if_p_entry; p_block; p_block = p_block->ib_p_next)
+    for (IR_INSTR *p_instr = p_block->ib_p_first; p_instr; p_instr = p_instr->ii_p_next)
+      for (uint32_t i = 0; i < p_instr->ii_n_args; ++i)
+        if (p_old == p_instr->ii_p_args[i])
+          p_instr->ii_p_args[i] = p_new;
+}
+//------------------------------------------------------------------------------
+// RETURNS: how many arguments refer to each value, indexed by ii_id.  The
+// caller frees it.
+uint32_t *ir_count_uses(IR_FUNC *p_func)
+{
+  uint32_t *p_n_uses = calloc(p_func->if_n_instrs, sizeof(uint32_t));
+  for (IR_BLOCK *p_block = p_func->if_p_entry; p_block; p_block = p_block->ib_p_next)
+    for (IR_INSTR *p_instr = p_block->ib_p_first; p_instr; p_instr = p_instr->ii_p_next)
+      for (uint32_t i = 0; i < p_instr->ii_n_args; ++i)
+        p_n_uses[p_instr->ii_p_args[i]->ii_id] += 1;
+  return p_n_uses;
+}
+//------------------------------------------------------------------------------
+static IR_BLOCK *ir_new_block(IR_FUNC *p_func, char *label_prefix)
+{
+  IR_BLOCK *p_block = calloc(1, sizeof(IR_BLOCK));
+  p_block->ib_id = p_func->if_n_blocks++;
+  p_block->ib_label_prefix = label_prefix;
+  if (p_block->ib_id >= p_func->if_all_blocks_size)
+  {
+    p_func->if_all_blocks_size = 2*p_func->if_all_blocks_size + 16;
+    p_func->if_p_all_blocks = realloc(p_func->if_p_all_blocks,
+                                      p_func->if_all_blocks_size*sizeof(IR_BLOCK *));
+  }
+  p_func->if_p_all_blocks[p_block->ib_id] = p_block;
+  return p_block;
+}
+//------------------------------------------------------------------------------
+// Put p_block after the last block placed.
+static void ir_place_block(BUILD *p_build, IR_BLOCK *p_block)
+{
+  if (p_build->bd_p_last_placed)
+    p_build->bd_p_last_placed->ib_p_next = p_block;
+  else
+    p_build->bd_p_func->if_p_entry = p_block;
+  p_build->bd_p_last_placed = p_block;
+  p_block->ib_placed = true;
+}
+//------------------------------------------------------------------------------
+static void ir_add_pred(IR_BLOCK *p_block, IR_BLOCK *p_pred)
+{
+  p_block->ib_p_preds = realloc(p_block->ib_p_preds, (p_block->ib_n_preds + 1)*sizeof(IR_BLOCK *));
+  p_block->ib_p_preds[p_block->ib_n_preds++] = p_pred;
+}
+//------------------------------------------------------------------------------
+// Drop the edge from p_pred to p_block, with the phi arguments that go with it.
+static void ir_remove_pred(IR_BLOCK *p_block, IR_BLOCK *p_pred)
+{
+  uint32_t idx_pred = 0;
+  while (idx_pred < p_block->ib_n_preds && p_pred != p_block->ib_p_preds[idx_pred])
+    idx_pred += 1;
+  if (idx_pred == p_block->ib_n_preds)
+    return;
+  p_block->ib_n_preds -= 1;
+  memmove(&p_block->ib_p_preds[idx_pred], &p_block->ib_p_preds[idx_pred + 1],
+          (p_block->ib_n_preds - idx_pred)*sizeof(IR_BLOCK *));
+  for (IR_INSTR *p_phi = p_block->ib_p_first; p_phi && IR_PHI == p_phi->ii_op; p_phi = p_phi->ii_p_next)
+  {
+    p_phi->ii_n_args -= 1;
+    memmove(&p_phi->ii_p_args[idx_pred], &p_phi->ii_p_args[idx_pred + 1],
+            (p_phi->ii_n_args - idx_pred)*sizeof(IR_INSTR *));
+  }
+}
+//------------------------------------------------------------------------------
+// RETURNS: index of variable 'name' in p_func, added if it's new.
+static uint32_t ir_variable(IR_FUNC *p_func, char *name)
+{
+  uint32_t result = 0;
+  while (result < p_func->if_n_variables && !STREQ(name, p_func->if_p_variable_names[result]))
+    result += 1;
+  if (result == p_func->if_n_variables)
+  {
+    p_func->if_p_variable_names = realloc(p_func->if_p_variable_names,
+                                          (p_func->if_n_variables + 1)*MAX_STR);
+    strcpy(p_func->if_p_variable_names[p_func->if_n_variables++], name);
+  }
+  return result;
+}
+//------------------------------------------------------------------------------
+static void ir_walk_names(BUILD *p_build, PARSE_NODE *p_tree, NAME_FN *p_fn);
+//------------------------------------------------------------------------------
+static void ir_walk_names_in_list(BUILD *p_build, LISTITEM *p_list, NAME_FN *p_fn)
+{
+  for (LISTITEM *p_item = p_list; p_item; p_item = p_item->l_p_next)
+    ir_walk_names(p_build, p_item->l_parse_node, p_fn);
+}
+//------------------------------------------------------------------------------
+// Call p_fn on each variable name in p_tree, with assigned true where the
+// variable gets a value (':=', 'receive', 'join reduce', 'join first').
+static void ir_walk_names(BUILD *p_build, PARSE_NODE *p_tree, NAME_FN *p_fn)
+{
+  if (!p_tree)
+    return;
+  switch (p_tree->nd_type)
+  {
+    case ND_STATEMENT_SEQUENCE:
+      ir_walk_names_in_list(p_build, p_tree->nd_p_statement_seq, p_fn);
+      break;
+    case ND_ATOMIC_PRINT:
+      ir_walk_names_in_list(p_build, p_tree->nd_p_print_items, p_fn);
+      break;
+    case ND_ASSIGN:
+      p_fn(p_build, p_tree->nd_var_name, true);
+      if (ND_CALL != p_tree->nd_p_assign_expr->nd_type)
+        ir_walk_names(p_build, p_tree->nd_p_assign_expr, p_fn);
+      break;
+    case ND_IF:
+      ir_walk_names(p_build, p_tree->nd_p_if_test_expr, p_fn);
+      ir_walk_names(p_build, p_tree->nd_p_true_branch_statement_seq, p_fn);
+      ir_walk_names(p_build, p_tree->nd_p_false_branch_statement_seq, p_fn);
+      break;
+    case ND_WHILE:
+      ir_walk_names(p_build, p_tree->nd_p_while_test_expr, p_fn);
+      ir_walk_names(p_build, p_tree->nd_p_while_statement_seq, p_fn);
+      break;
+    case ND_EVERY:
+      ir_walk_names(p_build, p_tree->nd_p_every_millisec_expr, p_fn);
+      ir_walk_names(p_build, p_tree->nd_p_every_statement_seq, p_fn);
+      break;
+    case ND_PRINT_INT:
+    case ND_NOT:
+    case ND_NEGATE:
+    case ND_SLEEP:
+    case ND_RETURN:
+      ir_walk_names(p_build, p_tree->nd_p_expr, p_fn);
+      break;
+    case ND_SPAWN_JOIN:
+    case ND_SPAWN_JOIN_WITH_TIMEOUT:
+    case ND_SPAWN_JOIN_FIRST:
+      ir_walk_names(p_build, p_tree->nd_p_limit_expr, p_fn);
+      ir_walk_names(p_build, p_tree->nd_p_millisec_expr, p_fn);
+      if (p_tree->nd_p_millisec_expr)
+      {
+        ir_walk_names(p_build, p_tree->nd_p_statement_seq_if_timed_out, p_fn);
+        ir_walk_names(p_build, p_tree->nd_p_statement_seq_if_not_timed_out, p_fn);
+      }
+      else if (ND_SPAWN_JOIN_FIRST == p_tree->nd_type)
+        p_fn(p_build, p_tree->nd_first_var_name, true);
+      else if (ND_SPAWN_JOIN == p_tree->nd_type && p_tree->nd_reduce_op[0])
+        p_fn(p_build, p_tree->nd_reduce_var_name, true);
+      break;
+    case ND_OR:
+    case ND_AND:
+    case ND_LE:
+    case ND_LT:
+    case ND_GE:
+    case ND_GT:
+    case ND_EQ:
+    case ND_NE:
+    case ND_ADD:
+    case ND_SUBTRACT:
+    case ND_MULTIPLY:
+    case ND_DIVIDE:
+    case ND_REMAINDER:
+      ir_walk_names(p_build, p_tree->nd_p_left_expr, p_fn);
+      ir_walk_names(p_build, p_tree->nd_p_right_expr, p_fn);
+      break;
+    case ND_SEND:
+      ir_walk_names(p_build, p_tree->nd_p_send_expr, p_fn);
+      break;
+    case ND_RECEIVE:
+      p_fn(p_build, p_tree->nd_receive_var_name, true);
+      break;
+    case ND_CRITICAL:
+      ir_walk_names(p_build, p_tree->nd_p_critical_statement_seq, p_fn);
+      break;
+    case ND_SELECT:
+      for (LISTITEM *p_case = p_tree->nd_p_select_cases; p_case; p_case = p_case->l_p_next)
+      {
+        ir_walk_names(p_build, p_case->l_parse_node->nd_p_select_op, p_fn);
+        if (!p_case->l_parse_node->nd_p_select_op)
+          ir_walk_names(p_build, p_case->l_parse_node->nd_p_select_millisec_expr, p_fn);
+        ir_walk_names(p_build, p_case->l_parse_node->nd_p_select_statement_seq, p_fn);
+      }
+      break;
+    case ND_VARIABLE:
+      p_fn(p_build, p_tree->nd_var_name, false);
+      break;
+    default:
+      break;
+  }
+}
+//------------------------------------------------------------------------------
+static void ir_add_variable_name(BUILD *p_build, char *name, bool assigned)
+{
+  ir_variable(p_build->bd_p_func, name);
+}
+//------------------------------------------------------------------------------
+static void ir_note_name(BUILD *p_build, char *name, bool assigned)
+{
+  uint32_t idx_var = ir_variable(p_build->bd_p_func, name);
+  p_build->bd_p_named[idx_var] = true;
+  if (assigned)
+    p_build->bd_p_assigned[idx_var] = true;
+}
+//------------------------------------------------------------------------------
+// Set bd_p_named[] and bd_p_assigned[] for the variables in p_tree.
+static void ir_find_names(BUILD *p_build, PARSE_NODE *p_tree)
+{
+  zero_mem(p_build->bd_p_named, p_build->bd_p_func->if_n_variables*sizeof(bool));
+  zero_mem(p_build->bd_p_assigned, p_build->bd_p_func->if_n_variables*sizeof(bool));
+  ir_walk_names(p_build, p_tree, ir_note_name);
+}
+//------------------------------------------------------------------------------
+// Add an instruction with n_args arguments to the block being built.
+static IR_INSTR *ir_add(BUILD *p_build, uint8_t op, uint32_t n_args)
+{
+  IR_INSTR *p_instr = ir_new_instr(p_build->bd_p_func, op, n_args);
+  ir_append(p_build->bd_p_block, p_instr);
+  return p_instr;
+}
+//------------------------------------------------------------------------------
+static IR_INSTR *ir_add_constant(BUILD *p_build, int32_t value)
+{
+  IR_INSTR *p_const = ir_add(p_build, IR_CONST, 0);
+  p_const->ii_const = value;
+  return p_const;
+}
+//------------------------------------------------------------------------------
+static void ir_assign(BUILD *p_build, char *var_name, IR_INSTR *p_value)
+{
+  uint32_t idx_var = ir_variable(p_build->bd_p_func, var_name);
+  p_value->ii_var = idx_var;
+  p_build->bd_p_defs[idx_var] = p_value;
+}
+//------------------------------------------------------------------------------
+// End the block being built with terminator op.  Its successors get it as a
+// predecessor, and the values of the variables at its end are kept for them.
+static IR_INSTR *ir_terminate(BUILD *p_build, uint8_t op, IR_BLOCK *p_succ0, IR_BLOCK *p_succ1)
+{
+  IR_BLOCK *p_block = p_build->bd_p_block;
+  IR_INSTR *p_instr = ir_add(p_build, op, IR_BRANCH == op ? 2 : IR_RETURN == op ? 1 : 0);
+  uint32_t size = p_build->bd_p_func->if_n_variables*sizeof(IR_INSTR *);
+  p_block->ib_p_succs[0] = p_succ0;
+  p_block->ib_p_succs[1] = p_succ1;
+  if (p_succ0)
+    ir_add_pred(p_succ0, p_block);
+  if (p_succ1)
+    ir_add_pred(p_succ1, p_block);
+  p_block->ib_p_defs_out = malloc(size + 1);
+  memcpy(p_block->ib_p_defs_out, p_build->bd_p_defs, size);
+  p_build->bd_p_block = NULL;
+  return p_instr;
+}
+//------------------------------------------------------------------------------
+// Start adding statements to p_block, whose predecessors are all built.  A
+// variable whose value differs between them gets a phi.  If there are no
+// predecessors, nothing is added until the next block.
+static void ir_join(BUILD *p_build, IR_BLOCK *p_block)
+{
+  uint32_t n_preds = p_block->ib_n_preds;
+  if (0 == n_preds)
+  {
+    p_build->bd_p_block = NULL;
+    return;
+  }
+  ir_place_block(p_build, p_block);
+  p_build->bd_p_block = p_block;
+  for (uint32_t idx_var = 0; idx_var < p_build->bd_p_func->if_n_variables; ++idx_var)
+  {
+    IR_INSTR *p_value = p_block->ib_p_preds[0]->ib_p_defs_out[idx_var];
+    bool same = true;
+    for (uint32_t idx_pred = 1; idx_pred < n_preds && same; ++idx_pred)
+      same = p_value == p_block->ib_p_preds[idx_pred]->ib_p_defs_out[idx_var];
+    if (!same)
+    {
+      IR_INSTR *p_phi = ir_add(p_build, IR_PHI, n_preds);
+      for (uint32_t idx_pred = 0; idx_pred < n_preds; ++idx_pred)
+        p_phi->ii_p_args[idx_pred] = p_block->ib_p_preds[idx_pred]->ib_p_defs_out[idx_var];
+      p_phi->ii_var = idx_var;
+      p_value = p_phi;
+    }
+    p_build->bd_p_defs[idx_var] = p_value;
+  }
+}
+//------------------------------------------------------------------------------
+// A statement or expression compile() emits: its arguments are the values of
+// the variables it names, and a variable it may assign gets an IR_SLOT value.
+static IR_INSTR *ir_add_opaque(BUILD *p_build, uint8_t op, PARSE_NODE *p_tree)
+{
+  IR_FUNC *p_func = p_build->bd_p_func;
+  IR_INSTR *p_instr;
+  uint32_t n_args = 0;
+  ir_find_names(p_build, p_tree);
+  for (uint32_t idx_var = 0; idx_var < p_func->if_n_variables; ++idx_var)
+    n_args += p_build->bd_p_named[idx_var];
+  p_instr = ir_add(p_build, op, n_args);
+  p_instr->ii_p_tree = p_tree;
+  n_args = 0;
+  for (uint32_t idx_var = 0; idx_var < p_func->if_n_variables; ++idx_var)
+    if (p_build->bd_p_named[idx_var])
+      p_instr->ii_p_args[n_args++] = p_build->bd_p_defs[idx_var];
+  for (uint32_t idx_var = 0; idx_var < p_func->if_n_variables; ++idx_var)
+    if (p_build->bd_p_assigned[idx_var])
+    {
+      IR_INSTR *p_slot = ir_add(p_build, IR_SLOT, 0);
+      p_slot->ii_var = idx_var;
+      p_build->bd_p_defs[idx_var] = p_slot;
+    }
+  return p_instr;
+}
+//------------------------------------------------------------------------------
+static IR_INSTR *ir_build_value(BUILD *p_build, PARSE_NODE *p_expr)
+{
+  IR_INSTR *p_arg;
+  IR_INSTR *p_value;
+  uint8_t op;
+  switch (p_expr->nd_type)
+  {
+    case ND_NUMBER:
+      return ir_add_constant(p_build, p_expr->nd_number);
+    case ND_VARIABLE:
+      return p_build->bd_p_defs[ir_variable(p_build->bd_p_func, p_expr->nd_var_name)];
+    case ND_NEGATE:
+    case ND_NOT:
+      p_arg = ir_build_value(p_build, p_expr->nd_p_expr);
+      p_value = ir_add(p_build, ir_op_for_node(p_expr->nd_type), 1);
+      p_value->ii_p_args[0] = p_arg;
+      return p_value;
+    default:
+      if (IR_BAD != (op = ir_op_for_node(p_expr->nd_type)))
+      {
+        IR_INSTR *p_left = ir_build_value(p_build, p_expr->nd_p_left_expr);
+        IR_INSTR *p_right = ir_build_value(p_build, p_expr->nd_p_right_expr);
+        p_value = ir_add(p_build, op, 2);
+        p_value->ii_p_args[0] = p_left;
+        p_value->ii_p_args[1] = p_right;
+        return p_value;
+      }
+      return ir_add_opaque(p_build, IR_EXPR, p_expr);
+  }
+}
+//------------------------------------------------------------------------------
+// End the block being built with jumps to p_true if p_test is non-zero, to
+// p_false if it is zero.
+static void ir_build_condition(BUILD *p_build, PARSE_NODE *p_test,
+                               IR_BLOCK *p_true, IR_BLOCK *p_false)
+{
+  IR_BLOCK *p_right;  // Where the right operand of 'and'/'or' is tested.
+  IR_INSTR *p_left_value;
+  IR_INSTR *p_right_value;
+  IR_INSTR *p_branch;
+  uint8_t op;
+  if (!p_build->bd_p_block)
+    return;
+  switch (p_test->nd_type)
+  {
+    case ND_AND:
+    case ND_OR:
+      p_right = ir_new_block(p_build->bd_p_func, NULL);
+      if (ND_AND == p_test->nd_type)
+        ir_build_condition(p_build, p_test->nd_p_left_expr, p_right, p_false);
+      else
+        ir_build_condition(p_build, p_test->nd_p_left_expr, p_true, p_right);
+      ir_join(p_build, p_right);
+      ir_build_condition(p_build, p_test->nd_p_right_expr, p_true, p_false);
+      break;
+    case ND_NOT:
+      ir_build_condition(p_build, p_test->nd_p_expr, p_false, p_true);
+      break;
+    case ND_NUMBER:
+      ir_terminate(p_build, IR_JUMP, p_test->nd_number ? p_true : p_false, NULL);
+      break;
+    default:
+      op = ir_op_for_node(p_test->nd_type);
+      if (op >= IR_EQ && op <= IR_GE)
+      {
+        p_left_value = ir_build_value(p_build, p_test->nd_p_left_expr);
+        p_right_value = ir_build_value(p_build, p_test->nd_p_right_expr);
+      }
+      else
+      {
+        op = IR_NE;
+        p_left_value = ir_build_value(p_build, p_test);
+        p_right_value = ir_add_constant(p_build, 0);
+      }
+      p_branch = ir_terminate(p_build, IR_BRANCH, p_true, p_false);
+      p_branch->ii_cond = op;
+      p_branch->ii_p_args[0] = p_left_value;
+      p_branch->ii_p_args[1] = p_right_value;
+      break;
+  }
+}
+//------------------------------------------------------------------------------
+static void ir_build_statement(BUILD *p_build, PARSE_NODE *p_tree);
+//------------------------------------------------------------------------------
+static void ir_build_if(BUILD *p_build, PARSE_NODE *p_nd_if)
+{
+  IR_FUNC *p_func = p_build->bd_p_func;
+  IR_BLOCK *p_then = ir_new_block(p_func, NULL);
+  IR_BLOCK *p_else = p_nd_if->nd_p_false_branch_statement_seq ? ir_new_block(p_func, "ELSE") : NULL;
+  IR_BLOCK *p_end_if = ir_new_block(p_func, "END-IF");
+  ir_build_condition(p_build, p_nd_if->nd_p_if_test_expr, p_then, p_else ? p_else : p_end_if);
+  ir_join(p_build, p_then);
+  ir_build_statement(p_build, p_nd_if->nd_p_true_branch_statement_seq);
+  if (p_build->bd_p_block)
+    ir_terminate(p_build, IR_JUMP, p_end_if, NULL);
+  if (p_else)
+  {
+    ir_join(p_build, p_else);
+    ir_build_statement(p_build, p_nd_if->nd_p_false_branch_statement_seq);
+    if (p_build->bd_p_block)
+      ir_terminate(p_build, IR_JUMP, p_end_if, NULL);
+  }
+  ir_join(p_build, p_end_if);
+}
+//------------------------------------------------------------------------------
+static void ir_build_while(BUILD *p_build, PARSE_NODE *p_nd_while)
+{
+  IR_FUNC *p_func = p_build->bd_p_func;
+  IR_BLOCK *p_body = ir_new_block(p_func, "WHILE");
+  IR_BLOCK *p_test = ir_new_block(p_func, "WHILE-TEST");
+  IR_BLOCK *p_end_while = ir_new_block(p_func, "END-WHILE");
+  uint32_t n_phis = 0;
+  IR_INSTR **p_phis;
+  ir_find_names(p_build, p_nd_while->nd_p_while_statement_seq);
+  for (uint32_t idx_var = 0; idx_var < p_func->if_n_variables; ++idx_var)
+    n_phis += p_build->bd_p_assigned[idx_var];
+  // The loop's variables get their phis, with arguments filled in once every
+  // edge into WHILE-TEST is known.
+  p_phis = malloc((n_phis + 1)*sizeof(IR_INSTR *));
+  n_phis = 0;
+  for (uint32_t idx_var = 0; idx_var < p_func->if_n_variables; ++idx_var)
+    if (p_build->bd_p_assigned[idx_var])
+    {
+      IR_INSTR *p_phi = ir_new_instr(p_func, IR_PHI, 0);
+      p_phi->ii_var = idx_var;
+      ir_append(p_test, p_phi);
+      p_phis[n_phis++] = p_phi;
+    }
+  ir_terminate(p_build, IR_JUMP, p_test, NULL);
+  for (uint32_t i = 0; i < n_phis; ++i)
+    p_build->bd_p_defs[p_phis[i]->ii_var] = p_phis[i];
+  ir_place_block(p_build, p_body);
+  p_build->bd_p_block = p_body;
+  ir_build_statement(p_build, p_nd_while->nd_p_while_statement_seq);
+  if (p_build->bd_p_block)
+    ir_terminate(p_build, IR_JUMP, p_test, NULL);
+  for (uint32_t i = 0; i < n_phis; ++i)
+  {
+    IR_INSTR *p_phi = p_phis[i];
+    p_phi->ii_n_args = p_test->ib_n_preds;
+    p_phi->ii_p_args = malloc(p_test->ib_n_preds*sizeof(IR_INSTR *));
+    for (uint32_t idx_pred = 0; idx_pred < p_test->ib_n_preds; ++idx_pred)
+      p_phi->ii_p_args[idx_pred] = p_test->ib_p_preds[idx_pred]->ib_p_defs_out[p_phi->ii_var];
+    p_build->bd_p_defs[p_phi->ii_var] = p_phi;
+  }
+  free(p_phis);
+  ir_place_block(p_build, p_test);
+  p_build->bd_p_block = p_test;
+  ir_build_condition(p_build, p_nd_while->nd_p_while_test_expr, p_body, p_end_while);
+  ir_join(p_build, p_end_while);
+}
+//------------------------------------------------------------------------------
+static void ir_build_statement(BUILD *p_build, PARSE_NODE *p_tree)
+{
+  IR_INSTR *p_value;
+  if (!p_tree || !p_build->bd_p_block)
+    return;
+  switch (p_tree->nd_type)
+  {
+    case ND_STATEMENT_SEQUENCE:
+      for (LISTITEM *p_statement = p_tree->nd_p_statement_seq;
+           p_statement;
+           p_statement = p_statement->l_p_next)
+        ir_build_statement(p_build, p_statement->l_parse_node);
+      break;
+    case ND_ASSIGN:
+      if (ND_CALL == p_tree->nd_p_assign_expr->nd_type)
+      {
+        p_value = ir_add(p_build, IR_CALL, 0);
+        p_value->ii_p_tree = p_tree->nd_p_assign_expr;
+      }
+      else if (ND_VARIABLE == p_tree->nd_p_assign_expr->nd_type)
+      {
+        IR_INSTR *p_source = ir_build_value(p_build, p_tree->nd_p_assign_expr);
+        (p_value = ir_add(p_build, IR_COPY, 1))->ii_p_args[0] = p_source;
+      }
+      else
+        p_value = ir_build_value(p_build, p_tree->nd_p_assign_expr);
+      ir_assign(p_build, p_tree->nd_var_name, p_value);
+      break;
+    case ND_CALL:
+      ir_add(p_build, IR_CALL, 0)->ii_p_tree = p_tree;
+      break;
+    case ND_IF:
+      ir_build_if(p_build, p_tree);
+      break;
+    case ND_WHILE:
+      ir_build_while(p_build, p_tree);
+      break;
+    case ND_PRINT_INT:
+      p_value = ir_build_value(p_build, p_tree->nd_p_expr);
+      ir_add(p_build, IR_PRINT_INT, 1)->ii_p_args[0] = p_value;
+      break;
+    case ND_PRINT_CHAR:
+      ir_add(p_build, IR_PRINT_CHAR, 0)->ii_p_tree = p_tree;
+      break;
+    case ND_PRINT_STRING:
+      ir_add(p_build, IR_PRINT_STRING, 0)->ii_p_tree = p_tree;
+      break;
+    case ND_ATOMIC_PRINT:
+      ir_add(p_build, IR_BEGIN_ATOMIC_PRINT, 0);
+      for (LISTITEM *p_item = p_tree->nd_p_print_items; p_item; p_item = p_item->l_p_next)
+        ir_build_statement(p_build, p_item->l_parse_node);
+      ir_add(p_build, IR_END_ATOMIC_PRINT, 0);
+      break;
+    case ND_SEND:
+      p_value = ir_build_value(p_build, p_tree->nd_p_send_expr);
+      ir_add(p_build, IR_SEND, 1)->ii_p_args[0] = p_value;
+      p_build->bd_p_block->ib_p_last->ii_p_tree = p_tree;
+      break;
+    case ND_RECEIVE:
+      p_value = ir_add(p_build, IR_RECEIVE, 0);
+      p_value->ii_p_tree = p_tree;
+      ir_assign(p_build, p_tree->nd_receive_var_name, p_value);
+      break;
+    case ND_SLEEP:
+      p_value = ir_build_value(p_build, p_tree->nd_p_expr);
+      ir_add(p_build, IR_SLEEP, 1)->ii_p_args[0] = p_value;
+      break;
+    case ND_RETURN:
+      p_value = ir_build_value(p_build, p_tree->nd_p_expr);
+      ir_terminate(p_build, IR_RETURN, NULL, NULL)->ii_p_args[0] = p_value;
+      break;
+    case ND_STOP:
+      ir_terminate(p_build, IR_STOP, NULL, NULL);
+      break;
+    default:
+      ir_add_opaque(p_build, IR_STATEMENT, p_tree);
+      break;
+  }
+}
+//------------------------------------------------------------------------------
+// Remove the blocks that can't be reached from the entry block.
+static void ir_remove_unreachable(IR_FUNC *p_func)
+{
+  bool *p_reached = calloc(p_func->if_n_blocks, sizeof(bool));
+  IR_BLOCK **p_work = malloc(p_func->if_n_blocks*sizeof(IR_BLOCK *));
+  uint32_t n_work = 0;
+  IR_BLOCK *p_prev = NULL;
+  p_reached[p_func->if_p_entry->ib_id] = true;
+  p_work[n_work++] = p_func->if_p_entry;
+  while (n_work)
+  {
+    IR_BLOCK *p_block = p_work[--n_work];
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+      IR_BLOCK *p_succ = p_block->ib_p_succs[i];
+      if (p_succ && !p_reached[p_succ->ib_id])
+      {
+        p_reached[p_succ->ib_id] = true;
+        p_work[n_work++] = p_succ;
+      }
+    }
+  }
+  for (IR_BLOCK *p_block = p_func->if_p_entry; p_block; p_block = p_block->ib_p_next)
+  {
+    if (p_reached[p_block->ib_id])
+    {
+      p_prev = p_block;
+      continue;
+    }
+    for (uint32_t i = 0; i < 2; ++i)
+      if (p_block->ib_p_succs[i])
+        ir_remove_pred(p_block->ib_p_succs[i], p_block);
+    p_prev->ib_p_next = p_block->ib_p_next;
+    p_block->ib_placed = false;
+  }
+  // Only now: an unreachable block's values may be arguments in another one.
+  for (uint32_t i = 0; i < p_func->if_n_blocks; ++i)
+  {
+    IR_BLOCK *p_block = p_func->if_p_all_blocks[i];
+    if (!p_reached[i])
+      while (p_block->ib_p_first)
+        ir_delete_instr(p_block->ib_p_first);
+  }
+  free(p_work);
+  free(p_reached);
+}
+//------------------------------------------------------------------------------
+// Replace each phi whose arguments are all one value (or the phi itself) by
+// that value.
+// RETURNS: number of phis removed.
+static uint32_t ir_remove_trivial_phis(IR_FUNC *p_func)
+{
+  uint32_t n_removed = 0;
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (IR_BLOCK *p_block = p_func->if_p_entry; p_block; p_block = p_block->ib_p_next)
+    {
+      IR_INSTR *p_next;
+      for (IR_INSTR *p_phi = p_block->ib_p_first; p_phi && IR_PHI == p_phi->ii_op; p_phi = p_next)
+      {
+        IR_INSTR *p_value = NULL;
+        bool trivial = true;
+        p_next = p_phi->ii_p_next;
+        for (uint32_t i = 0; i < p_phi->ii_n_args && trivial; ++i)
+        {
+          IR_INSTR *p_arg = p_phi->ii_p_args[i];
+          if (p_arg == p_phi || p_arg == p_value)
+            continue;
+          trivial = !p_value;
+          p_value = p_arg;
+        }
+        if (trivial && p_value)
+        {
+          ir_replace_uses(p_func, p_phi, p_value);
+          ir_delete_instr(p_phi);
+          n_removed += 1;
+          changed = true;
+        }
+      }
+    }
+  }
+  return n_removed;
+}
+//------------------------------------------------------------------------------
+// RETURNS: the IR of statements p_body followed by the implied 'stop'.
+IR_FUNC *ir_build(PARSE_NODE *p_body)
+{
+  BUILD build;
+  IR_FUNC *p_func = calloc(1, sizeof(IR_FUNC));
+  uint32_t n_variables;
+  zero_mem(&build, sizeof(BUILD));
+  build.bd_p_func = p_func;
+  ir_walk_names(&build, p_body, ir_add_variable_name);
+  n_variables = p_func->if_n_variables;
+  build.bd_p_defs = calloc(n_variables + 1, sizeof(IR_INSTR *));
+  build.bd_p_named = calloc(n_variables + 1, sizeof(bool));
+  build.bd_p_assigned = calloc(n_variables + 1, sizeof(bool));
+  build.bd_p_block = ir_new_block(p_func, NULL);
+  ir_place_block(&build, build.bd_p_block);
+  for (uint32_t idx_var = 0; idx_var < n_variables; ++idx_var)
+  {
+    IR_INSTR *p_entry = ir_add(&build, IR_ENTRY, 0);
+    p_entry->ii_var = idx_var;
+    build.bd_p_defs[idx_var] = p_entry;
+  }
+  ir_build_statement(&build, p_body);
+  if (build.bd_p_block)
+    ir_terminate(&build, IR_STOP, NULL, NULL);
+  for (uint32_t i = 0; i < p_func->if_n_blocks; ++i)
+  {
+    free(p_func->if_p_all_blocks[i]->ib_p_defs_out);
+    p_func->if_p_all_blocks[i]->ib_p_defs_out = NULL;
+  }
+  free(build.bd_p_assigned);
+  free(build.bd_p_named);
+  free(build.bd_p_defs);
+  ir_remove_unreachable(p_func);
+  ir_remove_trivial_phis(p_func);
+  return p_func;
+}
+//------------------------------------------------------------------------------
+void ir_free(IR_FUNC *p_func)
+{
+  for (uint32_t i = 0; i < p_func->if_n_blocks; ++i)
+  {
+    IR_BLOCK *p_block = p_func->if_p_all_blocks[i];
+    while (p_block->ib_p_first)
+      ir_delete_instr(p_block->ib_p_first);
+    free(p_block->ib_p_preds);
+    free(p_block);
+  }
+  free(p_func->if_p_all_blocks);
+  free(p_func->if_p_variable_names);
+  free(p_func);
+}
+//------------------------------------------------------------------------------
+static void ir_print_value(FILE *fout, IR_INSTR *p_value)
+{
+  if (IR_CONST == p_value->ii_op)
+    fprintf(fout, "%d", p_value->ii_const);
+  else
+    fprintf(fout, "v%u", p_value->ii_id);
+}
+//------------------------------------------------------------------------------
+void ir_print(FILE *fout, IR_FUNC *p_func)
+{
+  for (IR_BLOCK *p_block = p_func->if_p_entry; p_block; p_block = p_block->ib_p_next)
+  {
+    fprintf(fout, "B%u:", p_block->ib_id);
+    if (p_block->ib_label_prefix)
+      fprintf(fout, "  ; %s", p_block->ib_label_prefix);
+    if (p_block->ib_n_preds)
+    {
+      fprintf(fout, "  ; from");
+      for (uint32_t i = 0; i < p_block->ib_n_preds; ++i)
+        fprintf(fout, " B%u", p_block->ib_p_preds[i]->ib_id);
+    }
+    fprintf(fout, "\n");
+    for (IR_INSTR *p_instr = p_block->ib_p_first; p_instr; p_instr = p_instr->ii_p_next)
+    {
+      fprintf(fout, "    ");
+      if (ir_is_value(p_instr->ii_op))
+        fprintf(fout, "v%u = ", p_instr->ii_id);
+      fprintf(fout, "%s", g_ir_op_names[p_instr->ii_op]);
+      if (IR_BRANCH == p_instr->ii_op)
+        fprintf(fout, " %s", g_ir_op_names[p_instr->ii_cond]);
+      if (IR_CONST == p_instr->ii_op)
+        fprintf(fout, " %d", p_instr->ii_const);
+      for (uint32_t i = 0; i < p_instr->ii_n_args; ++i)
+      {
+        fprintf(fout, i ? ", " : " ");
+        ir_print_value(fout, p_instr->ii_p_args[i]);
+      }
+      if (IR_JUMP == p_instr->ii_op)
+        fprintf(fout, " B%u", p_block->ib_p_succs[0]->ib_id);
+      else if (IR_BRANCH == p_instr->ii_op)
+        fprintf(fout, " -> B%u, B%u", p_block->ib_p_succs[0]->ib_id, p_block->ib_p_succs[1]->ib_id);
+      if (IR_NO_VAR != p_instr->ii_var)
+        fprintf(fout, "  ; %s", p_func->if_p_variable_names[p_instr->ii_var]);
+      fprintf(fout, "\n");
+    }
+  }
+}
+//------------------------------------------------------------------------------
+// Fold p_instr to a constant if its arguments are constants.
+// RETURNS: true if it was folded.
+static bool ir_fold(IR_INSTR *p_instr)
+{
+  int32_t x = 0;
+  int32_t y = 0;
+  int32_t result;
+  if (IR_PHI == p_instr->ii_op)
+  {
+    bool found = false;
+    for (uint32_t i = 0; i < p_instr->ii_n_args; ++i)
+    {
+      int32_t value;
+      if (p_instr->ii_p_args[i] == p_instr)
+        continue;
+      if (!ir_constant_value(p_instr->ii_p_args[i], &value) || (found && value != x))
+        return false;
+      x = value;
+      found = true;
+    }
+    if (!found)
+      return false;
+    ir_make_constant(p_instr, x);
+    return true;
+  }
+  if (!ir_is_value(p_instr->ii_op) || IR_CONST == p_instr->ii_op || 0 == p_instr->ii_n_args
+      || IR_EXPR == p_instr->ii_op)
+    return false;
+  if (!ir_constant_value(p_instr->ii_p_args[0], &x)
+      || (p_instr->ii_n_args > 1 && !ir_constant_value(p_instr->ii_p_args[1], &y))
+      || !ir_eval(p_instr->ii_op, x, y, &result))
+    return false;
+  ir_make_constant(p_instr, result);
+  return true;
+}
+//------------------------------------------------------------------------------
+void ir_propagate_constants(IR_FUNC *p_func, OPT_STATS *p_stats)
+{
+  bool changed = true;
+  while (changed)
+  {
+    bool branch_folded = false;
+    changed = false;
+    for (IR_BLOCK *p_block = p_func->if_p_entry; p_block; p_block = p_block->ib_p_next)
+    {
+      for (IR_INSTR *p_instr = p_block->ib_p_first; p_instr; p_instr = p_instr->ii_p_next)
+      {
+        int32_t x;
+        int32_t y;
+        int32_t taken;
+        if (ir_fold(p_instr))
+        {
+          p_stats->os_n_propagated += 1;
+          changed = true;
+        }
+        else if (IR_BRANCH == p_instr->ii_op
+                 && ir_constant_value(p_instr->ii_p_args[0], &x)
+                 && ir_constant_value(p_instr->ii_p_args[1], &y)
+                 && ir_eval(p_instr->ii_cond, x, y, &taken))
+        {
+          IR_BLOCK *p_not_taken = p_block->ib_p_succs[taken ? 1 : 0];
+          p_block->ib_p_succs[0] = p_block->ib_p_succs[taken ? 0 : 1];
+          p_block->ib_p_succs[1] = NULL;
+          ir_remove_pred(p_not_taken, p_block);
+          p_instr->ii_op = IR_JUMP;
+          p_instr->ii_n_args = 0;
+          p_stats->os_n_branches_folded += 1;
+          branch_folded = changed = true;
+        }
+      }
+    }
+    if (branch_folded)
+      ir_remove_unreachable(p_func);
+    if (ir_remove_trivial_phis(p_func))
+      changed = true;
+  }
+}
+//------------------------------------------------------------------------------
+void ir_remove_dead_code(IR_FUNC *p_func, OPT_STATS *p_stats)
+{
+  uint32_t *p_n_uses = ir_count_uses(p_func);
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (IR_BLOCK *p_block = p_func->if_p_entry; p_block; p_block = p_block->ib_p_next)
+    {
+      IR_INSTR *p_next;
+      for (IR_INSTR *p_instr = p_block->ib_p_first; p_instr; p_instr = p_next)
+      {
+        p_next = p_instr->ii_p_next;
+        if (!ir_is_value(p_instr->ii_op) || p_n_uses[p_instr->ii_id] || !ir_is_pure(p_instr))
+          continue;
+        // Entry, slot and phi values and constants cost nothing by themselves.
+        if (p_instr->ii_op >= IR_COPY)
+          p_stats->os_n_dead_values += 1;
+        for (uint32_t i = 0; i < p_instr->ii_n_args; ++i)
+          p_n_uses[p_instr->ii_p_args[i]->ii_id] -= 1;
+        ir_delete_instr(p_instr);
+        changed = true;
+      }
+    }
+  }
+  free(p_n_uses);
+}
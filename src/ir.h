@@ -0,0 +1,103 @@
+#pragma once
+//------------------------------------------------------------------------------
+// Intermediate representation of a task's statements: a control flow graph of
+// basic blocks whose instructions are in SSA form.  mpc builds it between the
+// parse tree and the bytecode at -O2.  See ir.c.
+//------------------------------------------------------------------------------
+enum IR_OP
+{
+  IR_BAD = 0,
+  // Values.
+  IR_CONST,  // ii_const
+  IR_ENTRY,  // The 0 a variable starts with: frames are zeroed.
+  IR_SLOT,  // Whatever an IR_STATEMENT left in the variable's slot.
+  IR_PHI,  // One argument per predecessor of the block, in the same order.
+  IR_COPY,
+  IR_NEGATE,
+  IR_NOT,
+  IR_ADD,
+  IR_SUBTRACT,
+  IR_MULTIPLY,
+  IR_DIVIDE,
+  IR_REMAINDER,
+  IR_EQ,
+  IR_NE,
+  IR_LT,
+  IR_LE,
+  IR_GT,
+  IR_GE,
+  IR_CALL,  // ii_p_tree: ND_CALL.
+  IR_RECEIVE,  // ii_p_tree: ND_RECEIVE.
+  IR_EXPR,  // ii_p_tree: 'and'/'or' compile() evaluates.  Arguments: variables read.
+  // No value.
+  IR_PRINT_INT,
+  IR_PRINT_CHAR,  // ii_p_tree: ND_PRINT_CHAR.
+  IR_PRINT_STRING,  // ii_p_tree: ND_PRINT_STRING.
+  IR_BEGIN_ATOMIC_PRINT,
+  IR_END_ATOMIC_PRINT,
+  IR_SEND,  // ii_p_tree: ND_SEND.
+  IR_SLEEP,
+  IR_STATEMENT,  // ii_p_tree: statement compile() emits.  Arguments: variables
+                 // read or assigned, each followed by an IR_SLOT if assigned.
+  // Terminators, last in their block.
+  IR_JUMP,  // To ib_p_succs[0].
+  IR_BRANCH,  // To ib_p_succs[0] if arg0 ii_cond arg1, else ib_p_succs[1].
+  IR_RETURN,
+  IR_STOP
+};
+//------------------------------------------------------------------------------
+#define IR_NO_VAR UINT32_MAX
+//------------------------------------------------------------------------------
+typedef struct IR_BLOCK IR_BLOCK;
+typedef struct IR_INSTR IR_INSTR;
+struct IR_INSTR
+{
+  uint8_t ii_op;  // IR_...
+  uint8_t ii_cond;  // IR_BRANCH: IR_EQ ... IR_GE.
+  uint32_t ii_id;  // Index in per-function arrays, unique in the function.
+  uint32_t ii_var;  // Variable whose value this is, IR_NO_VAR for a temporary.
+  int32_t ii_const;  // IR_CONST
+  PARSE_NODE *ii_p_tree;
+  IR_INSTR **ii_p_args;
+  uint32_t ii_n_args;
+  IR_BLOCK *ii_p_block;
+  IR_INSTR *ii_p_prev;
+  IR_INSTR *ii_p_next;
+};
+//------------------------------------------------------------------------------
+struct IR_BLOCK
+{
+  uint32_t ib_id;
+  char *ib_label_prefix;  // Name of the jump label compile() would give it, or NULL.
+  IR_INSTR *ib_p_first;  // Phis first, terminator last.
+  IR_INSTR *ib_p_last;
+  IR_BLOCK *ib_p_next;  // Layout order: the order the code is emitted in.
+  IR_BLOCK *ib_p_succs[2];
+  IR_BLOCK **ib_p_preds;
+  uint32_t ib_n_preds;
+  IR_INSTR **ib_p_defs_out;  // While building: variable values at the end.
+  bool ib_placed;
+  uint32_t ib_addr;  // Used by the emitter.
+  uint32_t ib_jump_list;  // Used by the emitter.
+};
+//------------------------------------------------------------------------------
+typedef struct IR_FUNC IR_FUNC;
+struct IR_FUNC
+{
+  IR_BLOCK *if_p_entry;  // First block in layout order.
+  uint32_t if_n_blocks;  // Block ids are < if_n_blocks.
+  uint32_t if_n_instrs;  // Instruction ids are < if_n_instrs.
+  char (*if_p_variable_names)[MAX_STR];
+  uint32_t if_n_variables;
+  IR_BLOCK **if_p_all_blocks;  // Every block made, for ir_free().
+  uint32_t if_all_blocks_size;
+};
+//------------------------------------------------------------------------------
+IR_FUNC *ir_build(PARSE_NODE *p_body);
+void ir_free(IR_FUNC *p_func);
+void ir_print(FILE *fout, IR_FUNC *p_func);
+bool ir_is_value(uint8_t op);
+bool ir_is_pure(IR_INSTR *p_instr);
+uint32_t *ir_count_uses(IR_FUNC *p_func);
+void ir_propagate_constants(IR_FUNC *p_func, OPT_STATS *p_stats);
+void ir_remove_dead_code(IR_FUNC *p_func, OPT_STATS *p_stats);
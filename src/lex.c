@@ -217,19 +217,38 @@ static struct
 } keyword_to_type_table[] =
 {
   { "and",         LX_AND_KW        },
+  { "barrier",     LX_BARRIER_KW    },
+  { "call",        LX_CALL_KW       },
+  { "cancel",      LX_CANCEL_KW     },
+  { "case",        LX_CASE_KW       },
+  { "channel",     LX_CHANNEL_KW    },
+  { "critical",    LX_CRITICAL_KW   },
   { "do",          LX_DO_KW         },
   { "do_nothing",  LX_DO_NOTHING_KW },
   { "else",        LX_ELSE_KW       },
   { "end",         LX_END_KW        },
+  { "event",       LX_EVENT_KW      },
+  { "every",       LX_EVERY_KW      },
+  { "first",       LX_FIRST_KW      },
   { "if",          LX_IF_KW         },
   { "init",        LX_INIT_KW       },
   { "join",        LX_JOIN_KW       },
+  { "limit",       LX_LIMIT_KW      },
+  { "lock",        LX_LOCK_KW       },
   { "module",      LX_MODULE_KW     },
   { "not",         LX_NOT_KW        },
   { "or",          LX_OR_KW         },
   { "print",       LX_PRINT_KW      },
   { "print_char",  LX_PRINT_CHAR_KW },
   { "print_int",   LX_PRINT_INT_KW  },
+  { "priority",    LX_PRIORITY_KW   },
+  { "receive",     LX_RECEIVE_KW    },
+  { "reduce",      LX_REDUCE_KW     },
+  { "reset",       LX_RESET_KW      },
+  { "return",      LX_RETURN_KW     },
+  { "select",      LX_SELECT_KW     },
+  { "send",        LX_SEND_KW       },
+  { "signal",      LX_SIGNAL_KW     },
   { "sleep",       LX_SLEEP_KW      },
   { "spawn",       LX_SPAWN_KW      },
   { "stop",        LX_STOP_KW       },
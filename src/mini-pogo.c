@@ -11,6 +11,11 @@
 //------------------------------------------------------------------------------
 #include "lex.h"
 #include "parse.h"
+#include "instruction.h"
+#include "optimize.h"
+#include "code-opt.h"
+#include "ir.h"
+#include "passes.h"
 #include "compile.h"
 #include "binary-header.h"
 //------------------------------------------------------------------------------
@@ -28,6 +33,8 @@ extern uint32_t g_input_line_n;
 extern uint32_t g_input_column_n;
 extern char *g_lex_names[];
 extern bool g_lex_debug_print;  // Print lexical units as they are scanned.
+static bool g_verbose;  // --verbose: report what the optimizer did.
+static uint8_t g_opt_level = OPT_LEVEL_MAX;  // -O0, -O1, -O2
 //------------------------------------------------------------------------------
 // Sequence of expected lexical types from test-module-3.pogo.
 uint8_t test_module_3_pogo_lex_types[] =
@@ -237,6 +244,9 @@ void compile_selectively(uint32_t compile_flags,
     lex_set_input_function(file_input, &fr);
     if (p_tree = parse())
     {
+      OPT_STATS opt_stats;
+      zero_mem(&opt_stats, sizeof(OPT_STATS));
+      passes_run_tree(p_tree, g_opt_level, &opt_stats);
       if (!(fout = fopen(output_filename, "w")))
       {
         fprintf(stderr, "%s : cannot open\n", output_filename);
@@ -244,8 +254,14 @@ void compile_selectively(uint32_t compile_flags,
       }
       else
       {
-        compile_init();
+        compile_init(g_opt_level, &opt_stats);
         compile(p_tree);
+        compile_optimize_code();
+        if (g_verbose)
+        {
+          passes_print(stderr, g_opt_level);
+          optimize_print_stats(stderr, &opt_stats);
+        }
         if (compile_flags & CF_HEADER)
           compile_write_header(fout);
         if (compile_flags & CF_CODE)
@@ -257,6 +273,46 @@ void compile_selectively(uint32_t compile_flags,
   }
 }
 //------------------------------------------------------------------------------
+// Print the IR of one task body after the IR passes of the current -O level.
+static void ir_print_body(char *name, PARSE_NODE *p_body, OPT_STATS *p_stats)
+{
+  IR_FUNC *p_func = ir_build(p_body);
+  passes_run_ir(p_func, g_opt_level, p_stats);
+  printf("%s:\n", name);
+  ir_print(stdout, p_func);
+  ir_free(p_func);
+}
+//------------------------------------------------------------------------------
+// --ir-print: write the IR of the init statements and of each task to stdout.
+void ir_print_file(char *input_filename)
+{
+  FILE_READ fr;
+  PARSE_NODE *p_tree;
+  file_input_init(&fr);
+  if (!(fr.f_file = fopen(input_filename, "r")))
+    fprintf(stderr, "%s : not found\n", input_filename);
+  else
+  {
+    strcpy(fr.f_file_name, input_filename);
+    lex_set_input_function(file_input, &fr);
+    if (p_tree = parse())
+    {
+      OPT_STATS opt_stats;
+      zero_mem(&opt_stats, sizeof(OPT_STATS));
+      passes_run_tree(p_tree, g_opt_level, &opt_stats);
+      ir_print_body("init", p_tree->nd_p_init_statements, &opt_stats);
+      for (LISTITEM *p_task_declaration = p_tree->nd_p_task_decl_list;
+           p_task_declaration;
+           p_task_declaration = p_task_declaration->l_p_next)
+      {
+        PARSE_NODE *p_task = p_task_declaration->l_parse_node;
+        ir_print_body(p_task->nd_task_name, p_task->nd_p_task_body, &opt_stats);
+      }
+    }
+    fclose(fr.f_file);
+  }
+}
+//------------------------------------------------------------------------------
 void test_file_read(char *filename)
 {
   FILE_READ fr;
@@ -334,7 +390,15 @@ enum
   S_LEX_PRINT,
   S_TEST_PARSE,
   S_COMPILE_HEADER,
-  S_COMPILE
+  S_COMPILE,
+  S_VERBOSE,
+  S_TEST_STRENGTH,
+  S_OPT_0,
+  S_OPT_1,
+  S_OPT_2,
+  S_IR_PRINT,
+  S_UNROLL,
+  S_UNROLL_LIMIT
 };
 //------------------------------------------------------------------------------
 SWITCH g_lex_test_switches[] =
@@ -348,6 +412,14 @@ SWITCH g_lex_test_switches[] =
   { S_TEST_PARSE,       "--parse-test",           "-p",         1,               1,                  "usage: --parse-test <input file>",                        CS_PARAM_ERROR_ALL },
   { S_COMPILE_HEADER,   "--compile-header-only",  "",           2,               2,                  "usage: --compile-header-only <input file> <output file>", CS_PARAM_ERROR_ALL },
   { S_COMPILE,          "--compile",              "-c",         2,               2,                  "usage: --compile <input file> <output file>",             CS_PARAM_ERROR_ALL },
+  { S_VERBOSE,          "--verbose",              "-v",         0,               0,                  "usage: --verbose",                                        CS_PARAM_ERROR_ALL },
+  { S_TEST_STRENGTH,    "--strength-test",        "",           0,               0,                  "usage: --strength-test",                                  CS_PARAM_ERROR_ALL },
+  { S_OPT_0,            "--opt-level-0",          "-O0",        0,               0,                  "usage: -O0",                                              CS_PARAM_ERROR_ALL },
+  { S_OPT_1,            "--opt-level-1",          "-O1",        0,               0,                  "usage: -O1",                                              CS_PARAM_ERROR_ALL },
+  { S_OPT_2,            "--opt-level-2",          "-O2",        0,               0,                  "usage: -O2",                                              CS_PARAM_ERROR_ALL },
+  { S_IR_PRINT,         "--ir-print",             "",           1,               1,                  "usage: --ir-print <input file>",                          CS_PARAM_ERROR_ALL },
+  { S_UNROLL,           "--unroll",               "",           1,               1,                  "usage: --unroll <factor>",                                CS_PARAM_ERROR_ALL },
+  { S_UNROLL_LIMIT,     "--unroll-limit",         "",           1,               1,                  "usage: --unroll-limit <instructions>",                    CS_PARAM_ERROR_ALL },
   SWITCH_LIST_END
 };
 //------------------------------------------------------------------------------
@@ -362,6 +434,15 @@ void help(void)
   fprintf(stderr, "(--parse-test | -p) <input file>                  Parse file.  Write parse tree outline to stdout (in org format).\n");
   fprintf(stderr, "--compile-header-only  <input file> <output file> Write header and no code to output-file.\n");
   fprintf(stderr, "--compile <input file> <output file>              Write header code to output-file.\n");
+  fprintf(stderr, "--verbose | -v                                    Report optimizations done by later switches.\n");
+  fprintf(stderr, "--strength-test                                   Check strength-reduced '*', '/', '%%' against the plain ones.\n");
+  fprintf(stderr, "-O0 | -O1 | -O2                                   Optimization level for later switches (default -O2):\n");
+  fprintf(stderr, "                                                  none, tree folding and bytecode passes, and also the IR.\n");
+  fprintf(stderr, "--ir-print <input file>                           Write the IR of each task to stdout.\n");
+  fprintf(stderr, "--unroll <factor>                                 Unroll counted loops this many times over at -O2 (default %u, 1: don't).\n",
+          OPT_UNROLL_FACTOR);
+  fprintf(stderr, "--unroll-limit <instructions>                     Largest unrolled loop body (default %u).\n",
+          OPT_UNROLL_LIMIT);
 }
 //------------------------------------------------------------------------------
 int main(int argc, char **argv)
@@ -409,6 +490,31 @@ int main(int argc, char **argv)
           case S_COMPILE:
             compile_selectively(CF_HEADER | CF_CODE , switch_params[0], switch_params[1]);
             break;
+          case S_VERBOSE:
+            g_verbose = true;
+            break;
+          case S_TEST_STRENGTH:
+            if (copt_test_strength_reduction(stdout))
+              exit(1);
+            break;
+          case S_OPT_0:
+            g_opt_level = 0;
+            break;
+          case S_OPT_1:
+            g_opt_level = 1;
+            break;
+          case S_OPT_2:
+            g_opt_level = 2;
+            break;
+          case S_IR_PRINT:
+            ir_print_file(switch_params[0]);
+            break;
+          case S_UNROLL:
+            optimize_set_unroll_factor(strtoul(switch_params[0], NULL, 10));
+            break;
+          case S_UNROLL_LIMIT:
+            optimize_set_unroll_limit(strtoul(switch_params[0], NULL, 10));
+            break;
           case S_HELP:
             help();
             break;
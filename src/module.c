@@ -8,15 +8,41 @@
 //------------------------------------------------------------------------------
 #include "instruction.h"
 #include "binary-header.h"
+#include "park.h"
 #include "exec.h"
 #include "module.h"
 //------------------------------------------------------------------------------
+// Index task frame sizes and priorities by task address so OP_CALL/OP_SPAWN
+// needn't search the label list.
+static void module_index_task_labels(MODULE *p_module)
+{
+  HEADER *p_header = p_module->mod_p_header;
+  uint32_t n_instructions = p_header->hdr_code_size_bytes/sizeof(INSTRUCTION);
+  p_module->mod_p_frame_sizes = calloc(n_instructions + 1, sizeof(uint32_t));
+  p_module->mod_p_priorities = calloc(n_instructions + 1, sizeof(int8_t));
+  for (uint32_t i = 0; i < p_header->hdr_n_labels; ++i)
+  {
+    HEADER_LABEL *p_label = &p_header->hdr_p_label_list[i];
+    if (p_label->hlbl_type != 0 && p_label->hlbl_addr < n_instructions)
+    {
+      p_module->mod_p_frame_sizes[p_label->hlbl_addr] = p_label->hlbl_frame_size;
+      p_module->mod_p_priorities[p_label->hlbl_addr] = p_label->hlbl_priority;
+      if (p_label->hlbl_priority)
+        p_module->mod_has_priorities = true;
+    }
+  }
+}
+//------------------------------------------------------------------------------
 MODULE *module_read(FILE *fin)
 {
   MODULE *result = NULL;
   result = malloc(sizeof(MODULE));
   result->mod_p_header = bhdr_read(fin);
   result->mod_p_init_task = NULL;
+  result->mod_p_objects = NULL;
+  result->mod_p_frame_sizes = NULL;
+  result->mod_p_priorities = NULL;
+  result->mod_has_priorities = false;
   if (result->mod_p_header)
   {
     fseek(fin, result->mod_p_header->hdr_size_bytes, SEEK_SET);
@@ -31,6 +57,8 @@ MODULE *module_read(FILE *fin)
       result = NULL;
       fprintf(stderr, "Unable to read code.\n");
     }
+    else
+      module_index_task_labels(result);
   }
   else
   {
@@ -45,6 +73,8 @@ void module_free(MODULE *p_module)
 {
   free(p_module->mod_p_code);
   free(p_module->mod_p_header);
+  free(p_module->mod_p_frame_sizes);
+  free(p_module->mod_p_priorities);
   if (p_module->mod_p_init_task)
     free(p_module->mod_p_init_task);
   free(p_module);
@@ -8,6 +8,10 @@ struct MODULE
   HEADER *mod_p_header;
   INSTRUCTION *mod_p_code;
   TASK *mod_p_init_task;
+  void **mod_p_objects;  // Runtime state of hdr_p_object_list[] (CHANNEL *, ...).
+  uint32_t *mod_p_frame_sizes;  // [code address] -> frame size of task starting there.
+  int8_t *mod_p_priorities;  // [code address] -> priority of task starting there.
+  bool mod_has_priorities;  // Some task has a 'priority'.
 };
 //------------------------------------------------------------------------------
 MODULE *module_read(FILE *fin);
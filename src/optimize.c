@@ -0,0 +1,1248 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <util.h>
+//------------------------------------------------------------------------------
+#include "parse.h"
+#include "optimize.h"
+//------------------------------------------------------------------------------
+// THEORY OF OPERATION:
+//
+// optimize_fold() walks every statement of the module and rewrites each
+// expression subtree bottom up:
+//
+//   -- Folding: an operator whose operands are all ND_NUMBERs becomes an
+//      ND_NUMBER holding the value the runtime would have computed (int32
+//      arithmetic wraps, comparisons and 'not' give 0 or 1, 'and'/'or' give
+//      the operand that decides, as OP_TEST_AND_JUMP_IF_(NON)ZERO leave it).
+//
+//   -- Identities: x+0, 0+x, x-0, x*1, 1*x, x/1 -> x;  0-x, x*-1, -1*x -> -x;
+//      - -x -> x;  (x+c1)+c2 -> x+(c1+c2);  (x*c1)*c2 -> x*(c1*c2).
+//      x*0, 0*x and x%1 -> 0 only if evaluating x can't trap (see below).
+//      c*x -> x*c, the form code-opt.c's strength reduction looks for.
+//
+// Expressions have no side effects except that '/' and '%' trap when dividing
+// by 0 (or INT32_MIN by -1).  Those are never folded, and no subtree holding a
+// '/' or '%' whose divisor isn't a safe constant is dropped, so a program that
+// traps still traps at the same point.
+//
+// optimize_code_motion() moves arithmetic into compiler temporaries: variables
+// named '<tmp_N>', which no identifier can be, so compile() gives them frame
+// slots like any other variable.  Variables belong to one task (or call), so only
+// that task's statements can change them.
+//
+//   -- Loop-invariant code motion: in a 'while', an arithmetic subexpression
+//      none of whose variables are assigned in the loop (by ':=', 'receive',
+//      'join reduce' or 'join first') is computed once, into a temporary
+//      assigned just before the loop.  Loops are done outermost first, so an
+//      expression invariant in nested loops goes out of all of them.
+//
+//   -- Common subexpressions: within a run of straight-line statements
+//      (assignments, prints, send, receive, sleep), an arithmetic
+//      subexpression that appears n times before one of its variables is
+//      assigned is computed once, into a temporary assigned before the first
+//      statement, if that's fewer instructions (c*n > c + 1 + n for an
+//      expression of c instructions).
+//
+// Both evaluate the expression earlier than the program does, and a hoisted
+// one even if the loop runs 0 times, so only expressions that can't trap are
+// moved.
+//
+// optimize_unroll() unrolls counted loops: a 'while' whose test compares a
+// variable i with a number or a variable b the loop doesn't assign, and whose
+// last statement, the only one assigning i, steps it by a constant c toward b
+// ('i < b' or 'i <= b' with c > 0, 'i > b' or 'i >= b' with c < 0):
+//
+//     while i < b do S; i := i + c; end;
+//
+// With the unroll factor k, it becomes
+//
+//     while i < l do S; i := i + c; S; i := i + c; ... (k times) end;
+//     while i < b do S; i := i + c; end;
+//
+// where l is b - (k-1)*c: if i < l, the original loop would have run (at
+// least) k more times, so the first loop runs only iterations the original
+// does, k at a time, and the second one (the original) does the rest.  The
+// statements run in the same order, only fewer tests and jumps run between
+// them.  If b is a variable, l is a variable '<limit_N>' set before the loops,
+// and to INT32_MIN (INT32_MAX counting down) if b - (k-1)*c wraps around.
+//
+// A loop is unrolled only if its body compiles to at most the unroll limit
+// instructions k times over, and holds nothing but assignments, 'if', 'while',
+// prints, send, receive, sleep, 'call', 'return' and 'stop'.  Loops that spawn
+// tasks or wait on barriers, events, locks or 'select' spend their time
+// waiting rather than testing.  Inner loops are unrolled first, which usually
+// makes the loops around them too big.
+//------------------------------------------------------------------------------
+static OPT_STATS *g_p_stats;
+static uint32_t g_n_temporaries;  // In the task being optimized.
+static uint32_t g_n_limits;  // '<limit_N>' made by optimize_unroll().
+static uint32_t g_unroll_factor = OPT_UNROLL_FACTOR;
+static uint32_t g_unroll_limit = OPT_UNROLL_LIMIT;
+//------------------------------------------------------------------------------
+static bool optimize_is_number(PARSE_NODE *p_expr, int32_t n)
+{
+  return ND_NUMBER == p_expr->nd_type && n == p_expr->nd_number;
+}
+//------------------------------------------------------------------------------
+static bool optimize_is_binary(uint8_t nd_type)
+{
+  switch (nd_type)
+  {
+    case ND_OR:
+    case ND_AND:
+    case ND_LE:
+    case ND_LT:
+    case ND_GE:
+    case ND_GT:
+    case ND_EQ:
+    case ND_NE:
+    case ND_ADD:
+    case ND_SUBTRACT:
+    case ND_MULTIPLY:
+    case ND_DIVIDE:
+    case ND_REMAINDER:
+      return true;
+    default:
+      return false;
+  }
+}
+//------------------------------------------------------------------------------
+static void optimize_free_expr(PARSE_NODE *p_expr)
+{
+  if (ND_NEGATE == p_expr->nd_type || ND_NOT == p_expr->nd_type)
+    optimize_free_expr(p_expr->nd_p_expr);
+  else if (optimize_is_binary(p_expr->nd_type))
+  {
+    optimize_free_expr(p_expr->nd_p_left_expr);
+    optimize_free_expr(p_expr->nd_p_right_expr);
+  }
+  free(p_expr);
+}
+//------------------------------------------------------------------------------
+// RETURNS: true if evaluating p_expr might trap.
+static bool optimize_may_trap(PARSE_NODE *p_expr)
+{
+  if (ND_NEGATE == p_expr->nd_type || ND_NOT == p_expr->nd_type)
+    return optimize_may_trap(p_expr->nd_p_expr);
+  if (!optimize_is_binary(p_expr->nd_type))
+    return false;
+  if ((ND_DIVIDE == p_expr->nd_type || ND_REMAINDER == p_expr->nd_type)
+      && !(ND_NUMBER == p_expr->nd_p_right_expr->nd_type
+           && 0 != p_expr->nd_p_right_expr->nd_number
+           && -1 != p_expr->nd_p_right_expr->nd_number))
+    return true;
+  return optimize_may_trap(p_expr->nd_p_left_expr) || optimize_may_trap(p_expr->nd_p_right_expr);
+}
+//------------------------------------------------------------------------------
+// Evaluate nd_type on constants x and y as the runtime would.
+// RETURNS: false if it would trap (left for the runtime to do).
+static bool optimize_eval(uint8_t nd_type, int32_t x, int32_t y, int32_t *p_result)
+{
+  switch (nd_type)
+  {
+    case ND_OR:
+      *p_result = x ? x : y;
+      break;
+    case ND_AND:
+      *p_result = x ? y : x;
+      break;
+    case ND_LE:
+      *p_result = x <= y;
+      break;
+    case ND_LT:
+      *p_result = x < y;
+      break;
+    case ND_GE:
+      *p_result = x >= y;
+      break;
+    case ND_GT:
+      *p_result = x > y;
+      break;
+    case ND_EQ:
+      *p_result = x == y;
+      break;
+    case ND_NE:
+      *p_result = x != y;
+      break;
+    case ND_ADD:
+      *p_result = (int32_t) ((uint32_t) x + (uint32_t) y);
+      break;
+    case ND_SUBTRACT:
+      *p_result = (int32_t) ((uint32_t) x - (uint32_t) y);
+      break;
+    case ND_MULTIPLY:
+      *p_result = (int32_t) ((uint32_t) x*(uint32_t) y);
+      break;
+    case ND_DIVIDE:
+    case ND_REMAINDER:
+      if (0 == y || (INT32_MIN == x && -1 == y))
+        return false;
+      *p_result = ND_DIVIDE == nd_type ? x/y : x%y;
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+//------------------------------------------------------------------------------
+// Make *pp_expr the number n (keeping its source position).
+static void optimize_replace_by_number(PARSE_NODE **pp_expr, int32_t n)
+{
+  PARSE_NODE *p_number = malloc(sizeof(PARSE_NODE));
+  p_number->nd_type = ND_NUMBER;
+  p_number->nd_src_line = (*pp_expr)->nd_src_line;
+  p_number->nd_src_col = (*pp_expr)->nd_src_col;
+  p_number->nd_number = n;
+  optimize_free_expr(*pp_expr);
+  *pp_expr = p_number;
+}
+//------------------------------------------------------------------------------
+// Replace *pp_expr (a binary operator) by its operand p_keep.
+static void optimize_replace_by_operand(PARSE_NODE **pp_expr, PARSE_NODE *p_keep)
+{
+  PARSE_NODE *p_other = p_keep == (*pp_expr)->nd_p_left_expr ? (*pp_expr)->nd_p_right_expr
+                                                              : (*pp_expr)->nd_p_left_expr;
+  optimize_free_expr(p_other);
+  free(*pp_expr);
+  *pp_expr = p_keep;
+  g_p_stats->os_n_simplified += 1;
+}
+//------------------------------------------------------------------------------
+// Replace *pp_expr (a binary operator) by the negation of its operand p_keep.
+static void optimize_replace_by_negated_operand(PARSE_NODE **pp_expr, PARSE_NODE *p_keep)
+{
+  PARSE_NODE *p_other = p_keep == (*pp_expr)->nd_p_left_expr ? (*pp_expr)->nd_p_right_expr
+                                                              : (*pp_expr)->nd_p_left_expr;
+  optimize_free_expr(p_other);
+  (*pp_expr)->nd_type = ND_NEGATE;
+  (*pp_expr)->nd_p_expr = p_keep;
+  g_p_stats->os_n_simplified += 1;
+}
+//------------------------------------------------------------------------------
+static void optimize_expr(PARSE_NODE **pp_expr);
+//------------------------------------------------------------------------------
+static void optimize_unary(PARSE_NODE **pp_expr)
+{
+  PARSE_NODE *p_expr = *pp_expr;
+  PARSE_NODE *p_operand;
+  optimize_expr(&p_expr->nd_p_expr);
+  p_operand = p_expr->nd_p_expr;
+  if (ND_NUMBER == p_operand->nd_type)
+  {
+    int32_t n = p_operand->nd_number;
+    optimize_replace_by_number(pp_expr, ND_NOT == p_expr->nd_type ? !n
+                                                                  : (int32_t) (0U - (uint32_t) n));
+    g_p_stats->os_n_folded += 1;
+  }
+  else if (ND_NEGATE == p_expr->nd_type && ND_NEGATE == p_operand->nd_type)
+  {
+    *pp_expr = p_operand->nd_p_expr;
+    free(p_operand);
+    free(p_expr);
+    g_p_stats->os_n_simplified += 1;
+  }
+}
+//------------------------------------------------------------------------------
+static void optimize_binary(PARSE_NODE **pp_expr)
+{
+  PARSE_NODE *p_expr = *pp_expr;
+  PARSE_NODE *p_left;
+  PARSE_NODE *p_right;
+  int32_t n;
+  optimize_expr(&p_expr->nd_p_left_expr);
+  optimize_expr(&p_expr->nd_p_right_expr);
+  p_left = p_expr->nd_p_left_expr;
+  p_right = p_expr->nd_p_right_expr;
+  if (ND_NUMBER == p_left->nd_type && ND_NUMBER == p_right->nd_type)
+  {
+    if (optimize_eval(p_expr->nd_type, p_left->nd_number, p_right->nd_number, &n))
+    {
+      optimize_replace_by_number(pp_expr, n);
+      g_p_stats->os_n_folded += 1;
+    }
+    return;
+  }
+  switch (p_expr->nd_type)
+  {
+    case ND_OR:
+    case ND_AND:
+      // A constant left operand decides which operand is the value.
+      if (ND_NUMBER == p_left->nd_type)
+      {
+        bool keep_left = ND_OR == p_expr->nd_type ? 0 != p_left->nd_number : 0 == p_left->nd_number;
+        optimize_replace_by_operand(pp_expr, keep_left ? p_left : p_right);
+      }
+      break;
+    case ND_ADD:
+      if (optimize_is_number(p_right, 0))
+        optimize_replace_by_operand(pp_expr, p_left);
+      else if (optimize_is_number(p_left, 0))
+        optimize_replace_by_operand(pp_expr, p_right);
+      else if (ND_NUMBER == p_right->nd_type && ND_ADD == p_left->nd_type
+               && ND_NUMBER == p_left->nd_p_right_expr->nd_type)
+      {
+        // (x + c1) + c2 -> x + (c1 + c2)
+        optimize_eval(ND_ADD, p_left->nd_p_right_expr->nd_number, p_right->nd_number,
+                      &p_left->nd_p_right_expr->nd_number);
+        optimize_replace_by_operand(pp_expr, p_left);
+        optimize_expr(pp_expr);
+      }
+      break;
+    case ND_SUBTRACT:
+      if (optimize_is_number(p_right, 0))
+        optimize_replace_by_operand(pp_expr, p_left);
+      else if (optimize_is_number(p_left, 0))
+        optimize_replace_by_negated_operand(pp_expr, p_right);
+      break;
+    case ND_MULTIPLY:
+      if (ND_NUMBER == p_left->nd_type)
+      {
+        // c*x -> x*c.  c can't trap, so evaluating it last changes nothing.
+        p_expr->nd_p_left_expr = p_right;
+        p_expr->nd_p_right_expr = p_left;
+        p_left = p_expr->nd_p_left_expr;
+        p_right = p_expr->nd_p_right_expr;
+      }
+      if (optimize_is_number(p_right, 1))
+        optimize_replace_by_operand(pp_expr, p_left);
+      else if (optimize_is_number(p_right, -1))
+        optimize_replace_by_negated_operand(pp_expr, p_left);
+      else if (optimize_is_number(p_right, 0) && !optimize_may_trap(p_left))
+        optimize_replace_by_operand(pp_expr, p_right);
+      else if (ND_NUMBER == p_right->nd_type && ND_MULTIPLY == p_left->nd_type
+               && ND_NUMBER == p_left->nd_p_right_expr->nd_type)
+      {
+        // (x*c1)*c2 -> x*(c1*c2)
+        optimize_eval(ND_MULTIPLY, p_left->nd_p_right_expr->nd_number, p_right->nd_number,
+                      &p_left->nd_p_right_expr->nd_number);
+        optimize_replace_by_operand(pp_expr, p_left);
+        optimize_expr(pp_expr);
+      }
+      break;
+    case ND_DIVIDE:
+      if (optimize_is_number(p_right, 1))
+        optimize_replace_by_operand(pp_expr, p_left);
+      break;
+    case ND_REMAINDER:
+      if (optimize_is_number(p_right, 1) && !optimize_may_trap(p_left))
+      {
+        p_right->nd_number = 0;
+        optimize_replace_by_operand(pp_expr, p_right);
+      }
+      break;
+  }
+}
+//------------------------------------------------------------------------------
+static void optimize_expr(PARSE_NODE **pp_expr)
+{
+  if (!*pp_expr)
+    return;
+  if (ND_NEGATE == (*pp_expr)->nd_type || ND_NOT == (*pp_expr)->nd_type)
+    optimize_unary(pp_expr);
+  else if (optimize_is_binary((*pp_expr)->nd_type))
+    optimize_binary(pp_expr);
+}
+//------------------------------------------------------------------------------
+typedef void EXPR_FN(PARSE_NODE **pp_expr, void *pv_context);
+//------------------------------------------------------------------------------
+static void optimize_for_each_expr(PARSE_NODE *p_tree, EXPR_FN *p_fn, void *pv_context);
+//------------------------------------------------------------------------------
+static void optimize_for_each_expr_in_list(LISTITEM *p_list, EXPR_FN *p_fn, void *pv_context)
+{
+  for (LISTITEM *p_item = p_list; p_item; p_item = p_item->l_p_next)
+    optimize_for_each_expr(p_item->l_parse_node, p_fn, pv_context);
+}
+//------------------------------------------------------------------------------
+// Calls p_fn on (the address of) each expression in the statements of p_tree,
+// in program order.  *pp_expr may be NULL (no 'limit', ...).
+static void optimize_for_each_expr(PARSE_NODE *p_tree, EXPR_FN *p_fn, void *pv_context)
+{
+  if (!p_tree)
+    return;
+  switch (p_tree->nd_type)
+  {
+    case ND_MODULE_DECLARATION:
+      optimize_for_each_expr(p_tree->nd_p_init_statements, p_fn, pv_context);
+      optimize_for_each_expr_in_list(p_tree->nd_p_task_decl_list, p_fn, pv_context);
+      break;
+    case ND_TASK_DECLARATION:
+      optimize_for_each_expr(p_tree->nd_p_task_body, p_fn, pv_context);
+      break;
+    case ND_STATEMENT_SEQUENCE:
+      optimize_for_each_expr_in_list(p_tree->nd_p_statement_seq, p_fn, pv_context);
+      break;
+    case ND_ATOMIC_PRINT:
+      optimize_for_each_expr_in_list(p_tree->nd_p_print_items, p_fn, pv_context);
+      break;
+    case ND_ASSIGN:
+      if (ND_CALL != p_tree->nd_p_assign_expr->nd_type)
+        p_fn(&p_tree->nd_p_assign_expr, pv_context);
+      break;
+    case ND_IF:
+      p_fn(&p_tree->nd_p_if_test_expr, pv_context);
+      optimize_for_each_expr(p_tree->nd_p_true_branch_statement_seq, p_fn, pv_context);
+      optimize_for_each_expr(p_tree->nd_p_false_branch_statement_seq, p_fn, pv_context);
+      break;
+    case ND_WHILE:
+      p_fn(&p_tree->nd_p_while_test_expr, pv_context);
+      optimize_for_each_expr(p_tree->nd_p_while_statement_seq, p_fn, pv_context);
+      break;
+    case ND_EVERY:
+      p_fn(&p_tree->nd_p_every_millisec_expr, pv_context);
+      optimize_for_each_expr(p_tree->nd_p_every_statement_seq, p_fn, pv_context);
+      break;
+    case ND_PRINT_INT:
+    case ND_SLEEP:
+    case ND_RETURN:
+      p_fn(&p_tree->nd_p_expr, pv_context);
+      break;
+    case ND_SEND:
+      p_fn(&p_tree->nd_p_send_expr, pv_context);
+      break;
+    case ND_CRITICAL:
+      optimize_for_each_expr(p_tree->nd_p_critical_statement_seq, p_fn, pv_context);
+      break;
+    case ND_SPAWN_JOIN:
+    case ND_SPAWN_JOIN_FIRST:
+      p_fn(&p_tree->nd_p_limit_expr, pv_context);
+      break;
+    case ND_SPAWN_JOIN_WITH_TIMEOUT:
+      p_fn(&p_tree->nd_p_limit_expr, pv_context);
+      p_fn(&p_tree->nd_p_millisec_expr, pv_context);
+      optimize_for_each_expr(p_tree->nd_p_statement_seq_if_timed_out, p_fn, pv_context);
+      optimize_for_each_expr(p_tree->nd_p_statement_seq_if_not_timed_out, p_fn, pv_context);
+      break;
+    case ND_SELECT:
+      optimize_for_each_expr_in_list(p_tree->nd_p_select_cases, p_fn, pv_context);
+      break;
+    case ND_SELECT_CASE:
+      optimize_for_each_expr(p_tree->nd_p_select_op, p_fn, pv_context);
+      p_fn(&p_tree->nd_p_select_millisec_expr, pv_context);
+      optimize_for_each_expr(p_tree->nd_p_select_statement_seq, p_fn, pv_context);
+      break;
+    default:
+      break;
+  }
+}
+//------------------------------------------------------------------------------
+// EXPR_FN for folding.
+static void optimize_fold_expr(PARSE_NODE **pp_expr, void *pv_unused)
+{
+  optimize_expr(pp_expr);
+}
+//------------------------------------------------------------------------------
+// Code motion.
+//------------------------------------------------------------------------------
+// RETURNS: true if p_a and p_b are the same expression.
+static bool optimize_expr_equal(PARSE_NODE *p_a, PARSE_NODE *p_b)
+{
+  if (p_a->nd_type != p_b->nd_type)
+    return false;
+  if (ND_NUMBER == p_a->nd_type)
+    return p_a->nd_number == p_b->nd_number;
+  if (ND_VARIABLE == p_a->nd_type)
+    return STREQ(p_a->nd_var_name, p_b->nd_var_name);
+  if (ND_NEGATE == p_a->nd_type || ND_NOT == p_a->nd_type)
+    return optimize_expr_equal(p_a->nd_p_expr, p_b->nd_p_expr);
+  if (optimize_is_binary(p_a->nd_type))
+    return optimize_expr_equal(p_a->nd_p_left_expr, p_b->nd_p_left_expr)
+           && optimize_expr_equal(p_a->nd_p_right_expr, p_b->nd_p_right_expr);
+  return false;
+}
+//------------------------------------------------------------------------------
+// RETURNS: about how many instructions p_expr compiles to.
+static uint32_t optimize_expr_cost(PARSE_NODE *p_expr)
+{
+  if (ND_NEGATE == p_expr->nd_type || ND_NOT == p_expr->nd_type)
+    return 1 + optimize_expr_cost(p_expr->nd_p_expr);
+  if (optimize_is_binary(p_expr->nd_type))
+    return 1 + optimize_expr_cost(p_expr->nd_p_left_expr) + optimize_expr_cost(p_expr->nd_p_right_expr);
+  return 1;
+}
+//------------------------------------------------------------------------------
+// RETURNS: true if p_expr may go into a temporary (see THEORY).
+static bool optimize_is_movable(PARSE_NODE *p_expr)
+{
+  switch (p_expr->nd_type)
+  {
+    case ND_ADD:
+    case ND_SUBTRACT:
+    case ND_MULTIPLY:
+    case ND_DIVIDE:
+    case ND_REMAINDER:
+    case ND_NEGATE:
+      return !optimize_may_trap(p_expr);
+    default:
+      return false;
+  }
+}
+//------------------------------------------------------------------------------
+static bool optimize_assigns(PARSE_NODE *p_tree, char *var_name);
+//------------------------------------------------------------------------------
+static bool optimize_assigns_in_list(LISTITEM *p_list, char *var_name)
+{
+  for (LISTITEM *p_item = p_list; p_item; p_item = p_item->l_p_next)
+    if (optimize_assigns(p_item->l_parse_node, var_name))
+      return true;
+  return false;
+}
+//------------------------------------------------------------------------------
+// RETURNS: true if a statement in p_tree may assign variable var_name.
+static bool optimize_assigns(PARSE_NODE *p_tree, char *var_name)
+{
+  if (!p_tree)
+    return false;
+  switch (p_tree->nd_type)
+  {
+    case ND_STATEMENT_SEQUENCE:
+      return optimize_assigns_in_list(p_tree->nd_p_statement_seq, var_name);
+    case ND_ASSIGN:
+      return STREQ(var_name, p_tree->nd_var_name);
+    case ND_RECEIVE:
+      return STREQ(var_name, p_tree->nd_receive_var_name);
+    case ND_IF:
+      return optimize_assigns(p_tree->nd_p_true_branch_statement_seq, var_name)
+             || optimize_assigns(p_tree->nd_p_false_branch_statement_seq, var_name);
+    case ND_WHILE:
+      return optimize_assigns(p_tree->nd_p_while_statement_seq, var_name);
+    case ND_EVERY:
+      return optimize_assigns(p_tree->nd_p_every_statement_seq, var_name);
+    case ND_CRITICAL:
+      return optimize_assigns(p_tree->nd_p_critical_statement_seq, var_name);
+    case ND_SPAWN_JOIN:
+      return STREQ(var_name, p_tree->nd_reduce_var_name);
+    case ND_SPAWN_JOIN_FIRST:
+      return STREQ(var_name, p_tree->nd_first_var_name);
+    case ND_SPAWN_JOIN_WITH_TIMEOUT:
+      return optimize_assigns(p_tree->nd_p_statement_seq_if_timed_out, var_name)
+             || optimize_assigns(p_tree->nd_p_statement_seq_if_not_timed_out, var_name);
+    case ND_SELECT:
+      return optimize_assigns_in_list(p_tree->nd_p_select_cases, var_name);
+    case ND_SELECT_CASE:
+      return optimize_assigns(p_tree->nd_p_select_op, var_name)
+             || optimize_assigns(p_tree->nd_p_select_statement_seq, var_name);
+    default:
+      return false;
+  }
+}
+//------------------------------------------------------------------------------
+// RETURNS: true if no statement in p_tree assigns a variable p_expr reads.
+static bool optimize_is_invariant(PARSE_NODE *p_expr, PARSE_NODE *p_tree)
+{
+  if (ND_VARIABLE == p_expr->nd_type)
+    return !optimize_assigns(p_tree, p_expr->nd_var_name);
+  if (ND_NEGATE == p_expr->nd_type || ND_NOT == p_expr->nd_type)
+    return optimize_is_invariant(p_expr->nd_p_expr, p_tree);
+  if (optimize_is_binary(p_expr->nd_type))
+    return optimize_is_invariant(p_expr->nd_p_left_expr, p_tree)
+           && optimize_is_invariant(p_expr->nd_p_right_expr, p_tree);
+  return ND_NUMBER == p_expr->nd_type;
+}
+//------------------------------------------------------------------------------
+// RETURNS: a new ND_VARIABLE for the variable p_assign assigns.
+static PARSE_NODE *optimize_new_variable(PARSE_NODE *p_assign)
+{
+  PARSE_NODE *result = malloc(sizeof(PARSE_NODE));
+  result->nd_type = ND_VARIABLE;
+  result->nd_src_line = p_assign->nd_src_line;
+  result->nd_src_col = p_assign->nd_src_col;
+  strcpy(result->nd_var_name, p_assign->nd_var_name);
+  return result;
+}
+//------------------------------------------------------------------------------
+// Links 't := *pp_expr' for a new temporary t in at *pp_link, and makes
+// *pp_expr t.
+// RETURNS: the new statement's LISTITEM.
+static LISTITEM *optimize_new_temporary(PARSE_NODE **pp_expr, LISTITEM **pp_link)
+{
+  PARSE_NODE *p_assign = malloc(sizeof(PARSE_NODE));
+  LISTITEM *result = malloc(sizeof(LISTITEM));
+  p_assign->nd_type = ND_ASSIGN;
+  p_assign->nd_src_line = (*pp_expr)->nd_src_line;
+  p_assign->nd_src_col = (*pp_expr)->nd_src_col;
+  snprintf(p_assign->nd_var_name, MAX_STR, "<tmp_%u>", g_n_temporaries++);
+  p_assign->nd_p_assign_expr = *pp_expr;
+  *pp_expr = optimize_new_variable(p_assign);
+  result->l_parse_node = p_assign;
+  result->l_p_next = *pp_link;
+  *pp_link = result;
+  return result;
+}
+//------------------------------------------------------------------------------
+// optimize_hoist_expr() context: the 'while' and the temporaries put before it.
+typedef struct HOIST HOIST;
+struct HOIST
+{
+  PARSE_NODE *h_p_loop;
+  LISTITEM *h_p_first;  // First 't := e' put before the loop, NULL if none.
+  LISTITEM **h_pp_loop;  // Link to the loop's LISTITEM (where 't := e' go).
+};
+//------------------------------------------------------------------------------
+// EXPR_FN: move the invariant parts of *pp_expr out of the loop.
+static void optimize_hoist_expr(PARSE_NODE **pp_expr, void *pv_hoist)
+{
+  HOIST *p_hoist = pv_hoist;
+  PARSE_NODE *p_expr = *pp_expr;
+  if (!p_expr)
+    return;
+  if (optimize_is_movable(p_expr) && optimize_is_invariant(p_expr, p_hoist->h_p_loop))
+  {
+    LISTITEM *p_item;
+    g_p_stats->os_n_hoisted += 1;
+    for (p_item = p_hoist->h_p_first; p_item && p_item != *p_hoist->h_pp_loop; p_item = p_item->l_p_next)
+    {
+      if (optimize_expr_equal(p_expr, p_item->l_parse_node->nd_p_assign_expr))
+      {
+        *pp_expr = optimize_new_variable(p_item->l_parse_node);
+        optimize_free_expr(p_expr);
+        return;
+      }
+    }
+    p_item = optimize_new_temporary(pp_expr, p_hoist->h_pp_loop);
+    if (!p_hoist->h_p_first)
+      p_hoist->h_p_first = p_item;
+    p_hoist->h_pp_loop = &p_item->l_p_next;
+  }
+  else if (ND_NEGATE == p_expr->nd_type || ND_NOT == p_expr->nd_type)
+    optimize_hoist_expr(&p_expr->nd_p_expr, pv_hoist);
+  else if (optimize_is_binary(p_expr->nd_type))
+  {
+    optimize_hoist_expr(&p_expr->nd_p_left_expr, pv_hoist);
+    optimize_hoist_expr(&p_expr->nd_p_right_expr, pv_hoist);
+  }
+}
+//------------------------------------------------------------------------------
+// optimize_match_expr() context.
+typedef struct MATCH MATCH;
+struct MATCH
+{
+  PARSE_NODE *m_p_pattern;
+  PARSE_NODE *m_p_assign;  // Replace copies of m_p_pattern by what it assigns (NULL: just count).
+  uint32_t m_n_found;
+};
+//------------------------------------------------------------------------------
+// EXPR_FN: count (or replace) the copies of a pattern in *pp_expr.
+static void optimize_match_expr(PARSE_NODE **pp_expr, void *pv_match)
+{
+  MATCH *p_match = pv_match;
+  PARSE_NODE *p_expr = *pp_expr;
+  if (!p_expr)
+    return;
+  if (optimize_expr_equal(p_expr, p_match->m_p_pattern))
+  {
+    p_match->m_n_found += 1;
+    if (p_match->m_p_assign)
+    {
+      *pp_expr = optimize_new_variable(p_match->m_p_assign);
+      optimize_free_expr(p_expr);
+    }
+  }
+  else if (ND_NEGATE == p_expr->nd_type || ND_NOT == p_expr->nd_type)
+    optimize_match_expr(&p_expr->nd_p_expr, pv_match);
+  else if (optimize_is_binary(p_expr->nd_type))
+  {
+    optimize_match_expr(&p_expr->nd_p_left_expr, pv_match);
+    optimize_match_expr(&p_expr->nd_p_right_expr, pv_match);
+  }
+}
+//------------------------------------------------------------------------------
+static bool optimize_is_straight_line(PARSE_NODE *p_statement)
+{
+  if (!p_statement)
+    return false;
+  switch (p_statement->nd_type)
+  {
+    case ND_ASSIGN:
+    case ND_PRINT_INT:
+    case ND_PRINT_STRING:
+    case ND_PRINT_CHAR:
+    case ND_ATOMIC_PRINT:
+    case ND_SEND:
+    case ND_RECEIVE:
+    case ND_SLEEP:
+      return true;
+    default:
+      return false;
+  }
+}
+//------------------------------------------------------------------------------
+// RETURNS: the LISTITEM after the run of straight-line statements from p_first
+// in which p_expr keeps its value: the run ends with the first statement that
+// assigns one of its variables (it reads them first).
+static LISTITEM *optimize_range_end(LISTITEM *p_first, PARSE_NODE *p_expr)
+{
+  LISTITEM *p_item = p_first;
+  while (p_item && optimize_is_straight_line(p_item->l_parse_node))
+  {
+    bool is_last = !optimize_is_invariant(p_expr, p_item->l_parse_node);
+    p_item = p_item->l_p_next;
+    if (is_last)
+      break;
+  }
+  return p_item;
+}
+//------------------------------------------------------------------------------
+// optimize_share_expr() context: the statement the expressions are from.
+typedef struct SHARE SHARE;
+struct SHARE
+{
+  LISTITEM *sh_p_statement;
+  LISTITEM **sh_pp_statement;  // Link to sh_p_statement (where 't := e' go).
+};
+//------------------------------------------------------------------------------
+// EXPR_FN: compute the parts of *pp_expr that the statements that follow
+// repeat once, biggest first.
+static void optimize_share_expr(PARSE_NODE **pp_expr, void *pv_share)
+{
+  SHARE *p_share = pv_share;
+  PARSE_NODE *p_expr = *pp_expr;
+  if (!p_expr)
+    return;
+  if (optimize_is_movable(p_expr))
+  {
+    LISTITEM *p_end = optimize_range_end(p_share->sh_p_statement, p_expr);
+    uint32_t cost = optimize_expr_cost(p_expr);
+    MATCH match = { p_expr, NULL, 0 };
+    for (LISTITEM *p_item = p_share->sh_p_statement; p_item != p_end; p_item = p_item->l_p_next)
+      optimize_for_each_expr(p_item->l_parse_node, optimize_match_expr, &match);
+    if (cost*match.m_n_found > cost + 1 + match.m_n_found)
+    {
+      // This copy goes into 't := e', the others become t.
+      LISTITEM *p_temporary = optimize_new_temporary(pp_expr, p_share->sh_pp_statement);
+      p_share->sh_pp_statement = &p_temporary->l_p_next;
+      match.m_p_assign = p_temporary->l_parse_node;
+      match.m_n_found = 0;
+      for (LISTITEM *p_item = p_share->sh_p_statement; p_item != p_end; p_item = p_item->l_p_next)
+        optimize_for_each_expr(p_item->l_parse_node, optimize_match_expr, &match);
+      g_p_stats->os_n_shared += match.m_n_found;
+      return;
+    }
+  }
+  if (ND_NEGATE == p_expr->nd_type || ND_NOT == p_expr->nd_type)
+    optimize_share_expr(&p_expr->nd_p_expr, pv_share);
+  else if (optimize_is_binary(p_expr->nd_type))
+  {
+    optimize_share_expr(&p_expr->nd_p_left_expr, pv_share);
+    optimize_share_expr(&p_expr->nd_p_right_expr, pv_share);
+  }
+}
+//------------------------------------------------------------------------------
+static void optimize_move_code(PARSE_NODE *p_tree);
+//------------------------------------------------------------------------------
+// p_list: statements of an ND_STATEMENT_SEQUENCE.
+static void optimize_move_code_in_list(LISTITEM **pp_list)
+{
+  for (LISTITEM **pp_item = pp_list; *pp_item; pp_item = &(*pp_item)->l_p_next)
+  {
+    PARSE_NODE *p_statement = (*pp_item)->l_parse_node;
+    if (p_statement && ND_WHILE == p_statement->nd_type)
+    {
+      HOIST hoist = { p_statement, NULL, pp_item };
+      optimize_for_each_expr(p_statement, optimize_hoist_expr, &hoist);
+      pp_item = hoist.h_pp_loop;
+    }
+    optimize_move_code(p_statement);
+  }
+  for (LISTITEM **pp_item = pp_list; *pp_item; pp_item = &(*pp_item)->l_p_next)
+  {
+    SHARE share = { *pp_item, pp_item };
+    if (!optimize_is_straight_line(share.sh_p_statement->l_parse_node))
+      continue;
+    optimize_for_each_expr(share.sh_p_statement->l_parse_node, optimize_share_expr, &share);
+    pp_item = share.sh_pp_statement;
+  }
+}
+//------------------------------------------------------------------------------
+// Loop-invariant code motion and common subexpressions in the statement
+// sequences of p_tree.
+static void optimize_move_code(PARSE_NODE *p_tree)
+{
+  if (!p_tree)
+    return;
+  switch (p_tree->nd_type)
+  {
+    case ND_MODULE_DECLARATION:
+      g_n_temporaries = 0;
+      optimize_move_code(p_tree->nd_p_init_statements);
+      for (LISTITEM *p_item = p_tree->nd_p_task_decl_list; p_item; p_item = p_item->l_p_next)
+        optimize_move_code(p_item->l_parse_node);
+      break;
+    case ND_TASK_DECLARATION:
+      g_n_temporaries = 0;
+      optimize_move_code(p_tree->nd_p_task_body);
+      break;
+    case ND_STATEMENT_SEQUENCE:
+      optimize_move_code_in_list(&p_tree->nd_p_statement_seq);
+      break;
+    case ND_IF:
+      optimize_move_code(p_tree->nd_p_true_branch_statement_seq);
+      optimize_move_code(p_tree->nd_p_false_branch_statement_seq);
+      break;
+    case ND_WHILE:
+      optimize_move_code(p_tree->nd_p_while_statement_seq);
+      break;
+    case ND_EVERY:
+      optimize_move_code(p_tree->nd_p_every_statement_seq);
+      break;
+    case ND_CRITICAL:
+      optimize_move_code(p_tree->nd_p_critical_statement_seq);
+      break;
+    case ND_SPAWN_JOIN_WITH_TIMEOUT:
+      optimize_move_code(p_tree->nd_p_statement_seq_if_timed_out);
+      optimize_move_code(p_tree->nd_p_statement_seq_if_not_timed_out);
+      break;
+    case ND_SELECT:
+      for (LISTITEM *p_item = p_tree->nd_p_select_cases; p_item; p_item = p_item->l_p_next)
+        optimize_move_code(p_item->l_parse_node->nd_p_select_statement_seq);
+      break;
+    default:
+      break;
+  }
+}
+//------------------------------------------------------------------------------
+// Loop unrolling.
+//------------------------------------------------------------------------------
+#define NOT_UNROLLABLE UINT32_MAX  // Cost of statements optimize_copy() doesn't copy.
+//------------------------------------------------------------------------------
+static uint32_t optimize_add_costs(uint32_t a, uint32_t b)
+{
+  return NOT_UNROLLABLE == a || NOT_UNROLLABLE == b ? NOT_UNROLLABLE : a + b;
+}
+//------------------------------------------------------------------------------
+static uint32_t optimize_statement_cost(PARSE_NODE *p_tree);
+//------------------------------------------------------------------------------
+static uint32_t optimize_statement_list_cost(LISTITEM *p_list)
+{
+  uint32_t result = 0;
+  for (LISTITEM *p_item = p_list; p_item; p_item = p_item->l_p_next)
+    result = optimize_add_costs(result, optimize_statement_cost(p_item->l_parse_node));
+  return result;
+}
+//------------------------------------------------------------------------------
+// RETURNS: about how many instructions p_tree compiles to, NOT_UNROLLABLE if
+// loops holding it aren't unrolled (see THEORY).
+static uint32_t optimize_statement_cost(PARSE_NODE *p_tree)
+{
+  if (!p_tree)
+    return 0;
+  switch (p_tree->nd_type)
+  {
+    case ND_STATEMENT_SEQUENCE:
+      return optimize_statement_list_cost(p_tree->nd_p_statement_seq);
+    case ND_ATOMIC_PRINT:
+      return optimize_add_costs(2, optimize_statement_list_cost(p_tree->nd_p_print_items));
+    case ND_ASSIGN:
+      return 1 + optimize_expr_cost(p_tree->nd_p_assign_expr);
+    case ND_IF:
+      return optimize_add_costs(1 + optimize_expr_cost(p_tree->nd_p_if_test_expr),
+                                optimize_add_costs(optimize_statement_cost(p_tree->nd_p_true_branch_statement_seq),
+                                                   optimize_statement_cost(p_tree->nd_p_false_branch_statement_seq)));
+    case ND_WHILE:
+      return optimize_add_costs(1 + optimize_expr_cost(p_tree->nd_p_while_test_expr),
+                                optimize_statement_cost(p_tree->nd_p_while_statement_seq));
+    case ND_PRINT_INT:
+    case ND_SLEEP:
+    case ND_RETURN:
+      return 1 + optimize_expr_cost(p_tree->nd_p_expr);
+    case ND_SEND:
+      return 1 + optimize_expr_cost(p_tree->nd_p_send_expr);
+    case ND_PRINT_CHAR:
+    case ND_PRINT_STRING:
+    case ND_RECEIVE:
+    case ND_STOP:
+      return 1;
+    case ND_CALL:
+      return 2;  // OP_CALL, OP_DROP
+    default:
+      return NOT_UNROLLABLE;
+  }
+}
+//------------------------------------------------------------------------------
+static PARSE_NODE *optimize_copy(PARSE_NODE *p_tree);
+//------------------------------------------------------------------------------
+static LISTITEM *optimize_copy_list(LISTITEM *p_list)
+{
+  LISTITEM *result = NULL;
+  LISTITEM **pp_link = &result;
+  for (LISTITEM *p_item = p_list; p_item; p_item = p_item->l_p_next)
+  {
+    *pp_link = malloc(sizeof(LISTITEM));
+    (*pp_link)->l_parse_node = optimize_copy(p_item->l_parse_node);
+    pp_link = &(*pp_link)->l_p_next;
+  }
+  *pp_link = NULL;
+  return result;
+}
+//------------------------------------------------------------------------------
+// RETURNS: a copy of expression or statement p_tree (one that
+// optimize_statement_cost() doesn't reject).
+static PARSE_NODE *optimize_copy(PARSE_NODE *p_tree)
+{
+  PARSE_NODE *result;
+  if (!p_tree)
+    return NULL;
+  result = malloc(sizeof(PARSE_NODE));
+  *result = *p_tree;
+  switch (p_tree->nd_type)
+  {
+    case ND_STATEMENT_SEQUENCE:
+      result->nd_p_statement_seq = optimize_copy_list(p_tree->nd_p_statement_seq);
+      break;
+    case ND_ATOMIC_PRINT:
+      result->nd_p_print_items = optimize_copy_list(p_tree->nd_p_print_items);
+      break;
+    case ND_ASSIGN:
+      result->nd_p_assign_expr = optimize_copy(p_tree->nd_p_assign_expr);
+      break;
+    case ND_IF:
+      result->nd_p_if_test_expr = optimize_copy(p_tree->nd_p_if_test_expr);
+      result->nd_p_true_branch_statement_seq = optimize_copy(p_tree->nd_p_true_branch_statement_seq);
+      result->nd_p_false_branch_statement_seq = optimize_copy(p_tree->nd_p_false_branch_statement_seq);
+      break;
+    case ND_WHILE:
+      result->nd_p_while_test_expr = optimize_copy(p_tree->nd_p_while_test_expr);
+      result->nd_p_while_statement_seq = optimize_copy(p_tree->nd_p_while_statement_seq);
+      break;
+    case ND_PRINT_INT:
+    case ND_SLEEP:
+    case ND_RETURN:
+    case ND_NEGATE:
+    case ND_NOT:
+      result->nd_p_expr = optimize_copy(p_tree->nd_p_expr);
+      break;
+    case ND_SEND:
+      result->nd_p_send_expr = optimize_copy(p_tree->nd_p_send_expr);
+      break;
+    default:
+      if (optimize_is_binary(p_tree->nd_type))
+      {
+        result->nd_p_left_expr = optimize_copy(p_tree->nd_p_left_expr);
+        result->nd_p_right_expr = optimize_copy(p_tree->nd_p_right_expr);
+      }
+      break;
+  }
+  return result;
+}
+//------------------------------------------------------------------------------
+// RETURNS: a new node of type nd_type at p_where's source position.
+static PARSE_NODE *optimize_new_node(uint8_t nd_type, PARSE_NODE *p_where)
+{
+  PARSE_NODE *result = malloc(sizeof(PARSE_NODE));
+  result->nd_type = nd_type;
+  result->nd_src_line = p_where->nd_src_line;
+  result->nd_src_col = p_where->nd_src_col;
+  return result;
+}
+//------------------------------------------------------------------------------
+static PARSE_NODE *optimize_new_number(int32_t n, PARSE_NODE *p_where)
+{
+  PARSE_NODE *result = optimize_new_node(ND_NUMBER, p_where);
+  result->nd_number = n;
+  return result;
+}
+//------------------------------------------------------------------------------
+static PARSE_NODE *optimize_new_binary(uint8_t nd_type, PARSE_NODE *p_left, PARSE_NODE *p_right)
+{
+  PARSE_NODE *result = optimize_new_node(nd_type, p_left);
+  result->nd_p_left_expr = p_left;
+  result->nd_p_right_expr = p_right;
+  return result;
+}
+//------------------------------------------------------------------------------
+// Links p_statement in at *pp_link.
+// RETURNS: the link after it.
+static LISTITEM **optimize_insert_statement(LISTITEM **pp_link, PARSE_NODE *p_statement)
+{
+  LISTITEM *p_item = malloc(sizeof(LISTITEM));
+  p_item->l_parse_node = p_statement;
+  p_item->l_p_next = *pp_link;
+  *pp_link = p_item;
+  return &p_item->l_p_next;
+}
+//------------------------------------------------------------------------------
+// A counted loop 'while i cl_nd_type b do ... i := i + c; end' (see THEORY).
+typedef struct COUNTED_LOOP COUNTED_LOOP;
+struct COUNTED_LOOP
+{
+  PARSE_NODE *cl_p_counter;  // i: ND_VARIABLE.
+  PARSE_NODE *cl_p_bound;  // b: ND_NUMBER or ND_VARIABLE.
+  uint8_t cl_nd_type;  // ND_LT, ND_LE, ND_GT or ND_GE.
+  int32_t cl_step;  // c
+};
+//------------------------------------------------------------------------------
+// RETURNS: the step of 'i := i + c' (or c + i, i - c) for i p_counter, 0 if
+// p_statement isn't one.
+static int32_t optimize_counter_step(PARSE_NODE *p_statement, PARSE_NODE *p_counter)
+{
+  PARSE_NODE *p_expr;
+  if (ND_ASSIGN != p_statement->nd_type || !STREQ(p_statement->nd_var_name, p_counter->nd_var_name))
+    return 0;
+  p_expr = p_statement->nd_p_assign_expr;
+  if (ND_ADD != p_expr->nd_type && ND_SUBTRACT != p_expr->nd_type)
+    return 0;
+  if (optimize_expr_equal(p_expr->nd_p_left_expr, p_counter)
+      && ND_NUMBER == p_expr->nd_p_right_expr->nd_type)
+  {
+    int32_t c = p_expr->nd_p_right_expr->nd_number;
+    if (ND_ADD == p_expr->nd_type)
+      return c;
+    return INT32_MIN == c ? 0 : -c;
+  }
+  if (ND_ADD == p_expr->nd_type && optimize_expr_equal(p_expr->nd_p_right_expr, p_counter)
+      && ND_NUMBER == p_expr->nd_p_left_expr->nd_type)
+    return p_expr->nd_p_left_expr->nd_number;
+  return 0;
+}
+//------------------------------------------------------------------------------
+// RETURNS: true if p_loop counts p_counter toward p_bound (see THEORY), and
+// then fills in *p_counted.
+static bool optimize_is_counted(PARSE_NODE *p_loop, PARSE_NODE *p_counter, PARSE_NODE *p_bound,
+                                uint8_t nd_type, COUNTED_LOOP *p_counted)
+{
+  PARSE_NODE *p_body = p_loop->nd_p_while_statement_seq;
+  LISTITEM *p_last;
+  int32_t step;
+  if (ND_VARIABLE != p_counter->nd_type || !p_body || ND_STATEMENT_SEQUENCE != p_body->nd_type
+      || !p_body->nd_p_statement_seq)
+    return false;
+  if (ND_VARIABLE == p_bound->nd_type)
+  {
+    if (STREQ(p_bound->nd_var_name, p_counter->nd_var_name)
+        || optimize_assigns(p_body, p_bound->nd_var_name))
+      return false;
+  }
+  else if (ND_NUMBER != p_bound->nd_type)
+    return false;
+  for (p_last = p_body->nd_p_statement_seq; p_last->l_p_next; p_last = p_last->l_p_next)
+    if (optimize_assigns(p_last->l_parse_node, p_counter->nd_var_name))
+      return false;
+  step = optimize_counter_step(p_last->l_parse_node, p_counter);
+  if ((ND_LT == nd_type || ND_LE == nd_type) ? step <= 0 : step >= 0)
+    return false;
+  p_counted->cl_p_counter = p_counter;
+  p_counted->cl_p_bound = p_bound;
+  p_counted->cl_nd_type = nd_type;
+  p_counted->cl_step = step;
+  return true;
+}
+//------------------------------------------------------------------------------
+// RETURNS: true if p_loop is a counted loop, described in *p_counted.
+static bool optimize_is_counted_loop(PARSE_NODE *p_loop, COUNTED_LOOP *p_counted)
+{
+  PARSE_NODE *p_test = p_loop->nd_p_while_test_expr;
+  uint8_t mirrored;  // 'b > i' is 'i < b'.
+  switch (p_test->nd_type)
+  {
+    case ND_LT:
+      mirrored = ND_GT;
+      break;
+    case ND_LE:
+      mirrored = ND_GE;
+      break;
+    case ND_GT:
+      mirrored = ND_LT;
+      break;
+    case ND_GE:
+      mirrored = ND_LE;
+      break;
+    default:
+      return false;
+  }
+  return optimize_is_counted(p_loop, p_test->nd_p_left_expr, p_test->nd_p_right_expr,
+                             p_test->nd_type, p_counted)
+         || optimize_is_counted(p_loop, p_test->nd_p_right_expr, p_test->nd_p_left_expr,
+                                mirrored, p_counted);
+}
+//------------------------------------------------------------------------------
+// Unroll the loop in **pp_item if it is a counted loop (see THEORY).
+// RETURNS: the link to the loop's LISTITEM, which the unrolled loop and the
+// statements setting its limit go before.
+static LISTITEM **optimize_unroll_loop(LISTITEM **pp_item)
+{
+  PARSE_NODE *p_loop = (*pp_item)->l_parse_node;
+  COUNTED_LOOP counted;
+  bool counts_up;
+  int64_t offset;  // l is b - offset.
+  uint32_t cost;
+  PARSE_NODE *p_limit;
+  PARSE_NODE *p_unrolled;
+  PARSE_NODE *p_body;
+  LISTITEM **pp_link;
+  if (g_unroll_factor < 2 || !optimize_is_counted_loop(p_loop, &counted))
+    return pp_item;
+  cost = optimize_statement_cost(p_loop->nd_p_while_statement_seq);
+  if (NOT_UNROLLABLE == cost || (uint64_t) cost*g_unroll_factor > g_unroll_limit)
+    return pp_item;
+  // The unrolled loop tests i < l (i > l counting down).  For 'i <= b' that
+  // is l = b - (k-1)*c + 1, for 'i >= b' l = b - (k-1)*c - 1.
+  counts_up = counted.cl_step > 0;
+  offset = (int64_t) (g_unroll_factor - 1)*counted.cl_step;
+  if (ND_LE == counted.cl_nd_type)
+    offset -= 1;
+  else if (ND_GE == counted.cl_nd_type)
+    offset += 1;
+  if (offset > INT32_MAX || offset < -INT32_MAX)
+    return pp_item;
+  pp_link = pp_item;
+  if (ND_NUMBER == counted.cl_p_bound->nd_type)
+  {
+    int64_t limit = counted.cl_p_bound->nd_number - offset;
+    if (limit < INT32_MIN || limit > INT32_MAX)
+      return pp_item;  // The unrolled loop would never run.
+    p_limit = optimize_new_number((int32_t) limit, p_loop);
+  }
+  else
+  {
+    // '<limit_N> := b - offset;'
+    PARSE_NODE *p_assign = optimize_new_node(ND_ASSIGN, p_loop);
+    snprintf(p_assign->nd_var_name, MAX_STR, "<limit_%u>", g_n_limits++);
+    p_assign->nd_p_assign_expr = offset < 0
+      ? optimize_new_binary(ND_ADD, optimize_copy(counted.cl_p_bound), optimize_new_number(-offset, p_loop))
+      : optimize_new_binary(ND_SUBTRACT, optimize_copy(counted.cl_p_bound), optimize_new_number(offset, p_loop));
+    p_limit = optimize_new_variable(p_assign);
+    pp_link = optimize_insert_statement(pp_link, p_assign);
+    if (0 != offset)
+    {
+      // 'if <limit_N> > b then <limit_N> := INT32_MIN; end;' (or the other
+      // way around counting down).
+      PARSE_NODE *p_if = optimize_new_node(ND_IF, p_loop);
+      PARSE_NODE *p_wrapped = optimize_new_node(ND_ASSIGN, p_loop);
+      strcpy(p_wrapped->nd_var_name, p_assign->nd_var_name);
+      p_wrapped->nd_p_assign_expr = optimize_new_number(counts_up ? INT32_MIN : INT32_MAX, p_loop);
+      p_if->nd_p_if_test_expr = optimize_new_binary(counts_up ? ND_GT : ND_LT,
+                                                    optimize_new_variable(p_assign),
+                                                    optimize_copy(counted.cl_p_bound));
+      p_if->nd_p_true_branch_statement_seq = optimize_new_node(ND_STATEMENT_SEQUENCE, p_loop);
+      p_if->nd_p_true_branch_statement_seq->nd_p_statement_seq = NULL;
+      optimize_insert_statement(&p_if->nd_p_true_branch_statement_seq->nd_p_statement_seq, p_wrapped);
+      p_if->nd_p_false_branch_statement_seq = NULL;
+      pp_link = optimize_insert_statement(pp_link, p_if);
+    }
+  }
+  p_unrolled = optimize_new_node(ND_WHILE, p_loop);
+  p_unrolled->nd_p_while_test_expr = optimize_new_binary(counts_up ? ND_LT : ND_GT,
+                                                         optimize_copy(counted.cl_p_counter), p_limit);
+  p_body = p_unrolled->nd_p_while_statement_seq = optimize_new_node(ND_STATEMENT_SEQUENCE, p_loop);
+  p_body->nd_p_statement_seq = NULL;
+  for (uint32_t i = 0; i < g_unroll_factor; ++i)
+  {
+    LISTITEM *p_copy = optimize_copy_list(p_loop->nd_p_while_statement_seq->nd_p_statement_seq);
+    LISTITEM *p_copy_last = p_copy;
+    while (p_copy_last->l_p_next)
+      p_copy_last = p_copy_last->l_p_next;
+    p_copy_last->l_p_next = p_body->nd_p_statement_seq;
+    p_body->nd_p_statement_seq = p_copy;
+  }
+  g_p_stats->os_n_unrolled += 1;
+  return optimize_insert_statement(pp_link, p_unrolled);
+}
+//------------------------------------------------------------------------------
+static void optimize_unroll_loops(PARSE_NODE *p_tree);
+//------------------------------------------------------------------------------
+static void optimize_unroll_loops_in_list(LISTITEM **pp_list)
+{
+  for (LISTITEM **pp_item = pp_list; *pp_item; pp_item = &(*pp_item)->l_p_next)
+  {
+    PARSE_NODE *p_statement = (*pp_item)->l_parse_node;
+    optimize_unroll_loops(p_statement);
+    if (p_statement && ND_WHILE == p_statement->nd_type)
+      pp_item = optimize_unroll_loop(pp_item);
+  }
+}
+//------------------------------------------------------------------------------
+// Unroll the counted loops in the statement sequences of p_tree, innermost
+// first.
+static void optimize_unroll_loops(PARSE_NODE *p_tree)
+{
+  if (!p_tree)
+    return;
+  switch (p_tree->nd_type)
+  {
+    case ND_MODULE_DECLARATION:
+      optimize_unroll_loops(p_tree->nd_p_init_statements);
+      for (LISTITEM *p_item = p_tree->nd_p_task_decl_list; p_item; p_item = p_item->l_p_next)
+        optimize_unroll_loops(p_item->l_parse_node);
+      break;
+    case ND_TASK_DECLARATION:
+      optimize_unroll_loops(p_tree->nd_p_task_body);
+      break;
+    case ND_STATEMENT_SEQUENCE:
+      optimize_unroll_loops_in_list(&p_tree->nd_p_statement_seq);
+      break;
+    case ND_IF:
+      optimize_unroll_loops(p_tree->nd_p_true_branch_statement_seq);
+      optimize_unroll_loops(p_tree->nd_p_false_branch_statement_seq);
+      break;
+    case ND_WHILE:
+      optimize_unroll_loops(p_tree->nd_p_while_statement_seq);
+      break;
+    case ND_EVERY:
+      optimize_unroll_loops(p_tree->nd_p_every_statement_seq);
+      break;
+    case ND_CRITICAL:
+      optimize_unroll_loops(p_tree->nd_p_critical_statement_seq);
+      break;
+    case ND_SPAWN_JOIN_WITH_TIMEOUT:
+      optimize_unroll_loops(p_tree->nd_p_statement_seq_if_timed_out);
+      optimize_unroll_loops(p_tree->nd_p_statement_seq_if_not_timed_out);
+      break;
+    case ND_SELECT:
+      for (LISTITEM *p_item = p_tree->nd_p_select_cases; p_item; p_item = p_item->l_p_next)
+        optimize_unroll_loops(p_item->l_parse_node->nd_p_select_statement_seq);
+      break;
+    default:
+      break;
+  }
+}
+//------------------------------------------------------------------------------
+void optimize_fold(PARSE_NODE *p_tree, OPT_STATS *p_stats)
+{
+  g_p_stats = p_stats;
+  optimize_for_each_expr(p_tree, optimize_fold_expr, NULL);
+}
+//------------------------------------------------------------------------------
+void optimize_code_motion(PARSE_NODE *p_tree, OPT_STATS *p_stats)
+{
+  g_p_stats = p_stats;
+  optimize_move_code(p_tree);
+}
+//------------------------------------------------------------------------------
+void optimize_unroll(PARSE_NODE *p_tree, OPT_STATS *p_stats)
+{
+  g_p_stats = p_stats;
+  optimize_unroll_loops(p_tree);
+}
+//------------------------------------------------------------------------------
+// --unroll: how many times over counted loops are unrolled (below 2: not at all).
+void optimize_set_unroll_factor(uint32_t factor)
+{
+  g_unroll_factor = factor;
+}
+//------------------------------------------------------------------------------
+// --unroll-limit: most instructions an unrolled loop's body may take.
+void optimize_set_unroll_limit(uint32_t n_instructions)
+{
+  g_unroll_limit = n_instructions;
+}
+//------------------------------------------------------------------------------
+void optimize_print_stats(FILE *fout, OPT_STATS *p_stats)
+{
+  fprintf(fout, "constant expressions folded: %u\n", p_stats->os_n_folded);
+  fprintf(fout, "identities simplified: %u\n", p_stats->os_n_simplified);
+  fprintf(fout, "constant branches folded: %u\n", p_stats->os_n_branches_folded);
+  fprintf(fout, "unreachable instructions removed: %u\n", p_stats->os_n_dead_removed);
+  fprintf(fout, "jumps threaded: %u\n", p_stats->os_n_jumps_threaded);
+  fprintf(fout, "conditional jumps inverted: %u\n", p_stats->os_n_jumps_inverted);
+  fprintf(fout, "jumps to next instruction removed: %u\n", p_stats->os_n_jumps_removed);
+  fprintf(fout, "multiplications/divisions by constants reduced: %u\n",
+          p_stats->os_n_strength_reduced);
+  fprintf(fout, "loop-invariant expressions hoisted: %u\n", p_stats->os_n_hoisted);
+  fprintf(fout, "common subexpressions shared: %u\n", p_stats->os_n_shared);
+  fprintf(fout, "values propagated as constants: %u\n", p_stats->os_n_propagated);
+  fprintf(fout, "unused values removed: %u\n", p_stats->os_n_dead_values);
+  fprintf(fout, "loops unrolled: %u\n", p_stats->os_n_unrolled);
+  fprintf(fout, "instructions removed with dead stores: %u\n", p_stats->os_n_dead_stores);
+}
@@ -0,0 +1,34 @@
+#pragma once
+//------------------------------------------------------------------------------
+// Parse tree optimizations run by mpc between parse() and compile().  See
+// optimize.c.  Those on the IR are in ir.c, bytecode optimizations that follow
+// compile() in code-opt.c, and passes.c decides which of them run.
+//------------------------------------------------------------------------------
+#define OPT_UNROLL_FACTOR 4  // Default --unroll.
+#define OPT_UNROLL_LIMIT 64  // Default --unroll-limit (instructions).
+//------------------------------------------------------------------------------
+typedef struct OPT_STATS OPT_STATS;
+struct OPT_STATS
+{
+  uint32_t os_n_folded;  // Constant subexpressions replaced by their value.
+  uint32_t os_n_simplified;  // Identities (x+0, x*1, ...) rewritten.
+  uint32_t os_n_branches_folded;  // Conditional jumps on a constant.
+  uint32_t os_n_dead_removed;  // Unreachable instructions dropped.
+  uint32_t os_n_jumps_threaded;  // Jumps sent to the end of an OP_JUMP chain.
+  uint32_t os_n_jumps_inverted;  // Conditional jumps over an OP_JUMP.
+  uint32_t os_n_jumps_removed;  // Jumps to the next instruction.
+  uint32_t os_n_strength_reduced;  // '*', '/', '%' by a constant rewritten.
+  uint32_t os_n_hoisted;  // Loop-invariant expressions moved out of a loop.
+  uint32_t os_n_shared;  // Repeated subexpressions replaced by a temporary.
+  uint32_t os_n_propagated;  // IR values found to be constants.
+  uint32_t os_n_dead_values;  // IR values computed but never used.
+  uint32_t os_n_unrolled;  // Counted loops unrolled.
+  uint32_t os_n_dead_stores;  // Instructions removed storing values never read.
+};
+//------------------------------------------------------------------------------
+void optimize_fold(PARSE_NODE *p_tree, OPT_STATS *p_stats);
+void optimize_code_motion(PARSE_NODE *p_tree, OPT_STATS *p_stats);
+void optimize_unroll(PARSE_NODE *p_tree, OPT_STATS *p_stats);
+void optimize_set_unroll_factor(uint32_t factor);
+void optimize_set_unroll_limit(uint32_t n_instructions);
+void optimize_print_stats(FILE *fout, OPT_STATS *p_stats);
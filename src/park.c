@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <util.h>
+//------------------------------------------------------------------------------
+#include "park.h"
+//------------------------------------------------------------------------------
+// THEORY OF OPERATION:
+//
+// A PARK_EVENT  is an  "event count".   A task  that finds  that it  can't make
+// progress (channel  full, channel  empty, ...)  parks on the  event like this:
+//
+//     while (!try_operation())
+//     {
+//       key = park_prepare_wait(p_event);
+//       if (try_operation())
+//       {
+//         park_cancel_wait(p_event);
+//         break;
+//       }
+//       park_wait(p_event, key, NULL);
+//     }
+//
+// The task  that makes progress possible  calls park_notify_all() *after* its
+// operation is  visible.  The  waiter count  is incremented  before the  second
+// try_operation() and read by  the notifier after its operation, so  either the
+// waiter sees the  operation or the notifier  sees the waiter.  If  the notifier
+// bumps pe_seq between park_prepare_wait() and  the futex call, the kernel sees
+// that pe_seq != key and park_wait() returns at once.
+//
+// Notifiers pay one fence and one load when nobody is waiting.
+//
+// A task that waits for any of several events (a 'select' on several channels)
+// parks on  an event of  its own and  links it to each  of them with
+// park_link(): a notify of a linked event also notifies the task's event.  The
+// links are counted in  the high bits of  pe_n_waiters, so  the notifier's one
+// load sees both; events without links or waiters stay on the fast path.  The
+// waiter calls park_prepare_wait() on its  own event first, then park_link(),
+// then retries, so a forwarded notify either  finds the waiter or is seen by
+// the retry.
+//------------------------------------------------------------------------------
+void park_event_init(PARK_EVENT *p_event)
+{
+  atomic_init(&p_event->pe_seq, 0);
+  atomic_init(&p_event->pe_n_waiters, 0);
+  atomic_init(&p_event->pe_links_lock, false);
+  p_event->pe_p_links = NULL;
+}
+//------------------------------------------------------------------------------
+// RETURNS: key to pass to park_wait().
+uint32_t park_prepare_wait(PARK_EVENT *p_event)
+{
+  uint32_t key = atomic_load(&p_event->pe_seq);
+  atomic_fetch_add(&p_event->pe_n_waiters, 1);
+  return key;
+}
+//------------------------------------------------------------------------------
+// Undo park_prepare_wait() when the retried operation succeeded.
+void park_cancel_wait(PARK_EVENT *p_event)
+{
+  atomic_fetch_sub(&p_event->pe_n_waiters, 1);
+}
+//------------------------------------------------------------------------------
+// Block until p_event is notified after park_prepare_wait() returned key, or
+// until *p_timeout (relative) expires.  p_timeout == NULL waits forever.
+// Spurious wakeups are possible: the caller always retries its operation.
+// RETURNS: false if the timeout expired.
+bool park_wait(PARK_EVENT *p_event, uint32_t key, struct timespec *p_timeout)
+{
+  bool result = true;
+  if (key == atomic_load(&p_event->pe_seq))
+  {
+    if (syscall(SYS_futex, &p_event->pe_seq, FUTEX_WAIT_PRIVATE, key, p_timeout,
+                NULL, 0) < 0 && ETIMEDOUT == errno)
+      result = false;
+  }
+  atomic_fetch_sub(&p_event->pe_n_waiters, 1);
+  return result;
+}
+//------------------------------------------------------------------------------
+static void park_lock_links(PARK_EVENT *p_event)
+{
+  while (atomic_exchange_explicit(&p_event->pe_links_lock, true, memory_order_acquire))
+    CPU_RELAX();
+}
+//------------------------------------------------------------------------------
+static void park_unlock_links(PARK_EVENT *p_event)
+{
+  atomic_store_explicit(&p_event->pe_links_lock, false, memory_order_release);
+}
+//------------------------------------------------------------------------------
+void park_notify_all(PARK_EVENT *p_event)
+{
+  uint32_t n_waiters;
+  atomic_thread_fence(memory_order_seq_cst);
+  n_waiters = atomic_load_explicit(&p_event->pe_n_waiters, memory_order_relaxed);
+  if (n_waiters & PARK_WAITERS_MASK)
+  {
+    atomic_fetch_add(&p_event->pe_seq, 1);
+    syscall(SYS_futex, &p_event->pe_seq, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL,
+            NULL, 0);
+  }
+  if (n_waiters >= PARK_LINK_UNIT)
+  {
+    park_lock_links(p_event);
+    for (PARK_LINK *p_link = p_event->pe_p_links; p_link; p_link = p_link->pl_p_next)
+      park_notify_all(p_link->pl_p_target);
+    park_unlock_links(p_event);
+  }
+}
+//------------------------------------------------------------------------------
+// Notify p_target too each time p_event is notified, until park_unlink().
+// p_link is owned by the caller.  Like park_prepare_wait(), call it before the
+// last retry of the operation.
+void park_link(PARK_EVENT *p_event, PARK_LINK *p_link, PARK_EVENT *p_target)
+{
+  p_link->pl_p_target = p_target;
+  park_lock_links(p_event);
+  p_link->pl_p_next = p_event->pe_p_links;
+  p_event->pe_p_links = p_link;
+  park_unlock_links(p_event);
+  atomic_fetch_add(&p_event->pe_n_waiters, PARK_LINK_UNIT);
+}
+//------------------------------------------------------------------------------
+void park_unlink(PARK_EVENT *p_event, PARK_LINK *p_link)
+{
+  PARK_LINK **pp_link;
+  park_lock_links(p_event);
+  for (pp_link = &p_event->pe_p_links; *pp_link != p_link; pp_link = &(*pp_link)->pl_p_next)
+    ;
+  *pp_link = p_link->pl_p_next;
+  atomic_fetch_sub(&p_event->pe_n_waiters, PARK_LINK_UNIT);
+  park_unlock_links(p_event);
+}
@@ -0,0 +1,39 @@
+#pragma once
+//------------------------------------------------------------------------------
+// Futex-based parking for blocked tasks.  See park.c.
+//------------------------------------------------------------------------------
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX() __builtin_ia32_pause()
+#else
+#define CPU_RELAX() do {} while (0)
+#endif
+#define PARK_SPIN_TRIES 128  // Retries before a blocked task parks.
+//------------------------------------------------------------------------------
+#define PARK_LINK_UNIT (1u << 16)  // pe_n_waiters share of each PARK_LINK.  Caps
+                                   // the tasks parked on one event at 65535.
+#define PARK_WAITERS_MASK (PARK_LINK_UNIT - 1)
+//------------------------------------------------------------------------------
+typedef struct PARK_EVENT PARK_EVENT;
+typedef struct PARK_LINK PARK_LINK;
+struct PARK_EVENT
+{
+  atomic_uint pe_seq;  // Bumped by every notify that finds a waiter.
+  atomic_uint pe_n_waiters;  // Parked tasks + PARK_LINK_UNIT per link.
+  atomic_bool pe_links_lock;  // Guards pe_p_links.
+  PARK_LINK *pe_p_links;  // Events notified along with this one.
+};
+//------------------------------------------------------------------------------
+// Forwards the notifies of one event to another (see park_link()).
+struct PARK_LINK
+{
+  PARK_LINK *pl_p_next;
+  PARK_EVENT *pl_p_target;
+};
+//------------------------------------------------------------------------------
+void park_event_init(PARK_EVENT *p_event);
+uint32_t park_prepare_wait(PARK_EVENT *p_event);
+void park_cancel_wait(PARK_EVENT *p_event);
+bool park_wait(PARK_EVENT *p_event, uint32_t key, struct timespec *p_timeout);
+void park_notify_all(PARK_EVENT *p_event);
+void park_link(PARK_EVENT *p_event, PARK_LINK *p_link, PARK_EVENT *p_target);
+void park_unlink(PARK_EVENT *p_event, PARK_LINK *p_link);
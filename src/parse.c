@@ -20,25 +20,49 @@
 //
 // ND_MODULE:
 //       module-declaration  = 'module' name
+//                             (object-declaration ';')*
 //                             'init' statement-sequence 'end' ';'
 //                             task-declaration* 'end'
+// ND_CHANNEL_DECLARATION, ND_BARRIER_DECLARATION, ND_EVENT_DECLARATION,
+// ND_LOCK_DECLARATION:
+//       object-declaration  = 'channel' name number
+//                           | 'barrier' name number
+//                           | 'event' name
+//                           | 'lock' name
 // ND_TASK_DECLARATION:
-//          task-declaration = 'task' name statement-sequence 'end'
+//          task-declaration = 'task' name ['priority' ['-'] number]
+//                             statement-sequence 'end'
 //
 // ND_STATEMENT_SEQUENCE:
 //        statement-sequence = (statement ';')*
 //                 statement = assignment-statement
 //                           | if-statement
 //                           | while-statement
+//                           | every-statement
 //                           | stop-statement
 //                           | spawn-statement
 //                           | print-int-statement
 //                           | print-char-statement
 //                           | sleep-statement
 //                           | print-statement
+//                           | send-statement
+//                           | receive-statement
+//                           | select-statement
+//                           | call-statement
+//                           | return-statement
+//                           | wait-statement
+//                           | signal-statement
+//                           | reset-statement
+//                           | critical-statement
 //
 // ND_ASSIGN:
-//     assignment-statement = variable-name ':=' expression
+//     assignment-statement = variable-name ':=' (expression | call-statement)
+//
+// ND_CALL:
+//           call-statement = 'call' task-name
+//
+// ND_RETURN:
+//         return-statement = 'return' or-expression
 //
 // ND_IF:
 //             if-statement = 'if' expression 'then' statement-sequence
@@ -47,15 +71,23 @@
 // ND_WHILE:
 //          while-statement = 'while' expression 'do' statement-sequence 'end'
 //
+// ND_EVERY:
+//          every-statement = 'every' expression 'do' statement-sequence 'end'
+//
 // ND_STOP:
 //           stop-statement = 'stop'
 //
 // ND_SPAWN:
 //          spawn-statement = 'spawn' (name ';')+
-//                            'join' [timeout-clause]
+//                            ['limit' expression]
+//                            'join' ('first' name ['cancel']
+//                                    | 'reduce' reduce-op name
+//                                    | [timeout-clause])
+//
+//                reduce-op = 'sum' | 'min' | 'max' | 'and' | 'or' | 'xor' 
 //
 //           timeout = 'wait' time-unit '(' expression ')'
-//                      'timeout' statement-sequence
+//                      'timeout' ['cancel'] statement-sequence
 //                      ['else' statement-sequence]
 //                      'end'
 // ND_SLEEP:
@@ -65,6 +97,32 @@
 // ND_PRINT_INT:
 //      print-int-statement = 'print_int' expression
 //
+// ND_SEND:
+//           send-statement = 'send' channel-name ',' or-expression
+//
+// ND_RECEIVE:
+//        receive-statement = 'receive' channel-name ',' variable-name
+//
+// ND_SYNC_WAIT:
+//           wait-statement = 'wait' (barrier-name | event-name)
+//
+// ND_SIGNAL:
+//         signal-statement = 'signal' event-name
+//
+// ND_RESET:
+//          reset-statement = 'reset' event-name
+//
+// ND_CRITICAL:
+//       critical-statement = 'critical' lock-name statement-sequence 'end'
+//
+// ND_SELECT:
+//         select-statement = 'select' select-case+ 'end'
+// ND_SELECT_CASE:
+//              select-case = 'case' (send-statement | receive-statement)
+//                                   'then' statement-sequence
+//                          | 'case' 'wait' expression
+//                                   'timeout' statement-sequence
+//
 // ND_PRINT_CHAR:
 //   print-char-statement = 'print_char' character-constant
 //
@@ -132,7 +190,7 @@ void parse_print_tree(uint32_t indent_level, PARSE_NODE *const p_tree)
         printf("%d\n", p_tree->nd_number);
         break;
       case ND_VARIABLE:
-        printf("%c\n", p_tree->nd_var_name);
+        printf("%s\n", p_tree->nd_var_name);
         break;
       case ND_MULTIPLY:
       case ND_DIVIDE:
@@ -157,7 +215,7 @@ void parse_print_tree(uint32_t indent_level, PARSE_NODE *const p_tree)
         parse_print_tree(indent_level + 1, p_tree->nd_p_expr);
         break;
       case ND_ASSIGN:
-        printf("%c\n", p_tree->nd_var_name);
+        printf("%s\n", p_tree->nd_var_name);
         parse_print_tree(indent_level + 1, p_tree->nd_p_assign_expr);
         break;
       case ND_STATEMENT_SEQUENCE:
@@ -178,8 +236,14 @@ void parse_print_tree(uint32_t indent_level, PARSE_NODE *const p_tree)
         parse_print_tree(indent_level + 1, p_tree->nd_p_while_test_expr);
         parse_print_tree(indent_level + 1, p_tree->nd_p_true_branch_statement_seq);
         break;
+      case ND_EVERY:
+        printf("\n");
+        parse_print_tree(indent_level + 1, p_tree->nd_p_every_millisec_expr);
+        parse_print_tree(indent_level + 1, p_tree->nd_p_every_statement_seq);
+        break;
       case ND_SPAWN_JOIN:
       case ND_SPAWN_JOIN_WITH_TIMEOUT:
+      case ND_SPAWN_JOIN_FIRST:
         for (LISTITEM *p_name = p_tree->nd_p_task_names;
              p_name;
              p_name = p_name->l_p_next)
@@ -189,8 +253,24 @@ void parse_print_tree(uint32_t indent_level, PARSE_NODE *const p_tree)
             printf(", ");
         }
         printf("\n");
+        if (ND_SPAWN_JOIN == p_tree->nd_type && p_tree->nd_reduce_op[0])
+        {
+          parse_print_indent(indent_level + 1, '*');
+          printf(" reduce %s %s\n", p_tree->nd_reduce_op, p_tree->nd_reduce_var_name);
+        }
+        if (ND_SPAWN_JOIN_FIRST == p_tree->nd_type)
+        {
+          parse_print_indent(indent_level + 1, '*');
+          printf(" first %s%s\n", p_tree->nd_first_var_name,
+                 p_tree->nd_cancel_rest ? " cancel" : "");
+        }
         if (ND_SPAWN_JOIN_WITH_TIMEOUT == p_tree->nd_type)
         {
+          if (p_tree->nd_cancel_on_timeout)
+          {
+            parse_print_indent(indent_level + 1, '*');
+            printf(" cancel\n");
+          }
           parse_print_tree(indent_level + 1, p_tree->nd_p_millisec_expr);
           parse_print_tree(indent_level + 1, p_tree->nd_p_statement_seq_if_timed_out);
           parse_print_tree(indent_level + 1, p_tree->nd_p_statement_seq_if_not_timed_out);
@@ -199,20 +279,67 @@ void parse_print_tree(uint32_t indent_level, PARSE_NODE *const p_tree)
       case ND_PRINT_CHAR:
         printf("%s\n", ASCII[(uint8_t) p_tree->nd_char]);
         break;
+      case ND_CALL:
+        printf("%s\n", p_tree->nd_callee_name);
+        break;
       case ND_PRINT_INT:
       case ND_SLEEP:
+      case ND_RETURN:
         printf("\n");
         parse_print_tree(indent_level + 1, p_tree->nd_p_expr);
         break;
       case ND_STOP:
         printf("\n");
         break;
+      case ND_CHANNEL_DECLARATION:
+      case ND_BARRIER_DECLARATION:
+        printf("%s %d\n", p_tree->nd_object_name, p_tree->nd_object_size);
+        break;
+      case ND_EVENT_DECLARATION:
+      case ND_LOCK_DECLARATION:
+        printf("%s\n", p_tree->nd_object_name);
+        break;
+      case ND_SYNC_WAIT:
+      case ND_SIGNAL:
+      case ND_RESET:
+        printf("%s\n", p_tree->nd_sync_object_name);
+        break;
+      case ND_CRITICAL:
+        printf("%s\n", p_tree->nd_sync_object_name);
+        parse_print_tree(indent_level + 1, p_tree->nd_p_critical_statement_seq);
+        break;
+      case ND_SEND:
+        printf("%s\n", p_tree->nd_channel_name);
+        parse_print_tree(indent_level + 1, p_tree->nd_p_send_expr);
+        break;
+      case ND_RECEIVE:
+        printf("%s %s\n", p_tree->nd_channel_name, p_tree->nd_receive_var_name);
+        break;
+      case ND_SELECT:
+        printf("\n");
+        for (LISTITEM *p_case = p_tree->nd_p_select_cases;
+             p_case;
+             p_case = p_case->l_p_next)
+          parse_print_tree(indent_level + 1, p_case->l_parse_node);
+        break;
+      case ND_SELECT_CASE:
+        printf("%s\n", p_tree->nd_p_select_op ? "" : "timeout");
+        parse_print_tree(indent_level + 1, p_tree->nd_p_select_op);
+        parse_print_tree(indent_level + 1, p_tree->nd_p_select_millisec_expr);
+        parse_print_tree(indent_level + 1, p_tree->nd_p_select_statement_seq);
+        break;
       case ND_TASK_DECLARATION:
-        printf("%s\n", p_tree->nd_task_name);
+        printf("%s priority %d\n", p_tree->nd_task_name, p_tree->nd_task_priority);
         parse_print_tree(indent_level + 1, p_tree->nd_p_task_body);
         break;
       case ND_MODULE_DECLARATION:
         printf("%s\n", p_tree->nd_module_name);
+        for (LISTITEM *p_object_decl = p_tree->nd_p_object_decl_list;
+             p_object_decl;
+             p_object_decl = p_object_decl->l_p_next)
+        {
+          parse_print_tree(indent_level + 1, p_object_decl->l_parse_node);
+        }
         parse_print_tree(indent_level + 1, p_tree->nd_p_init_statements);
         for (LISTITEM *p_task_decl = p_tree->nd_p_task_decl_list;
              p_task_decl;
@@ -282,14 +409,22 @@ static PARSE_NODE *parse_number(void)
   return retval;
 }
 //------------------------------------------------------------------------------
+// Copy  the  name at  the  current  lexical unit  into  dest  and scan  past  it.
+static void parse_name(char *dest)
+{
+  parse_expect(LX_IDENTIFIER, false);
+  strncpy(dest, g_current_lex_unit.l_name, MAX_STR - 1);
+  dest[MAX_STR - 1] = '\0';
+  lex_scan();  // Skip past name.
+}
+//------------------------------------------------------------------------------
 static PARSE_NODE *parse_variable_name(void)
 {
   PARSE_NODE *retval = NULL;
   retval = malloc(sizeof(PARSE_NODE));
   SET_SRC_POS(retval);
   retval->nd_type = ND_VARIABLE;
-  retval->nd_var_name = toupper(g_current_lex_unit.l_name[0]);  // Variable names are one character long.
-  lex_scan();  // Skip over variable name.
+  parse_name(retval->nd_var_name);
   return retval;
 }
 //------------------------------------------------------------------------------
@@ -490,16 +625,20 @@ static PARSE_NODE *parse_or_expression(void)
   return retval;
 }
 //------------------------------------------------------------------------------
-// assignment-statement = variable-name ':=' or-expression
+static PARSE_NODE *parse_call(void);
+//------------------------------------------------------------------------------
+// assignment-statement = variable-name ':=' (or-expression | call-statement)
 static PARSE_NODE *parse_assignment(void)
 {
   PARSE_NODE *retval = malloc(sizeof(PARSE_NODE));
   SET_SRC_POS(retval);
   retval->nd_type = ND_ASSIGN;
-  retval->nd_var_name = toupper(g_current_lex_unit.l_name[0]);
-  lex_scan();  // Skip over variable name.
+  parse_name(retval->nd_var_name);
   parse_expect(LX_ASSIGN_SYM, true);
-  retval->nd_p_assign_expr = parse_or_expression();
+  if (LX_CALL_KW == g_current_lex_unit.l_type)
+    retval->nd_p_assign_expr = parse_call();
+  else
+    retval->nd_p_assign_expr = parse_or_expression();
   return retval;
 }
 //------------------------------------------------------------------------------
@@ -521,7 +660,8 @@ static PARSE_NODE *parse_statement_sequence(void)
   // else
   //   x := 666;
   // end
-  while (LX_ELSE_KW != g_current_lex_unit.l_type && LX_END_KW != g_current_lex_unit.l_type) {
+  while (LX_ELSE_KW != g_current_lex_unit.l_type && LX_END_KW != g_current_lex_unit.l_type
+         && LX_CASE_KW != g_current_lex_unit.l_type) {
     p_statement = malloc(sizeof(LISTITEM));
     p_statement->l_p_next = NULL;
     p_statement->l_parse_node = parse_statement();
@@ -570,13 +710,46 @@ static PARSE_NODE *parse_while(void)
   return retval;
 }
 //------------------------------------------------------------------------------
+// every-statement = 'every' expression 'do' statement-sequence 'end'
+//
+// Run the statements every <expression> milliseconds, for as long as the task
+// runs ('stop', 'return' or cancellation leave the loop).  Periods are measured
+// from when the loop was entered, so a slow pass doesn't push back the next.
+static PARSE_NODE *parse_every(void)
+{
+  PARSE_NODE *retval = malloc(sizeof(PARSE_NODE));
+  SET_SRC_POS(retval);
+  retval->nd_type = ND_EVERY;
+  lex_scan();  // Skip over 'every'.
+  retval->nd_p_every_millisec_expr = parse_or_expression();
+  parse_expect(LX_DO_KW, true);
+  retval->nd_p_every_statement_seq = parse_statement_sequence();
+  parse_expect(LX_END_KW, true);
+  return retval;
+}
+//------------------------------------------------------------------------------
 //spawn-statement = 'spawn' (name ';')+
-//                  'join' [timeout]
+//                  ['limit' expression]
+//                  'join' ('first' name ['cancel']
+//                          | 'reduce' reduce-op name
+//                          | [timeout])
 //
 // timeout = 'wait' expression
-//            'timeout' statement-sequence
+//            'timeout' ['cancel'] statement-sequence
 //            ['else' statement-sequence]
 //            'end'
+//
+// 'cancel' stops tasks still running when the wait times out (see exec.c).
+//
+// 'limit' n keeps at most n of the tasks running at once.  The others start, in
+// order, as running ones stop.
+//
+// 'join' 'first' x continues as soon as any one of the tasks stops and sets x to
+// its position in the list (from 0).  The rest are cancelled ('cancel') or left
+// running on their own.
+//
+// 'join' 'reduce' op x waits for all the tasks and combines the values they
+// 'return'ed (0 if they didn't) with op into x.
 static PARSE_NODE *parse_spawn(void)
 {
   PARSE_NODE *retval = malloc(sizeof(PARSE_NODE));
@@ -586,6 +759,10 @@ static PARSE_NODE *parse_spawn(void)
   lex_scan();   // Skip over 'spawn'.
   retval->nd_type = ND_SPAWN_JOIN;
   retval->nd_p_task_names = NULL;
+  retval->nd_p_limit_expr = NULL;
+  retval->nd_reduce_op[0] = '\0';
+  retval->nd_p_millisec_expr = NULL;
+  retval->nd_cancel_on_timeout = false;
   // parse 1st part : 'spawn' (name ';')+ 'join'
   do
   {
@@ -600,17 +777,52 @@ static PARSE_NODE *parse_spawn(void)
     else
       p_prev_name->l_p_next = p_current_name;
     p_prev_name = p_current_name;
-  } while (LX_JOIN_KW != g_current_lex_unit.l_type);
-  lex_scan();  // Skip past 'join'.
-  if (LX_WAIT_KW == g_current_lex_unit.l_type)
+  } while (LX_JOIN_KW != g_current_lex_unit.l_type
+           && LX_LIMIT_KW != g_current_lex_unit.l_type);
+  if (LX_LIMIT_KW == g_current_lex_unit.l_type)
+  {
+    lex_scan();  // Skip past 'limit'.
+    retval->nd_p_limit_expr = parse_or_expression();
+  }
+  parse_expect(LX_JOIN_KW, true);
+  if (LX_FIRST_KW == g_current_lex_unit.l_type)
+  {
+    lex_scan();  // Skip past 'first'.
+    retval->nd_type = ND_SPAWN_JOIN_FIRST;
+    parse_name(retval->nd_first_var_name);
+    retval->nd_cancel_rest = LX_CANCEL_KW == g_current_lex_unit.l_type;
+    if (retval->nd_cancel_rest)
+      lex_scan();  // Skip past 'cancel'.
+  }
+  else if (LX_REDUCE_KW == g_current_lex_unit.l_type)
+  {
+    lex_scan();  // Skip past 'reduce'.
+    // 'and' and 'or' are keywords; the compiler checks the other names.
+    if (LX_AND_KW == g_current_lex_unit.l_type)
+      strcpy(retval->nd_reduce_op, "and");
+    else if (LX_OR_KW == g_current_lex_unit.l_type)
+      strcpy(retval->nd_reduce_op, "or");
+    else
+    {
+      parse_expect(LX_IDENTIFIER, false);
+      strncpy(retval->nd_reduce_op, g_current_lex_unit.l_name, MAX_STR - 1);
+    }
+    lex_scan();  // Skip past reduce-op.
+    parse_name(retval->nd_reduce_var_name);
+  }
+  else if (LX_WAIT_KW == g_current_lex_unit.l_type)
   {
     // parse 2nd part : timeout = 'wait' expression
-    //                            'timeout' statement-sequence
+    //                            'timeout' ['cancel'] statement-sequence
     //                            ['else' statement-sequence]
     //                            'end'
     lex_scan();  // Skip past 'wait'.
+    retval->nd_type = ND_SPAWN_JOIN_WITH_TIMEOUT;
     retval->nd_p_millisec_expr = parse_or_expression();
     parse_expect(LX_TIMEOUT_KW, true);
+    retval->nd_cancel_on_timeout = LX_CANCEL_KW == g_current_lex_unit.l_type;
+    if (retval->nd_cancel_on_timeout)
+      lex_scan();  // Skip past 'cancel'.
     retval->nd_p_statement_seq_if_timed_out = parse_statement_sequence();
     if (LX_ELSE_KW == g_current_lex_unit.l_type)
     {
@@ -621,8 +833,6 @@ static PARSE_NODE *parse_spawn(void)
       retval->nd_p_statement_seq_if_not_timed_out = NULL;
     parse_expect(LX_END_KW, true);
   }
-  else
-    retval->nd_type = ND_SPAWN_JOIN;
   return retval;
 }
 //------------------------------------------------------------------------------
@@ -649,6 +859,30 @@ static PARSE_NODE *parse_stop(void)
   return retval;
 }
 //------------------------------------------------------------------------------
+// call-statement = 'call' task-name
+//
+// Runs the task on the caller's thread and yields the value of its 'return'.
+static PARSE_NODE *parse_call(void)
+{
+  PARSE_NODE *retval = malloc(sizeof(PARSE_NODE));
+  SET_SRC_POS(retval);
+  lex_scan();  // Skip past 'call'.
+  retval->nd_type = ND_CALL;
+  parse_name(retval->nd_callee_name);
+  return retval;
+}
+//------------------------------------------------------------------------------
+// return-statement = 'return' or-expression
+static PARSE_NODE *parse_return(void)
+{
+  PARSE_NODE *retval = malloc(sizeof(PARSE_NODE));
+  SET_SRC_POS(retval);
+  lex_scan();  // Skip past 'return'.
+  retval->nd_type = ND_RETURN;
+  retval->nd_p_expr = parse_or_expression();
+  return retval;
+}
+//------------------------------------------------------------------------------
 // print-int-statement = 'print_int' expression
 static PARSE_NODE *parse_print_int(void)
 {
@@ -671,6 +905,131 @@ static PARSE_NODE *parse_sleep(void)
   return retval;
 }
 //------------------------------------------------------------------------------
+// send-statement = 'send' channel-name ',' or-expression
+static PARSE_NODE *parse_send(void)
+{
+  PARSE_NODE *retval = malloc(sizeof(PARSE_NODE));
+  SET_SRC_POS(retval);
+  lex_scan();  // Skip past 'send'.
+  retval->nd_type = ND_SEND;
+  parse_name(retval->nd_channel_name);
+  parse_expect(LX_COMMA_SYM, true);
+  retval->nd_p_send_expr = parse_or_expression();
+  return retval;
+}
+//------------------------------------------------------------------------------
+// wait-statement   = 'wait' (barrier-name | event-name)
+// signal-statement = 'signal' event-name
+// reset-statement  = 'reset' event-name
+//
+// The compiler checks what kind of object the name is.
+static PARSE_NODE *parse_sync_statement(uint8_t nd_type)
+{
+  PARSE_NODE *retval = malloc(sizeof(PARSE_NODE));
+  SET_SRC_POS(retval);
+  lex_scan();  // Skip past 'wait', 'signal' or 'reset'.
+  retval->nd_type = nd_type;
+  parse_name(retval->nd_sync_object_name);
+  return retval;
+}
+//------------------------------------------------------------------------------
+// critical-statement = 'critical' lock-name statement-sequence 'end'
+//
+// Only one task at a time runs the statements in a 'critical' block for a
+// given lock.  The lock is let go of at 'end', and also if the task stops
+// (or returns from a call) inside the block.
+static PARSE_NODE *parse_critical(void)
+{
+  PARSE_NODE *retval = malloc(sizeof(PARSE_NODE));
+  SET_SRC_POS(retval);
+  lex_scan();  // Skip past 'critical'.
+  retval->nd_type = ND_CRITICAL;
+  parse_name(retval->nd_sync_object_name);
+  retval->nd_p_critical_statement_seq = parse_statement_sequence();
+  parse_expect(LX_END_KW, true);
+  return retval;
+}
+//------------------------------------------------------------------------------
+// receive-statement = 'receive' channel-name ',' variable-name
+static PARSE_NODE *parse_receive(void)
+{
+  PARSE_NODE *retval = malloc(sizeof(PARSE_NODE));
+  SET_SRC_POS(retval);
+  lex_scan();  // Skip past 'receive'.
+  retval->nd_type = ND_RECEIVE;
+  parse_name(retval->nd_channel_name);
+  parse_expect(LX_COMMA_SYM, true);
+  parse_name(retval->nd_receive_var_name);
+  return retval;
+}
+//------------------------------------------------------------------------------
+// select-case = 'case' (send-statement | receive-statement)
+//                      'then' statement-sequence
+//             | 'case' 'wait' expression 'timeout' statement-sequence
+static PARSE_NODE *parse_select_case(void)
+{
+  PARSE_NODE *retval = malloc(sizeof(PARSE_NODE));
+  SET_SRC_POS(retval);
+  parse_expect(LX_CASE_KW, true);
+  retval->nd_type = ND_SELECT_CASE;
+  retval->nd_p_select_op = NULL;
+  retval->nd_p_select_millisec_expr = NULL;
+  switch (g_current_lex_unit.l_type)
+  {
+    case LX_SEND_KW:
+      retval->nd_p_select_op = parse_send();
+      parse_expect(LX_THEN_KW, true);
+      break;
+    case LX_RECEIVE_KW:
+      retval->nd_p_select_op = parse_receive();
+      parse_expect(LX_THEN_KW, true);
+      break;
+    default:
+      parse_expect(LX_WAIT_KW, true);
+      retval->nd_p_select_millisec_expr = parse_or_expression();
+      parse_expect(LX_TIMEOUT_KW, true);
+      break;
+  }
+  retval->nd_p_select_statement_seq = parse_statement_sequence();
+  return retval;
+}
+//------------------------------------------------------------------------------
+// select-statement = 'select' select-case+ 'end'
+static PARSE_NODE *parse_select(void)
+{
+  PARSE_NODE *retval = malloc(sizeof(PARSE_NODE));
+  LISTITEM *p_current_case;
+  LISTITEM *p_prev_case = NULL;
+  bool has_timeout = false;
+  SET_SRC_POS(retval);
+  lex_scan();  // Skip past 'select'.
+  retval->nd_type = ND_SELECT;
+  retval->nd_p_select_cases = NULL;
+  do
+  {
+    p_current_case = malloc(sizeof(LISTITEM));
+    p_current_case->l_p_next = NULL;
+    p_current_case->l_parse_node = parse_select_case();
+    if (!p_current_case->l_parse_node->nd_p_select_op)
+    {
+      if (has_timeout)
+      {
+        fprintf(stderr, "%d:%d : select has more than one timeout case.\n",
+                g_input_line_n, g_input_column_n);
+        error_exit(0);
+      }
+      has_timeout = true;
+    }
+    if (!retval->nd_p_select_cases)
+      retval->nd_p_select_cases = p_current_case;
+    else
+      p_prev_case->l_p_next = p_current_case;
+    p_prev_case = p_current_case;
+  } while (LX_CASE_KW == g_current_lex_unit.l_type);
+  parse_expect(LX_END_KW, true);
+  return retval;
+}
+//------------------------------------------------------------------------------
 //  print-statement = 'print' (string-constant | or-expression)
 //                    (',' (string-constant | or-expression))*
 //  Result parse tree: (OP_BEGIN_ATOMIC_PRINT [OP_PRINT_STRING|OP_PRINT_INT]+)
@@ -716,11 +1075,15 @@ static PARSE_NODE *parse_print(void)
 //             assignment-statement
 //           | if-statement
 //           | while-statement
+//           | every-statement
 //           | stop-statement
 //           | spawn-statement
 //           | print-int-statement
 //           | print-char-statement
 //           | sleep-statement
+//           | send-statement
+//           | receive-statement
+//           | select-statement
 static PARSE_NODE *parse_statement(void)
 {
   PARSE_NODE *retval = NULL;
@@ -738,6 +1101,9 @@ static PARSE_NODE *parse_statement(void)
     case LX_WHILE_KW:
       retval = parse_while();
       break;
+    case LX_EVERY_KW:
+      retval = parse_every();
+      break;
     case LX_SPAWN_KW:
       retval = parse_spawn();
       break;
@@ -753,13 +1119,44 @@ static PARSE_NODE *parse_statement(void)
   case LX_PRINT_CHAR_KW:
       retval = parse_print_char();
       break;
+    case LX_SEND_KW:
+      retval = parse_send();
+      break;
+    case LX_RECEIVE_KW:
+      retval = parse_receive();
+      break;
+    case LX_WAIT_KW:
+      retval = parse_sync_statement(ND_SYNC_WAIT);
+      break;
+    case LX_SIGNAL_KW:
+      retval = parse_sync_statement(ND_SIGNAL);
+      break;
+    case LX_RESET_KW:
+      retval = parse_sync_statement(ND_RESET);
+      break;
+    case LX_CRITICAL_KW:
+      retval = parse_critical();
+      break;
+    case LX_SELECT_KW:
+      retval = parse_select();
+      break;
+    case LX_CALL_KW:
+      retval = parse_call();
+      break;
+    case LX_RETURN_KW:
+      retval = parse_return();
+      break;
     default:
       break;
   }
   return retval;
 }
 //------------------------------------------------------------------------------
-// task-declaration = 'task' name [';'] statement-sequence 'end'
+// task-declaration = 'task' name ['priority' ['-'] number] [';']
+//                    statement-sequence 'end'
+//
+// A task with a higher priority gets more of the CPU than one with a lower
+// priority when they compete (see exec_set_priority()).
 static PARSE_NODE *parse_task_declaration(void)
 {
   PARSE_NODE *retval = malloc(sizeof(PARSE_NODE));
@@ -770,13 +1167,61 @@ static PARSE_NODE *parse_task_declaration(void)
   parse_expect(LX_IDENTIFIER, false);
   strcpy(retval->nd_task_name, g_current_lex_unit.l_name);
   lex_scan();  // Skip name.
+  retval->nd_task_priority = 0;
+  if (LX_PRIORITY_KW == g_current_lex_unit.l_type)
+  {
+    bool negative;
+    lex_scan();  // Skip over 'priority'.
+    negative = LX_MINUS_SYM == g_current_lex_unit.l_type;
+    parse_optional(LX_MINUS_SYM);
+    parse_expect(LX_NUMBER, false);
+    retval->nd_task_priority = negative ? -g_current_lex_unit.l_number
+                                        : g_current_lex_unit.l_number;
+    lex_scan();  // Skip over the priority.
+  }
   retval->nd_p_task_body = parse_statement_sequence();
   parse_expect(LX_END_KW, true);
   return retval;
 }
 //------------------------------------------------------------------------------
+// object-declaration = 'channel' name number
+//                    | 'barrier' name number
+//                    | 'event' name
+//                    | 'lock' name
+static PARSE_NODE *parse_object_declaration(void)
+{
+  PARSE_NODE *retval = malloc(sizeof(PARSE_NODE));
+  SET_SRC_POS(retval);
+  switch (g_current_lex_unit.l_type)
+  {
+    case LX_BARRIER_KW:
+      retval->nd_type = ND_BARRIER_DECLARATION;
+      break;
+    case LX_EVENT_KW:
+      retval->nd_type = ND_EVENT_DECLARATION;
+      break;
+    case LX_LOCK_KW:
+      retval->nd_type = ND_LOCK_DECLARATION;
+      break;
+    default:
+      retval->nd_type = ND_CHANNEL_DECLARATION;
+      break;
+  }
+  lex_scan();  // Skip over 'channel', 'barrier', 'event' or 'lock'.
+  parse_name(retval->nd_object_name);
+  retval->nd_object_size = 0;
+  if (ND_CHANNEL_DECLARATION == retval->nd_type || ND_BARRIER_DECLARATION == retval->nd_type)
+  {
+    parse_expect(LX_NUMBER, false);
+    retval->nd_object_size = g_current_lex_unit.l_number;
+    lex_scan();  // Skip over capacity/number of tasks.
+  }
+  return retval;
+}
+//------------------------------------------------------------------------------
 // module-declaration  =
 //                       'module' name [';']
+//                       (object-declaration ';')*
 //                       'init' statement-sequence 'end' ';'
 //                       (task-declaration ';')* 'end'
 static PARSE_NODE *parse_module_declaration(void)
@@ -784,6 +1229,8 @@ static PARSE_NODE *parse_module_declaration(void)
   PARSE_NODE *retval = malloc(sizeof(PARSE_NODE));
   LISTITEM *p_current_task_decl = NULL;
   LISTITEM *p_prev_task_decl = NULL;
+  LISTITEM *p_current_object_decl = NULL;
+  LISTITEM *p_prev_object_decl = NULL;
   SET_SRC_POS(retval);
   retval->nd_type = ND_MODULE_DECLARATION;
   parse_expect(LX_MODULE_KW, true);
@@ -791,6 +1238,22 @@ static PARSE_NODE *parse_module_declaration(void)
   strcpy(retval->nd_module_name, g_current_lex_unit.l_name);
   lex_scan();  // Skip over name.
   parse_optional(LX_SEMICOLON_SYM);
+  retval->nd_p_object_decl_list = NULL;
+  while (LX_CHANNEL_KW == g_current_lex_unit.l_type
+         || LX_BARRIER_KW == g_current_lex_unit.l_type
+         || LX_EVENT_KW == g_current_lex_unit.l_type
+         || LX_LOCK_KW == g_current_lex_unit.l_type)
+  {
+    p_current_object_decl = malloc(sizeof(LISTITEM));
+    p_current_object_decl->l_parse_node = parse_object_declaration();
+    p_current_object_decl->l_p_next = NULL;
+    parse_expect(LX_SEMICOLON_SYM, true);
+    if (!retval->nd_p_object_decl_list)
+      retval->nd_p_object_decl_list = p_current_object_decl;
+    else
+      p_prev_object_decl->l_p_next = p_current_object_decl;
+    p_prev_object_decl = p_current_object_decl;
+  }
   parse_expect(LX_INIT_KW, true);
   retval->nd_p_init_statements = parse_statement_sequence();
   parse_expect(LX_END_KW, true);
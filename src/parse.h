@@ -36,13 +36,22 @@ struct PARSE_NODE
     struct
     {
       char nd_module_name[MAX_STR];
+      LISTITEM *nd_p_object_decl_list;  // ND_CHANNEL_DECLARATION, ND_BARRIER_DECLARATION, ...
       PARSE_NODE *nd_p_init_statements;
       LISTITEM *nd_p_task_decl_list;
     };
+    // nd_type == ND_CHANNEL_DECLARATION, ND_BARRIER_DECLARATION, ND_EVENT_DECLARATION,
+    //            ND_LOCK_DECLARATION
+    struct
+    {
+      char nd_object_name[MAX_STR];
+      int32_t nd_object_size;  // Channel capacity (in int32s), tasks per barrier.
+    };
     // nd_type ==  ND_TASK_DECLARATION
     struct
     {
       char nd_task_name[MAX_STR];
+      int32_t nd_task_priority;  // 0 if no 'priority'.
       PARSE_NODE *nd_p_task_body;
     };
     //  nd_type == ND_STATEMENT_SEQUENCE
@@ -56,7 +65,7 @@ struct PARSE_NODE
     //  nd_type == ND_ASSIGN
     struct
     {
-      char nd_var_name;
+      char nd_var_name[MAX_STR];
       PARSE_NODE *nd_p_assign_expr;
     };
     //  nd_type == ND_IF
@@ -72,16 +81,32 @@ struct PARSE_NODE
       PARSE_NODE *nd_p_while_test_expr;
       PARSE_NODE *nd_p_while_statement_seq;
     };
+    //  nd_type == ND_EVERY
+    struct
+    {
+      PARSE_NODE *nd_p_every_millisec_expr;  // Period.
+      PARSE_NODE *nd_p_every_statement_seq;
+    };
     //  nd_type == ND_PRINT_CHAR
     char nd_char;
-    //  nd_type == ND_PRINT_INT, ND_NOT, ND_NEGATE, ND_SLEEP
+    //  nd_type == ND_PRINT_INT, ND_NOT, ND_NEGATE, ND_SLEEP, ND_RETURN
     PARSE_NODE *nd_p_expr;
-    //  nd_type == ND_SPAWN_JOIN, ND_SPAWN_JOIN_WITH_TIMEOUT
+    //  nd_type == ND_CALL
+    char nd_callee_name[MAX_STR];
+    //  nd_type == ND_SPAWN_JOIN, ND_SPAWN_JOIN_WITH_TIMEOUT, ND_SPAWN_JOIN_FIRST
     struct
     {
       LISTITEM *nd_p_task_names;
+      PARSE_NODE *nd_p_limit_expr;  // NULL: no 'limit'.
+      //  nd_type == ND_SPAWN_JOIN ('reduce', empty nd_reduce_op if none)
+      char nd_reduce_op[MAX_STR];
+      char nd_reduce_var_name[MAX_STR];
+      //  nd_type == ND_SPAWN_JOIN_FIRST
+      char nd_first_var_name[MAX_STR];  // Gets the index of the first task to stop.
+      bool nd_cancel_rest;  // 'first' name 'cancel': stop the others.
       //  nd_type == ND_SPAWN_JOIN_WITH_TIMEOUT
       PARSE_NODE *nd_p_millisec_expr;
+      bool nd_cancel_on_timeout;  // 'timeout' 'cancel'
       PARSE_NODE *nd_p_statement_seq_if_timed_out;
       PARSE_NODE *nd_p_statement_seq_if_not_timed_out;
     };
@@ -97,6 +122,29 @@ struct PARSE_NODE
       PARSE_NODE *nd_p_left_expr;
       PARSE_NODE *nd_p_right_expr;
     };
+    //  nd_type == ND_SEND, ND_RECEIVE
+    struct
+    {
+      char nd_channel_name[MAX_STR];
+      PARSE_NODE *nd_p_send_expr;  // ND_SEND
+      char nd_receive_var_name[MAX_STR];    // ND_RECEIVE
+    };
+    //  nd_type == ND_SYNC_WAIT, ND_SIGNAL, ND_RESET, ND_CRITICAL
+    struct
+    {
+      char nd_sync_object_name[MAX_STR];  // Barrier, event or lock.
+      PARSE_NODE *nd_p_critical_statement_seq;  // ND_CRITICAL
+    };
+    //  nd_type == ND_SELECT
+    //  Each LISTITEM holds an ND_SELECT_CASE.
+    LISTITEM *nd_p_select_cases;
+    //  nd_type == ND_SELECT_CASE
+    struct
+    {
+      PARSE_NODE *nd_p_select_op;  // ND_SEND or ND_RECEIVE (NULL for timeout case).
+      PARSE_NODE *nd_p_select_millisec_expr;  // Timeout case.
+      PARSE_NODE *nd_p_select_statement_seq;
+    };
     // nd_type ==  ND_NUMBER
     int32_t nd_number;
     //  nd_type == ND_STOP (no subtree(s) or other infotainment).
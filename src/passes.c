@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <util.h>
+//------------------------------------------------------------------------------
+#include "parse.h"
+#include "instruction.h"
+#include "optimize.h"
+#include "code-opt.h"
+#include "ir.h"
+#include "passes.h"
+//------------------------------------------------------------------------------
+// THEORY OF OPERATION:
+//
+// mpc optimizes the program in three forms, each by its own list of passes:
+//
+//   tree   The parse tree, before compile() (optimize.c).
+//   IR     Each task's IR, when compile() goes through it (ir.c).
+//   code   The module's instructions, after compile() (code-opt.c).
+//
+// g_passes[] lists all of them in the order they run.  A pass runs if the -O
+// level asked for is at least its ps_level:
+//
+//   -O0  Nothing.  compile() emits code straight from the parse tree.
+//   -O1  Folding and identities on the tree, then the bytecode passes.
+//   -O2  Also loop-invariant code motion, common subexpressions and
+//        unrolling of counted loops on the tree, and compile() goes through
+//        the IR, where constants are propagated and dead code removed.  This
+//        is the default.
+//
+// Adding a pass is writing a function with its form's arguments and giving
+// it a line in g_passes[].
+//------------------------------------------------------------------------------
+typedef struct PASS PASS;
+struct PASS
+{
+  char *ps_name;
+  uint8_t ps_level;  // Lowest -O level it runs at.
+  // Exactly one of:
+  void (*ps_p_tree_fn)(PARSE_NODE *p_tree, OPT_STATS *p_stats);
+  void (*ps_p_ir_fn)(IR_FUNC *p_func, OPT_STATS *p_stats);
+  void (*ps_p_code_fn)(INSTRUCTION *p_code, uint32_t *p_n_instructions, OPT_STATS *p_stats);
+};
+//------------------------------------------------------------------------------
+static PASS g_passes[] =
+{
+  { "fold",           1, optimize_fold,        NULL,                   NULL },
+  { "code-motion",    2, optimize_code_motion, NULL,                   NULL },
+  { "unroll",         2, optimize_unroll,      NULL,                   NULL },
+  { "ir-constants",   2, NULL,                 ir_propagate_constants, NULL },
+  { "ir-dead-code",   2, NULL,                 ir_remove_dead_code,    NULL },
+  { "jumps",          1, NULL,                 NULL,                   copt_simplify_jumps },
+  { "dead-stores",    1, NULL,                 NULL,                   copt_remove_dead_stores },
+  { "strength",       1, NULL,                 NULL,                   copt_strength_reduce },
+  { NULL,             0, NULL,                 NULL,                   NULL }
+};
+//------------------------------------------------------------------------------
+void passes_run_tree(PARSE_NODE *p_tree, uint8_t level, OPT_STATS *p_stats)
+{
+  for (PASS *p_pass = g_passes; p_pass->ps_name; ++p_pass)
+    if (p_pass->ps_p_tree_fn && level >= p_pass->ps_level)
+      p_pass->ps_p_tree_fn(p_tree, p_stats);
+}
+//------------------------------------------------------------------------------
+void passes_run_ir(IR_FUNC *p_func, uint8_t level, OPT_STATS *p_stats)
+{
+  for (PASS *p_pass = g_passes; p_pass->ps_name; ++p_pass)
+    if (p_pass->ps_p_ir_fn && level >= p_pass->ps_level)
+      p_pass->ps_p_ir_fn(p_func, p_stats);
+}
+//------------------------------------------------------------------------------
+void passes_run_code(INSTRUCTION *p_code, uint32_t *p_n_instructions, uint8_t level,
+                     OPT_STATS *p_stats)
+{
+  for (PASS *p_pass = g_passes; p_pass->ps_name; ++p_pass)
+    if (p_pass->ps_p_code_fn && level >= p_pass->ps_level)
+      p_pass->ps_p_code_fn(p_code, p_n_instructions, p_stats);
+}
+//------------------------------------------------------------------------------
+// Print the names of the passes run at level.
+void passes_print(FILE *fout, uint8_t level)
+{
+  fprintf(fout, "-O%u passes:", level);
+  for (PASS *p_pass = g_passes; p_pass->ps_name; ++p_pass)
+    if (level >= p_pass->ps_level)
+      fprintf(fout, " %s", p_pass->ps_name);
+  fprintf(fout, "\n");
+}
@@ -0,0 +1,13 @@
+#pragma once
+//------------------------------------------------------------------------------
+// Which optimization passes mpc runs at each -O level, and in what order.  See
+// passes.c.
+//------------------------------------------------------------------------------
+#define OPT_LEVEL_MAX 2  // Also the default.
+#define OPT_LEVEL_IR 2  // compile() goes through the IR (ir.h) from this level on.
+//------------------------------------------------------------------------------
+void passes_run_tree(PARSE_NODE *p_tree, uint8_t level, OPT_STATS *p_stats);
+void passes_run_ir(IR_FUNC *p_func, uint8_t level, OPT_STATS *p_stats);
+void passes_run_code(INSTRUCTION *p_code, uint32_t *p_n_instructions, uint8_t level,
+                     OPT_STATS *p_stats);
+void passes_print(FILE *fout, uint8_t level);
@@ -0,0 +1,301 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <util.h>
+//------------------------------------------------------------------------------
+#include "park.h"
+#include "exec.h"
+#include "reaper.h"
+//------------------------------------------------------------------------------
+// THEORY OF OPERATION:
+//
+// Every TASK is on the registry list (r_p_tasks) from exec_create_task() until
+// exec_free_task().  A task's life looks like this:
+//
+//   admitted -> registered -> live (thread running) -> stopped -> freed
+//
+// Normally the  parent joins  and frees its  children (OP_JOIN,  a timed  join
+// that succeeds, or one that  cancels).  When a timed join (OP_WAIT_JUMP) times
+// out without 'cancel', the parent  lets go of the tasks still running and hands
+// the group to reaper_detach_group().  From then on:
+//
+//   -- A detached task that stops puts itself on the zombie list.
+//   -- The reaper thread takes tasks off the zombie list, pthread_join()s and
+//      frees them.
+//
+// Detaching and stopping both happen under r_mtx and are recorded in
+// task_reg_flags, so a task that stopped before its group was detached is
+// found by reaper_detach_group() instead.
+//
+// Ceiling:
+//
+// Each TASK  has at  most one thread, so the  number of TASKs  allocated bounds
+// both the  threads and the  TASK memory in  use (variable frames are small
+// next to the TASK itself and are not counted).  OP_BEGIN_SPAWN n  calls
+// reaper_admit() for n TASKs before creating them.  If that would go over the
+// ceiling (--max-threads, --max-task-mem)  the spawning task parks on
+// r_task_freed until enough TASKs are freed.
+//
+// A spawner only waits while there are detached tasks left to reap.  Any other
+// task  may  be  (transitively)  waiting  for the spawner  itself,  so  waiting
+// for it could deadlock.  When there is nothing left to reap the spawn goes
+// ahead over the ceiling and is counted in rs_n_over_ceiling.
+//------------------------------------------------------------------------------
+static struct
+{
+  pthread_mutex_t r_mtx;
+  pthread_cond_t r_zombie_added;  // Wakes the reaper thread.
+  PARK_EVENT r_task_freed;  // Spawners waiting for admission park here.
+  pthread_t r_thread_id;
+  bool r_running;
+  bool r_shutdown;
+  uint32_t r_max_tasks;  // min(max threads, max task memory/sizeof(TASK)).
+  uint32_t r_stats_period_sec;  // 0: don't print stats periodically.
+  TASK *r_p_tasks;  // All registered TASKs.
+  TASK *r_p_zombies;  // Stopped detached TASKs (linked by task_p_zombie_next).
+  REAPER_STATS r_stats;
+} g_registry =
+{
+  .r_mtx = PTHREAD_MUTEX_INITIALIZER,
+  .r_zombie_added = PTHREAD_COND_INITIALIZER,
+  .r_max_tasks = UINT32_MAX
+};
+//------------------------------------------------------------------------------
+// Must hold r_mtx.
+static void reaper_add_zombie(TASK *p_task)
+{
+  p_task->task_reg_flags |= REG_ZOMBIE;
+  p_task->task_p_zombie_next = g_registry.r_p_zombies;
+  g_registry.r_p_zombies = p_task;
+  g_registry.r_stats.rs_n_zombies += 1;
+  pthread_cond_signal(&g_registry.r_zombie_added);
+}
+//------------------------------------------------------------------------------
+static void *reaper_run(void *pv_unused)
+{
+  struct timespec next_stats_time;
+  clock_gettime(CLOCK_REALTIME, &next_stats_time);
+  next_stats_time.tv_sec += g_registry.r_stats_period_sec;
+  pthread_mutex_lock(&g_registry.r_mtx);
+  for (;;)
+  {
+    TASK *p_zombies = g_registry.r_p_zombies;
+    if (p_zombies)
+    {
+      g_registry.r_p_zombies = NULL;
+      pthread_mutex_unlock(&g_registry.r_mtx);
+      while (p_zombies)
+      {
+        TASK *p_task = p_zombies;
+        p_zombies = p_task->task_p_zombie_next;
+        pthread_join(p_task->task_thread_id, NULL);
+        exec_free_task(p_task);
+      }
+      pthread_mutex_lock(&g_registry.r_mtx);
+    }
+    else if (g_registry.r_shutdown)
+      break;
+    else if (g_registry.r_stats_period_sec)
+    {
+      if (ETIMEDOUT == pthread_cond_timedwait(&g_registry.r_zombie_added, &g_registry.r_mtx,
+                                              &next_stats_time))
+      {
+        pthread_mutex_unlock(&g_registry.r_mtx);
+        reaper_print_stats(stderr);
+        pthread_mutex_lock(&g_registry.r_mtx);
+        next_stats_time.tv_sec += g_registry.r_stats_period_sec;
+      }
+    }
+    else
+      pthread_cond_wait(&g_registry.r_zombie_added, &g_registry.r_mtx);
+  }
+  pthread_mutex_unlock(&g_registry.r_mtx);
+  return NULL;
+}
+//------------------------------------------------------------------------------
+// Start the reaper thread.  max_threads/max_task_bytes == 0: use the default.
+void reaper_init(uint32_t max_threads, uint64_t max_task_bytes, uint32_t stats_period_sec)
+{
+  uint64_t max_tasks_by_mem;
+  if (!max_threads)
+    max_threads = REAPER_DEFAULT_MAX_THREADS;
+  if (!max_task_bytes)
+    max_task_bytes = REAPER_DEFAULT_MAX_TASK_MEM;
+  max_tasks_by_mem = max_task_bytes/sizeof(TASK);
+  g_registry.r_max_tasks = max_tasks_by_mem < max_threads ? (uint32_t) max_tasks_by_mem : max_threads;
+  g_registry.r_stats_period_sec = stats_period_sec;
+  g_registry.r_shutdown = false;
+  park_event_init(&g_registry.r_task_freed);
+  g_registry.r_running = 0 == pthread_create(&g_registry.r_thread_id, NULL, reaper_run, NULL);
+}
+//------------------------------------------------------------------------------
+// Reap the zombies there are now and stop the reaper thread.  Detached tasks
+// still running are left alone (they go when the process exits).
+void reaper_shutdown(void)
+{
+  if (g_registry.r_running)
+  {
+    pthread_mutex_lock(&g_registry.r_mtx);
+    g_registry.r_shutdown = true;
+    pthread_cond_signal(&g_registry.r_zombie_added);
+    pthread_mutex_unlock(&g_registry.r_mtx);
+    pthread_join(g_registry.r_thread_id, NULL);
+    g_registry.r_running = false;
+  }
+}
+//------------------------------------------------------------------------------
+typedef struct ADMISSION
+{
+  uint32_t adm_n_tasks;
+  bool adm_waited;
+} ADMISSION;
+//------------------------------------------------------------------------------
+// Charge adm_n_tasks to the registry if they fit under the ceiling (or if
+// there is nothing left to reap).
+// RETURNS: true if charged.
+static bool reaper_try_admit(void *pv_admission)
+{
+  ADMISSION *p_admission = (ADMISSION *) pv_admission;
+  REAPER_STATS *p_stats = &g_registry.r_stats;
+  bool result;
+  pthread_mutex_lock(&g_registry.r_mtx);
+  result = (uint64_t) p_stats->rs_n_tasks + p_admission->adm_n_tasks <= g_registry.r_max_tasks;
+  if (!result && 0 == p_stats->rs_n_detached)
+  {
+    p_stats->rs_n_over_ceiling += 1;
+    result = true;
+  }
+  if (result)
+  {
+    p_stats->rs_n_tasks += p_admission->adm_n_tasks;
+    p_stats->rs_task_bytes = (uint64_t) p_stats->rs_n_tasks*sizeof(TASK);
+    if (p_admission->adm_waited)
+      p_stats->rs_n_admit_waits += 1;
+  }
+  p_admission->adm_waited = true;
+  pthread_mutex_unlock(&g_registry.r_mtx);
+  return result;
+}
+//------------------------------------------------------------------------------
+// Reserve n_tasks TASKs before they are created.  p_spawner parks while the
+// ceiling is reached and detached tasks remain to be reaped.  p_spawner == NULL
+// (the init task) never waits.
+void reaper_admit(TASK *p_spawner, uint32_t n_tasks)
+{
+  ADMISSION admission = { n_tasks, false };
+  if (!reaper_try_admit(&admission))
+  {
+    if (p_spawner)
+      exec_wait_until(p_spawner, &g_registry.r_task_freed, reaper_try_admit, &admission,
+                      NULL, /*interruptible*/ false);
+    else
+    {
+      pthread_mutex_lock(&g_registry.r_mtx);
+      g_registry.r_stats.rs_n_tasks += n_tasks;
+      g_registry.r_stats.rs_task_bytes = (uint64_t) g_registry.r_stats.rs_n_tasks*sizeof(TASK);
+      pthread_mutex_unlock(&g_registry.r_mtx);
+    }
+  }
+}
+//------------------------------------------------------------------------------
+void reaper_register(TASK *p_task)
+{
+  pthread_mutex_lock(&g_registry.r_mtx);
+  p_task->task_reg_flags = 0;
+  p_task->task_p_zombie_next = NULL;
+  p_task->task_p_reg_prev = NULL;
+  p_task->task_p_reg_next = g_registry.r_p_tasks;
+  if (g_registry.r_p_tasks)
+    g_registry.r_p_tasks->task_p_reg_prev = p_task;
+  g_registry.r_p_tasks = p_task;
+  pthread_mutex_unlock(&g_registry.r_mtx);
+}
+//------------------------------------------------------------------------------
+// p_task is about to be freed.  Give its charge back and wake waiting spawners.
+void reaper_unregister(TASK *p_task)
+{
+  REAPER_STATS *p_stats = &g_registry.r_stats;
+  pthread_mutex_lock(&g_registry.r_mtx);
+  if (p_task->task_p_reg_prev)
+    p_task->task_p_reg_prev->task_p_reg_next = p_task->task_p_reg_next;
+  else
+    g_registry.r_p_tasks = p_task->task_p_reg_next;
+  if (p_task->task_p_reg_next)
+    p_task->task_p_reg_next->task_p_reg_prev = p_task->task_p_reg_prev;
+  if (p_task->task_reg_flags & REG_DETACHED)
+  {
+    p_stats->rs_n_detached -= 1;
+    p_stats->rs_n_reaped += 1;
+    if (p_task->task_reg_flags & REG_ZOMBIE)
+      p_stats->rs_n_zombies -= 1;
+  }
+  else
+    p_stats->rs_n_joined += 1;
+  p_stats->rs_n_tasks -= 1;
+  p_stats->rs_task_bytes = (uint64_t) p_stats->rs_n_tasks*sizeof(TASK);
+  pthread_mutex_unlock(&g_registry.r_mtx);
+  park_notify_all(&g_registry.r_task_freed);
+}
+//------------------------------------------------------------------------------
+void reaper_task_started(TASK *p_task)
+{
+  pthread_mutex_lock(&g_registry.r_mtx);
+  g_registry.r_stats.rs_n_live += 1;
+  if (g_registry.r_stats.rs_n_live > g_registry.r_stats.rs_n_peak_live)
+    g_registry.r_stats.rs_n_peak_live = g_registry.r_stats.rs_n_live;
+  pthread_mutex_unlock(&g_registry.r_mtx);
+}
+//------------------------------------------------------------------------------
+// Called by the task itself (exec_end_task()) after it is done with its group.
+// A detached task becomes a zombie.
+void reaper_task_stopped(TASK *p_task)
+{
+  pthread_mutex_lock(&g_registry.r_mtx);
+  g_registry.r_stats.rs_n_live -= 1;
+  p_task->task_reg_flags |= REG_STOPPED;
+  if (p_task->task_reg_flags & REG_DETACHED)
+    reaper_add_zombie(p_task);
+  pthread_mutex_unlock(&g_registry.r_mtx);
+}
+//------------------------------------------------------------------------------
+// The parent of p_group's tasks has stopped waiting for them: the reaper joins
+// and frees them from now on.  The caller still holds its group reference.
+void reaper_detach_group(SPAWN_GROUP *p_group)
+{
+  pthread_mutex_lock(&g_registry.r_mtx);
+  for (uint32_t i = 0; i < p_group->sg_n_tasks; ++i)
+  {
+    TASK *p_task = p_group->sg_p_tasks[i];
+    p_task->task_reg_flags |= REG_DETACHED;
+    g_registry.r_stats.rs_n_detached += 1;
+    if (p_task->task_reg_flags & REG_STOPPED)
+      reaper_add_zombie(p_task);
+  }
+  pthread_mutex_unlock(&g_registry.r_mtx);
+}
+//------------------------------------------------------------------------------
+void reaper_get_stats(REAPER_STATS *p_stats)
+{
+  pthread_mutex_lock(&g_registry.r_mtx);
+  *p_stats = g_registry.r_stats;
+  pthread_mutex_unlock(&g_registry.r_mtx);
+}
+//------------------------------------------------------------------------------
+void reaper_print_stats(FILE *fout)
+{
+  REAPER_STATS stats;
+  reaper_get_stats(&stats);
+  fprintf(fout, "tasks: %u (%lu bytes, ceiling %u) live: %u (peak %u) "
+          "detached: %u zombies: %u reaped: %lu joined: %lu "
+          "admit waits: %lu over ceiling: %lu\n",
+          stats.rs_n_tasks, (unsigned long) stats.rs_task_bytes, g_registry.r_max_tasks,
+          stats.rs_n_live, stats.rs_n_peak_live, stats.rs_n_detached, stats.rs_n_zombies,
+          (unsigned long) stats.rs_n_reaped, (unsigned long) stats.rs_n_joined,
+          (unsigned long) stats.rs_n_admit_waits, (unsigned long) stats.rs_n_over_ceiling);
+}
@@ -0,0 +1,40 @@
+#pragma once
+//------------------------------------------------------------------------------
+// Task registry and reaper for detached tasks.  See reaper.c.
+//------------------------------------------------------------------------------
+#define REAPER_DEFAULT_MAX_THREADS 4096
+#define REAPER_DEFAULT_MAX_TASK_MEM ((uint64_t) 256*1024*1024)
+//------------------------------------------------------------------------------
+// TASK.task_reg_flags (guarded by the registry mutex).
+enum
+{
+  REG_STOPPED = 1,  // exec_end_task() has run.
+  REG_DETACHED = 2,  // Parent timed out and let go of it.
+  REG_ZOMBIE = 4  // On the zombie list.
+};
+//------------------------------------------------------------------------------
+typedef struct REAPER_STATS REAPER_STATS;
+struct REAPER_STATS
+{
+  uint32_t rs_n_tasks;  // TASKs allocated (admitted and not yet freed).
+  uint32_t rs_n_live;  // Threads started and not yet stopped.
+  uint32_t rs_n_peak_live;
+  uint32_t rs_n_detached;  // Detached TASKs not yet reaped (running or zombie).
+  uint32_t rs_n_zombies;  // Stopped detached TASKs waiting for the reaper.
+  uint64_t rs_n_reaped;  // Detached TASKs joined and freed by the reaper.
+  uint64_t rs_n_joined;  // TASKs joined and freed by their parent.
+  uint64_t rs_n_admit_waits;  // Spawns that waited for the reaper.
+  uint64_t rs_n_over_ceiling;  // Spawns admitted over the ceiling (see reaper.c).
+  uint64_t rs_task_bytes;  // rs_n_tasks*sizeof(TASK).
+};
+//------------------------------------------------------------------------------
+void reaper_init(uint32_t max_threads, uint64_t max_task_bytes, uint32_t stats_period_sec);
+void reaper_shutdown(void);
+void reaper_admit(TASK *p_spawner, uint32_t n_tasks);
+void reaper_register(TASK *p_task);
+void reaper_unregister(TASK *p_task);
+void reaper_task_started(TASK *p_task);
+void reaper_task_stopped(TASK *p_task);
+void reaper_detach_group(SPAWN_GROUP *p_group);
+void reaper_get_stats(REAPER_STATS *p_stats);
+void reaper_print_stats(FILE *fout);
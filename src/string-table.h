@@ -9,3 +9,7 @@ struct STRING_CONST
 };
 //------------------------------------------------------------------------------
 #define STRING_HTABLE_SIZE 4999
+//------------------------------------------------------------------------------
+void strtab_init(void);
+STRING_CONST *strtab_lookup_string(char *s);
+STRING_CONST *strtab_add_string(char *s);
@@ -49,9 +49,11 @@ LABEL *symtab_add_label(char *name,
   uint32_t h = symtab_hash(name);
   LABEL *result = malloc(sizeof(LABEL));
   strcpy(result->lbl_name, name);
-  result->lbl_addr_set = false;
+  result->lbl_addr_set = addr_set;
   result->lbl_addr = addr;
   result->lbl_is_task = is_task;
+  result->lbl_frame_size = 0;
+  result->lbl_priority = 0;
   result->lbl_p_backpatch_list = NULL;
   result->lbl_p_next = g_hash_labels[h];
   g_hash_labels[h] = result;
@@ -13,6 +13,8 @@ struct LABEL {
   bool lbl_addr_set;  // Is lbl_addr storing a valid address?
   uint32_t lbl_addr;
   bool lbl_is_task;  // Jump label or location of task?
+  uint32_t lbl_frame_size;  // Task: number of variable slots.
+  int8_t lbl_priority;  // Task: 'priority'.
   BACKPATCH *lbl_p_backpatch_list;  // Backpatches  for  forward  references  to
                                     // task names.
   struct LABEL *lbl_p_next;  // next LABEL in hash bucket list.
@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <util.h>
+//------------------------------------------------------------------------------
+#include "park.h"
+#include "sync.h"
+//------------------------------------------------------------------------------
+// THEORY OF OPERATION:
+//
+// Barrier ('barrier b n;', 'wait b'):
+//
+//   A task reads br_generation, then counts itself in br_n_arrived.  The n-th
+//   task to arrive zeroes br_n_arrived, bumps br_generation and notifies
+//   br_released.  The others wait for br_generation to change.  Because the
+//   generation is read before arriving, a fast task that is already arriving
+//   at the next round can't be confused with one still leaving this round.
+//
+// Event flag ('event e;', 'wait e', 'signal e', 'reset e'):
+//
+//   'signal' sets ev_is_set and notifies ev_set; 'reset' clears it.  'wait'
+//   returns at once while the flag is set and blocks while it isn't.
+//
+// Waiting:
+//
+//   A waiter first spins (sync_*_spin()), then parks on the PARK_EVENT through
+//   exec_wait_until(), which is a futex wait (see park.c).  How long to spin is
+//   learned per object: if the wait ended while spinning the budget doubles,
+//   otherwise it halves, between SYNC_MIN_SPIN_TRIES and SYNC_MAX_SPIN_TRIES.
+//   Tightly coupled phases (all tasks on their own core) end up spinning and
+//   never enter the kernel; oversubscribed ones end up parking almost at once.
+//
+// Lock ('lock l;', 'critical l ... end'):
+//
+//   A test-and-test-and-set flag.  A task that finds it held spins on
+//   sync_lock_try_acquire() with the same adaptive budget, then parks on
+//   lk_released, which every release notifies.  The runtime records which
+//   locks a task holds (TASK.task_held_locks) so that they are let go of if
+//   the task stops or is cancelled inside the block.
+//------------------------------------------------------------------------------
+typedef bool (*SYNC_CONDITION)(void *, uint32_t);
+//------------------------------------------------------------------------------
+// Spin until condition(p_arg, arg) holds or *p_spin_tries run out, then adapt
+// *p_spin_tries.
+// RETURNS: true if condition holds.
+static bool sync_spin(atomic_uint *p_spin_tries, SYNC_CONDITION condition,
+                      void *p_arg, uint32_t arg)
+{
+  uint32_t n_tries = atomic_load_explicit(p_spin_tries, memory_order_relaxed);
+  bool result = false;
+  for (uint32_t i = 0; i < n_tries && !result; ++i)
+  {
+    result = condition(p_arg, arg);
+    if (!result)
+      CPU_RELAX();
+  }
+  if (result)
+    n_tries = n_tries*2 > SYNC_MAX_SPIN_TRIES ? SYNC_MAX_SPIN_TRIES : n_tries*2;
+  else
+    n_tries = n_tries/2 < SYNC_MIN_SPIN_TRIES ? SYNC_MIN_SPIN_TRIES : n_tries/2;
+  atomic_store_explicit(p_spin_tries, n_tries, memory_order_relaxed);
+  return result;
+}
+//------------------------------------------------------------------------------
+BARRIER *sync_barrier_new(uint32_t n_parties)
+{
+  BARRIER *result = malloc(sizeof(BARRIER));
+  result->br_n_parties = n_parties;
+  atomic_init(&result->br_n_arrived, 0);
+  atomic_init(&result->br_generation, 0);
+  atomic_init(&result->br_spin_tries, PARK_SPIN_TRIES);
+  park_event_init(&result->br_released);
+  return result;
+}
+//------------------------------------------------------------------------------
+void sync_barrier_free(BARRIER *p_barrier)
+{
+  free(p_barrier);
+}
+//------------------------------------------------------------------------------
+// Count the calling task as arrived.  *p_generation gets the generation to wait
+// out.
+// RETURNS: true if the caller was the last to arrive (and released the others).
+bool sync_barrier_arrive(BARRIER *p_barrier, uint32_t *p_generation)
+{
+  bool result;
+  *p_generation = atomic_load(&p_barrier->br_generation);
+  result = atomic_fetch_add(&p_barrier->br_n_arrived, 1) + 1 == p_barrier->br_n_parties;
+  if (result)
+  {
+    atomic_store(&p_barrier->br_n_arrived, 0);
+    atomic_fetch_add(&p_barrier->br_generation, 1);
+    park_notify_all(&p_barrier->br_released);
+  }
+  return result;
+}
+//------------------------------------------------------------------------------
+bool sync_barrier_passed(BARRIER *p_barrier, uint32_t generation)
+{
+  return generation != atomic_load(&p_barrier->br_generation);
+}
+//------------------------------------------------------------------------------
+static bool sync_barrier_passed_condition(void *pv_barrier, uint32_t generation)
+{
+  return sync_barrier_passed((BARRIER *) pv_barrier, generation);
+}
+//------------------------------------------------------------------------------
+bool sync_barrier_spin(BARRIER *p_barrier, uint32_t generation)
+{
+  return sync_spin(&p_barrier->br_spin_tries, sync_barrier_passed_condition,
+                   p_barrier, generation);
+}
+//------------------------------------------------------------------------------
+EVENT *sync_event_new(void)
+{
+  EVENT *result = malloc(sizeof(EVENT));
+  atomic_init(&result->ev_is_set, false);
+  atomic_init(&result->ev_spin_tries, PARK_SPIN_TRIES);
+  park_event_init(&result->ev_set);
+  return result;
+}
+//------------------------------------------------------------------------------
+void sync_event_free(EVENT *p_event)
+{
+  free(p_event);
+}
+//------------------------------------------------------------------------------
+void sync_event_signal(EVENT *p_event)
+{
+  atomic_store(&p_event->ev_is_set, true);
+  park_notify_all(&p_event->ev_set);
+}
+//------------------------------------------------------------------------------
+void sync_event_reset(EVENT *p_event)
+{
+  atomic_store(&p_event->ev_is_set, false);
+}
+//------------------------------------------------------------------------------
+bool sync_event_is_set(EVENT *p_event)
+{
+  return atomic_load(&p_event->ev_is_set);
+}
+//------------------------------------------------------------------------------
+static bool sync_event_is_set_condition(void *pv_event, uint32_t unused)
+{
+  return sync_event_is_set((EVENT *) pv_event);
+}
+//------------------------------------------------------------------------------
+bool sync_event_spin(EVENT *p_event)
+{
+  return sync_spin(&p_event->ev_spin_tries, sync_event_is_set_condition, p_event, 0);
+}
+//------------------------------------------------------------------------------
+LOCK *sync_lock_new(void)
+{
+  LOCK *result = malloc(sizeof(LOCK));
+  atomic_init(&result->lk_is_held, false);
+  atomic_init(&result->lk_spin_tries, PARK_SPIN_TRIES);
+  park_event_init(&result->lk_released);
+  atomic_init(&result->lk_n_acquires, 0);
+  atomic_init(&result->lk_n_contended, 0);
+  atomic_init(&result->lk_wait_nsec, 0);
+  return result;
+}
+//------------------------------------------------------------------------------
+void sync_lock_free(LOCK *p_lock)
+{
+  free(p_lock);
+}
+//------------------------------------------------------------------------------
+// RETURNS: true if the caller now holds p_lock.
+bool sync_lock_try_acquire(LOCK *p_lock)
+{
+  return !atomic_load_explicit(&p_lock->lk_is_held, memory_order_relaxed)
+    && !atomic_exchange_explicit(&p_lock->lk_is_held, true, memory_order_acquire);
+}
+//------------------------------------------------------------------------------
+static bool sync_lock_try_acquire_condition(void *pv_lock, uint32_t unused)
+{
+  return sync_lock_try_acquire((LOCK *) pv_lock);
+}
+//------------------------------------------------------------------------------
+bool sync_lock_spin(LOCK *p_lock)
+{
+  return sync_spin(&p_lock->lk_spin_tries, sync_lock_try_acquire_condition, p_lock, 0);
+}
+//------------------------------------------------------------------------------
+void sync_lock_release(LOCK *p_lock)
+{
+  atomic_store_explicit(&p_lock->lk_is_held, false, memory_order_release);
+  park_notify_all(&p_lock->lk_released);
+}
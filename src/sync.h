@@ -0,0 +1,53 @@
+#pragma once
+//------------------------------------------------------------------------------
+// Barriers, event flags and locks.  See sync.c.
+//------------------------------------------------------------------------------
+#define SYNC_MIN_SPIN_TRIES 16
+#define SYNC_MAX_SPIN_TRIES 16384
+//------------------------------------------------------------------------------
+typedef struct BARRIER BARRIER;
+struct BARRIER
+{
+  uint32_t br_n_parties;  // Tasks that must arrive before any leaves.
+  atomic_uint br_n_arrived;  // This generation.
+  atomic_uint br_generation;  // Bumped by the last task to arrive.
+  atomic_uint br_spin_tries;  // Adapted by sync_barrier_spin().
+  PARK_EVENT br_released;  // Waiting tasks park here.
+};
+//------------------------------------------------------------------------------
+typedef struct EVENT EVENT;
+struct EVENT
+{
+  atomic_bool ev_is_set;
+  atomic_uint ev_spin_tries;  // Adapted by sync_event_spin().
+  PARK_EVENT ev_set;  // Waiting tasks park here.
+};
+//------------------------------------------------------------------------------
+typedef struct LOCK LOCK;
+struct LOCK
+{
+  atomic_bool lk_is_held;
+  atomic_uint lk_spin_tries;  // Adapted by sync_lock_spin().
+  PARK_EVENT lk_released;  // Waiting tasks park here.
+  // Contention counters (mpr --stats).
+  atomic_ulong lk_n_acquires;
+  atomic_ulong lk_n_contended;  // Acquires that found the lock held.
+  atomic_ulong lk_wait_nsec;  // Time spent waiting by contended acquires.
+};
+//------------------------------------------------------------------------------
+BARRIER *sync_barrier_new(uint32_t n_parties);
+void sync_barrier_free(BARRIER *p_barrier);
+bool sync_barrier_arrive(BARRIER *p_barrier, uint32_t *p_generation);
+bool sync_barrier_passed(BARRIER *p_barrier, uint32_t generation);
+bool sync_barrier_spin(BARRIER *p_barrier, uint32_t generation);
+EVENT *sync_event_new(void);
+void sync_event_free(EVENT *p_event);
+void sync_event_signal(EVENT *p_event);
+void sync_event_reset(EVENT *p_event);
+bool sync_event_is_set(EVENT *p_event);
+bool sync_event_spin(EVENT *p_event);
+LOCK *sync_lock_new(void);
+void sync_lock_free(LOCK *p_lock);
+bool sync_lock_try_acquire(LOCK *p_lock);
+bool sync_lock_spin(LOCK *p_lock);
+void sync_lock_release(LOCK *p_lock);